@@ -67,7 +67,7 @@ void Error_Handler(void);
 #define LED2_GPIO_Port GPIOO
 
 /* USER CODE BEGIN Private defines */
-
+extern UART_HandleTypeDef huart4;
 /* USER CODE END Private defines */
 
 #ifdef __cplusplus
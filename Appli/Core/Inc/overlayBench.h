@@ -0,0 +1,18 @@
+/* SPDX-License-Identifier: Unlicense */
+
+#ifndef OVERLAYBENCH_H_
+#define OVERLAYBENCH_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "common.h"
+
+void overlayBench(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // OVERLAYBENCH_H_
@@ -0,0 +1,22 @@
+/* SPDX-License-Identifier: Unlicense */
+
+#ifndef PLACEMENTBENCH_H_
+#define PLACEMENTBENCH_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "common.h"
+
+void placementBench(bool profile);
+void placementWorkloadInit(void);
+void placementWorkloadPass(uint32_t pass);
+void placementZones(void);
+void placementSamples(uint32_t rate_hz);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // PLACEMENTBENCH_H_
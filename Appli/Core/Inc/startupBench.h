@@ -0,0 +1,19 @@
+/* SPDX-License-Identifier: Unlicense */
+
+#ifndef STARTUPBENCH_H_
+#define STARTUPBENCH_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "common.h"
+
+void startupBenchEntry(void);
+void startupBench(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // STARTUPBENCH_H_
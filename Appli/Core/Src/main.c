@@ -21,7 +21,18 @@
 
 /* Private includes ----------------------------------------------------------*/
 /* USER CODE BEGIN Includes */
-
+#include "common.h"
+#include "overlayBench.h"
+#include "placementBench.h"
+#include "startupBench.h"
+#include "scatterLoad.h"
+#include "bootCtrl.h"
+#include "timeline.h"
+#include "handoff.h"
+#include "fwUpdate.h"
+#include "logSink.h"
+#include "dlog.h"
+#include "traceRing.h"
 /* USER CODE END Includes */
 
 /* Private typedef -----------------------------------------------------------*/
@@ -31,6 +42,57 @@
 
 /* Private define ------------------------------------------------------------*/
 /* USER CODE BEGIN PD */
+/* Set to 1 to print the XIP vs ITCM overlay benchmark at startup */
+#ifndef RUN_OVERLAY_BENCH
+#define RUN_OVERLAY_BENCH 0
+#endif
+
+/* Set to 1 to time the code placement workload, 2 to print its function profile
+   (build with -finstrument-functions, see Common/funcProfile.c) */
+#ifndef RUN_PLACEMENT_BENCH
+#define RUN_PLACEMENT_BENCH 0
+#endif
+
+/* Set to 1 to send the zone profile of the placement workload for Tools/zoneprof.py
+   (build with ZONE_PROFILE_ENABLE=1, see Common/zoneProfile.c) */
+#ifndef RUN_ZONE_PROFILE
+#define RUN_ZONE_PROFILE 0
+#endif
+
+/* Set to a rate in Hz to PC-sample the placement workload for a second, for Tools/pcsample.py */
+#ifndef RUN_PC_SAMPLE
+#define RUN_PC_SAMPLE 0
+#endif
+
+/* Set to 1 to compare the cost of a deferred log record with printf, decode with Tools/dlog.py */
+#ifndef RUN_DLOG_BENCH
+#define RUN_DLOG_BENCH 0
+#endif
+
+/* Set to 1 to count the work done in the first 100 ms after the bootloader jump */
+#ifndef RUN_STARTUP_BENCH
+#define RUN_STARTUP_BENCH 0
+#endif
+
+/* Set to 1 to print the startup scatter table and its timings */
+#ifndef RUN_SCATTER_STATS
+#define RUN_SCATTER_STATS 0
+#endif
+
+/* Set to 1 to print the boot timeline recorded by the bootloader and the application */
+#ifndef RUN_BOOT_TIMELINE
+#define RUN_BOOT_TIMELINE 0
+#endif
+
+/* Set to 0 to initialise GPIO and UART4 from scratch instead of reusing the bootloader setup */
+#ifndef ATTACH_BOOT_HANDOFF
+#define ATTACH_BOOT_HANDOFF 1
+#endif
+
+/* Set to 0 to ignore Tools/fwupdate.py on the console instead of resetting into the bootloader update */
+#ifndef LISTEN_FW_UPDATE
+#define LISTEN_FW_UPDATE 1
+#endif
 
 /* USER CODE END PD */
 
@@ -68,7 +130,13 @@ int main(void)
 {
 
   /* USER CODE BEGIN 1 */
-
+  timelineMark(TL_APP_START);
+#if RUN_STARTUP_BENCH
+  startupBenchEntry();
+#endif
+#if ATTACH_BOOT_HANDOFF
+  handoffAttach();
+#endif
   /* USER CODE END 1 */
 
   /* MPU Configuration--------------------------------------------------------*/
@@ -84,8 +152,12 @@ int main(void)
 
   /* MCU Configuration--------------------------------------------------------*/
 
-  /* Update SystemCoreClock variable according to RCC registers values. */
-  SystemCoreClockUpdate();
+  /* Update SystemCoreClock variable according to RCC registers values,
+     unless handoffAttach() took it from the Boot's record. */
+  if (!handoffHas(HANDOFF_CLOCKS))
+  {
+    SystemCoreClockUpdate();
+  }
 
   /* Reset of all peripherals, Initializes the Flash interface and the Systick. */
   HAL_Init();
@@ -102,7 +174,39 @@ int main(void)
   MX_GPIO_Init();
   MX_UART4_Init();
   /* USER CODE BEGIN 2 */
-
+  logSinkInit();
+  dlogInit();
+  traceRingInit();
+  timelineMark(TL_APP_INIT);
+#if RUN_STARTUP_BENCH
+  startupBench();
+#endif
+#if RUN_SCATTER_STATS
+  scatterPrintStats();
+#endif
+#if RUN_OVERLAY_BENCH
+  overlayBench();
+#endif
+#if RUN_PLACEMENT_BENCH
+  placementBench(RUN_PLACEMENT_BENCH == 2);
+#endif
+#if RUN_ZONE_PROFILE
+  placementZones();
+#endif
+#if RUN_PC_SAMPLE
+  placementSamples(RUN_PC_SAMPLE);
+#endif
+#if RUN_DLOG_BENCH
+  dlogBench();
+#endif
+
+  /* Initialisation went fine: confirms a trial boot of this slot in the boot-control record */
+  bootCtrlConfirm();
+  timelineMark(TL_APP_READY);
+#if RUN_BOOT_TIMELINE
+  timelineReport();
+  handoffReport();
+#endif
   /* USER CODE END 2 */
 
   /* Infinite loop */
@@ -112,6 +216,9 @@ int main(void)
     /* USER CODE END WHILE */
 
     /* USER CODE BEGIN 3 */
+#if LISTEN_FW_UPDATE
+    fwUpdateListen();
+#endif
   }
   /* USER CODE END 3 */
 }
@@ -125,14 +232,17 @@ static void MX_UART4_Init(void)
 {
 
   /* USER CODE BEGIN UART4_Init 0 */
-
+  if (handoffAttachUart4(&huart4))
+  {
+    return;
+  }
   /* USER CODE END UART4_Init 0 */
 
   /* USER CODE BEGIN UART4_Init 1 */
 
   /* USER CODE END UART4_Init 1 */
   huart4.Instance = UART4;
-  huart4.Init.BaudRate = 115200;
+  huart4.Init.BaudRate = 2000000;
   huart4.Init.WordLength = UART_WORDLENGTH_8B;
   huart4.Init.StopBits = UART_STOPBITS_1;
   huart4.Init.Parity = UART_PARITY_NONE;
@@ -154,7 +264,7 @@ static void MX_UART4_Init(void)
   {
     Error_Handler();
   }
-  if (HAL_UARTEx_DisableFifoMode(&huart4) != HAL_OK)
+  if (HAL_UARTEx_EnableFifoMode(&huart4) != HAL_OK)
   {
     Error_Handler();
   }
@@ -173,7 +283,10 @@ static void MX_GPIO_Init(void)
 {
   GPIO_InitTypeDef GPIO_InitStruct = {0};
   /* USER CODE BEGIN MX_GPIO_Init_1 */
-
+  if (handoffHas(HANDOFF_GPIO))
+  {
+    return;
+  }
   /* USER CODE END MX_GPIO_Init_1 */
 
   /* GPIO Ports Clock Enable */
@@ -280,6 +393,17 @@ static void MPU_Config(void)
   MPU_InitStruct.IsCacheable = MPU_ACCESS_NOT_CACHEABLE;
   MPU_InitStruct.IsBufferable = MPU_ACCESS_NOT_BUFFERABLE;
 
+  HAL_MPU_ConfigRegion(&MPU_InitStruct);
+
+  /** Initializes and configures the Region and the memory to be protected
+  */
+  MPU_InitStruct.Number = MPU_REGION_NUMBER5;
+  MPU_InitStruct.BaseAddress = 0x38800000;
+  MPU_InitStruct.Size = MPU_REGION_SIZE_4KB;
+  MPU_InitStruct.TypeExtField = MPU_TEX_LEVEL1;
+  MPU_InitStruct.AccessPermission = MPU_REGION_FULL_ACCESS;
+  MPU_InitStruct.DisableExec = MPU_INSTRUCTION_ACCESS_DISABLE;
+
   HAL_MPU_ConfigRegion(&MPU_InitStruct);
   /* Enables the MPU */
   HAL_MPU_Enable(MPU_PRIVILEGED_DEFAULT);
@@ -294,6 +418,7 @@ void Error_Handler(void)
 {
   /* USER CODE BEGIN Error_Handler_Debug */
   /* User can add his own implementation to report the HAL error return state */
+  logSinkFlush();
   __disable_irq();
   while (1)
   {
@@ -0,0 +1,222 @@
+/* SPDX-License-Identifier: Unlicense */
+
+// -----------------------------------------------------------------------------
+// IMPLEMENTATION NOTES
+//
+// Runs two DSP kernels, a FIR filter and a biquad cascade, in place from the
+// NOR (XIP) and from ITCM through the overlay loader, and prints the mean CPU
+// cycles per call as CSV. Data lives in internal RAM so only the instruction
+// fetch path differs between the two.
+//
+// Each mode is timed twice: "cold" invalidates the I-cache before every call,
+// standing in for an application whose code does not fit the I-cache, "warm"
+// repeats the call back to back. The overlay is loaded once before timing
+// (the copy cost is reported separately as "load"), then every call goes
+// through OVERLAY_CALL() so the lookup is part of the measured cost. The ITCM
+// outputs are compared with the XIP outputs to check the relocated copy.
+//
+// -----------------------------------------------------------------------------
+
+#include "overlayBench.h"
+#include "overlay.h"
+#include "cycles.h"
+#include "stm32.h"
+
+#define BENCH_SAMPLES           512
+#define BENCH_TAPS              32
+#define BENCH_SECTIONS          4
+#define BENCH_RUNS              16
+#define BENCH_SEED              0x12345678UL
+
+typedef struct
+{
+	uint32_t load;              // Cycles to copy the overlay into its slot
+	uint32_t xip_cold;          // Mean cycles per call
+	uint32_t xip_warm;
+	uint32_t itcm_cold;
+	uint32_t itcm_warm;
+	uint32_t mismatches;        // Output samples differing between XIP and ITCM
+} bench_result_t;
+
+static float bench_in[BENCH_SAMPLES + BENCH_TAPS];
+static float bench_out_xip[BENCH_SAMPLES];
+static float bench_out_itcm[BENCH_SAMPLES];
+static float fir_coeffs[BENCH_TAPS];
+static float biquad_coeffs[BENCH_SECTIONS][5];
+static float biquad_state[BENCH_SECTIONS][2];
+
+// -----------------------------------------------------------------------------
+// Description: Direct form FIR filter
+//     Returns: none
+//      Inputs: Output, input (n + taps - 1 samples), coefficients, # of outputs, # of taps
+// -----------------------------------------------------------------------------
+OVERLAY(fir) void firFilter(float *out, const float *in, const float *coeffs, uint32_t n, uint32_t taps)
+{
+	for(uint32_t i = 0; i < n; i++)
+	{
+		float acc = 0.0f;
+
+		for(uint32_t k = 0; k < taps; k++)
+		{
+			acc += coeffs[k] * in[i + k];
+		}
+		out[i] = acc;
+	}
+}
+OVERLAY_DEFINE(fir);
+
+// -----------------------------------------------------------------------------
+// Description: Cascade of direct form II transposed biquads
+//     Returns: none
+//      Inputs: Output, input, {b0, b1, b2, a1, a2} per section, state per
+//              section, # of samples, # of sections
+// -----------------------------------------------------------------------------
+OVERLAY(biquad) void biquadFilter(float *out, const float *in, const float *coeffs, float *state, uint32_t n, uint32_t sections)
+{
+	for(uint32_t i = 0; i < n; i++)
+	{
+		float x = in[i];
+
+		for(uint32_t s = 0; s < sections; s++)
+		{
+			const float *c = &coeffs[s * 5];
+			float *z = &state[s * 2];
+			float y = c[0] * x + z[0];
+
+			z[0] = c[1] * x - c[3] * y + z[1];
+			z[1] = c[2] * x - c[4] * y;
+			x = y;
+		}
+		out[i] = x;
+	}
+}
+OVERLAY_DEFINE(biquad);
+
+// -----------------------------------------------------------------------------
+// Description: Fills the input and coefficients with reproducible values
+//     Returns: none
+//      Inputs: none
+// -----------------------------------------------------------------------------
+static void benchData(void)
+{
+	uint32_t lcg = BENCH_SEED;
+
+	for(uint32_t i = 0; i < ARRAY_SIZE(bench_in); i++)
+	{
+		lcg = lcg * 1664525UL + 1013904223UL;
+		bench_in[i] = (float)(int32_t)lcg / 2147483648.0f;
+	}
+	for(uint32_t k = 0; k < BENCH_TAPS; k++)
+	{
+		fir_coeffs[k] = 1.0f / BENCH_TAPS;
+	}
+	for(uint32_t s = 0; s < BENCH_SECTIONS; s++)
+	{
+		// Mild low pass sections, stable for any input
+		biquad_coeffs[s][0] = 0.2f;
+		biquad_coeffs[s][1] = 0.4f;
+		biquad_coeffs[s][2] = 0.2f;
+		biquad_coeffs[s][3] = -0.5f;
+		biquad_coeffs[s][4] = 0.3f;
+	}
+}
+
+static uint32_t benchCompare(void)
+{
+	uint32_t mismatches = 0;
+
+	for(uint32_t i = 0; i < BENCH_SAMPLES; i++)
+	{
+		mismatches += (memcmp(&bench_out_xip[i], &bench_out_itcm[i], sizeof(float)) != 0);
+	}
+	return mismatches;
+}
+
+// -----------------------------------------------------------------------------
+// Description: Runs one kernel call in the given mode
+//     Returns: CPU cycles taken
+//      Inputs: Kernel (0 = FIR, 1 = biquad), run from ITCM, invalidate the I-cache first
+// -----------------------------------------------------------------------------
+static uint32_t benchRun(uint32_t kernel, bool itcm, bool cold)
+{
+	float *out = itcm ? bench_out_itcm : bench_out_xip;
+	uint32_t t0;
+
+	memset(biquad_state, 0, sizeof(biquad_state));
+	if(cold)
+	{
+		SCB_InvalidateICache();
+	}
+
+	t0 = cycles();
+	if(kernel == 0)
+	{
+		if(itcm)
+		{
+			OVERLAY_CALL(fir, firFilter, out, bench_in, fir_coeffs, BENCH_SAMPLES, BENCH_TAPS);
+		}
+		else
+		{
+			firFilter(out, bench_in, fir_coeffs, BENCH_SAMPLES, BENCH_TAPS);
+		}
+	}
+	else
+	{
+		if(itcm)
+		{
+			OVERLAY_CALL(biquad, biquadFilter, out, bench_in, biquad_coeffs[0], biquad_state[0], BENCH_SAMPLES, BENCH_SECTIONS);
+		}
+		else
+		{
+			biquadFilter(out, bench_in, biquad_coeffs[0], biquad_state[0], BENCH_SAMPLES, BENCH_SECTIONS);
+		}
+	}
+	return cyclesElapsed(t0);
+}
+
+static uint32_t benchMean(uint32_t kernel, bool itcm, bool cold)
+{
+	uint64_t total = 0;
+
+	for(uint32_t r = 0; r < BENCH_RUNS; r++)
+	{
+		total += benchRun(kernel, itcm, cold);
+	}
+	return (uint32_t)(total / BENCH_RUNS);
+}
+
+// -----------------------------------------------------------------------------
+// Description: Compares XIP and ITCM overlay execution of the DSP kernels
+//     Returns: none
+//      Inputs: none
+// -----------------------------------------------------------------------------
+void overlayBench(void)
+{
+	static const char *const names[] = {"fir", "biquad"};
+	const overlay_t *const ovls[] = {&overlay_fir, &overlay_biquad};
+	overlay_stats_t before, after;
+	bench_result_t r;
+
+	cyclesInit();
+	overlayInit();
+	benchData();
+
+	printf("ovlbench,kernel,size,load,xip_cold,xip_warm,itcm_cold,itcm_warm,mismatches" EOL);
+	for(uint32_t k = 0; k < ARRAY_SIZE(names); k++)
+	{
+		overlayGetStats(&before);
+		overlayLoad(ovls[k]);
+		overlayGetStats(&after);
+		r.load = after.load_cycles - before.load_cycles;
+
+		r.xip_cold = benchMean(k, false, true);
+		r.xip_warm = benchMean(k, false, false);
+		r.itcm_cold = benchMean(k, true, true);
+		r.itcm_warm = benchMean(k, true, false);
+		r.mismatches = benchCompare();
+
+		printf("ovlbench,%s,%lu,%lu,%lu,%lu,%lu,%lu,%lu" EOL, names[k], (uint32_t)(ovls[k]->end - ovls[k]->start),
+		       r.load, r.xip_cold, r.xip_warm, r.itcm_cold, r.itcm_warm, r.mismatches);
+	}
+	overlayPrintStats();
+}
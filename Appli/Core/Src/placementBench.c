@@ -0,0 +1,314 @@
+/* SPDX-License-Identifier: Unlicense */
+
+// -----------------------------------------------------------------------------
+// IMPLEMENTATION NOTES
+//
+// Reference workload for profile-guided code placement: a table-driven CRC,
+// an insertion sort and a fixed point FIR, called in a loop like the stages
+// of a processing pipeline. Each kernel is a separate function in its own
+// section (-ffunction-sections), so Tools/placement.py can move it.
+//
+// Workflow:
+//  1. Build with -finstrument-functions (see Common/funcProfile.c) and
+//     RUN_PLACEMENT_BENCH = 2: the workload runs under the function profiler
+//     and the profile is printed.
+//  2. Tools/placement.py generate: picks hot / warm functions from the
+//     profile and writes Appli/placement_itcm.ld and placement_axi.ld.
+//  3. Rebuild without instrumentation and RUN_PLACEMENT_BENCH = 1, before and
+//     after applying the placement, and feed both logs to
+//     Tools/placement.py compare.
+//
+// The pass stages are also profiling zones (Common/zoneProfile.c): built with
+// ZONE_PROFILE_ENABLE = 1, placementZones() runs the workload and sends the
+// zone profile for Tools/zoneprof.py. placementSamples() runs it under the
+// PC-sampling profiler (Common/pcSample.c) instead, for Tools/pcsample.py.
+//
+// The Cortex-M7 has no I-cache miss counter, so misses are measured by their
+// cost: "cold" runs invalidate the I-cache before every pass, "warm" runs do
+// not. Code in ITCM never misses and AXI SRAM refills much faster than the
+// NOR, so placement shrinks the cold - warm gap as well as the run time.
+//
+// -----------------------------------------------------------------------------
+
+#include "placementBench.h"
+#include "funcProfile.h"
+#include "zoneProfile.h"
+#include "pcSample.h"
+#include "cycles.h"
+#include "stm32.h"
+
+#define BENCH_BLOCK             1024
+#define BENCH_SORT              128
+#define BENCH_TAPS              24
+#define BENCH_PASSES            32
+#define BENCH_SEED              0x12345678UL
+#define CRC32_POLY              0xEDB88320UL
+
+// Kept out of line so each kernel stays a separately placeable section
+#define BENCH_KERNEL            __attribute__((noinline))
+
+typedef enum
+{
+	ZONE_PASS,
+	ZONE_KEYS,
+	ZONE_SORT,
+	ZONE_FIR,
+	ZONE_CRC,
+} bench_zone_t;
+
+static uint32_t crc_table[256];
+static uint8_t block[BENCH_BLOCK];
+static int16_t samples[BENCH_BLOCK + BENCH_TAPS];
+static int16_t filtered[BENCH_BLOCK];
+static int16_t taps[BENCH_TAPS];
+static uint32_t keys[BENCH_SORT];
+static volatile uint32_t sink;
+
+static void crcTableInit(void)
+{
+	for(uint32_t i = 0; i < 256; i++)
+	{
+		uint32_t c = i;
+
+		for(uint32_t b = 0; b < 8; b++)
+		{
+			c = (c & 1) ? (c >> 1) ^ CRC32_POLY : c >> 1;
+		}
+		crc_table[i] = c;
+	}
+}
+
+static BENCH_KERNEL uint32_t crc32Block(const uint8_t *data, uint32_t size)
+{
+	uint32_t crc = 0xFFFFFFFFUL;
+
+	while(size--)
+	{
+		crc = crc_table[(crc ^ *data++) & 0xFF] ^ (crc >> 8);
+	}
+	return ~crc;
+}
+
+static BENCH_KERNEL void sortKeys(uint32_t *k, uint32_t n)
+{
+	for(uint32_t i = 1; i < n; i++)
+	{
+		uint32_t v = k[i];
+		uint32_t j = i;
+
+		while((j > 0) && (k[j - 1] > v))
+		{
+			k[j] = k[j - 1];
+			j--;
+		}
+		k[j] = v;
+	}
+}
+
+static BENCH_KERNEL void firQ15(int16_t *out, const int16_t *in, const int16_t *coeffs, uint32_t n, uint32_t ntaps)
+{
+	for(uint32_t i = 0; i < n; i++)
+	{
+		int32_t acc = 0;
+
+		for(uint32_t k = 0; k < ntaps; k++)
+		{
+			acc += (int32_t)coeffs[k] * in[i + k];
+		}
+		out[i] = (int16_t)(acc >> 15);
+	}
+}
+
+// -----------------------------------------------------------------------------
+// Description: One pass of the workload, with fresh inputs
+//     Returns: none
+//      Inputs: Pass #
+// -----------------------------------------------------------------------------
+static BENCH_KERNEL void workloadPass(uint32_t pass)
+{
+	uint32_t lcg = BENCH_SEED + pass;
+
+	PROFILE_BEGIN(ZONE_PASS);
+	PROFILE_BEGIN(ZONE_KEYS);
+	for(uint32_t i = 0; i < BENCH_SORT; i++)
+	{
+		lcg = lcg * 1664525UL + 1013904223UL;
+		keys[i] = lcg;
+	}
+	PROFILE_BEGIN(ZONE_SORT);
+	sortKeys(keys, BENCH_SORT);
+	PROFILE_END(ZONE_SORT);
+	PROFILE_END(ZONE_KEYS);
+	PROFILE_BEGIN(ZONE_FIR);
+	firQ15(filtered, samples, taps, BENCH_BLOCK, BENCH_TAPS);
+	PROFILE_END(ZONE_FIR);
+	PROFILE_BEGIN(ZONE_CRC);
+	memcpy(block, filtered, sizeof(block));
+	sink = crc32Block(block, sizeof(block)) ^ keys[0];
+	PROFILE_END(ZONE_CRC);
+	PROFILE_END(ZONE_PASS);
+}
+
+static void workloadData(void)
+{
+	uint32_t lcg = BENCH_SEED;
+
+	crcTableInit();
+	for(uint32_t i = 0; i < ARRAY_SIZE(samples); i++)
+	{
+		lcg = lcg * 1664525UL + 1013904223UL;
+		samples[i] = (int16_t)(lcg >> 16);
+	}
+	for(uint32_t k = 0; k < BENCH_TAPS; k++)
+	{
+		taps[k] = 32767 / BENCH_TAPS;
+	}
+}
+
+// -----------------------------------------------------------------------------
+// Description: Times the workload
+//     Returns: Mean CPU cycles per pass
+//      Inputs: Invalidate the I-cache before every pass
+// -----------------------------------------------------------------------------
+static uint32_t workloadRun(bool cold)
+{
+	uint64_t total = 0;
+
+	for(uint32_t p = 0; p < BENCH_PASSES; p++)
+	{
+		uint32_t t0;
+
+		if(cold)
+		{
+			SCB_InvalidateICache();
+		}
+		t0 = cycles();
+		workloadPass(p);
+		total += cyclesElapsed(t0);
+	}
+	return (uint32_t)(total / BENCH_PASSES);
+}
+
+// -----------------------------------------------------------------------------
+// Description: Entry points for other benchmarks driving the same workload
+//     Returns: none
+//      Inputs: Pass # (placementWorkloadPass())
+// -----------------------------------------------------------------------------
+void placementWorkloadInit(void)
+{
+	workloadData();
+}
+
+void placementWorkloadPass(uint32_t pass)
+{
+	workloadPass(pass);
+}
+
+static const char *regionName(const void *fn)
+{
+	uint32_t addr = (uint32_t)fn;
+
+	if(addr < 0x00010000UL)
+	{
+		return "itcm";
+	}
+	if((addr - 0x24000000UL) < 0x00080000UL)
+	{
+		return "axi";
+	}
+	return "xip";
+}
+
+// -----------------------------------------------------------------------------
+// Description: Runs the placement workload: profiled (for Tools/placement.py
+//              generate) or timed (for Tools/placement.py compare)
+//     Returns: none
+//      Inputs: Collect a function profile instead of timing
+// -----------------------------------------------------------------------------
+void placementBench(bool profile)
+{
+	static const struct
+	{
+		const char *name;
+		const void *fn;
+	} funcs[] = {
+		{"crc32Block", (const void *)crc32Block},
+		{"sortKeys", (const void *)sortKeys},
+		{"firQ15", (const void *)firQ15},
+		{"workloadPass", (const void *)workloadPass},
+		{"memcpy", (const void *)memcpy},
+	};
+
+	cyclesInit();
+	workloadData();
+
+	if(profile)
+	{
+		funcProfileReset();
+		funcProfileStart();
+		for(uint32_t p = 0; p < BENCH_PASSES; p++)
+		{
+			workloadPass(p);
+		}
+		funcProfileStop();
+		funcProfileDump();
+		return;
+	}
+
+	printf("placement,function,addr,region" EOL);
+	for(uint32_t i = 0; i < ARRAY_SIZE(funcs); i++)
+	{
+		printf("placement,%s,0x%08lX,%s" EOL, funcs[i].name, (uint32_t)funcs[i].fn, regionName(funcs[i].fn));
+	}
+
+	workloadRun(false);
+	printf("placement_run,cold_cycles,warm_cycles" EOL);
+	printf("placement_run,%lu,%lu" EOL, workloadRun(true), workloadRun(false));
+}
+
+// -----------------------------------------------------------------------------
+// Description: Runs the placement workload under the zone profiler and sends
+//              the profile (build with ZONE_PROFILE_ENABLE = 1)
+//     Returns: none
+//      Inputs: none
+// -----------------------------------------------------------------------------
+void placementZones(void)
+{
+	workloadData();
+	zoneProfileReset();
+	zoneProfileName(ZONE_PASS, "pass");
+	zoneProfileName(ZONE_KEYS, "keys");
+	zoneProfileName(ZONE_SORT, "sort");
+	zoneProfileName(ZONE_FIR, "fir");
+	zoneProfileName(ZONE_CRC, "crc");
+	for(uint32_t p = 0; p < BENCH_PASSES; p++)
+	{
+		workloadPass(p);
+	}
+	zoneProfileDump();
+}
+
+// -----------------------------------------------------------------------------
+// Description: Runs the placement workload for a second under the PC-sampling
+//              profiler and sends the samples
+//     Returns: none
+//      Inputs: Samples per second
+// -----------------------------------------------------------------------------
+void placementSamples(uint32_t rate_hz)
+{
+	uint32_t start, pass = 0;
+
+	workloadData();
+	if(!pcSampleStart(rate_hz))
+	{
+		printf("pcsample: rate %lu Hz out of range" EOL, rate_hz);
+		return;
+	}
+	start = HAL_GetTick();
+	while((HAL_GetTick() - start) < 1000)
+	{
+		workloadPass(pass++);
+	}
+	pcSampleStop();
+	pcSampleFlush();
+}
@@ -0,0 +1,106 @@
+/* SPDX-License-Identifier: Unlicense */
+
+// -----------------------------------------------------------------------------
+// IMPLEMENTATION NOTES
+//
+// First 100 ms of the application: how much work it gets done in the first
+// 100 ms after the bootloader jumps to it. The placement workload
+// (placementBench.c) runs back to back from the end of the app's init, and
+// the passes completed in every 10 ms bucket are counted from the jump (the
+// TL_JUMP mark of the boot timeline, or main() without one). Buckets taken by
+// the startup code and the init stay at 0, the first ones after it show the
+// caches warming up, so the output compares jump modes as a whole: the cold
+// start of the middleware jump against the caches kept on by the bootloader
+// (Board/bootLoad.h BOOT_JUMP_KEEP_CACHES).
+//
+// startupBenchEntry() must run first thing in main(), before the app enables
+// the caches itself, to tell the two cases apart.
+//
+// -----------------------------------------------------------------------------
+
+#include "startupBench.h"
+#include "placementBench.h"
+#include "timeline.h"
+#include "cycles.h"
+#include "stm32.h"
+
+#define STARTUP_WINDOW_MS       100
+#define STARTUP_BUCKET_MS       10
+#define STARTUP_BUCKETS         (STARTUP_WINDOW_MS / STARTUP_BUCKET_MS)
+
+static uint32_t entry_cycles;
+static uint32_t entry_ccr;
+
+//------------------------------------------------------------------------------
+// Description: Records the time and the cache state at main()
+//     Returns: none
+//      Inputs: none
+//------------------------------------------------------------------------------
+void startupBenchEntry(void)
+{
+	cyclesInit();
+	entry_cycles = cycles();
+	entry_ccr = SCB->CCR;
+}
+
+static bool startupJumpCycles(uint32_t *at)
+{
+	const timeline_t *tl = timelineGet();
+
+	if(tl == NULL)
+	{
+		return false;
+	}
+	for(uint32_t i = 0; i < tl->count; i++)
+	{
+		if(tl->entries[i].stage == TL_JUMP)
+		{
+			*at = tl->entries[i].cycles;
+			return true;
+		}
+	}
+	return false;
+}
+
+//------------------------------------------------------------------------------
+// Description: Runs the workload until 100 ms after the jump and prints the
+//              passes per 10 ms bucket as CSV
+//     Returns: none
+//      Inputs: none
+//------------------------------------------------------------------------------
+void startupBench(void)
+{
+	uint32_t passes[STARTUP_BUCKETS] = {0};
+	uint32_t cycles_per_us = SystemCoreClock / 1000000U;
+	uint32_t bucket = STARTUP_BUCKET_MS * 1000U * cycles_per_us;
+	uint32_t t0 = entry_cycles, first = 0, total = 0;
+	bool from_jump = startupJumpCycles(&t0);
+
+	placementWorkloadInit();
+	for(uint32_t pass = 0; ; pass++)
+	{
+		uint32_t at;
+
+		placementWorkloadPass(pass);
+		at = cycles() - t0;
+		if(at >= STARTUP_BUCKETS * bucket)
+		{
+			break;
+		}
+		if(total++ == 0)
+		{
+			first = at;
+		}
+		passes[at / bucket]++;
+	}
+
+	printf("startup,bucket_ms,passes" EOL);
+	for(uint32_t i = 0; i < STARTUP_BUCKETS; i++)
+	{
+		printf("startup,%lu,%lu" EOL, (i + 1) * STARTUP_BUCKET_MS, passes[i]);
+	}
+	printf("startup_total,origin,icache,dcache,main_us,first_pass_us,passes" EOL);
+	printf("startup_total,%s,%s,%s,%lu,%lu,%lu" EOL, from_jump ? "jump" : "main",
+	       (entry_ccr & SCB_CCR_IC_Msk) ? "kept" : "cold", (entry_ccr & SCB_CCR_DC_Msk) ? "kept" : "cold",
+	       (entry_cycles - t0) / cycles_per_us, first / cycles_per_us, total);
+}
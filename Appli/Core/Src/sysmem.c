@@ -23,6 +23,21 @@
 /* Includes */
 #include <errno.h>
 #include <stdint.h>
+#include <reent.h>
+#include "heap.h"
+
+/**
+ * Set to 0 to keep malloc out of the PSRAM (e.g. when the boot stage does not
+ * map it). It is only used when the linker script declares the EXTRAM region.
+ */
+#ifndef HEAP_USE_PSRAM
+#define HEAP_USE_PSRAM 1
+#endif
+
+/* Only defined by the linker scripts that place external RAM */
+extern uint8_t __EXTRAM_BEGIN __attribute__((weak));
+extern uint8_t __EXTRAM_SIZE __attribute__((weak));
+extern uint8_t __extram_heap_start __attribute__((weak)); /* End of .extram_data / .extram_bss */
 
 /**
  * Pointer to the current high watermark of the heap usage
@@ -35,15 +50,16 @@ static uint8_t *__sbrk_heap_end = NULL;
  *
  * @verbatim
  * ############################################################################
- * #  .data  #  .bss  #       newlib heap       #          MSP stack          #
- * #         #        #                         # Reserved by _Min_Stack_Size #
+ * #  sbrk reserve  #         "dtcm" heap region        #      MSP stack       #
+ * # _Min_Heap_Size #                                   #   _Min_Stack_Size    #
  * ############################################################################
- * ^-- RAM start      ^-- _end                             _estack, RAM end --^
+ * ^-- _end, DTCM start                                    _estack, DTCM end --^
  * @endverbatim
  *
- * This implementation starts allocating at the '_end' linker symbol
- * The '_Min_Stack_Size' linker symbol reserves a memory for the MSP stack
- * The implementation considers '_estack' linker symbol to be RAM end
+ * malloc and friends no longer reach _sbrk: they are served by the TLSF heap
+ * (see heapInitRegions() below). _sbrk is kept for direct callers and is
+ * limited to the '_Min_Heap_Size' bytes after the '_end' linker symbol, which
+ * the heap leaves alone.
  * NOTE: If the MSP stack, at any point during execution, grows larger than the
  * reserved size, please increase the '_Min_Stack_Size'.
  *
@@ -53,10 +69,8 @@ static uint8_t *__sbrk_heap_end = NULL;
 void *_sbrk(ptrdiff_t incr)
 {
   extern uint8_t _end; /* Symbol defined in the linker script */
-  extern uint8_t _estack; /* Symbol defined in the linker script */
-  extern uint32_t _Min_Stack_Size; /* Symbol defined in the linker script */
-  const uint32_t stack_limit = (uint32_t)&_estack - (uint32_t)&_Min_Stack_Size;
-  const uint8_t *max_heap = (uint8_t *)stack_limit;
+  extern uint32_t _Min_Heap_Size; /* Symbol defined in the linker script */
+  const uint8_t *max_heap = &_end + (uint32_t)&_Min_Heap_Size;
   uint8_t *prev_heap_end;
 
   /* Initialize heap end at first call */
@@ -77,3 +91,137 @@ void *_sbrk(ptrdiff_t incr)
 
   return (void *)prev_heap_end;
 }
+
+/**
+ * @brief Registers the heap regions, called by the allocator before the first
+ *        allocation
+ *
+ * @verbatim
+ *   "dtcm"  HEAP_ATTR_FAST   DTCM between the sbrk reserve and the MSP stack
+ *   "axi"   HEAP_ATTR_DMA    AXI SRAM from the end of .bss to the end of RAM
+ *   "psram" HEAP_ATTR_LARGE  The EXTRAM region after .extram_data / .extram_bss,
+ *                            mapped by the boot stage
+ * @endverbatim
+ */
+void heapInitRegions(void)
+{
+  extern uint8_t _end, _estack, _ebss, __RAM_BEGIN, __RAM_SIZE; /* Symbols defined in the linker script */
+  extern uint32_t _Min_Heap_Size, _Min_Stack_Size; /* Symbols defined in the linker script */
+  uint8_t *dtcm_start = &_end + (uint32_t)&_Min_Heap_Size;
+  uint8_t *dtcm_end = (uint8_t *)((uint32_t)&_estack - (uint32_t)&_Min_Stack_Size);
+  uint8_t *ram_end = &__RAM_BEGIN + (uint32_t)&__RAM_SIZE;
+
+  heapAddRegion("dtcm", dtcm_start, dtcm_end - dtcm_start, HEAP_ATTR_FAST);
+  if ((&_ebss >= &__RAM_BEGIN) && (&_ebss < ram_end))
+  {
+    heapAddRegion("axi", &_ebss, ram_end - &_ebss, HEAP_ATTR_DMA);
+  }
+#if HEAP_USE_PSRAM
+  if (&__EXTRAM_BEGIN != NULL)
+  {
+    uint8_t *psram_start = (&__extram_heap_start != NULL) ? &__extram_heap_start : &__EXTRAM_BEGIN;
+    uint8_t *psram_end = &__EXTRAM_BEGIN + (uint32_t)&__EXTRAM_SIZE;
+
+    heapAddRegion("psram", psram_start, psram_end - psram_start, HEAP_ATTR_LARGE);
+  }
+#endif
+}
+
+/**
+ * @brief newlib allocation hooks, all routed to the TLSF heap. Unhinted
+ *        requests land in internal RAM, or in the PSRAM from
+ *        HEAP_LARGE_THRESHOLD bytes on. Use malloc_hint() for explicit
+ *        placement; its result may be released with free().
+ */
+void *_malloc_r(struct _reent *r, size_t size)
+{
+  void *ptr = heapAlloc(size, HEAP_HINT_ANY);
+
+  if (NULL == ptr)
+  {
+    r->_errno = ENOMEM;
+  }
+  return ptr;
+}
+
+void _free_r(struct _reent *r, void *ptr)
+{
+  (void)r;
+  heapFree(ptr);
+}
+
+void *_realloc_r(struct _reent *r, void *ptr, size_t size)
+{
+  void *moved = heapRealloc(ptr, size);
+
+  if ((NULL == moved) && (size != 0))
+  {
+    r->_errno = ENOMEM;
+  }
+  return moved;
+}
+
+void *_calloc_r(struct _reent *r, size_t count, size_t size)
+{
+  size_t total;
+  void *ptr;
+
+  if (__builtin_mul_overflow(count, size, &total))
+  {
+    r->_errno = ENOMEM;
+    return NULL;
+  }
+  ptr = _malloc_r(r, total);
+  if (ptr != NULL)
+  {
+    memset(ptr, 0, total);
+  }
+  return ptr;
+}
+
+void *_memalign_r(struct _reent *r, size_t align, size_t size)
+{
+  void *ptr = heapAllocAligned(size, align, HEAP_HINT_ANY);
+
+  if (NULL == ptr)
+  {
+    r->_errno = ENOMEM;
+  }
+  return ptr;
+}
+
+size_t _malloc_usable_size_r(struct _reent *r, void *ptr)
+{
+  (void)r;
+  return heapUsableSize(ptr);
+}
+
+void *malloc(size_t size)
+{
+  return _malloc_r(_REENT, size);
+}
+
+void free(void *ptr)
+{
+  _free_r(_REENT, ptr);
+}
+
+void *realloc(void *ptr, size_t size)
+{
+  return _realloc_r(_REENT, ptr, size);
+}
+
+void *calloc(size_t count, size_t size)
+{
+  return _calloc_r(_REENT, count, size);
+}
+
+void *memalign(size_t align, size_t size)
+{
+  return _memalign_r(_REENT, align, size);
+}
+
+size_t malloc_usable_size(void *ptr)
+{
+  return _malloc_usable_size_r(_REENT, ptr);
+}
@@ -0,0 +1,214 @@
+/* SPDX-License-Identifier: Unlicense */
+
+// -----------------------------------------------------------------------------
+// IMPLEMENTATION NOTES
+//
+// Streaming patch applier for delta updates (Board/bootUpdate.c, patches from
+// Tools/fwdelta.py). A patch is a header and a list of two ops: COPY a run of
+// the old image, or DATA bytes carried by the patch. The old image is read in
+// place through the NOR memory mapped window, so COPY costs one memcpy into
+// the staging block and nothing of the old image is buffered.
+//
+// The patch arrives in arbitrary pieces (frames of the update protocol), so
+// the decoder is a byte level state machine that resumes mid-header, mid-varint
+// or mid-DATA. The new image is assembled in one staging block and handed to
+// the flush callback each time the block fills, at block aligned offsets: with
+// a 64 KB block in PSRAM that is one erase and one program per flush, and the
+// memory used is the block plus this structure whatever the image size.
+//
+// COPY sources are relative to the end of the previous copy. A change that
+// keeps the layout (a patched constant, a renamed string) becomes DATA followed
+// by a COPY with a source delta of 0, which encodes in two bytes.
+//
+// The old image is checked against the CRC in the header before any output is
+// produced, so a patch made for another build fails before the target slot is
+// erased.
+//
+// -----------------------------------------------------------------------------
+
+#include "bootDelta.h"
+#include "bootLoad.h"
+
+typedef enum
+{
+	DELTA_HEADER,
+	DELTA_OP,
+	DELTA_SOURCE,
+	DELTA_DATA,
+	DELTA_END,
+} delta_state_t;
+
+void bootDeltaInit(boot_delta_t *d)
+{
+	memset(&d->header, 0, sizeof(d->header));
+	d->state = DELTA_HEADER;
+	d->header_fill = 0;
+	d->produced = 0;
+	d->fill = 0;
+	d->src = 0;
+	d->length = 0;
+	d->value = 0;
+	d->shift = 0;
+}
+
+static boot_delta_status_t deltaCheckHeader(boot_delta_t *d)
+{
+	const boot_delta_header_t *h = &d->header;
+
+	if((h->magic != BOOT_DELTA_MAGIC) || (h->version != BOOT_DELTA_VERSION) ||
+	   (h->header_size != sizeof(boot_delta_header_t)) || (h->new_size == 0) ||
+	   (h->header_crc != bootCrc32(h, offsetof(boot_delta_header_t, header_crc))))
+	{
+		return BOOT_DELTA_BAD_HEADER;
+	}
+	if((h->old_size > d->old_max) || (h->old_crc != bootCrc32(d->old, h->old_size)))
+	{
+		return BOOT_DELTA_BAD_BASE;
+	}
+	return BOOT_DELTA_MORE;
+}
+
+// -----------------------------------------------------------------------------
+// Description: Appends to the new image, flushing full blocks and the last one
+//     Returns: false when the flush failed
+//      Inputs: Patch state, data, size (within the new image)
+// -----------------------------------------------------------------------------
+static bool deltaOutput(boot_delta_t *d, const uint8_t *data, uint32_t size)
+{
+	while(size != 0)
+	{
+		uint32_t n = MIN(size, d->block_size - d->fill);
+
+		memcpy(&d->block[d->fill], data, n);
+		d->fill += n;
+		d->produced += n;
+		data += n;
+		size -= n;
+		if((d->fill == d->block_size) || (d->produced == d->header.new_size))
+		{
+			if(!d->flush(d->ctx, d->produced - d->fill, d->block, d->fill))
+			{
+				return false;
+			}
+			d->fill = 0;
+		}
+	}
+	return true;
+}
+
+// -----------------------------------------------------------------------------
+// Description: Accumulates one varint byte
+//     Returns: true once the value is complete
+//      Inputs: Patch state, byte
+// -----------------------------------------------------------------------------
+static bool deltaVarint(boot_delta_t *d, uint8_t c)
+{
+	if(d->shift < 32)
+	{
+		d->value |= (uint32_t)(c & 0x7F) << d->shift;
+	}
+	d->shift += 7;
+	return (c & 0x80) == 0;
+}
+
+// -----------------------------------------------------------------------------
+// Description: Applies the next piece of a patch
+//     Returns: BOOT_DELTA_MORE until the new image is complete, then
+//              BOOT_DELTA_DONE, or an error (the state is then undefined)
+//      Inputs: Patch state, patch data, size
+// -----------------------------------------------------------------------------
+boot_delta_status_t bootDeltaFeed(boot_delta_t *d, const uint8_t *data, uint32_t size)
+{
+	boot_delta_status_t status;
+
+	while(size != 0)
+	{
+		switch(d->state)
+		{
+		case DELTA_HEADER:
+		{
+			uint32_t n = MIN(size, sizeof(d->header) - d->header_fill);
+
+			memcpy((uint8_t *)&d->header + d->header_fill, data, n);
+			d->header_fill += n;
+			data += n;
+			size -= n;
+			if(d->header_fill == sizeof(d->header))
+			{
+				status = deltaCheckHeader(d);
+				if(status != BOOT_DELTA_MORE)
+				{
+					return status;
+				}
+				d->state = DELTA_OP;
+			}
+			break;
+		}
+
+		case DELTA_OP:
+			size--;
+			if(!deltaVarint(d, *data++))
+			{
+				break;
+			}
+			d->length = d->value >> 1;
+			if((d->shift > 35) || (d->length == 0) || (d->length > (d->header.new_size - d->produced)))
+			{
+				return BOOT_DELTA_BAD_OP;
+			}
+			d->state = ((d->value & 1) == BOOT_DELTA_OP_COPY) ? DELTA_SOURCE : DELTA_DATA;
+			d->value = 0;
+			d->shift = 0;
+			break;
+
+		case DELTA_SOURCE:
+		{
+			uint32_t src;
+
+			size--;
+			if(!deltaVarint(d, *data++))
+			{
+				break;
+			}
+			// Zigzag: 0, -1, 1, -2...
+			src = d->src + ((d->value >> 1) ^ (0UL - (d->value & 1)));
+			if((d->shift > 35) || (src > d->header.old_size) || (d->length > (d->header.old_size - src)))
+			{
+				return BOOT_DELTA_BAD_OP;
+			}
+			if(!deltaOutput(d, &d->old[src], d->length))
+			{
+				return BOOT_DELTA_FLUSH_FAILED;
+			}
+			d->src = src + d->length;
+			d->value = 0;
+			d->shift = 0;
+			d->state = (d->produced == d->header.new_size) ? DELTA_END : DELTA_OP;
+			break;
+		}
+
+		case DELTA_DATA:
+		{
+			uint32_t n = MIN(size, d->length);
+
+			if(!deltaOutput(d, data, n))
+			{
+				return BOOT_DELTA_FLUSH_FAILED;
+			}
+			d->length -= n;
+			data += n;
+			size -= n;
+			if(d->length == 0)
+			{
+				d->state = (d->produced == d->header.new_size) ? DELTA_END : DELTA_OP;
+			}
+			break;
+		}
+
+		default:
+			// Past the end of the new image
+			return BOOT_DELTA_BAD_OP;
+		}
+	}
+	return (d->state == DELTA_END) ? BOOT_DELTA_DONE : BOOT_DELTA_MORE;
+}
@@ -0,0 +1,74 @@
+/* SPDX-License-Identifier: Unlicense */
+
+#ifndef BOOTDELTA_H_
+#define BOOTDELTA_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "common.h"
+
+#define BOOT_DELTA_MAGIC            0x544C4442UL    // "BDLT"
+#define BOOT_DELTA_VERSION          1
+
+// Ops follow the header, each starts with a varint (LEB128) of length << 1 | op
+#define BOOT_DELTA_OP_DATA          0               // length literal bytes follow
+#define BOOT_DELTA_OP_COPY          1               // zigzag varint: source - end of the previous copy
+
+// Header of a patch, written by Tools/fwdelta.py
+typedef struct
+{
+	uint32_t magic;             // BOOT_DELTA_MAGIC
+	uint16_t version;           // BOOT_DELTA_VERSION
+	uint16_t header_size;       // Bytes, the ops follow
+	uint32_t old_size;          // Image the patch applies to
+	uint32_t old_crc;           // CRC-32 of it
+	uint32_t new_size;          // Image the patch produces
+	uint32_t new_crc;
+	uint32_t reserved;
+	uint32_t header_crc;        // CRC-32 of the fields above
+} boot_delta_header_t;
+
+typedef enum
+{
+	BOOT_DELTA_MORE,            // Feed more of the patch
+	BOOT_DELTA_DONE,            // new_size bytes produced and flushed
+	BOOT_DELTA_BAD_HEADER,
+	BOOT_DELTA_BAD_BASE,        // Old image does not match the patch
+	BOOT_DELTA_BAD_OP,          // Op out of the old or the new image, trailing bytes
+	BOOT_DELTA_FLUSH_FAILED,
+} boot_delta_status_t;
+
+// Receives each completed block of the new image, block aligned but the last
+typedef bool (*boot_delta_flush_t)(void *ctx, uint32_t offset, const uint8_t *data, uint32_t size);
+
+typedef struct
+{
+	const uint8_t *old;         // Old image, read in place
+	uint32_t old_max;           // Bytes readable at old
+	uint8_t *block;             // Staging for the new image
+	uint32_t block_size;
+	boot_delta_flush_t flush;
+	void *ctx;
+
+	// Progress, set up by bootDeltaInit()
+	boot_delta_header_t header;
+	uint32_t state;
+	uint32_t header_fill;
+	uint32_t produced;          // New image bytes
+	uint32_t fill;              // Of block
+	uint32_t src;               // Old image offset after the last copy
+	uint32_t length;            // Of the op being decoded
+	uint32_t value;             // Varint being decoded
+	uint32_t shift;
+} boot_delta_t;
+
+void bootDeltaInit(boot_delta_t *d);
+boot_delta_status_t bootDeltaFeed(boot_delta_t *d, const uint8_t *data, uint32_t size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // BOOTDELTA_H_
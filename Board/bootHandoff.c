@@ -0,0 +1,120 @@
+/* SPDX-License-Identifier: Unlicense */
+
+// -----------------------------------------------------------------------------
+// IMPLEMENTATION NOTES
+//
+// Bootloader side of the handoff record (Common/handoff.h). It is filled once
+// every peripheral the app inherits is in its final state, right before the
+// application is started, from the live registers rather than from the init
+// structures so it also covers later changes (NOR burst mode, PSRAM tuning).
+// The magic goes in last: a record cut short by a fault is never attached to.
+//
+// -----------------------------------------------------------------------------
+
+#include "bootHandoff.h"
+#include "bootSlot.h"
+#include "nor.h"
+#include "psram.h"
+#include "main.h"
+#include "stm32_extmem_conf.h"
+
+static void bootHandoffXspi(handoff_xspi_t *x, const XSPI_TypeDef *xspi, uint32_t base, uint32_t size)
+{
+	x->base = base;
+	x->size = size;
+	x->cr = xspi->CR;
+	x->dcr1 = xspi->DCR1;
+	x->dcr2 = xspi->DCR2;
+	x->dcr3 = xspi->DCR3;
+	x->dcr4 = xspi->DCR4;
+	x->ccr = xspi->CCR;
+	x->tcr = xspi->TCR;
+	x->ir = xspi->IR;
+	x->wccr = xspi->WCCR;
+	x->wtcr = xspi->WTCR;
+	x->wir = xspi->WIR;
+}
+
+static bool bootHandoffMapped(const XSPI_TypeDef *xspi)
+{
+	return ((xspi->CR & XSPI_CR_EN) != 0) && ((xspi->CR & XSPI_CR_FMODE) == XSPI_CR_FMODE);
+}
+
+// -----------------------------------------------------------------------------
+// Description: Writes the handoff record for the app
+//     Returns: none
+//      Inputs: none
+// -----------------------------------------------------------------------------
+void bootHandoffPublish(void)
+{
+	handoff_t *h = HANDOFF;
+	const EXTMEM_DRIVER_NOR_SFDP_ObjectTypeDef *nor = &extmem_list_config[EXT_MEMORY_NOR_FLASH].NorSfdpObject;
+	const EXTMEM_DRIVER_NOR_SFDP_InfoTypeDef *info = &nor->sfpd_private.DriverInfo;
+	const uint8_t erase_size[4] = { info->EraseType1Size, info->EraseType2Size, info->EraseType3Size, info->EraseType4Size };
+	const uint8_t erase_cmd[4] = { info->EraseType1Command, info->EraseType2Command, info->EraseType3Command, info->EraseType4Command };
+
+	RCC->AHB4ENR |= RCC_AHB4ENR_BKPRAMEN;
+	PWR->CR1 |= PWR_CR1_DBP;
+	(void)RCC->AHB4ENR;
+
+	memset(h, 0, sizeof(*h));
+	h->version = HANDOFF_VERSION;
+	h->size = sizeof(*h);
+	h->flags = HANDOFF_CLOCKS | HANDOFF_GPIO;
+
+	h->clocks.sysclk_hz = HAL_RCC_GetSysClockFreq();
+	h->clocks.cpu_hz = SystemCoreClock;
+	h->clocks.hclk_hz = HAL_RCC_GetHCLKFreq();
+	h->clocks.pclk1_hz = HAL_RCC_GetPCLK1Freq();
+	h->clocks.pclk2_hz = HAL_RCC_GetPCLK2Freq();
+	h->clocks.pclk4_hz = HAL_RCC_GetPCLK4Freq();
+	h->clocks.pclk5_hz = HAL_RCC_GetPCLK5Freq();
+	h->clocks.xspi1_hz = HAL_RCCEx_GetPeriphCLKFreq(RCC_PERIPHCLK_XSPI1);
+	h->clocks.xspi2_hz = HAL_RCCEx_GetPeriphCLKFreq(RCC_PERIPHCLK_XSPI2);
+	h->clocks.uart4_hz = HAL_RCCEx_GetPeriphCLKFreq(RCC_PERIPHCLK_USART234578);
+	h->clocks.cfgr = RCC->CFGR;
+	h->clocks.cdcfgr = RCC->CDCFGR;
+	h->clocks.bmcfgr = RCC->BMCFGR;
+	h->clocks.apbcfgr = RCC->APBCFGR;
+	h->clocks.pllckselr = RCC->PLLCKSELR;
+	h->clocks.pllcfgr = RCC->PLLCFGR;
+	h->clocks.pll1divr1 = RCC->PLL1DIVR1;
+	h->clocks.pll2divr1 = RCC->PLL2DIVR1;
+	h->clocks.ccipr1 = RCC->CCIPR1;
+	h->clocks.ccipr2 = RCC->CCIPR2;
+
+	bootHandoffXspi(&h->nor.xspi, XSPI2, NOR_BASE_ADDRESS, 1UL << nor->sfpd_private.FlashSize);
+	h->nor.page_size = nor->sfpd_private.PageSize;
+	h->nor.slot_offset = bootSlotOffset();
+	h->nor.manufacturer_id = nor->sfpd_private.ManuID;
+	h->nor.phy_link = (uint8_t)info->SpiPhyLink;
+	h->nor.dummy_cycles = (uint8_t)nor->sfpd_private.SALObject.Commandbase.DummyCycles;
+	h->nor.burst_mode = (uint8_t)NOR_GetBurstMode();
+	h->nor.read_cmd = info->ReadInstruction;
+	h->nor.program_cmd = info->PageProgramInstruction;
+	h->nor.write_enable_cmd = info->WriteWELCommand;
+	h->nor.read_status_cmd = info->ReadWIPCommand;
+	h->nor.wip_position = info->WIPPosition;
+	h->nor.wip_busy_polarity = info->WIPBusyPolarity;
+	memcpy(h->nor.erase_size, erase_size, sizeof(erase_size));
+	memcpy(h->nor.erase_cmd, erase_cmd, sizeof(erase_cmd));
+	if(bootHandoffMapped(XSPI2))
+	{
+		h->flags |= HANDOFF_NOR_MAPPED;
+	}
+
+	bootHandoffXspi(&h->psram, XSPI1, PSRAM_BASE_ADDRESS, PSRAM_SIZE);
+	if(bootHandoffMapped(XSPI1))
+	{
+		h->flags |= HANDOFF_PSRAM_MAPPED;
+	}
+
+	if((UART4->CR1 & USART_CR1_UE) != 0)
+	{
+		h->uart_baud = huart4.Init.BaudRate;
+		h->flags |= HANDOFF_UART4;
+	}
+
+	__DMB();
+	h->magic = HANDOFF_MAGIC;
+}
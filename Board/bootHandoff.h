@@ -0,0 +1,19 @@
+/* SPDX-License-Identifier: Unlicense */
+
+#ifndef BOOTHANDOFF_H_
+#define BOOTHANDOFF_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "common.h"
+#include "handoff.h"
+
+void bootHandoffPublish(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // BOOTHANDOFF_H_
@@ -0,0 +1,334 @@
+/* SPDX-License-Identifier: Unlicense */
+
+// -----------------------------------------------------------------------------
+// IMPLEMENTATION NOTES
+//
+// Load-and-run boot. When the NOR holds a packed image (Tools/imagepack.py) at
+// the image offset of the boot slot (Board/bootSlot.c) instead of a plain
+// vector table, the image is decompressed into PSRAM or AXI SRAM and started
+// there; otherwise the boot flow carries on with the XIP jump of
+// boot/stm32_boot_xip.c, which only knows slot A. A plain binary in slot B is
+// started here the same way, and so is one in slot A when the caches are kept
+// across the jump (BOOT_JUMP_KEEP_CACHES), which the middleware jump cannot do.
+//
+// The image is linked for its run address, e.g. STM32H7S7L8HXH_ROMxspi1_RAMxspi2.ld
+// (PSRAM, 0x90000000) or STM32H7S7L8HXH_sram.ld (AXI SRAM, 0x24050000). AXI
+// SRAM is only accepted above the bootloader's own .bss, and not at all when
+// the bootloader itself runs from it.
+//
+// The LZ4 decoder streams straight from the memory mapped NOR into the run
+// region with both caches on (Boot MPU_Config() makes the NOR and the PSRAM
+// write-back), so the NOR is fetched in whole lines and matches read back from
+// the output hit the D-cache. The output is cleaned to memory and the I-cache
+// invalidated over it, which is all a copy of code needs.
+//
+// The jump then keeps the caches on: the app's startup code (scatter load, C
+// runtime) no longer runs uncached until main() enables them, and whatever the
+// bootloader left in them (the image just hashed or copied) is still valid.
+// The D-cache is cleaned by set/way before the jump, a fixed ~1000 operations
+// that are cheaper than cleaning the ranges the bootloader wrote by address,
+// so no dirty line can be written back over memory the app or its DMA owns.
+// Nothing has to be invalidated: both images map memory with the same
+// attributes. With BOOT_JUMP_KEEP_CACHES at 0 the caches are turned off as by
+// the XIP path of the middleware.
+//
+// One "bootload" CSV record reports the decompression throughput and the time
+// since HAL_Init() at the jump, for both modes, so a packed and an XIP image
+// can be compared run for run.
+//
+// Images with BOOT_IMAGE_SHA256 carry the digest of their payload (as stored
+// in the NOR, i.e. before decompression). bootLoadVerifyStart() hands it to
+// Board/bootVerify.c as soon as the NOR is mapped, so the HASH peripheral
+// works through the image while main() initialises the PSRAM; the result is
+// collected here before anything is copied or jumped to. The same header can
+// also sit in front of an XIP image (BOOT_IMAGE_XIP): the payload is then
+// linked to run in place right behind it, at load_addr.
+//
+// -----------------------------------------------------------------------------
+
+#include "bootLoad.h"
+#include "bootVerify.h"
+#include "bootSlot.h"
+#include "lz4.h"
+#include "psram.h"
+#include "timebase.h"
+#include "timeline.h"
+#include "traceRing.h"
+#include "logSink.h"
+#include "extmem_manager.h"
+#include "stm32_boot_xip.h"
+
+#define CRC32_POLY                  0xEDB88320UL
+#define BOOT_IMAGE_MAX              0x08000000UL    // NOR size
+
+// Only defined by the linker script that runs the bootloader from internal flash
+extern uint8_t __RAM_BEGIN[] __attribute__((weak));
+extern uint8_t __RAM_SIZE[] __attribute__((weak));
+extern uint8_t _ebss[];
+
+// boot/stm32_boot_xip.c, not in its header
+extern BOOTStatus_TypeDef MapMemory(void);
+
+// -----------------------------------------------------------------------------
+// Description: CRC-32 as zlib computes it, for the image and boot-control records
+//              and the update frames; continues from a previous result
+//     Returns: See above
+//      Inputs: CRC so far (0 to start), data, size
+// -----------------------------------------------------------------------------
+uint32_t bootCrc32Update(uint32_t crc, const void *data, uint32_t size)
+{
+	const uint8_t *p = data;
+
+	crc = ~crc;
+	while(size--)
+	{
+		crc ^= *p++;
+		for(uint32_t b = 0; b < 8; b++)
+		{
+			crc = (crc & 1) ? (crc >> 1) ^ CRC32_POLY : crc >> 1;
+		}
+	}
+	return ~crc;
+}
+
+uint32_t bootCrc32(const void *data, uint32_t size)
+{
+	return bootCrc32Update(0, data, size);
+}
+
+// -----------------------------------------------------------------------------
+// Description: Checks that an image can be loaded at its run address
+//     Returns: true for PSRAM, or AXI SRAM not used by the bootloader
+//      Inputs: Run address, size
+// -----------------------------------------------------------------------------
+static bool bootRegionValid(uint32_t addr, uint32_t size)
+{
+	uint32_t free_start = ((uint32_t)_ebss + __SCB_DCACHE_LINE_SIZE - 1) & ~(__SCB_DCACHE_LINE_SIZE - 1);
+
+	if((addr >= PSRAM_BASE_ADDRESS) && (size <= PSRAM_SIZE) && ((addr - PSRAM_BASE_ADDRESS) <= (PSRAM_SIZE - size)))
+	{
+		return true;
+	}
+	if(__RAM_BEGIN == NULL)
+	{
+		return false;
+	}
+	return (addr >= free_start) && (addr < ((uint32_t)__RAM_BEGIN + (uint32_t)__RAM_SIZE)) &&
+	       (size <= ((uint32_t)__RAM_BEGIN + (uint32_t)__RAM_SIZE - addr));
+}
+
+static bool bootHeaderValid(const boot_image_header_t *h)
+{
+	if((h->magic != BOOT_IMAGE_MAGIC) || (h->version != BOOT_IMAGE_VERSION) ||
+	   (h->header_size < sizeof(boot_image_header_t)))
+	{
+		return false;
+	}
+	if(h->header_crc != bootCrc32(h, offsetof(boot_image_header_t, header_crc)))
+	{
+		return false;
+	}
+	if(h->flags & BOOT_IMAGE_XIP)
+	{
+		// Runs where it is: nothing to decompress, linked for the address behind the header
+		return !(h->flags & BOOT_IMAGE_LZ4) && (h->packed_size == h->image_size) &&
+		       (h->load_addr == ((uint32_t)h + h->header_size));
+	}
+	return (h->image_size >= 8) && (h->packed_size <= BOOT_IMAGE_MAX);
+}
+
+// -----------------------------------------------------------------------------
+// Description: Finds the image header at the image offset of the boot slot
+//     Returns: Header, or NULL without one (plain XIP binary)
+//      Inputs: Image address storage
+// -----------------------------------------------------------------------------
+static const boot_image_header_t *bootImageHeader(uint32_t *addr)
+{
+	uint32_t base;
+
+	*addr = 0;
+	if((EXTMEM_GetMapAddress(EXTMEM_MEMORY_BOOTXIP, &base) != EXTMEM_OK) || !BOOT_LOAD_ENABLE)
+	{
+		return NULL;
+	}
+	*addr = base + bootSlotOffset();
+	return (((const boot_image_header_t *)*addr)->magic == BOOT_IMAGE_MAGIC) ? (const boot_image_header_t *)*addr : NULL;
+}
+
+static void bootLoadReport(const char *mode, uint32_t addr, uint32_t image_size, uint32_t packed_size, uint32_t load_us)
+{
+	uint32_t kbps = (load_us != 0) ? (uint32_t)(((uint64_t)image_size * 1000U) / load_us) : 0;
+
+	printf("bootload,mode,addr,image_bytes,packed_bytes,load_us,kBps,boot_us" EOL);
+	printf("bootload,%s,0x%08lX,%lu,%lu,%lu,%lu,%lu" EOL, mode, addr, image_size, packed_size, load_us, kbps, ticks());
+}
+
+// -----------------------------------------------------------------------------
+// Description: Jumps to an image, the same way the XIP path does but with
+//              the caches kept on (BOOT_JUMP_KEEP_CACHES), every interrupt
+//              line disabled and cleared
+//     Returns: none (only if the image returns)
+//      Inputs: Vector table address
+// -----------------------------------------------------------------------------
+static void bootJump(uint32_t vector)
+{
+	static void (*entry)(void);             // Not on the stack, which is replaced below
+	uint32_t primask;
+
+	timelineMark(TL_JUMP);
+	TRACE(TRACE_JUMP, vector);
+	logSinkFlush();
+	HAL_SuspendTick();
+#if BOOT_JUMP_KEEP_CACHES
+	SCB_CleanDCache();
+#else
+	SCB_DisableICache();
+	SCB_DisableDCache();
+#endif
+
+	primask = __get_PRIMASK();
+	__disable_irq();
+	// The app's vector table has no handler for what the bootloader enabled
+	// (log sink DMA, TIM5/TIM7, HASH and its DMA): none may be left to fire
+	for(uint32_t i = 0; i < ARRAYSIZE(NVIC->ICER); i++)
+	{
+		NVIC->ICER[i] = 0xFFFFFFFFUL;
+		NVIC->ICPR[i] = 0xFFFFFFFFUL;
+	}
+	__DSB();
+	__ISB();
+	SCB->VTOR = vector;
+	entry = (void (*)(void))(*(volatile uint32_t *)(vector + 4));
+	__set_MSP(*(volatile uint32_t *)vector);
+	__set_PRIMASK(primask);
+	entry();
+}
+
+// -----------------------------------------------------------------------------
+// Description: Starts hashing the image in the background, if it has a digest
+//     Returns: none
+//      Inputs: none
+// -----------------------------------------------------------------------------
+void bootLoadVerifyStart(void)
+{
+	uint32_t addr;
+	const boot_image_header_t *h = bootImageHeader(&addr);
+
+	if((h != NULL) && bootHeaderValid(h) && (h->flags & BOOT_IMAGE_SHA256))
+	{
+		bootVerifyStart((const uint8_t *)h + h->header_size, h->packed_size, h->digest);
+	}
+}
+
+// -----------------------------------------------------------------------------
+// Description: Boots the image from the NOR if it has a header: verifies it,
+//              then loads it or runs it in place
+//     Returns: Only without an image header: BOOT_LOAD_NO_IMAGE to go on with
+//              the XIP boot, an error otherwise
+//      Inputs: none
+// -----------------------------------------------------------------------------
+boot_load_status_t bootLoadApplication(void)
+{
+	const boot_image_header_t *h;
+	const uint8_t *payload;
+	uint32_t addr, t0, load_us;
+	bool icache, dcache;
+	int32_t size;
+
+	h = bootImageHeader(&addr);
+	if(h == NULL)
+	{
+		bootLoadReport("xip", addr, 0, 0, 0);
+		if(BOOT_VERIFY_REQUIRED)
+		{
+			return BOOT_LOAD_UNVERIFIED;
+		}
+		if((addr != 0) && (BOOT_JUMP_KEEP_CACHES || (bootSlotGet()->slot != BOOT_SLOT_A)))
+		{
+			// What BOOT_Application() does, at the offset of the slot
+			if(MapMemory() == BOOT_OK)
+			{
+				bootJump(addr);
+			}
+			return BOOT_LOAD_BAD_ADDRESS;
+		}
+		return BOOT_LOAD_NO_IMAGE;
+	}
+	if(!bootHeaderValid(h))
+	{
+		return BOOT_LOAD_BAD_HEADER;
+	}
+	if(!(h->flags & BOOT_IMAGE_XIP) && !bootRegionValid(h->load_addr, h->image_size))
+	{
+		return BOOT_LOAD_BAD_ADDRESS;
+	}
+	payload = (const uint8_t *)h + h->header_size;
+
+	if(h->flags & BOOT_IMAGE_SHA256)
+	{
+		verify_result_t result = bootVerifyWait();
+
+		if(result == VERIFY_IDLE)
+		{
+			// Not started early by main()
+			bootLoadVerifyStart();
+			result = bootVerifyWait();
+		}
+		timelineMark(TL_VERIFY);
+		bootVerifyReport();
+		if(result != VERIFY_OK)
+		{
+			return BOOT_LOAD_BAD_DIGEST;
+		}
+	}
+	else if(BOOT_VERIFY_REQUIRED)
+	{
+		return BOOT_LOAD_UNVERIFIED;
+	}
+
+	if(h->flags & BOOT_IMAGE_XIP)
+	{
+		bootLoadReport("xip", h->load_addr, h->image_size, h->packed_size, 0);
+		bootJump(h->load_addr);
+		return BOOT_LOAD_BAD_PAYLOAD;
+	}
+
+	icache = (SCB->CCR & SCB_CCR_IC_Msk) != 0;
+	dcache = (SCB->CCR & SCB_CCR_DC_Msk) != 0;
+	SCB_EnableICache();
+	SCB_EnableDCache();
+	t0 = ticks();
+	if(h->flags & BOOT_IMAGE_LZ4)
+	{
+		size = lz4Decompress(payload, h->packed_size, (uint8_t *)h->load_addr, h->image_size);
+	}
+	else
+	{
+		size = (h->packed_size == h->image_size) ? (int32_t)h->image_size : LZ4_ERROR;
+		if(size != LZ4_ERROR)
+		{
+			memcpy((void *)h->load_addr, payload, h->image_size);
+		}
+	}
+	SCB_CleanDCache_by_Addr((void *)h->load_addr, (int32_t)h->image_size);
+	SCB_InvalidateICache_by_Addr((void *)h->load_addr, (int32_t)h->image_size);
+	load_us = ticksElapsed(t0);
+	timelineMark(TL_LOAD);
+
+	if(size != (int32_t)h->image_size)
+	{
+		if(!dcache)
+		{
+			SCB_DisableDCache();
+		}
+		if(!icache)
+		{
+			SCB_DisableICache();
+		}
+		return BOOT_LOAD_BAD_PAYLOAD;
+	}
+
+	bootLoadReport((h->flags & BOOT_IMAGE_LZ4) ? "lz4" : "stored", h->load_addr, h->image_size, h->packed_size, load_us);
+	bootJump(h->load_addr);
+	return BOOT_LOAD_BAD_PAYLOAD;
+}
@@ -0,0 +1,74 @@
+/* SPDX-License-Identifier: Unlicense */
+
+#ifndef BOOTLOAD_H_
+#define BOOTLOAD_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "common.h"
+#include "sha256.h"
+
+#define BOOT_IMAGE_MAGIC            0x5A344C42UL    // "BL4Z"
+#define BOOT_IMAGE_VERSION          2
+
+// Header flags
+#define BOOT_IMAGE_LZ4              BIT(0)          // Payload is one LZ4 block, else stored as is
+#define BOOT_IMAGE_SHA256           BIT(1)          // digest holds the SHA-256 of the payload
+#define BOOT_IMAGE_XIP              BIT(2)          // Payload runs in place, at load_addr in the NOR
+
+// Set to 0 to always boot XIP, even if the NOR holds a packed image
+#ifndef BOOT_LOAD_ENABLE
+#define BOOT_LOAD_ENABLE            1
+#endif
+
+// Set to 1 to refuse images without a digest, plain XIP binaries included
+#ifndef BOOT_VERIFY_REQUIRED
+#define BOOT_VERIFY_REQUIRED        0
+#endif
+
+// Set to 0 to turn the caches off before the jump, as boot/stm32_boot_xip.c
+// does. At 1 they stay on and only the D-cache is cleaned: the app must keep
+// AXI SRAM, the PSRAM and the NOR cacheable in its MPU (as Boot MPU_Config()
+// does) or clean and invalidate before demoting any of them, and must not
+// invalidate the D-cache without cleaning it first.
+#ifndef BOOT_JUMP_KEEP_CACHES
+#define BOOT_JUMP_KEEP_CACHES       1
+#endif
+
+// Header of an image, written by Tools/imagepack.py at the image offset of a slot
+typedef struct
+{
+	uint32_t magic;             // BOOT_IMAGE_MAGIC
+	uint16_t version;           // BOOT_IMAGE_VERSION
+	uint16_t header_size;       // Bytes, the payload follows
+	uint32_t flags;             // BOOT_IMAGE_xxx
+	uint32_t load_addr;         // Run address, where the vector table lands
+	uint32_t image_size;        // Bytes once decompressed
+	uint32_t packed_size;       // Payload bytes
+	uint8_t digest[SHA256_DIGEST_SIZE];
+	uint32_t reserved;
+	uint32_t header_crc;        // CRC-32 of the fields above
+} boot_image_header_t;
+
+typedef enum
+{
+	BOOT_LOAD_NO_IMAGE,         // No image header: boot XIP
+	BOOT_LOAD_BAD_HEADER,
+	BOOT_LOAD_BAD_ADDRESS,      // Load region not in PSRAM / free AXI SRAM
+	BOOT_LOAD_BAD_PAYLOAD,      // Decompression failed
+	BOOT_LOAD_BAD_DIGEST,       // Payload does not match its SHA-256
+	BOOT_LOAD_UNVERIFIED,       // No digest and BOOT_VERIFY_REQUIRED
+} boot_load_status_t;
+
+uint32_t bootCrc32(const void *data, uint32_t size);
+uint32_t bootCrc32Update(uint32_t crc, const void *data, uint32_t size);
+void bootLoadVerifyStart(void);
+boot_load_status_t bootLoadApplication(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // BOOTLOAD_H_
@@ -0,0 +1,200 @@
+/* SPDX-License-Identifier: Unlicense */
+
+// -----------------------------------------------------------------------------
+// IMPLEMENTATION NOTES
+//
+// A/B slot selection. Two image slots share the 128 MB NOR (Common/bootCtrl.h),
+// and 16 byte boot-control records after each slot say which one to start.
+// bootSlotSelect() runs from MX_EXTMEM_MANAGER_Init() before the NOR is memory
+// mapped, so the records cost two small indirect reads and the decision is the
+// same handful of compares whatever the slots hold: nothing is scanned, hashed
+// or copied here. The image in the chosen slot is then checked and started by
+// Board/bootLoad.c from bootSlotOffset() instead of EXTMEM_XIP_IMAGE_OFFSET.
+//
+// The current record is the valid one with the newest sequence number. A new
+// record goes to the other sector, trailing fields first and the CRC covered
+// header last, so until it is complete the old one stays current: a power
+// loss during an update boots as if the update had not been activated.
+//
+// A trial boot clears one bit of the attempts field before the app runs, so a
+// crash or a hang that ends in a reset still counts. The app confirms by
+// clearing the confirmed field itself (bootCtrlConfirm(), from RAM); if it
+// cannot, it sets a backup register instead, which the next boot turns into
+// the cleared field. Both are bit clears, so the bootloader never erases the
+// current record's sector. Once the attempts are gone without a confirmation,
+// the fallback slot boots.
+//
+// Since nothing moves between slots, an update is written to the inactive slot
+// followed by a new record, and switching over is one reset.
+//
+// -----------------------------------------------------------------------------
+
+#include "bootSlot.h"
+#include "bootLoad.h"
+#include "timebase.h"
+#include "extmem_manager.h"
+
+// Same default as boot/stm32_boot_xip.c
+#ifndef EXTMEM_XIP_IMAGE_OFFSET
+#define EXTMEM_XIP_IMAGE_OFFSET     0
+#endif
+
+_Static_assert(EXTMEM_XIP_IMAGE_OFFSET + BOOT_SLOT_SIZE <= BOOT_CTRL_RECORD_OFFSET(0), "Slot A overlaps boot-control record 0");
+_Static_assert(BOOT_SLOT_B_OFFSET + BOOT_SLOT_SIZE <= BOOT_CTRL_RECORD_OFFSET(1), "Slot B overlaps boot-control record 1");
+
+static boot_slot_t selected =
+{
+	.slot = BOOT_SLOT_A,
+	.offset = EXTMEM_XIP_IMAGE_OFFSET,
+	.state = BOOT_SLOT_DEFAULT,
+};
+
+uint32_t bootSlotOffsetOf(uint32_t slot)
+{
+	return (slot == BOOT_SLOT_B) ? BOOT_SLOT_B_OFFSET : EXTMEM_XIP_IMAGE_OFFSET;
+}
+
+// -----------------------------------------------------------------------------
+// Description: Reads and checks a boot-control record
+//     Returns: true if the record is valid
+//      Inputs: Record index, storage
+// -----------------------------------------------------------------------------
+static bool bootCtrlRead(uint32_t record, boot_ctrl_t *rec)
+{
+	return (EXTMEM_Read(EXTMEM_MEMORY_BOOTXIP, BOOT_CTRL_RECORD_OFFSET(record), (uint8_t *)rec, sizeof(*rec)) == EXTMEM_OK) &&
+	       (rec->magic == BOOT_CTRL_MAGIC) && (rec->crc == bootCrc32(rec, offsetof(boot_ctrl_t, crc))) &&
+	       (rec->active <= BOOT_SLOT_B) && (rec->fallback <= BOOT_SLOT_B);
+}
+
+// -----------------------------------------------------------------------------
+// Description: Clears bits of a 16-bit field of the current record, without an
+//              erase
+//     Returns: true on success
+//      Inputs: Field offset, new value (only bits cleared)
+// -----------------------------------------------------------------------------
+static bool bootCtrlProgram(uint32_t field, uint16_t value)
+{
+	return EXTMEM_Write(EXTMEM_MEMORY_BOOTXIP, BOOT_CTRL_RECORD_OFFSET(selected.record) + field,
+	                    (const uint8_t *)&value, sizeof(value)) == EXTMEM_OK;
+}
+
+// -----------------------------------------------------------------------------
+// Description: Reads the boot-control records and picks the slot to boot,
+//              updating the current record for trial boots. Must run while the
+//              NOR is in indirect mode.
+//     Returns: none
+//      Inputs: none
+// -----------------------------------------------------------------------------
+void bootSlotSelect(void)
+{
+	boot_ctrl_t recs[BOOT_CTRL_RECORDS], rec;
+	bool valids[BOOT_CTRL_RECORDS];
+	uint32_t t0 = ticks();
+	uint32_t record_bit;
+	bool valid;
+
+	RCC->APB4ENR |= RCC_APB4ENR_RTCAPBEN;
+	PWR->CR1 |= PWR_CR1_DBP;
+
+	for(uint32_t i = 0; i < BOOT_CTRL_RECORDS; i++)
+	{
+		valids[i] = bootCtrlRead(i, &recs[i]);
+	}
+	// The newest valid record, the sequence wrapping at 16 bits
+	selected.record = (valids[1] && (!valids[0] || ((int16_t)(recs[1].sequence - recs[0].sequence) > 0))) ? 1 : 0;
+	valid = valids[selected.record];
+	rec = recs[selected.record];
+	record_bit = selected.record ? BOOT_CTRL_RECORD : 0;
+
+	selected.slot = BOOT_SLOT_A;
+	selected.state = BOOT_SLOT_DEFAULT;
+	selected.attempts = 0;
+	selected.sequence = 0;
+	if(valid)
+	{
+		selected.sequence = rec.sequence;
+
+		// The trial boot before this reset confirmed, but could not write the NOR
+		if((rec.confirmed != 0) && (BOOT_CTRL_CONFIRM == BOOT_CTRL_CONFIRM_MAGIC) &&
+		   (BOOT_CTRL_RUNNING == (rec.active | BOOT_CTRL_TRIAL | record_bit)) &&
+		   bootCtrlProgram(offsetof(boot_ctrl_t, confirmed), 0))
+		{
+			rec.confirmed = 0;
+			selected.confirmed_now = true;
+		}
+
+		if(rec.confirmed == 0)
+		{
+			selected.slot = rec.active;
+			selected.state = BOOT_SLOT_CONFIRMED;
+		}
+		else if((rec.attempts != 0) && bootCtrlProgram(offsetof(boot_ctrl_t, attempts), rec.attempts & (rec.attempts - 1)))
+		{
+			selected.slot = rec.active;
+			selected.state = BOOT_SLOT_TRIAL;
+			selected.attempts = __builtin_popcount(rec.attempts) - 1;
+		}
+		else
+		{
+			selected.slot = rec.fallback;
+			selected.state = BOOT_SLOT_ROLLBACK;
+		}
+	}
+
+	BOOT_CTRL_CONFIRM = 0;
+	BOOT_CTRL_RUNNING = selected.slot | ((selected.state == BOOT_SLOT_TRIAL) ? BOOT_CTRL_TRIAL : 0) | record_bit;
+	selected.offset = bootSlotOffsetOf(selected.slot);
+	selected.select_us = ticksElapsed(t0);
+}
+
+// -----------------------------------------------------------------------------
+// Description: Writes a new boot-control record, for Board/bootUpdate.c once an
+//              image is in place, in the sector of the other record. The
+//              running slot becomes the fallback.
+//     Returns: true on success
+//      Inputs: Slot to boot, trial boots (0 for a permanent switch)
+// -----------------------------------------------------------------------------
+bool bootSlotActivate(uint32_t slot, uint32_t trials)
+{
+	uint32_t offset = BOOT_CTRL_RECORD_OFFSET(selected.record ^ 1);
+	boot_ctrl_t rec;
+
+	rec.magic = BOOT_CTRL_MAGIC;
+	rec.active = (uint8_t)slot;
+	rec.fallback = (uint8_t)selected.slot;
+	rec.sequence = selected.sequence + 1;
+	rec.crc = bootCrc32(&rec, offsetof(boot_ctrl_t, crc));
+	rec.attempts = (trials != 0) ? (uint16_t)((1UL << MIN(trials, BOOT_CTRL_ATTEMPTS_MAX)) - 1) : 0;
+	rec.confirmed = (trials != 0) ? 0xFFFF : 0;
+
+	// The header, which makes the record valid, goes last
+	return (EXTMEM_EraseSector(EXTMEM_MEMORY_BOOTXIP, offset, BOOT_CTRL_SECTOR) == EXTMEM_OK) &&
+	       (EXTMEM_Write(EXTMEM_MEMORY_BOOTXIP, offset + offsetof(boot_ctrl_t, attempts), (const uint8_t *)&rec.attempts,
+	                     sizeof(rec) - offsetof(boot_ctrl_t, attempts)) == EXTMEM_OK) &&
+	       (EXTMEM_Write(EXTMEM_MEMORY_BOOTXIP, offset, (const uint8_t *)&rec, offsetof(boot_ctrl_t, attempts)) == EXTMEM_OK);
+}
+
+uint32_t bootSlotOffset(void)
+{
+	return selected.offset;
+}
+
+const boot_slot_t *bootSlotGet(void)
+{
+	return &selected;
+}
+
+// -----------------------------------------------------------------------------
+// Description: Prints the slot decision as CSV
+//     Returns: none
+//      Inputs: none
+// -----------------------------------------------------------------------------
+void bootSlotReport(void)
+{
+	static const char *const state_names[] = {"default", "confirmed", "trial", "rollback"};
+
+	printf("bootslot,slot,offset,state,attempts_left,confirmed_now,record,sequence,select_us" EOL);
+	printf("bootslot,%c,0x%08lX,%s,%lu,%u,%lu,%u,%lu" EOL, (selected.slot == BOOT_SLOT_B) ? 'B' : 'A', selected.offset,
+	       state_names[selected.state], selected.attempts, selected.confirmed_now, selected.record, selected.sequence,
+	       selected.select_us);
+}
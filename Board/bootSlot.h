@@ -0,0 +1,44 @@
+/* SPDX-License-Identifier: Unlicense */
+
+#ifndef BOOTSLOT_H_
+#define BOOTSLOT_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "common.h"
+#include "bootCtrl.h"
+
+typedef enum
+{
+	BOOT_SLOT_DEFAULT,          // No (valid) boot-control record: slot A
+	BOOT_SLOT_CONFIRMED,
+	BOOT_SLOT_TRIAL,            // One attempt used up by this boot
+	BOOT_SLOT_ROLLBACK,         // Trial out of attempts: fallback slot
+} boot_slot_state_t;
+
+typedef struct
+{
+	uint32_t slot;              // BOOT_SLOT_A or BOOT_SLOT_B
+	uint32_t offset;            // Image offset in the NOR
+	boot_slot_state_t state;
+	uint32_t attempts;          // Trial boots left after this one
+	bool confirmed_now;         // The trial was confirmed by this boot
+	uint32_t record;            // Current boot-control record (the next update writes the other)
+	uint16_t sequence;          // Of the boot-control record, 0 without one
+	uint32_t select_us;
+} boot_slot_t;
+
+void bootSlotSelect(void);
+uint32_t bootSlotOffset(void);
+uint32_t bootSlotOffsetOf(uint32_t slot);
+bool bootSlotActivate(uint32_t slot, uint32_t trials);
+const boot_slot_t *bootSlotGet(void);
+void bootSlotReport(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // BOOTSLOT_H_
@@ -0,0 +1,749 @@
+/* SPDX-License-Identifier: Unlicense */
+
+// -----------------------------------------------------------------------------
+// IMPLEMENTATION NOTES
+//
+// Firmware update over UART4 (protocol in Common/fwUpdate.h, host side in
+// Tools/fwupdate.py). The app cannot program the NOR it runs from, so it only
+// sets a backup register and resets (Common/fwUpdate.c); the transfer happens
+// here, before any image is started, and writes the inactive A/B slot followed
+// by a new boot-control record (Board/bootSlot.c).
+//
+// The START frame is polled at the console rate. Once answered, UART4 moves to
+// the rate the host asked for with its FIFO on, and GPDMA1 channel 1 receives
+// the DATA frames into two buffers chained by a circular linked list, so
+// reception never waits for the CPU: while one frame is checked and programmed
+// with EXTMEM_Write() the next one lands in the other buffer. The host keeps at
+// most two frames in flight, sending chunk n + 2 only once chunk n is
+// acknowledged, which is what makes two buffers enough.
+//
+// Sectors are erased one 64 KB block at a time ahead of the write cursor,
+// whenever no frame is waiting: a block erase takes longer than a frame at the
+// update rate, and the two buffers keep filling meanwhile. With the defaults
+// (32 KB chunks, 2 Mbaud) the bootloader spends most of its time in rx_wait,
+// i.e. the link is the bottleneck; bootUpdateReport() shows the split.
+//
+// A frame with a bad CRC or an unexpected sequence number, or that stalls part
+// way, throws away whatever is in flight: the DMA is stopped, the line drained
+// until idle, the ring re-armed and a NAK tells the host where to resume (go
+// back N). The end of the image is checked by reading the slot back.
+//
+// The frame buffers borrow the top of the PSRAM, which holds nothing until an
+// image is loaded, rather than 64 KB of AXI SRAM that load-and-run images use.
+//
+// The loopback flag of START runs the same transfer without erasing,
+// programming or switching slots, and checks a running CRC of the payload
+// instead of the read back: a link test that leaves the NOR alone.
+//
+// With the delta flag the frames carry a patch against the running slot
+// (Board/bootDelta.c). The NOR then stays memory mapped while frames come in,
+// since the patch reads the old image in place, and only leaves mapped mode
+// for the erase and program of each 64 KB block of the new image, staged in
+// PSRAM below the frame buffers. There is no erase ahead: the receive ring
+// keeps filling during a block flush, and the window holds the host back.
+//
+// -----------------------------------------------------------------------------
+
+#include "bootUpdate.h"
+#include "bootDelta.h"
+#include "bootSlot.h"
+#include "bootLoad.h"
+#include "bootVerify.h"
+#include "bootCtrl.h"
+#include "logSink.h"
+#include "psram.h"
+#include "stm32.h"
+#include "timebase.h"
+#include "traceRing.h"
+#include "main.h"
+#include "extmem_manager.h"
+
+#define UPDATE_DMA              GPDMA1_Channel1
+#define UPDATE_DMA_IRQn         GPDMA1_Channel1_IRQn
+#define UPDATE_DMA_ERRORS       (DMA_CSR_DTEF | DMA_CSR_ULEF | DMA_CSR_USEF)
+#define UPDATE_DMA_FLAGS        (DMA_CFCR_TCF | DMA_CFCR_HTF | DMA_CFCR_DTEF | DMA_CFCR_ULEF | \
+                                 DMA_CFCR_USEF | DMA_CFCR_SUSPF | DMA_CFCR_TOF)
+#define UPDATE_LLI_FIELDS       (DMA_CLLR_UB1 | DMA_CLLR_UDA | DMA_CLLR_ULL)
+#define UPDATE_UART_ERRORS      (USART_ISR_ORE | USART_ISR_FE | USART_ISR_NE)
+#define UPDATE_UART_CLEAR       (USART_ICR_ORECF | USART_ICR_FECF | USART_ICR_NECF)
+
+#define UPDATE_FRAME_SIZE       (sizeof(fw_update_frame_t) + BOOT_UPDATE_CHUNK_SIZE)
+#define UPDATE_BUFFER_SIZE      ((UPDATE_FRAME_SIZE + __SCB_DCACHE_LINE_SIZE - 1) & ~(__SCB_DCACHE_LINE_SIZE - 1))
+#define UPDATE_BUFFERS          (PSRAM_BASE_ADDRESS + PSRAM_SIZE - 2 * UPDATE_BUFFER_SIZE)
+#define UPDATE_ERASE_BLOCK      0x10000UL
+#define UPDATE_DELTA_BLOCK      (UPDATE_BUFFERS - UPDATE_ERASE_BLOCK)
+
+#define UPDATE_BYTE_TIMEOUT_MS  50              // Within the START frame
+#define UPDATE_FRAME_TIMEOUT_MS 100             // DATA frame stalled part way
+#define UPDATE_IDLE_TIMEOUT_MS  15000           // Host gone, longer than its reply timeout
+#define UPDATE_DRAIN_IDLE_MS    5               // Line quiet before a NAK
+#define UPDATE_REPORT_DELAY_MS  100             // Host back at the console rate
+#define UPDATE_NAKS_MAX         64
+
+// Linked-list item: the registers flagged in CLLR, in register order
+typedef struct
+{
+	uint32_t cbr1;
+	uint32_t cdar;
+	uint32_t cllr;
+} update_lli_t;
+
+static struct
+{
+	volatile uint32_t frames;   // Completed since the ring was armed
+	volatile bool failed;       // DMA error
+	uint8_t *buffer[2];
+} rx;
+
+// Console setup of UART4, restored at the end
+static struct
+{
+	uint32_t brr;
+	uint32_t cr1;
+	uint32_t cr3;
+} console;
+
+static update_lli_t lli[2] __attribute__((aligned(32)));
+static boot_update_stats_t stats;
+static boot_delta_t delta;
+
+static void updateReply(uint8_t status, uint16_t seq, uint32_t value)
+{
+	fw_update_reply_t reply = {FW_UPDATE_SYNC, status, seq, value};
+
+	HAL_UART_Transmit(&huart4, (uint8_t *)&reply, sizeof(reply), 100);
+}
+
+static bool updateGetByte(uint8_t *c, uint32_t timeout_ms)
+{
+	uint32_t t0 = ticks();
+
+	do
+	{
+		if(UART4->ISR & UPDATE_UART_ERRORS)
+		{
+			UART4->ICR = UPDATE_UART_CLEAR;
+		}
+		if(UART4->ISR & USART_ISR_RXNE_RXFNE)
+		{
+			*c = (uint8_t)UART4->RDR;
+			return true;
+		}
+	} while(ticksElapsed(t0) < msToTicks(timeout_ms));
+	return false;
+}
+
+// -----------------------------------------------------------------------------
+// Description: Waits for a START frame at the console rate
+//     Returns: true when one came in
+//      Inputs: Timeout (0 for none), frame header and payload storage
+// -----------------------------------------------------------------------------
+static bool updateGetStart(uint32_t wait_ms, fw_update_frame_t *f, fw_update_start_t *start)
+{
+	uint8_t frame[sizeof(fw_update_frame_t) + sizeof(fw_update_start_t)];
+	uint32_t matched = 0;
+	uint32_t t0 = ticks();
+
+	while((wait_ms == 0) || (ticksElapsed(t0) < msToTicks(wait_ms)))
+	{
+		uint8_t c;
+
+		if(!updateGetByte(&c, UPDATE_BYTE_TIMEOUT_MS))
+		{
+			matched = 0;
+			continue;
+		}
+		// Magic first, byte by byte
+		if((matched < sizeof(f->magic)) && (c != (uint8_t)(FW_UPDATE_MAGIC >> (8 * matched))))
+		{
+			matched = (c == (uint8_t)FW_UPDATE_MAGIC) ? 1 : 0;
+			frame[0] = c;
+			continue;
+		}
+		frame[matched++] = c;
+		if(matched < sizeof(frame))
+		{
+			continue;
+		}
+
+		matched = 0;
+		memcpy(f, frame, sizeof(*f));
+		memcpy(start, &frame[sizeof(*f)], sizeof(*start));
+		if((f->cmd == FW_UPDATE_START) && (f->length == sizeof(*start)) &&
+		   (f->crc == bootCrc32Update(bootCrc32(f, offsetof(fw_update_frame_t, crc)), start, sizeof(*start))))
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+// -----------------------------------------------------------------------------
+// Description: Provides the UART4 divider for a rate
+//     Returns: BRR value, 0 when out of reach or off by more than 2%
+//      Inputs: Rate
+// -----------------------------------------------------------------------------
+static uint32_t updateBaudDivider(uint32_t baud)
+{
+	uint32_t clock = HAL_RCCEx_GetPeriphCLKFreq(RCC_PERIPHCLK_USART234578) / UARTPrescTable[huart4.Init.ClockPrescaler];
+	uint32_t div;
+	uint32_t actual;
+
+	if((baud == 0) || (baud > clock / 16))
+	{
+		return 0;
+	}
+	div = (clock + baud / 2) / baud;
+	actual = clock / div;
+	if((div > 0xFFFF) || (((actual > baud) ? (actual - baud) : (baud - actual)) > (baud / 50)))
+	{
+		return 0;
+	}
+	return div;
+}
+
+static void updateUartFast(uint32_t div)
+{
+	console.brr = UART4->BRR;
+	console.cr1 = UART4->CR1;
+	console.cr3 = UART4->CR3;
+
+	// OVRDIS: an overrun costs a frame CRC rather than stopping the receiver
+	UART4->CR1 = console.cr1 & ~USART_CR1_UE;
+	UART4->BRR = div;
+	UART4->CR3 = console.cr3 | USART_CR3_OVRDIS;
+	UART4->CR1 = console.cr1 | USART_CR1_FIFOEN;
+}
+
+static void updateUartRestore(void)
+{
+	UART4->CR1 = console.cr1 & ~USART_CR1_UE;
+	UART4->BRR = console.brr;
+	UART4->CR3 = console.cr3;
+	UART4->CR1 = console.cr1;
+	UART4->ICR = UPDATE_UART_CLEAR;
+}
+
+// -----------------------------------------------------------------------------
+// Description: Arms the two-buffer receive ring, frame n lands in buffer n & 1
+//     Returns: none
+//      Inputs: none
+// -----------------------------------------------------------------------------
+static void updateRxStart(void)
+{
+	DMA_Channel_TypeDef *ch = UPDATE_DMA;
+
+	rx.frames = 0;
+	rx.failed = false;
+	for(uint32_t i = 0; i < 2; i++)
+	{
+		lli[i].cbr1 = UPDATE_FRAME_SIZE;
+		lli[i].cdar = (uint32_t)rx.buffer[i];
+		lli[i].cllr = UPDATE_LLI_FIELDS | ((uint32_t)&lli[i ^ 1] & DMA_CLLR_LA);
+	}
+	SCB_CleanDCache_by_Addr(lli, sizeof(lli));
+	SCB_InvalidateDCache_by_Addr(rx.buffer[0], 2 * UPDATE_BUFFER_SIZE);
+
+	ch->CCR = DMA_CCR_RESET;
+	ch->CFCR = UPDATE_DMA_FLAGS;
+	ch->CTR1 = DMA_CTR1_DINC;
+	ch->CTR2 = GPDMA1_REQUEST_UART4_RX << DMA_CTR2_REQSEL_Pos;
+	ch->CBR1 = UPDATE_FRAME_SIZE;
+	ch->CSAR = (uint32_t)&UART4->RDR;
+	ch->CDAR = (uint32_t)rx.buffer[0];
+	ch->CLBAR = (uint32_t)lli & DMA_CLBAR_LBA;
+	ch->CLLR = lli[0].cllr;
+
+	UART4->RQR = USART_RQR_RXFRQ;
+	UART4->ICR = UPDATE_UART_CLEAR;
+	UART4->CR3 |= USART_CR3_DMAR;
+	ch->CCR = DMA_CCR_EN | DMA_CCR_TCIE | DMA_CCR_DTEIE | DMA_CCR_ULEIE | DMA_CCR_USEIE;
+}
+
+static void updateRxStop(void)
+{
+	DMA_Channel_TypeDef *ch = UPDATE_DMA;
+
+	UART4->CR3 &= ~USART_CR3_DMAR;
+	if(ch->CCR & DMA_CCR_EN)
+	{
+		ch->CCR |= DMA_CCR_SUSP;
+		while(!(ch->CSR & (DMA_CSR_SUSPF | DMA_CSR_IDLEF)))
+		{
+		}
+	}
+	ch->CCR = DMA_CCR_RESET;
+	ch->CFCR = UPDATE_DMA_FLAGS;
+}
+
+void GPDMA1_Channel1_IRQHandler(void)
+{
+	uint32_t csr = UPDATE_DMA->CSR;
+
+	UPDATE_DMA->CFCR = UPDATE_DMA_FLAGS;
+	if(csr & UPDATE_DMA_ERRORS)
+	{
+		rx.failed = true;
+	}
+	else if(csr & DMA_CSR_TCF)
+	{
+		rx.frames++;
+	}
+}
+
+// -----------------------------------------------------------------------------
+// Description: Drops what the host has in flight and asks it to resend
+//     Returns: none
+//      Inputs: Chunk to resume from, reason
+// -----------------------------------------------------------------------------
+static void updateResync(uint16_t seq, fw_update_error_t error)
+{
+	uint32_t t0 = ticks();
+
+	updateRxStop();
+	stats.naks++;
+	while(ticksElapsed(t0) < msToTicks(UPDATE_DRAIN_IDLE_MS))
+	{
+		if(UART4->ISR & UPDATE_UART_ERRORS)
+		{
+			UART4->ICR = UPDATE_UART_CLEAR;
+		}
+		if(UART4->ISR & USART_ISR_RXNE_RXFNE)
+		{
+			(void)UART4->RDR;
+			t0 = ticks();
+		}
+	}
+	updateRxStart();
+	updateReply(FW_UPDATE_NAK, seq, error);
+}
+
+// -----------------------------------------------------------------------------
+// Description: Checks a DATA frame against the transfer so far
+//     Returns: FW_UPDATE_ERR_CRC or _SEQ to resend, _SIZE to give up
+//      Inputs: Frame, expected chunk, image bytes done and total, header storage
+// -----------------------------------------------------------------------------
+static fw_update_error_t updateCheckFrame(const uint8_t *frame, uint16_t seq, uint32_t offset, uint32_t image_size,
+                                          fw_update_frame_t *f)
+{
+	uint32_t crc;
+	uint32_t remaining = image_size - offset;
+
+	memcpy(f, frame, sizeof(*f));
+	if((f->magic != FW_UPDATE_MAGIC) || (f->cmd != FW_UPDATE_DATA))
+	{
+		return FW_UPDATE_ERR_CRC;
+	}
+	crc = bootCrc32Update(bootCrc32(f, offsetof(fw_update_frame_t, crc)), &frame[sizeof(*f)], BOOT_UPDATE_CHUNK_SIZE);
+	if(crc != f->crc)
+	{
+		return FW_UPDATE_ERR_CRC;
+	}
+	if(f->seq != seq)
+	{
+		return FW_UPDATE_ERR_SEQ;
+	}
+	if(f->flags & FW_UPDATE_LAST)
+	{
+		return ((f->length == remaining) && (f->length <= BOOT_UPDATE_CHUNK_SIZE)) ? FW_UPDATE_OK : FW_UPDATE_ERR_SIZE;
+	}
+	return ((f->length == BOOT_UPDATE_CHUNK_SIZE) && (remaining > f->length)) ? FW_UPDATE_OK : FW_UPDATE_ERR_SIZE;
+}
+
+static bool updateErase(uint32_t base, uint32_t *erased)
+{
+	uint32_t t0 = ticks();
+	bool ok = EXTMEM_EraseSector(EXTMEM_MEMORY_BOOTXIP, base + *erased, UPDATE_ERASE_BLOCK) == EXTMEM_OK;
+
+	*erased += UPDATE_ERASE_BLOCK;
+	stats.erase_us += ticksElapsed(t0);
+	return ok;
+}
+
+// -----------------------------------------------------------------------------
+// Description: Writes a block of the new image of a delta update, out of
+//              memory mapped mode for the duration
+//     Returns: true on success
+//      Inputs: Slot offset in the NOR, block offset and data in the image, size
+// -----------------------------------------------------------------------------
+static bool updateDeltaFlush(void *ctx, uint32_t offset, const uint8_t *data, uint32_t size)
+{
+	uint32_t base = *(const uint32_t *)ctx;
+	uint32_t erased = offset;
+	uint32_t t0;
+	bool ok;
+
+	if(EXTMEM_MemoryMappedMode(EXT_MEMORY_NOR_FLASH, EXTMEM_DISABLE) != EXTMEM_OK)
+	{
+		return false;
+	}
+	ok = updateErase(base, &erased);
+	t0 = ticks();
+	ok = ok && (EXTMEM_Write(EXTMEM_MEMORY_BOOTXIP, base + offset, data, size) == EXTMEM_OK);
+	stats.program_us += ticksElapsed(t0);
+	stats.written = offset + size;
+	return (EXTMEM_MemoryMappedMode(EXT_MEMORY_NOR_FLASH, EXTMEM_ENABLE) == EXTMEM_OK) && ok;
+}
+
+static fw_update_error_t updateDeltaError(boot_delta_status_t status)
+{
+	switch(status)
+	{
+	case BOOT_DELTA_MORE:
+	case BOOT_DELTA_DONE:
+		return FW_UPDATE_OK;
+	case BOOT_DELTA_BAD_BASE:
+		return FW_UPDATE_ERR_BASE;
+	case BOOT_DELTA_FLUSH_FAILED:
+		return FW_UPDATE_ERR_PROGRAM;
+	default:
+		return FW_UPDATE_ERR_PATCH;
+	}
+}
+
+// -----------------------------------------------------------------------------
+// Description: Receives and programs the DATA frames, ring already armed
+//     Returns: FW_UPDATE_OK once the last chunk is in
+//      Inputs: START payload, slot offset in the NOR, payload CRC storage
+// -----------------------------------------------------------------------------
+static fw_update_error_t updateReceive(const fw_update_start_t *start, uint32_t base, uint32_t *crc)
+{
+	fw_update_frame_t f;
+	fw_update_error_t err;
+	uint32_t offset = 0;
+	uint32_t erased = 0;
+	uint32_t next = 0;
+	uint16_t seq = 0;
+	uint32_t remaining = UPDATE_FRAME_SIZE;
+	uint32_t progress = ticks();
+	uint32_t wait_t0 = 0;
+	bool waiting = false;
+
+	*crc = 0;
+	while(true)
+	{
+		uint32_t now = ticks();
+		uint32_t bndt = UPDATE_DMA->CBR1 & DMA_CBR1_BNDT;
+
+		if(rx.failed)
+		{
+			updateResync(seq, FW_UPDATE_ERR_CRC);
+			next = 0;
+		}
+		else if(rx.frames > next)
+		{
+			const uint8_t *frame = rx.buffer[next & 1];
+			uint32_t t0;
+
+			if(waiting)
+			{
+				stats.rx_wait_us += ticksDiff(wait_t0, now);
+				waiting = false;
+			}
+			next++;
+			SCB_InvalidateDCache_by_Addr((void *)frame, UPDATE_BUFFER_SIZE);
+
+			t0 = ticks();
+			err = updateCheckFrame(frame, seq, offset, start->image_size, &f);
+			stats.check_us += ticksElapsed(t0);
+			if((err == FW_UPDATE_ERR_CRC) || (err == FW_UPDATE_ERR_SEQ))
+			{
+				if(stats.naks >= UPDATE_NAKS_MAX)
+				{
+					return err;
+				}
+				updateResync(seq, err);
+				next = 0;
+			}
+			else if(err != FW_UPDATE_OK)
+			{
+				return err;
+			}
+			else
+			{
+				if(stats.loopback || stats.delta)
+				{
+					*crc = bootCrc32Update(*crc, &frame[sizeof(f)], f.length);
+				}
+				if(stats.delta && !stats.loopback)
+				{
+					boot_delta_status_t status = bootDeltaFeed(&delta, &frame[sizeof(f)], f.length);
+
+					if(status > BOOT_DELTA_DONE)
+					{
+						return updateDeltaError(status);
+					}
+					if((f.flags & FW_UPDATE_LAST) && (status != BOOT_DELTA_DONE))
+					{
+						return FW_UPDATE_ERR_PATCH;
+					}
+				}
+				else if(!stats.loopback)
+				{
+					while(erased < (offset + f.length))
+					{
+						if(!updateErase(base, &erased))
+						{
+							return FW_UPDATE_ERR_ERASE;
+						}
+					}
+					t0 = ticks();
+					if(EXTMEM_Write(EXTMEM_MEMORY_BOOTXIP, base + offset, &frame[sizeof(f)], f.length) != EXTMEM_OK)
+					{
+						return FW_UPDATE_ERR_PROGRAM;
+					}
+					stats.program_us += ticksElapsed(t0);
+					stats.written = offset + f.length;
+				}
+				offset += f.length;
+				seq++;
+				stats.bytes = offset;
+				stats.chunks++;
+				if(f.flags & FW_UPDATE_LAST)
+				{
+					return FW_UPDATE_OK;
+				}
+				updateReply(FW_UPDATE_ACK, f.seq, offset);
+			}
+		}
+		else if(!stats.loopback && !stats.delta && (erased < start->image_size) && (erased < (offset + BOOT_UPDATE_ERASE_AHEAD)))
+		{
+			// Nothing received yet: erase ahead while the buffers fill
+			if(!updateErase(base, &erased))
+			{
+				return FW_UPDATE_ERR_ERASE;
+			}
+		}
+		else
+		{
+			// Waiting for the link
+			if(!waiting)
+			{
+				wait_t0 = now;
+				waiting = true;
+			}
+			if(bndt != remaining)
+			{
+				remaining = bndt;
+				progress = now;
+			}
+			else if(bndt != UPDATE_FRAME_SIZE)
+			{
+				if(ticksDiff(progress, now) > (int32_t)msToTicks(UPDATE_FRAME_TIMEOUT_MS))
+				{
+					if(stats.naks >= UPDATE_NAKS_MAX)
+					{
+						return FW_UPDATE_ERR_TIMEOUT;
+					}
+					updateResync(seq, FW_UPDATE_ERR_TIMEOUT);
+					next = 0;
+				}
+			}
+			else if(ticksDiff(progress, now) > (int32_t)msToTicks(UPDATE_IDLE_TIMEOUT_MS))
+			{
+				return FW_UPDATE_ERR_TIMEOUT;
+			}
+			continue;
+		}
+		remaining = UPDATE_DMA->CBR1 & DMA_CBR1_BNDT;
+		progress = ticks();
+	}
+}
+
+// -----------------------------------------------------------------------------
+// Description: CRC-32 of a slot as programmed, NOR out of memory mapped mode
+//     Returns: true when read back
+//      Inputs: Slot offset, size, CRC storage
+// -----------------------------------------------------------------------------
+static bool updateReadBack(uint32_t base, uint32_t size, uint32_t *crc)
+{
+	uint8_t *buffer = rx.buffer[0];
+
+	*crc = 0;
+	for(uint32_t offset = 0; offset < size; offset += BOOT_UPDATE_CHUNK_SIZE)
+	{
+		uint32_t n = MIN(size - offset, BOOT_UPDATE_CHUNK_SIZE);
+
+		if(EXTMEM_Read(EXTMEM_MEMORY_BOOTXIP, base + offset, buffer, n) != EXTMEM_OK)
+		{
+			return false;
+		}
+		*crc = bootCrc32Update(*crc, buffer, n);
+	}
+	return true;
+}
+
+// -----------------------------------------------------------------------------
+// Description: Consumes the update request left by the app
+//     Returns: true when the app asked for an update
+//      Inputs: none
+// -----------------------------------------------------------------------------
+bool bootUpdateRequested(void)
+{
+	bool requested;
+
+	RCC->APB4ENR |= RCC_APB4ENR_RTCAPBEN;
+	PWR->CR1 |= PWR_CR1_DBP;
+	requested = (FW_UPDATE_REQUEST == FW_UPDATE_REQUEST_MAGIC);
+	FW_UPDATE_REQUEST = 0;
+	return requested;
+}
+
+// -----------------------------------------------------------------------------
+// Description: Waits for the host and runs an update. Resets once a slot was
+//              written, successfully or not, so that the boot decision is
+//              taken again from the NOR contents.
+//     Returns: FW_UPDATE_ERR_TIMEOUT without a host, else the result of a
+//              rejected or loopback transfer
+//      Inputs: Timeout for the START frame (0 for none)
+// -----------------------------------------------------------------------------
+fw_update_error_t bootUpdate(uint32_t wait_ms)
+{
+	fw_update_frame_t f;
+	fw_update_start_t start;
+	fw_update_error_t err = FW_UPDATE_OK;
+	uint32_t div;
+	uint32_t slot;
+	uint32_t base;
+	uint32_t map;
+	uint32_t crc = 0;
+	uint32_t t0;
+
+	// Replies and rate changes bypass the log output
+	logSinkFlush();
+	if(!updateGetStart(wait_ms, &f, &start))
+	{
+		return FW_UPDATE_ERR_TIMEOUT;
+	}
+	TRACE(TRACE_UPDATE, f.flags);
+
+	memset(&stats, 0, sizeof(stats));
+	stats.loopback = (f.flags & FW_UPDATE_LOOPBACK) != 0;
+	stats.delta = (f.flags & FW_UPDATE_DELTA) != 0;
+	slot = (start.slot == FW_UPDATE_SLOT_INACTIVE) ? (bootSlotGet()->slot ^ 1) : start.slot;
+	base = bootSlotOffsetOf(slot);
+	stats.slot = slot;
+	stats.baud = (start.baud != 0) ? start.baud : huart4.Init.BaudRate;
+	div = updateBaudDivider(stats.baud);
+
+	if((slot > BOOT_SLOT_B) || (start.image_size == 0) || (start.image_size > BOOT_SLOT_SIZE))
+	{
+		err = FW_UPDATE_ERR_SIZE;
+	}
+	else if(div == 0)
+	{
+		err = FW_UPDATE_ERR_BAUD;
+	}
+	else if(stats.delta && ((slot == bootSlotGet()->slot) || (EXTMEM_GetMapAddress(EXTMEM_MEMORY_BOOTXIP, &map) != EXTMEM_OK)))
+	{
+		// The patch reads the running slot, it cannot also be the target
+		err = FW_UPDATE_ERR_BASE;
+	}
+	else if(!stats.loopback)
+	{
+		// The image hash reads the mapped NOR, which the erase ends
+		bootVerifyWait();
+		if(!stats.delta && (EXTMEM_MemoryMappedMode(EXT_MEMORY_NOR_FLASH, EXTMEM_DISABLE) != EXTMEM_OK))
+		{
+			err = FW_UPDATE_ERR_ERASE;
+		}
+	}
+	if(err != FW_UPDATE_OK)
+	{
+		updateReply(FW_UPDATE_FAIL, 0, err);
+		stats.result = err;
+		return err;
+	}
+
+	rx.buffer[0] = (uint8_t *)UPDATE_BUFFERS;
+	rx.buffer[1] = rx.buffer[0] + UPDATE_BUFFER_SIZE;
+	if(stats.delta)
+	{
+		delta.old = (const uint8_t *)(map + bootSlotOffset());
+		delta.old_max = BOOT_SLOT_SIZE;
+		delta.block = (uint8_t *)UPDATE_DELTA_BLOCK;
+		delta.block_size = UPDATE_ERASE_BLOCK;
+		delta.flush = updateDeltaFlush;
+		delta.ctx = &base;
+		bootDeltaInit(&delta);
+	}
+	RCC->AHB1ENR |= RCC_AHB1ENR_GPDMA1EN;
+	(void)RCC->AHB1ENR;
+	NVIC_ClearPendingIRQ(UPDATE_DMA_IRQn);
+	NVIC_EnableIRQ(UPDATE_DMA_IRQn);
+
+	// READY goes out at the console rate, the frames come at the update rate
+	updateReply(FW_UPDATE_READY, 0, BOOT_UPDATE_CHUNK_SIZE);
+	updateUartFast(div);
+	updateRxStart();
+	t0 = ticks();
+	err = updateReceive(&start, base, &crc);
+	stats.total_us = ticksElapsed(t0);
+	updateRxStop();
+	NVIC_DisableIRQ(UPDATE_DMA_IRQn);
+
+	if((err == FW_UPDATE_OK) && (stats.loopback || stats.delta) && (crc != start.image_crc))
+	{
+		err = FW_UPDATE_ERR_VERIFY;
+	}
+	if((err == FW_UPDATE_OK) && !stats.loopback)
+	{
+		uint32_t size = stats.delta ? delta.header.new_size : start.image_size;
+		uint32_t expected = stats.delta ? delta.header.new_crc : start.image_crc;
+
+		t0 = ticks();
+		if((stats.delta && (EXTMEM_MemoryMappedMode(EXT_MEMORY_NOR_FLASH, EXTMEM_DISABLE) != EXTMEM_OK)) ||
+		   !updateReadBack(base, size, &crc) || (crc != expected))
+		{
+			err = FW_UPDATE_ERR_VERIFY;
+		}
+		stats.verify_us = ticksElapsed(t0);
+	}
+	if((err == FW_UPDATE_OK) && !stats.loopback && !bootSlotActivate(slot, start.trials))
+	{
+		err = FW_UPDATE_ERR_ACTIVATE;
+	}
+	if(err == FW_UPDATE_OK)
+	{
+		updateReply(FW_UPDATE_DONE, (uint16_t)stats.chunks, crc);
+	}
+	else
+	{
+		updateReply(FW_UPDATE_FAIL, (uint16_t)stats.chunks, err);
+	}
+	stats.result = err;
+
+	updateUartRestore();
+	ticksDelay(msToTicks(UPDATE_REPORT_DELAY_MS));
+	bootUpdateReport();
+	if(stats.loopback)
+	{
+		return err;
+	}
+	logSinkFlush();
+	NVIC_SystemReset();
+	return err;
+}
+
+const boot_update_stats_t *bootUpdateGetStats(void)
+{
+	return &stats;
+}
+
+// -----------------------------------------------------------------------------
+// Description: Prints the last update as CSV. rx_wait_us close to total_us means
+//              the link was the bottleneck, not the erase or the programming.
+//     Returns: none
+//      Inputs: none
+// -----------------------------------------------------------------------------
+void bootUpdateReport(void)
+{
+	uint32_t kbps = (stats.total_us != 0) ? (uint32_t)(((uint64_t)stats.bytes * 1000) / stats.total_us) : 0;
+
+	printf("update,result,mode,slot,baud,bytes,written,chunks,naks,total_us,rx_wait_us,check_us,program_us,erase_us,verify_us,kbytes_s" EOL);
+	printf("update,%u,%s,%lu,%lu,%lu,%lu,%lu,%lu,%lu,%lu,%lu,%lu,%lu,%lu,%lu" EOL,
+	       stats.result, stats.loopback ? "loopback" : (stats.delta ? "delta" : "write"), stats.slot, stats.baud,
+	       stats.bytes, stats.written, stats.chunks,
+	       stats.naks, stats.total_us, stats.rx_wait_us, stats.check_us, stats.program_us, stats.erase_us,
+	       stats.verify_us, kbps);
+}
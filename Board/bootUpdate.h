@@ -0,0 +1,57 @@
+/* SPDX-License-Identifier: Unlicense */
+
+#ifndef BOOTUPDATE_H_
+#define BOOTUPDATE_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "common.h"
+#include "fwUpdate.h"
+
+// Payload bytes per DATA frame. Two frames are buffered, which must cover the
+// longest erase at the update rate (2 x 32 KB at 2 Mbaud is ~330 ms).
+#ifndef BOOT_UPDATE_CHUNK_SIZE
+#define BOOT_UPDATE_CHUNK_SIZE      32768
+#endif
+
+// Bytes kept erased past the write cursor
+#ifndef BOOT_UPDATE_ERASE_AHEAD
+#define BOOT_UPDATE_ERASE_AHEAD     0x20000UL
+#endif
+
+// Wait for the host after a request from the app
+#ifndef BOOT_UPDATE_WAIT_MS
+#define BOOT_UPDATE_WAIT_MS         10000
+#endif
+
+typedef struct
+{
+	fw_update_error_t result;
+	bool loopback;              // Nothing written
+	bool delta;                 // The frames carried a patch
+	uint32_t slot;
+	uint32_t baud;
+	uint32_t bytes;             // Image (or patch) bytes received
+	uint32_t written;           // Image bytes programmed
+	uint32_t chunks;
+	uint32_t naks;
+	uint32_t total_us;          // READY to the last chunk
+	uint32_t rx_wait_us;        // Blocked waiting for a frame, i.e. link bound
+	uint32_t check_us;          // Frame CRCs
+	uint32_t program_us;
+	uint32_t erase_us;
+	uint32_t verify_us;         // Read back CRC
+} boot_update_stats_t;
+
+bool bootUpdateRequested(void);
+fw_update_error_t bootUpdate(uint32_t wait_ms);
+const boot_update_stats_t *bootUpdateGetStats(void);
+void bootUpdateReport(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // BOOTUPDATE_H_
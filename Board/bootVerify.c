@@ -0,0 +1,369 @@
+/* SPDX-License-Identifier: Unlicense */
+
+// -----------------------------------------------------------------------------
+// IMPLEMENTATION NOTES
+//
+// SHA-256 of the boot image, computed in the background while the bootloader
+// brings up the rest of the board. The HASH peripheral is fed straight from the
+// memory mapped NOR by GPDMA1 channel 0 (request HASH_IN), so the CPU only
+// chains the 64 KB blocks from the channel interrupt and is otherwise free for
+// PSRAM_Init() and friends. MDMAT stays set while blocks follow, so the HASH
+// only pads and finishes on the last one; the digest is collected from the
+// HASH interrupt, which also timestamps the end of the work.
+//
+// The data is hashed as bytes (DATATYPE 8-bit), so the last partial word is
+// read whole by the DMA and NBLW tells the HASH how many of its bits count.
+//
+// bootVerifyWait() falls back to Common/sha256.c when the hardware is not
+// usable: a DMA error, a source the DMA cannot reach (TCMs, unaligned), or no
+// digest within a generous timeout. The software path runs with both caches
+// on and is an order of magnitude slower, but gives the same answer.
+//
+// bootVerifySelfTest() checks both engines against the known answers printed
+// by Tools/imagepack.py vectors, including blocks shorter than a SHA-256 block
+// so that the DMA chaining is exercised without a multi-MB buffer.
+//
+// -----------------------------------------------------------------------------
+
+#include "bootVerify.h"
+#include "stm32.h"
+#include "timebase.h"
+
+#define VERIFY_DMA              GPDMA1_Channel0
+#define VERIFY_DMA_IRQn         GPDMA1_Channel0_IRQn
+#define VERIFY_DMA_BLOCK        0xFFFCUL        // BNDT limit, whole words
+#define VERIFY_DMA_ERRORS       (DMA_CSR_DTEF | DMA_CSR_ULEF | DMA_CSR_USEF)
+#define VERIFY_DMA_FLAGS        (DMA_CFCR_TCF | DMA_CFCR_HTF | DMA_CFCR_DTEF | DMA_CFCR_ULEF | \
+                                 DMA_CFCR_USEF | DMA_CFCR_SUSPF | DMA_CFCR_TOF)
+#define VERIFY_ALGO_SHA256      (HASH_CR_ALGO_0 | HASH_CR_ALGO_1)
+#define VERIFY_DATATYPE_8       HASH_CR_DATATYPE_1
+#define VERIFY_TIMEOUT_US(n)    (10000UL + ((n) / 16U))     // Hardware slower than 16 MB/s has failed
+
+#define KAT_BLOCK_SHORT         20              // DMA block for the self-test, not a divisor of 64
+#define KAT_PATTERN(i)          ((uint8_t)((i) * 167U + 13U))
+
+typedef struct
+{
+	uint32_t size;
+	uint8_t digest[SHA256_DIGEST_SIZE];
+} verify_vector_t;
+
+// Generated by Tools/imagepack.py vectors
+static const verify_vector_t vectors[] =
+{
+	{0, {0xE3, 0xB0, 0xC4, 0x42, 0x98, 0xFC, 0x1C, 0x14, 0x9A, 0xFB, 0xF4, 0xC8, 0x99, 0x6F, 0xB9, 0x24, 0x27, 0xAE, 0x41, 0xE4, 0x64, 0x9B, 0x93, 0x4C, 0xA4, 0x95, 0x99, 0x1B, 0x78, 0x52, 0xB8, 0x55}},
+	{1, {0x9D, 0x1E, 0x0E, 0x2D, 0x94, 0x59, 0xD0, 0x65, 0x23, 0xAD, 0x13, 0xE2, 0x8A, 0x40, 0x93, 0xC2, 0x31, 0x6B, 0xAA, 0xFE, 0x7A, 0xEC, 0x5B, 0x25, 0xF3, 0x0E, 0xBA, 0x2E, 0x11, 0x35, 0x99, 0xC4}},
+	{3, {0x13, 0xC4, 0x25, 0xA7, 0x46, 0xAC, 0x9E, 0x72, 0xBE, 0x47, 0x60, 0xDD, 0x13, 0xB1, 0x56, 0x26, 0x0D, 0x7A, 0xD6, 0xEA, 0x6B, 0x87, 0x50, 0xFB, 0xF1, 0xC7, 0xB0, 0xD5, 0xA4, 0x84, 0xB8, 0x52}},
+	{4, {0x3C, 0xA5, 0x0C, 0x11, 0x60, 0x95, 0x95, 0xB6, 0x46, 0x93, 0xBE, 0x32, 0xE5, 0x8B, 0x46, 0xEB, 0x35, 0xC8, 0x1D, 0xBC, 0xE7, 0x7F, 0xEF, 0x61, 0x62, 0xE9, 0xB6, 0x75, 0xE5, 0x4C, 0x76, 0x19}},
+	{55, {0xB2, 0xCA, 0x0A, 0xDC, 0x38, 0x8A, 0x66, 0xD3, 0xA5, 0xA7, 0xF6, 0x54, 0x12, 0x39, 0x33, 0x1D, 0x5A, 0x86, 0x7E, 0xED, 0xE5, 0x54, 0xE1, 0x12, 0x62, 0x24, 0x12, 0x71, 0xFA, 0xAF, 0x36, 0xC5}},
+	{56, {0x37, 0x68, 0xEF, 0xF4, 0x4F, 0x1D, 0xF0, 0x27, 0x04, 0xA8, 0x32, 0xCF, 0x70, 0x89, 0x35, 0xFB, 0xED, 0x9B, 0xB7, 0x4D, 0x07, 0x14, 0xFB, 0xE7, 0x54, 0x54, 0xC2, 0x66, 0xC4, 0xE1, 0x28, 0x56}},
+	{63, {0xDC, 0x06, 0xEA, 0x9E, 0x45, 0x6D, 0xA9, 0xF9, 0xFC, 0x22, 0x76, 0x56, 0x40, 0x18, 0x23, 0x1C, 0x36, 0x19, 0x6F, 0xF7, 0x74, 0x5B, 0xF5, 0x05, 0xFD, 0x7F, 0x50, 0x3A, 0xEC, 0x5C, 0x67, 0xFD}},
+	{64, {0xB6, 0x8F, 0xE5, 0x43, 0xB0, 0xB5, 0xA5, 0x44, 0xE3, 0x2E, 0xB0, 0x87, 0x12, 0xE6, 0x97, 0xBF, 0xCD, 0x3A, 0x3C, 0xB4, 0x91, 0x56, 0x3C, 0x3B, 0x1C, 0xBA, 0x11, 0x2D, 0x37, 0x8F, 0x4B, 0xDB}},
+	{65, {0x58, 0x7C, 0xDB, 0x9A, 0xD9, 0xBE, 0x37, 0x17, 0x21, 0xF2, 0xF8, 0x4A, 0x84, 0xEB, 0x09, 0xF2, 0xB6, 0x98, 0xEC, 0x19, 0xBB, 0xE2, 0xD7, 0xC2, 0x22, 0x17, 0x99, 0x96, 0x54, 0x7A, 0x04, 0xA6}},
+	{119, {0xB2, 0x7B, 0x61, 0x03, 0x7B, 0xE6, 0x84, 0x92, 0x4F, 0x54, 0x97, 0xEE, 0x79, 0xC7, 0x84, 0xF0, 0x9C, 0x97, 0x1D, 0x8C, 0x8C, 0x31, 0x36, 0xF6, 0x27, 0x0E, 0x0F, 0xD3, 0x47, 0x75, 0xAA, 0x1B}},
+	{120, {0x00, 0xC6, 0x66, 0xE9, 0x60, 0x13, 0x29, 0x85, 0xE9, 0xC9, 0x9D, 0xC9, 0x8B, 0xF2, 0x57, 0x82, 0xDF, 0x79, 0x11, 0x38, 0xD0, 0xF1, 0x25, 0x2B, 0x69, 0x78, 0x16, 0x94, 0xED, 0x97, 0xD6, 0x93}},
+	{1000, {0xFA, 0x10, 0xD4, 0xE7, 0x6A, 0xB2, 0x4B, 0x0F, 0xF9, 0xD6, 0xC5, 0x96, 0xA0, 0x0D, 0xF1, 0x78, 0xCD, 0x2A, 0x80, 0xA1, 0x5C, 0x70, 0x77, 0x0D, 0xEE, 0x68, 0xD3, 0x74, 0xCC, 0xB3, 0x9B, 0xC6}},
+};
+
+static struct
+{
+	volatile verify_result_t result;
+	volatile bool hw_failed;
+	const uint8_t *data;
+	uint32_t size;
+	uint32_t offset;            // Bytes the DMA is done with
+	uint32_t block;             // Bytes in flight
+	uint32_t max_block;
+	uint32_t t0;
+	uint8_t expected[SHA256_DIGEST_SIZE];
+} job;
+
+static verify_stats_t stats;
+static uint8_t kat_buffer[1024 + 4] __attribute__((aligned(32)));
+
+// -----------------------------------------------------------------------------
+// Description: Checks whether GPDMA1 can feed the HASH from a buffer
+//     Returns: true for word aligned data outside the TCMs
+//      Inputs: Data
+// -----------------------------------------------------------------------------
+static bool verifyDmaReachable(const void *data)
+{
+	uint32_t addr = (uint32_t)data;
+
+	if(addr & 3)
+	{
+		return false;
+	}
+	return ((addr >= FLASH_BASE) && (addr < 0x20000000UL)) || (addr >= 0x24000000UL);
+}
+
+static void verifyFinish(const uint8_t digest[SHA256_DIGEST_SIZE])
+{
+	stats.hash_us = ticksElapsed(job.t0);
+	job.result = (memcmp(digest, job.expected, SHA256_DIGEST_SIZE) == 0) ? VERIFY_OK : VERIFY_MISMATCH;
+}
+
+static void verifyHwStop(void)
+{
+	NVIC_DisableIRQ(VERIFY_DMA_IRQn);
+	NVIC_DisableIRQ(HASH_IRQn);
+	VERIFY_DMA->CCR = DMA_CCR_RESET;
+	VERIFY_DMA->CFCR = VERIFY_DMA_FLAGS;
+	HASH->IMR = 0;
+	HASH->CR = 0;
+}
+
+// -----------------------------------------------------------------------------
+// Description: Hands the next block of the image to the DMA
+//     Returns: none
+//      Inputs: none
+// -----------------------------------------------------------------------------
+static void verifyDmaNext(void)
+{
+	DMA_Channel_TypeDef *ch = VERIFY_DMA;
+	uint32_t block = MIN(job.size - job.offset, job.max_block);
+
+	// Without MDMAT the end of this transfer pads the message and starts the digest
+	if((job.offset + block) < job.size)
+	{
+		HASH->CR |= HASH_CR_MDMAT | HASH_CR_DMAE;
+	}
+	else
+	{
+		HASH->CR = (HASH->CR & ~HASH_CR_MDMAT) | HASH_CR_DMAE;
+	}
+
+	job.block = block;
+	ch->CFCR = VERIFY_DMA_FLAGS;
+	ch->CTR1 = (2UL << DMA_CTR1_SDW_LOG2_Pos) | DMA_CTR1_SINC | (2UL << DMA_CTR1_DDW_LOG2_Pos);
+	ch->CTR2 = (GPDMA1_REQUEST_HASH_IN << DMA_CTR2_REQSEL_Pos) | DMA_CTR2_DREQ;
+	ch->CBR1 = (block + 3) & ~3UL;
+	ch->CSAR = (uint32_t)job.data + job.offset;
+	ch->CDAR = (uint32_t)&HASH->DIN;
+	ch->CLLR = 0;
+	ch->CCR = DMA_CCR_EN | DMA_CCR_TCIE | DMA_CCR_DTEIE | DMA_CCR_ULEIE | DMA_CCR_USEIE;
+}
+
+static void verifyHwStart(void)
+{
+	RCC->AHB3ENR |= RCC_AHB3ENR_HASHEN;
+	RCC->AHB1ENR |= RCC_AHB1ENR_GPDMA1EN;
+	(void)RCC->AHB1ENR;
+
+	VERIFY_DMA->CCR = DMA_CCR_RESET;
+	HASH->CR = VERIFY_ALGO_SHA256 | VERIFY_DATATYPE_8 | HASH_CR_INIT;
+	HASH->STR = (job.size & 3) * 8;             // NBLW: valid bits of the last word
+	HASH->SR = 0;
+	HASH->IMR = HASH_IMR_DCIE;
+	NVIC_ClearPendingIRQ(HASH_IRQn);
+	NVIC_EnableIRQ(HASH_IRQn);
+
+	if(job.size == 0)
+	{
+		HASH->STR |= HASH_STR_DCAL;
+		return;
+	}
+	NVIC_ClearPendingIRQ(VERIFY_DMA_IRQn);
+	NVIC_EnableIRQ(VERIFY_DMA_IRQn);
+	verifyDmaNext();
+}
+
+void GPDMA1_Channel0_IRQHandler(void)
+{
+	uint32_t csr = VERIFY_DMA->CSR;
+
+	VERIFY_DMA->CFCR = VERIFY_DMA_FLAGS;
+	if(csr & VERIFY_DMA_ERRORS)
+	{
+		verifyHwStop();
+		job.hw_failed = true;
+	}
+	else if(csr & DMA_CSR_TCF)
+	{
+		job.offset += job.block;
+		if(job.offset < job.size)
+		{
+			verifyDmaNext();
+		}
+	}
+}
+
+void HASH_IRQHandler(void)
+{
+	uint8_t digest[SHA256_DIGEST_SIZE];
+
+	if(!(HASH->SR & HASH_SR_DCIS))
+	{
+		return;
+	}
+	for(uint32_t i = 0; i < 8; i++)
+	{
+		uint32_t w = HASH_DIGEST->HR[i];
+
+		digest[4 * i] = (uint8_t)(w >> 24);
+		digest[4 * i + 1] = (uint8_t)(w >> 16);
+		digest[4 * i + 2] = (uint8_t)(w >> 8);
+		digest[4 * i + 3] = (uint8_t)w;
+	}
+	verifyHwStop();
+	verifyFinish(digest);
+}
+
+// -----------------------------------------------------------------------------
+// Description: Hashes the job with the CPU, caches on for the duration
+//     Returns: none
+//      Inputs: none
+// -----------------------------------------------------------------------------
+static void verifySoftware(void)
+{
+	uint8_t digest[SHA256_DIGEST_SIZE];
+	bool icache = (SCB->CCR & SCB_CCR_IC_Msk) != 0;
+	bool dcache = (SCB->CCR & SCB_CCR_DC_Msk) != 0;
+
+	stats.engine = VERIFY_ENGINE_SW;
+	SCB_EnableICache();
+	SCB_EnableDCache();
+	sha256(job.data, job.size, digest);
+	if(!dcache)
+	{
+		SCB_DisableDCache();
+	}
+	if(!icache)
+	{
+		SCB_DisableICache();
+	}
+	verifyFinish(digest);
+}
+
+static void verifyStart(const void *data, uint32_t size, const uint8_t digest[SHA256_DIGEST_SIZE], uint32_t max_block, bool hw)
+{
+	memset(&stats, 0, sizeof(stats));
+	job.data = data;
+	job.size = size;
+	job.offset = 0;
+	job.block = 0;
+	job.max_block = max_block;
+	job.hw_failed = false;
+	job.result = VERIFY_BUSY;
+	memcpy(job.expected, digest, SHA256_DIGEST_SIZE);
+	stats.bytes = size;
+	stats.engine = VERIFY_ENGINE_SW;
+	job.t0 = ticks();
+
+	if(hw && verifyDmaReachable(data))
+	{
+		if(SCB->CCR & SCB_CCR_DC_Msk)
+		{
+			SCB_CleanDCache_by_Addr((void *)data, (int32_t)size);
+		}
+		stats.engine = VERIFY_ENGINE_HASH;
+		verifyHwStart();
+	}
+}
+
+// -----------------------------------------------------------------------------
+// Description: Starts hashing a buffer in the background, see bootVerifyWait()
+//     Returns: none
+//      Inputs: Data, size, expected SHA-256
+// -----------------------------------------------------------------------------
+void bootVerifyStart(const void *data, uint32_t size, const uint8_t digest[SHA256_DIGEST_SIZE])
+{
+	verifyStart(data, size, digest, VERIFY_DMA_BLOCK, BOOT_VERIFY_HW);
+}
+
+// -----------------------------------------------------------------------------
+// Description: Waits for the hash started by bootVerifyStart(), finishing it in
+//              software if the hardware could not
+//     Returns: VERIFY_IDLE if nothing was started, VERIFY_OK or VERIFY_MISMATCH
+//      Inputs: none
+// -----------------------------------------------------------------------------
+verify_result_t bootVerifyWait(void)
+{
+	uint32_t t0 = ticks();
+
+	if(job.result != VERIFY_BUSY)
+	{
+		return job.result;
+	}
+
+	if(stats.engine == VERIFY_ENGINE_HASH)
+	{
+		while((job.result == VERIFY_BUSY) && !job.hw_failed)
+		{
+			if(ticksElapsed(t0) > VERIFY_TIMEOUT_US(job.size))
+			{
+				verifyHwStop();
+				job.hw_failed = true;
+			}
+		}
+		if(job.hw_failed)
+		{
+			stats.dma_errors++;
+		}
+	}
+	if(job.result == VERIFY_BUSY)
+	{
+		verifySoftware();
+	}
+	stats.wait_us = ticksElapsed(t0);
+	return job.result;
+}
+
+const verify_stats_t *bootVerifyGetStats(void)
+{
+	return &stats;
+}
+
+// -----------------------------------------------------------------------------
+// Description: Prints the last verification as CSV
+//     Returns: none
+//      Inputs: none
+// -----------------------------------------------------------------------------
+void bootVerifyReport(void)
+{
+	static const char *const result_names[] = {"none", "busy", "ok", "mismatch"};
+	uint32_t kbps = (stats.hash_us != 0) ? (uint32_t)(((uint64_t)stats.bytes * 1000U) / stats.hash_us) : 0;
+
+	printf("verify,engine,bytes,hash_us,wait_us,kBps,dma_errors,result" EOL);
+	printf("verify,%s,%lu,%lu,%lu,%lu,%lu,%s" EOL, (stats.engine == VERIFY_ENGINE_HASH) ? "hash" : "sw",
+	       stats.bytes, stats.hash_us, stats.wait_us, kbps, stats.dma_errors, result_names[job.result]);
+}
+
+// -----------------------------------------------------------------------------
+// Description: Runs the known answer vectors through both engines
+//     Returns: true if every vector matches
+//      Inputs: none
+// -----------------------------------------------------------------------------
+bool bootVerifySelfTest(void)
+{
+	static const uint32_t blocks[] = {VERIFY_DMA_BLOCK, KAT_BLOCK_SHORT};
+	uint32_t failed_hw = 0, failed_sw = 0;
+
+	for(uint32_t i = 0; i < sizeof(kat_buffer); i++)
+	{
+		kat_buffer[i] = KAT_PATTERN(i);
+	}
+
+	for(uint32_t v = 0; v < ARRAY_SIZE(vectors); v++)
+	{
+		for(uint32_t b = 0; b < ARRAY_SIZE(blocks); b++)
+		{
+			verifyStart(kat_buffer, vectors[v].size, vectors[v].digest, blocks[b], true);
+			if((bootVerifyWait() != VERIFY_OK) || (stats.engine != VERIFY_ENGINE_HASH))
+			{
+				failed_hw++;
+			}
+		}
+		verifyStart(kat_buffer, vectors[v].size, vectors[v].digest, VERIFY_DMA_BLOCK, false);
+		if(bootVerifyWait() != VERIFY_OK)
+		{
+			failed_sw++;
+		}
+	}
+	job.result = VERIFY_IDLE;
+
+	printf("verify_kat,engine,vectors,failed" EOL);
+	printf("verify_kat,hash,%lu,%lu" EOL, (uint32_t)(ARRAY_SIZE(vectors) * ARRAY_SIZE(blocks)), failed_hw);
+	printf("verify_kat,sw,%lu,%lu" EOL, (uint32_t)ARRAY_SIZE(vectors), failed_sw);
+	return (failed_hw == 0) && (failed_sw == 0);
+}
@@ -0,0 +1,51 @@
+/* SPDX-License-Identifier: Unlicense */
+
+#ifndef BOOTVERIFY_H_
+#define BOOTVERIFY_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "common.h"
+#include "sha256.h"
+
+// Set to 0 to hash in software only
+#ifndef BOOT_VERIFY_HW
+#define BOOT_VERIFY_HW              1
+#endif
+
+typedef enum
+{
+	VERIFY_IDLE,                // Nothing started
+	VERIFY_BUSY,
+	VERIFY_OK,                  // Digest matches
+	VERIFY_MISMATCH,
+} verify_result_t;
+
+typedef enum
+{
+	VERIFY_ENGINE_HASH,         // HASH peripheral fed by GPDMA1
+	VERIFY_ENGINE_SW,           // Common/sha256.c
+} verify_engine_t;
+
+typedef struct
+{
+	verify_engine_t engine;
+	uint32_t bytes;
+	uint32_t hash_us;           // Start to digest
+	uint32_t wait_us;           // Part of it spent blocked in bootVerifyWait()
+	uint32_t dma_errors;        // Hardware attempts that fell back to software
+} verify_stats_t;
+
+void bootVerifyStart(const void *data, uint32_t size, const uint8_t digest[SHA256_DIGEST_SIZE]);
+verify_result_t bootVerifyWait(void);
+const verify_stats_t *bootVerifyGetStats(void);
+void bootVerifyReport(void);
+bool bootVerifySelfTest(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // BOOTVERIFY_H_
@@ -0,0 +1,412 @@
+/* SPDX-License-Identifier: Unlicense */
+
+// -----------------------------------------------------------------------------
+// IMPLEMENTATION NOTES
+//
+// Integrity tests run with the D-cache off so every access reaches the memory:
+//  - data bus: walking ones on a single word
+//  - address bus: a marker at every power-of-two word offset, checked for
+//    aliasing after each offset is overwritten in turn (stuck/shorted lines)
+//  - March C- over the test window, repeated for the log2(32) + 1 data
+//    backgrounds needed to also catch intra-word coupling faults
+//
+// Bandwidth runs sequential, strided (one word per cache line) and random
+// (fixed-seed LCG) 32-bit reads and writes, uncached (D-cache off) and cached.
+// Cached runs start from a clean, invalidated D-cache and the timed write
+// includes cleaning the window, so they measure line fill and write back
+// traffic rather than hits. Rates count the bytes the CPU moved.
+//
+// The windows avoid everything the boot stage uses: the AXI SRAM window is a
+// static buffer, the DTCM window sits between the sbrk heap and the stack, and
+// the PSRAM and SRAMAHB are otherwise unused before the application starts.
+// All tests are destructive within their window.
+//
+// The report is CSV over UART4, one record per line, keyed by the first field:
+//  memreport,<format version>,<cpu_hz>,<xspi1_hz>
+//  memtest,<region>,<base>,<size>,<test>,<pass|fail|skip>,<addr>,<expected>,<actual>
+//  membw,<region>,<cached|uncached>,<pattern>,<read_kBps>,<write_kBps>
+//  memsummary,<failures>
+//
+// -----------------------------------------------------------------------------
+
+#include "memTest.h"
+#include "cycles.h"
+#include "psram.h"
+#include "stm32.h"
+
+#define MEMTEST_REPORT_VERSION  1
+#define CACHE_LINE_SIZE         32
+#define MEMTEST_RANDOM_ACCESSES 4096
+#define MEMTEST_SEED            0x12345678UL
+#define MEMTEST_STACK_MARGIN    4096
+#define MEMTEST_HEAP_MARGIN     1024
+
+#define SRAMAHB_BASE            0x30000000UL
+#define SRAMAHB_SIZE            0x00008000UL
+
+typedef struct
+{
+	bool up;                    // Ascending address order
+	bool read;                  // Read and check before writing
+	bool read_inv;              // Expect the inverted background
+	bool write;
+	bool write_inv;             // Write the inverted background
+} march_element_t;
+
+// March C-: {(w0); up(r0,w1); up(r1,w0); down(r0,w1); down(r1,w0); (r0)}
+static const march_element_t march_c[] =
+{
+	{true,  false, false, true,  false},
+	{true,  true,  false, true,  true },
+	{true,  true,  true,  true,  false},
+	{false, true,  false, true,  true },
+	{false, true,  true,  true,  false},
+	{true,  true,  false, false, false},
+};
+
+static const uint32_t march_backgrounds[] = {0x00000000, 0x55555555, 0x33333333, 0x0F0F0F0F, 0x00FF00FF, 0x0000FFFF};
+
+static const char *const pattern_names[MEMTEST_PATTERNS] = {"sequential", "strided", "random"};
+
+static uint8_t axi_window[RAM_TEST_SIZE] __ALIGNED(CACHE_LINE_SIZE);
+
+extern void *_sbrk(ptrdiff_t incr);
+
+// -----------------------------------------------------------------------------
+// Description: Converts a byte count and cycle count into kB/s
+//     Returns: See above
+//      Inputs: Bytes transferred, elapsed cycles
+// -----------------------------------------------------------------------------
+static uint32_t kbps(uint32_t bytes, uint32_t elapsed)
+{
+	return (uint32_t)(((uint64_t)bytes * (SystemCoreClock / 1000)) / MAX(elapsed, 1));
+}
+
+// -----------------------------------------------------------------------------
+// Description: Turns the D-cache off for an integrity test or uncached run
+//     Returns: Whether the D-cache was on, to be handed to dcacheRestore()
+//      Inputs: Whether the D-cache should be on
+// -----------------------------------------------------------------------------
+static bool dcacheSet(bool on)
+{
+	bool was_on = (SCB->CCR & SCB_CCR_DC_Msk) != 0;
+
+	if(on && !was_on)
+	{
+		SCB_EnableDCache();
+	}
+	else if(!on && was_on)
+	{
+		SCB_DisableDCache();
+	}
+	return was_on;
+}
+
+static void dcacheRestore(bool was_on)
+{
+	(void)dcacheSet(was_on);
+}
+
+static uint32_t fail(memtest_fail_t *f, uint32_t addr, uint32_t expected, uint32_t actual)
+{
+	if(f)
+	{
+		f->addr = addr;
+		f->expected = expected;
+		f->actual = actual;
+	}
+	return HAL_ERROR;
+}
+
+// -----------------------------------------------------------------------------
+// Description: Walks a one through every bit of a single word
+//     Returns: HAL_OK or HAL_ERROR
+//      Inputs: Word address, failure details storage (may be NULL)
+// -----------------------------------------------------------------------------
+uint32_t memTestDataBus(uint32_t addr, memtest_fail_t *f)
+{
+	volatile uint32_t *p = (volatile uint32_t *)addr;
+	bool dcache_was_on = dcacheSet(false);
+	uint32_t status = HAL_OK;
+
+	for(uint32_t bit = 1; bit != 0; bit <<= 1)
+	{
+		*p = bit;
+		if(*p != bit)
+		{
+			status = fail(f, addr, bit, *p);
+			break;
+		}
+	}
+
+	dcacheRestore(dcache_was_on);
+	return status;
+}
+
+// -----------------------------------------------------------------------------
+// Description: Checks the address lines spanned by a window for stuck and
+//              shorted bits
+//     Returns: HAL_OK or HAL_ERROR
+//      Inputs: Window base address, window size, failure details storage (may be NULL)
+// -----------------------------------------------------------------------------
+uint32_t memTestAddrBus(uint32_t base, uint32_t size, memtest_fail_t *f)
+{
+	volatile uint32_t *p = (volatile uint32_t *)base;
+	const uint32_t pattern = 0xAAAAAAAA;
+	const uint32_t antipattern = 0x55555555;
+	uint32_t words = size / sizeof(uint32_t);
+	bool dcache_was_on = dcacheSet(false);
+	uint32_t status = HAL_OK;
+
+	for(uint32_t offset = 1; offset < words; offset <<= 1)
+	{
+		p[offset] = pattern;
+	}
+
+	// Stuck high: writing word 0 must not show up at any power-of-two offset
+	p[0] = antipattern;
+	for(uint32_t offset = 1; (offset < words) && (status == HAL_OK); offset <<= 1)
+	{
+		if(p[offset] != pattern)
+		{
+			status = fail(f, base + (offset * sizeof(uint32_t)), pattern, p[offset]);
+		}
+	}
+	p[0] = pattern;
+
+	// Stuck low and shorted: each offset in turn must only change itself
+	for(uint32_t test = 1; (test < words) && (status == HAL_OK); test <<= 1)
+	{
+		p[test] = antipattern;
+		if(p[0] != pattern)
+		{
+			status = fail(f, base, pattern, p[0]);
+		}
+		for(uint32_t offset = 1; (offset < words) && (status == HAL_OK); offset <<= 1)
+		{
+			if((offset != test) && (p[offset] != pattern))
+			{
+				status = fail(f, base + (offset * sizeof(uint32_t)), pattern, p[offset]);
+			}
+		}
+		p[test] = pattern;
+	}
+
+	dcacheRestore(dcache_was_on);
+	return status;
+}
+
+// -----------------------------------------------------------------------------
+// Description: Runs March C- over a window for each data background
+//     Returns: HAL_OK or HAL_ERROR
+//      Inputs: Window base address, window size, failure details storage (may be NULL)
+// -----------------------------------------------------------------------------
+uint32_t memTestMarch(uint32_t base, uint32_t size, memtest_fail_t *f)
+{
+	volatile uint32_t *p = (volatile uint32_t *)base;
+	uint32_t words = size / sizeof(uint32_t);
+	bool dcache_was_on = dcacheSet(false);
+	uint32_t status = HAL_OK;
+
+	for(uint32_t b = 0; (b < ARRAY_SIZE(march_backgrounds)) && (status == HAL_OK); b++)
+	{
+		for(uint32_t e = 0; (e < ARRAY_SIZE(march_c)) && (status == HAL_OK); e++)
+		{
+			const march_element_t *m = &march_c[e];
+			uint32_t expect = m->read_inv ? ~march_backgrounds[b] : march_backgrounds[b];
+			uint32_t value = m->write_inv ? ~march_backgrounds[b] : march_backgrounds[b];
+
+			for(uint32_t n = 0; n < words; n++)
+			{
+				uint32_t i = m->up ? n : (words - 1 - n);
+
+				if(m->read && (p[i] != expect))
+				{
+					status = fail(f, base + (i * sizeof(uint32_t)), expect, p[i]);
+					break;
+				}
+				if(m->write)
+				{
+					p[i] = value;
+				}
+			}
+		}
+	}
+
+	dcacheRestore(dcache_was_on);
+	return status;
+}
+
+// -----------------------------------------------------------------------------
+// Description: Times one read and one write pass of a given access pattern
+//     Returns: none
+//      Inputs: Window base address, window size (power of two), pattern,
+//              whether the D-cache is on, result storage
+// -----------------------------------------------------------------------------
+static void bandwidthRun(uint32_t base, uint32_t size, memtest_pattern_t pattern, bool cached, memtest_bw_t *result)
+{
+	volatile uint32_t *p = (volatile uint32_t *)base;
+	uint32_t words = size / sizeof(uint32_t);
+	uint32_t step = (pattern == MEMTEST_STRIDED) ? (CACHE_LINE_SIZE / sizeof(uint32_t)) : 1;
+	uint32_t count = (pattern == MEMTEST_RANDOM) ? MEMTEST_RANDOM_ACCESSES : (words / step);
+	uint32_t seed, start, elapsed;
+	uint32_t sink = 0;
+
+	if(cached)
+	{
+		SCB_CleanInvalidateDCache();
+	}
+	seed = MEMTEST_SEED;
+	start = cycles();
+	if(pattern == MEMTEST_RANDOM)
+	{
+		for(uint32_t n = 0; n < count; n++)
+		{
+			seed = (seed * 1664525UL) + 1013904223UL;
+			sink += p[(seed >> 8) & (words - 1)];
+		}
+	}
+	else
+	{
+		for(uint32_t i = 0; i < words; i += step)
+		{
+			sink += p[i];
+		}
+	}
+	__DSB();
+	elapsed = cyclesElapsed(start);
+	(void)sink;
+	result->read_kbps = kbps(count * sizeof(uint32_t), elapsed);
+
+	if(cached)
+	{
+		SCB_CleanInvalidateDCache();
+	}
+	seed = MEMTEST_SEED;
+	start = cycles();
+	if(pattern == MEMTEST_RANDOM)
+	{
+		for(uint32_t n = 0; n < count; n++)
+		{
+			seed = (seed * 1664525UL) + 1013904223UL;
+			p[(seed >> 8) & (words - 1)] = n;
+		}
+	}
+	else
+	{
+		for(uint32_t i = 0; i < words; i += step)
+		{
+			p[i] = i;
+		}
+	}
+	if(cached)
+	{
+		SCB_CleanDCache_by_Addr((void *)base, size);
+	}
+	__DSB();
+	elapsed = cyclesElapsed(start);
+	result->write_kbps = kbps(count * sizeof(uint32_t), elapsed);
+}
+
+// -----------------------------------------------------------------------------
+// Description: Measures read/write bandwidth of a window for every pattern
+//     Returns: none
+//      Inputs: Window base address, window size (rounded down to a power of
+//              two), cached or uncached, result storage (MEMTEST_PATTERNS entries)
+// -----------------------------------------------------------------------------
+void memTestBandwidth(uint32_t base, uint32_t size, bool cached, memtest_bw_t result[MEMTEST_PATTERNS])
+{
+	bool dcache_was_on;
+
+	if(size < CACHE_LINE_SIZE)
+	{
+		memset(result, 0, MEMTEST_PATTERNS * sizeof(memtest_bw_t));
+		return;
+	}
+	size = 1UL << (31 - __builtin_clz(size));
+
+	cyclesInit();
+	dcache_was_on = dcacheSet(cached);
+	for(uint32_t pattern = 0; pattern < MEMTEST_PATTERNS; pattern++)
+	{
+		bandwidthRun(base, size, (memtest_pattern_t)pattern, cached, &result[pattern]);
+	}
+	dcacheRestore(dcache_was_on);
+}
+
+// -----------------------------------------------------------------------------
+// Description: Prints one integrity test record
+//     Returns: 1 on failure, 0 otherwise
+//      Inputs: Region name, window, test name, status, failure details
+// -----------------------------------------------------------------------------
+static uint32_t reportTest(const char *region, uint32_t base, uint32_t size, const char *test, uint32_t status, const memtest_fail_t *f)
+{
+	if(status == HAL_OK)
+	{
+		printf("memtest,%s,0x%08lX,%lu,%s,pass,0,0,0" EOL, region, base, size, test);
+		return 0;
+	}
+	printf("memtest,%s,0x%08lX,%lu,%s,fail,0x%08lX,0x%08lX,0x%08lX" EOL, region, base, size, test, f->addr, f->expected, f->actual);
+	return 1;
+}
+
+// -----------------------------------------------------------------------------
+// Description: Tests and benchmarks one region and prints its records
+//     Returns: # of failed tests
+//      Inputs: Region name, bus test window, march window, bandwidth window size
+// -----------------------------------------------------------------------------
+static uint32_t reportRegion(const char *region, uint32_t base, uint32_t bus_size, uint32_t march_size, uint32_t bw_size)
+{
+	memtest_fail_t f;
+	memtest_bw_t bw[MEMTEST_PATTERNS];
+	uint32_t failures = 0;
+
+	if(bus_size < CACHE_LINE_SIZE)
+	{
+		printf("memtest,%s,0x%08lX,%lu,all,skip,0,0,0" EOL, region, base, bus_size);
+		return 0;
+	}
+
+	failures += reportTest(region, base, sizeof(uint32_t), "data_bus", memTestDataBus(base, &f), &f);
+	failures += reportTest(region, base, bus_size, "addr_bus", memTestAddrBus(base, bus_size, &f), &f);
+	failures += reportTest(region, base, march_size, "march_c-", memTestMarch(base, march_size, &f), &f);
+
+	for(uint32_t cached = 0; cached < 2; cached++)
+	{
+		memTestBandwidth(base, bw_size, cached, bw);
+		for(uint32_t pattern = 0; pattern < MEMTEST_PATTERNS; pattern++)
+		{
+			printf("membw,%s,%s,%s,%lu,%lu" EOL, region, cached ? "cached" : "uncached", pattern_names[pattern],
+			       bw[pattern].read_kbps, bw[pattern].write_kbps);
+		}
+	}
+	return failures;
+}
+
+// -----------------------------------------------------------------------------
+// Description: Runs the integrity tests and bandwidth benchmarks on the PSRAM,
+//              AXI SRAM, DTCM and SRAMAHB and prints the report
+//     Returns: # of failed tests
+//      Inputs: none
+// -----------------------------------------------------------------------------
+uint32_t memTestReport(void)
+{
+	uint32_t dtcm_start = ((uint32_t)_sbrk(0) + MEMTEST_HEAP_MARGIN + CACHE_LINE_SIZE - 1) & ~(CACHE_LINE_SIZE - 1);
+	uint32_t dtcm_end = (__get_MSP() - MEMTEST_STACK_MARGIN) & ~(CACHE_LINE_SIZE - 1);
+	uint32_t dtcm_size = (dtcm_end > dtcm_start) ? MIN(dtcm_end - dtcm_start, RAM_TEST_SIZE) : 0;
+	uint32_t failures = 0;
+
+	__HAL_RCC_SRAM1_CLK_ENABLE();
+	__HAL_RCC_SRAM2_CLK_ENABLE();
+
+	printf("memreport,%u,%lu,%lu" EOL, MEMTEST_REPORT_VERSION, SystemCoreClock,
+	       HAL_RCCEx_GetPeriphCLKFreq(RCC_PERIPHCLK_XSPI1));
+
+	failures += reportRegion("psram", PSRAM_BASE_ADDRESS, PSRAM_SIZE, MEMTEST_PSRAM_MARCH_SIZE, MEMTEST_PSRAM_BW_SIZE);
+	failures += reportRegion("axi", (uint32_t)axi_window, sizeof(axi_window), sizeof(axi_window), sizeof(axi_window));
+	failures += reportRegion("dtcm", dtcm_start, dtcm_size, dtcm_size, dtcm_size);
+	failures += reportRegion("sramahb", SRAMAHB_BASE, SRAMAHB_SIZE, SRAMAHB_SIZE, SRAMAHB_SIZE);
+
+	printf("memsummary,%lu" EOL, failures);
+	return failures;
+}
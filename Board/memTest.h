@@ -0,0 +1,58 @@
+/* SPDX-License-Identifier: Unlicense */
+
+#ifndef MEMTEST_H_
+#define MEMTEST_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "common.h"
+
+// Size of the test window in each internal RAM
+#ifndef RAM_TEST_SIZE
+#define RAM_TEST_SIZE 16384
+#endif
+
+// Size of the PSRAM window the march test runs on (the bus tests cover the whole device)
+#ifndef MEMTEST_PSRAM_MARCH_SIZE
+#define MEMTEST_PSRAM_MARCH_SIZE (256 * 1024)
+#endif
+
+// Size of the PSRAM window the bandwidth runs use
+#ifndef MEMTEST_PSRAM_BW_SIZE
+#define MEMTEST_PSRAM_BW_SIZE (64 * 1024)
+#endif
+
+typedef enum
+{
+	MEMTEST_SEQUENTIAL,
+	MEMTEST_STRIDED,            // One word per cache line
+	MEMTEST_RANDOM,
+	MEMTEST_PATTERNS
+} memtest_pattern_t;
+
+typedef struct
+{
+	uint32_t addr;
+	uint32_t expected;
+	uint32_t actual;
+} memtest_fail_t;
+
+typedef struct
+{
+	uint32_t read_kbps;
+	uint32_t write_kbps;
+} memtest_bw_t;
+
+uint32_t memTestDataBus(uint32_t addr, memtest_fail_t *fail);
+uint32_t memTestAddrBus(uint32_t base, uint32_t size, memtest_fail_t *fail);
+uint32_t memTestMarch(uint32_t base, uint32_t size, memtest_fail_t *fail);
+void memTestBandwidth(uint32_t base, uint32_t size, bool cached, memtest_bw_t result[MEMTEST_PATTERNS]);
+uint32_t memTestReport(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // MEMTEST_H_
@@ -0,0 +1,100 @@
+/* SPDX-License-Identifier: Unlicense */
+#include "nor.h"
+#include "common.h"
+#include "stm32.h"
+#include "memKernels.h"
+#include "stm32_extmem_conf.h"
+#include "sal/stm32_sal_xspi_api.h"
+
+/* Macronix octal flash (MX66UW1G45G) */
+#define MACRONIX_MANUFACTURER_ID                0xC2
+
+/* Set Burst Length, selects the wrap size used by the regular read command */
+#define SBL_CMD                                 0xC0
+#define SBL_WRAP_32                             0x01
+#define SBL_WRAP_DISABLE                        0x10
+
+static nor_burst_t burst_mode = NOR_BURST_LINEAR;
+
+/**
+* @brief  Select linear or wrapped bursts for the NOR memory mapped window
+* @note   Memory mapped mode is left for the duration of the switch, so this
+*         must run from internal memory (the bootloader, or ITCM/RAM code).
+* @param  mode Burst mode
+* @retval error status
+*/
+uint32_t NOR_SetBurstMode(nor_burst_t mode)
+{
+  EXTMEM_DRIVER_NOR_SFDP_ObjectTypeDef *nor = &extmem_list_config[EXT_MEMORY_NOR_FLASH].NorSfdpObject;
+  SAL_XSPI_ObjectTypeDef *sal = &nor->sfpd_private.SALObject;
+  bool wrap = (mode == NOR_BURST_WRAP_32);
+  /* DTR transfers are an even number of bytes */
+  uint8_t sbl[2];
+
+  /* The burst length command is vendor specific */
+  if (nor->sfpd_private.ManuID != MACRONIX_MANUFACTURER_ID)
+  {
+    return HAL_ERROR;
+  }
+
+  if (EXTMEM_MemoryMappedMode(EXT_MEMORY_NOR_FLASH, EXTMEM_DISABLE) != EXTMEM_OK)
+  {
+    return HAL_ERROR;
+  }
+
+  sbl[0] = sbl[1] = wrap ? SBL_WRAP_32 : SBL_WRAP_DISABLE;
+  if (SAL_XSPI_Write(sal, SBL_CMD, 0, sbl, sizeof(sbl)) != HAL_OK)
+  {
+    return HAL_ERROR;
+  }
+
+  /* The flash has no separate wrap command: with SBL set every read wraps at 32 bytes,
+     so linear reads are kept correct by releasing chip select on each 32-byte boundary */
+  hxspi2.Init.WrapSize = wrap ? HAL_XSPI_WRAP_32_BYTES : HAL_XSPI_WRAP_NOT_SUPPORTED;
+  hxspi2.Init.ChipSelectBoundary = wrap ? HAL_XSPI_BONDARYOF_256B : HAL_XSPI_BONDARYOF_NONE;
+  MODIFY_REG(hxspi2.Instance->DCR2, XSPI_DCR2_WRAPSIZE, hxspi2.Init.WrapSize);
+  MODIFY_REG(hxspi2.Instance->DCR3, XSPI_DCR3_CSBOUND, (hxspi2.Init.ChipSelectBoundary << XSPI_DCR3_CSBOUND_Pos));
+
+  if (wrap)
+  {
+    /* Once SBL is set the regular read command wraps, so reuse it for refills */
+    if (SAL_XSPI_ConfigureWrappMode(sal, nor->sfpd_private.DriverInfo.ReadInstruction,
+                                    (uint8_t)sal->Commandbase.DummyCycles) != HAL_OK)
+    {
+      return HAL_ERROR;
+    }
+  }
+
+  if (EXTMEM_MemoryMappedMode(EXT_MEMORY_NOR_FLASH, EXTMEM_ENABLE) != EXTMEM_OK)
+  {
+    return HAL_ERROR;
+  }
+
+  burst_mode = mode;
+  return HAL_OK;
+}
+
+/**
+* @brief  Provide the current burst mode
+* @param  None
+* @retval See above
+*/
+nor_burst_t NOR_GetBurstMode(void)
+{
+  return burst_mode;
+}
+
+/**
+* @brief  Copy data into the NOR memory mapped write window (overrides the weak
+*         byte-assembling loop of the SFDP driver)
+* @note   Whole words only, in 32-byte bursts; the size is rounded up to words
+*         like the original.
+* @param  destination_Address Word aligned address in the mapped window
+* @param  ptrData Source data, any alignment
+* @param  DataSize Size in bytes
+* @retval None
+*/
+void EXTMEM_MemCopy(uint32_t* destination_Address, const uint8_t* ptrData, uint32_t DataSize)
+{
+  memCopyToWords(destination_Address, ptrData, DataSize);
+}
@@ -0,0 +1,33 @@
+/* SPDX-License-Identifier: Unlicense */
+
+#ifndef NOR_H_
+#define NOR_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "common.h"
+
+#define NOR_BASE_ADDRESS        0x70000000UL
+
+typedef enum
+{
+	NOR_BURST_LINEAR,           // Continuous reads, no wrapped transactions
+	NOR_BURST_WRAP_32,          // 32-byte wrap for cache line refills (critical word first),
+	                            //  linear reads are split at every 32-byte boundary
+} nor_burst_t;
+
+// Burst mode applied by the boot flow once the NOR is memory mapped
+#ifndef NOR_BURST_MODE_DEFAULT
+#define NOR_BURST_MODE_DEFAULT      NOR_BURST_LINEAR
+#endif
+
+uint32_t NOR_SetBurstMode(nor_burst_t mode);
+nor_burst_t NOR_GetBurstMode(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // NOR_H_
@@ -7,9 +7,11 @@
   
 /* Read Operations */
 #define READ_CMD                                0x00
+#define READ_LINEAR_BURST_CMD                   0x20
   
 /* Write Operations */
 #define WRITE_CMD                               0x80
+#define WRITE_LINEAR_BURST_CMD                  0xA0
   
 /* Registers definition */
 #define MR0                                     0x00000000
@@ -23,11 +25,52 @@
 #define READ_REG_CMD                            0x40
 #define WRITE_REG_CMD                           0xC0
   
-/* Default dummy clocks cycles */
-#define DUMMY_CLOCK_CYCLES_READ                 6
-#define DUMMY_CLOCK_CYCLES_WRITE                6
+/* Dummy clock cycles follow the latency profile */
+#define DUMMY_CLOCK_CYCLES_READ                 (latency.read_code - 1)
+#define DUMMY_CLOCK_CYCLES_WRITE                (latency.write_code - 1)
 
-#define READ_REG_LATENCY												5
+/* Register reads follow the read latency code the memory runs with */
+#define READ_REG_LATENCY                        (mr_read_code - 1)
+#define READ_LATENCY_RESET                      6     /* Before MR0 is written: 5 dummy cycles */
+
+/* MR0 fields */
+#define MR0_DRIVE_MASK                          0x03
+#define MR0_LC_POS                              2     /* Read latency code, 3..7 clocks as 0..4 */
+#define MR0_LT_FIXED                            0x20  /* Fixed latency (always 2x) */
+
+/* MR4 fields */
+#define MR4_WLC_POS                             5     /* Write latency code, bit reversed encoding */
+#define MR4_REFRESH_PASR                        0x00  /* always 4x refresh, full array refresh */
+
+/* MR8 fields, burst length is psram_bl_t */
+#define MR8_RBX                                 0x08  /* Row boundary crossing enabled */
+#define MR8_X16                                 0x40  /* x16 IO mode */
+
+static psram_burst_t burst_mode = PSRAM_BURST_LINEAR;
+
+static psram_latency_t latency =
+{
+  .type       = PSRAM_LATENCY_TYPE_DEFAULT,
+  .read_code  = PSRAM_READ_LATENCY_DEFAULT,
+  .write_code = PSRAM_WRITE_LATENCY_DEFAULT,
+};
+
+/* MR0 read latency code in effect, the reset value until PSRAM_WriteLatency() */
+static uint8_t mr_read_code = READ_LATENCY_RESET;
+
+/* Max clock per latency code (3..7) */
+static const uint32_t latency_max_freq[] = {66000000, 109000000, 133000000, 166000000, 200000000};
+
+/* MR4 write latency encoding per latency code (3..7) */
+static const uint8_t write_latency_code[] = {0x0, 0x4, 0x2, 0x6, 0x1};
+
+static psram_xfer_t xfer =
+{
+  .cs_boundary = PSRAM_XSPI_CS_BOUNDARY,
+  .max_tran    = PSRAM_XSPI_MAX_TRAN,
+  .refresh     = PSRAM_XSPI_REFRESH,
+  .burst_len   = PSRAM_MR8_BURST_LEN,
+};
 
 /**
 * @brief  Write mode register
@@ -117,60 +160,49 @@ uint32_t APS256_ReadReg(XSPI_HandleTypeDef *Ctx, uint32_t Address, uint8_t *Valu
 }
 
 /**
-* @brief  Switch from Octal Mode to Hexa Mode on the memory
-* @param  None
-* @retval None
+* @brief  Write a mode register and read it back
+* @param  Address Register address
+* @param  Value Register value pointer (2 bytes, x16 DTR)
+* @retval error status
 */
-void PSRAM_Init(void)
+static uint32_t PSRAM_WriteRegChecked(uint32_t Address, uint8_t *Value)
 {
- /* MR8 register for read and write */
-  uint8_t regW_MR8[2]={0x4B,0x10}; /* x16, 2k burst, variable latency 7-14 for 200MHz, full drive strength*/
-  uint8_t regR_MR8[2]={0};
- 
-  /* Configure Burst Length */
-  if (APS256_WriteReg(&hxspi1, MR8, regW_MR8) != HAL_OK)
-  {
-    Error_Handler();
-  }
-  
-  /* Check MR8 configuration */
-  if (APS256_ReadReg(&hxspi1, MR8, regR_MR8) != HAL_OK)
-  {
-    Error_Handler();
-  }
-  
-  if (regR_MR8[0] != regW_MR8[0])
-  {
-    Error_Handler() ;
-  }
-
-	/* MR8 register for read and write */
-  uint8_t regW_MR4[2]={0x20,0x4B}; /* 100000000 = latency of 7 for 200MHz, always 4x refresh, full array refresh */
-  uint8_t regR_MR4[2]={0};
+  uint8_t regR[2] = {0};
 
-  if (APS256_WriteReg(&hxspi1, MR4, regW_MR4) != HAL_OK)
+  if (APS256_WriteReg(&hxspi1, Address, Value) != HAL_OK)
   {
-    Error_Handler();
+    return HAL_ERROR;
   }
-  
-  /* Check MR4 configuration */
-  if (APS256_ReadReg(&hxspi1, MR4, regR_MR4) != HAL_OK)
+
+  if (APS256_ReadReg(&hxspi1, Address, regR) != HAL_OK)
   {
-    Error_Handler();
+    return HAL_ERROR;
   }
-  
-  if (regR_MR4[0] != regW_MR4[0])
+
+  if (regR[0] != Value[0])
   {
-    Error_Handler() ;
+    return HAL_ERROR;
   }
 
+  return HAL_OK;
+}
+
+/**
+* @brief  Configure the read/write/wrap commands and enter memory mapped mode
+* @param  None
+* @retval error status
+*/
+static uint32_t PSRAM_EnableMemoryMapped(void)
+{
   XSPI_RegularCmdTypeDef sCommand = {0};
+  bool wrap = (burst_mode == PSRAM_BURST_WRAP_32);
 
   sCommand.OperationType      = HAL_XSPI_OPTYPE_WRITE_CFG;
   sCommand.InstructionMode    = HAL_XSPI_INSTRUCTION_8_LINES;
   sCommand.InstructionWidth   = HAL_XSPI_INSTRUCTION_8_BITS;
   sCommand.InstructionDTRMode = HAL_XSPI_INSTRUCTION_DTR_DISABLE;
-  sCommand.Instruction        = WRITE_CMD;
+  /* In wrap mode a plain sync write would wrap at 32 bytes, so use linear bursts */
+  sCommand.Instruction        = wrap ? WRITE_LINEAR_BURST_CMD : WRITE_CMD;
   sCommand.AddressMode        = HAL_XSPI_ADDRESS_8_LINES;
   sCommand.AddressWidth       = HAL_XSPI_ADDRESS_32_BITS;
   sCommand.AddressDTRMode     = HAL_XSPI_ADDRESS_DTR_ENABLE;
@@ -184,27 +216,337 @@ void PSRAM_Init(void)
   
   if (HAL_XSPI_Command(&hxspi1, &sCommand, HAL_XSPI_TIMEOUT_DEFAULT_VALUE) != HAL_OK)
   {
-    Error_Handler();
+    return HAL_ERROR;
   }
   
   sCommand.OperationType = HAL_XSPI_OPTYPE_READ_CFG;
-  sCommand.Instruction = READ_CMD;
+  sCommand.Instruction = wrap ? READ_LINEAR_BURST_CMD : READ_CMD;
   sCommand.DummyCycles = DUMMY_CLOCK_CYCLES_READ;
   sCommand.DQSMode     = HAL_XSPI_DQS_ENABLE;
   
   if (HAL_XSPI_Command(&hxspi1, &sCommand, HAL_XSPI_TIMEOUT_DEFAULT_VALUE) != HAL_OK)
   {
-    Error_Handler();
+    return HAL_ERROR;
+  }
+
+  if (wrap)
+  {
+    /* Cache line refills: sync read follows the MR8 32-byte wrap, critical word first */
+    sCommand.OperationType = HAL_XSPI_OPTYPE_WRAP_CFG;
+    sCommand.Instruction = READ_CMD;
+
+    if (HAL_XSPI_Command(&hxspi1, &sCommand, HAL_XSPI_TIMEOUT_DEFAULT_VALUE) != HAL_OK)
+    {
+      return HAL_ERROR;
+    }
   }
   
   XSPI_MemoryMappedTypeDef sMemMappedCfg;
   sMemMappedCfg.TimeOutActivation = HAL_XSPI_TIMEOUT_COUNTER_ENABLE;
   sMemMappedCfg.TimeoutPeriodClock      = 0x34;
   
-  
   if (HAL_XSPI_MemoryMapped(&hxspi1, &sMemMappedCfg) != HAL_OK)
+  {
+    return HAL_ERROR;
+  }
+
+  return HAL_OK;
+}
+
+/**
+* @brief  Write MR8 for the current burst mode and burst length
+* @param  None
+* @retval error status
+*/
+static uint32_t PSRAM_WriteMR8(void)
+{
+  uint8_t regW_MR8[2] = {MR8_X16 | MR8_RBX, 0x10}; /* x16, row boundary crossing, full drive strength */
+
+  /* Wrap mode uses the sync read for refills only, linear mode for every access */
+  regW_MR8[0] |= (burst_mode == PSRAM_BURST_WRAP_32) ? PSRAM_BL_32 : xfer.burst_len;
+
+  return PSRAM_WriteRegChecked(MR8, regW_MR8);
+}
+
+/**
+* @brief  Write MR0/MR4 for the current latency profile
+* @param  None
+* @retval error status
+*/
+static uint32_t PSRAM_WriteLatency(void)
+{
+  uint8_t regW_MR0[2] = {0};
+  uint8_t regW_MR4[2] = {0};
+
+  /* Keep the drive strength */
+  if (APS256_ReadReg(&hxspi1, MR0, regW_MR0) != HAL_OK)
+  {
+    return HAL_ERROR;
+  }
+
+  regW_MR0[0] &= MR0_DRIVE_MASK;
+  regW_MR0[0] |= (uint8_t)((latency.read_code - PSRAM_LATENCY_MIN) << MR0_LC_POS);
+  if (latency.type == PSRAM_LATENCY_FIXED)
+  {
+    regW_MR0[0] |= MR0_LT_FIXED;
+  }
+
+  /* The read back already runs at the new read latency */
+  mr_read_code = latency.read_code;
+  if (PSRAM_WriteRegChecked(MR0, regW_MR0) != HAL_OK)
+  {
+    return HAL_ERROR;
+  }
+
+  regW_MR4[0] = (uint8_t)(write_latency_code[latency.write_code - PSRAM_LATENCY_MIN] << MR4_WLC_POS) | MR4_REFRESH_PASR;
+
+  return PSRAM_WriteRegChecked(MR4, regW_MR4);
+}
+
+/**
+* @brief  Program the transaction shaping fields of XSPI1
+* @note   Same register writes as HAL_XSPI_Init, which only touches them
+*         from the reset state
+* @param  None
+* @retval None
+*/
+static void PSRAM_ApplyXspiXfer(void)
+{
+  hxspi1.Init.ChipSelectBoundary = xfer.cs_boundary;
+  hxspi1.Init.MaxTran = xfer.max_tran;
+  hxspi1.Init.Refresh = xfer.refresh;
+
+  MODIFY_REG(hxspi1.Instance->DCR3, XSPI_DCR3_CSBOUND, (hxspi1.Init.ChipSelectBoundary << XSPI_DCR3_CSBOUND_Pos));
+  MODIFY_REG(hxspi1.Instance->DCR3, XSPI_DCR3_MAXTRAN, (hxspi1.Init.MaxTran << XSPI_DCR3_MAXTRAN_Pos));
+  hxspi1.Instance->DCR4 = hxspi1.Init.Refresh;
+}
+
+/**
+* @brief  Leave memory mapped mode so the memory can be reconfigured
+* @note   Dirty D-cache lines covering the PSRAM are cleaned first
+* @param  None
+* @retval error status
+*/
+static uint32_t PSRAM_DisableMemoryMapped(void)
+{
+  if (SCB->CCR & SCB_CCR_DC_Msk)
+  {
+    SCB_CleanDCache();
+  }
+
+  return HAL_XSPI_Abort(&hxspi1);
+}
+
+/**
+* @brief  Switch from Octal Mode to Hexa Mode on the memory
+* @param  None
+* @retval None
+*/
+void PSRAM_Init(void)
+{
+  burst_mode = PSRAM_BURST_LINEAR;
+
+  /* Configure Burst Length: x16, 2k burst by default */
+  if (PSRAM_WriteMR8() != HAL_OK)
+  {
+    Error_Handler();
+  }
+
+  /* Configure latency: variable 7-14 read, 7 write for 200MHz by default */
+  if (PSRAM_WriteLatency() != HAL_OK)
   {
     Error_Handler();
   }
 
+  PSRAM_ApplyXspiXfer();
+
+  if (PSRAM_EnableMemoryMapped() != HAL_OK)
+  {
+    Error_Handler();
+  }
+
+  if (PSRAM_BURST_MODE_DEFAULT != PSRAM_BURST_LINEAR)
+  {
+    if (PSRAM_SetBurstMode(PSRAM_BURST_MODE_DEFAULT) != HAL_OK)
+    {
+      Error_Handler();
+    }
+  }
+}
+
+/**
+* @brief  Select linear or wrapped bursts for the memory mapped window
+* @note   Memory mapped mode is left for the duration of the switch, so nothing
+*         may execute from or access the PSRAM while this runs.
+* @param  mode Burst mode
+* @retval error status
+*/
+uint32_t PSRAM_SetBurstMode(psram_burst_t mode)
+{
+  if (PSRAM_DisableMemoryMapped() != HAL_OK)
+  {
+    return HAL_ERROR;
+  }
+
+  burst_mode = mode;
+
+  if (PSRAM_WriteMR8() != HAL_OK)
+  {
+    return HAL_ERROR;
+  }
+
+  /* Let the XSPI issue wrapped transactions for cache line refills */
+  hxspi1.Init.WrapSize = (mode == PSRAM_BURST_WRAP_32) ? HAL_XSPI_WRAP_32_BYTES : HAL_XSPI_WRAP_NOT_SUPPORTED;
+  MODIFY_REG(hxspi1.Instance->DCR2, XSPI_DCR2_WRAPSIZE, hxspi1.Init.WrapSize);
+
+  return PSRAM_EnableMemoryMapped();
+}
+
+/**
+* @brief  Provide the current burst mode
+* @param  None
+* @retval See above
+*/
+psram_burst_t PSRAM_GetBurstMode(void)
+{
+  return burst_mode;
+}
+
+/**
+* @brief  Apply a transaction shaping configuration at runtime
+* @note   Memory mapped mode is left for the duration of the switch, so nothing
+*         may execute from or access the PSRAM while this runs. It is entered
+*         again on failure too, with the previous configuration.
+* @param  cfg Configuration to apply
+* @retval error status
+*/
+uint32_t PSRAM_SetXferConfig(const psram_xfer_t *cfg)
+{
+  psram_xfer_t previous = xfer;
+
+  /* In linear mode a wrapping burst length must not be crossed by one transaction */
+  if (!PSRAM_XferConfigValid(cfg))
+  {
+    return HAL_ERROR;
+  }
+
+  if (PSRAM_DisableMemoryMapped() != HAL_OK)
+  {
+    (void)PSRAM_EnableMemoryMapped();
+    return HAL_ERROR;
+  }
+
+  xfer = *cfg;
+  PSRAM_ApplyXspiXfer();
+
+  if (PSRAM_WriteMR8() != HAL_OK)
+  {
+    /* The memory may still have the previous burst length */
+    xfer = previous;
+    PSRAM_ApplyXspiXfer();
+    (void)PSRAM_WriteMR8();
+    (void)PSRAM_EnableMemoryMapped();
+    return HAL_ERROR;
+  }
+
+  return PSRAM_EnableMemoryMapped();
+}
+
+/**
+* @brief  Provide the current transaction shaping configuration
+* @param  cfg Configuration storage
+* @retval None
+*/
+void PSRAM_GetXferConfig(psram_xfer_t *cfg)
+{
+  *cfg = xfer;
+}
+
+/**
+* @brief  Apply a latency profile at runtime, reissuing the memory mapped
+*         read/write configuration with the matching dummy cycles
+* @note   Memory mapped mode is left for the duration of the switch, so nothing
+*         may execute from or access the PSRAM while this runs.
+* @param  lat Latency profile to apply
+* @retval error status
+*/
+uint32_t PSRAM_SetLatency(const psram_latency_t *lat)
+{
+  if (!PSRAM_LatencyValid(lat, HAL_RCCEx_GetPeriphCLKFreq(RCC_PERIPHCLK_XSPI1)))
+  {
+    return HAL_ERROR;
+  }
+
+  if (PSRAM_DisableMemoryMapped() != HAL_OK)
+  {
+    return HAL_ERROR;
+  }
+
+  latency = *lat;
+
+  if (PSRAM_WriteLatency() != HAL_OK)
+  {
+    return HAL_ERROR;
+  }
+
+  return PSRAM_EnableMemoryMapped();
+}
+
+/**
+* @brief  Provide the current latency profile
+* @param  lat Latency profile storage
+* @retval None
+*/
+void PSRAM_GetLatency(psram_latency_t *lat)
+{
+  *lat = latency;
+}
+
+/**
+* @brief  Check that a latency profile is supported at a given memory clock
+* @param  lat Latency profile to check
+* @param  clock Memory clock in Hz
+* @retval true if usable
+*/
+bool PSRAM_LatencyValid(const psram_latency_t *lat, uint32_t clock)
+{
+  if ((lat->read_code < PSRAM_LATENCY_MIN) || (lat->read_code > PSRAM_LATENCY_MAX) ||
+      (lat->write_code < PSRAM_LATENCY_MIN) || (lat->write_code > PSRAM_LATENCY_MAX))
+  {
+    return false;
+  }
+
+  return (clock <= latency_max_freq[lat->read_code - PSRAM_LATENCY_MIN]) &&
+         (clock <= latency_max_freq[lat->write_code - PSRAM_LATENCY_MIN]);
+}
+
+/**
+* @brief  Check that a configuration keeps linear accesses correct and the
+*         chip select low time within the PSRAM refresh window (tCEM)
+* @param  cfg Configuration to check
+* @retval true if usable
+*/
+bool PSRAM_XferConfigValid(const psram_xfer_t *cfg)
+{
+  /* Linear burst lengths below 2K wrap, so transactions must end on that boundary */
+  static const uint32_t bl_bytes[] = {16, 32, 64, 2048};
+  uint32_t cs_bytes = (cfg->cs_boundary == HAL_XSPI_BONDARYOF_NONE) ? 0 : (1UL << cfg->cs_boundary);
+
+  if (cfg->burst_len > PSRAM_BL_2K)
+  {
+    return false;
+  }
+
+  if ((cfg->burst_len != PSRAM_BL_2K) && ((cs_bytes == 0) || (cs_bytes > bl_bytes[cfg->burst_len])))
+  {
+    return false;
+  }
+
+  /* Without a boundary or a refresh limit a long transfer could hold CS past tCEM */
+  if ((cs_bytes == 0) && (cfg->refresh == 0))
+  {
+    return false;
+  }
+
+  return true;
 }
@@ -7,7 +7,91 @@
 extern "C" {
 #endif
 
+#include "common.h"
+#include "stm32.h"
+
+#define PSRAM_BASE_ADDRESS      0x90000000UL
+#define PSRAM_SIZE              0x02000000UL
+
+typedef enum
+{
+	PSRAM_BURST_LINEAR,         // Sync read/write for every access, MR8 burst length applies
+	PSRAM_BURST_WRAP_32,        // 32-byte wrap for cache line refills (critical word first)
+} psram_burst_t;
+
+typedef enum
+{
+	PSRAM_BL_16,                // MR8 burst length field values
+	PSRAM_BL_32,
+	PSRAM_BL_64,
+	PSRAM_BL_2K,
+} psram_bl_t;
+
+typedef enum
+{
+	PSRAM_LATENCY_VARIABLE,     // 1x latency unless a refresh collides (2x), signalled on DQS
+	PSRAM_LATENCY_FIXED,        // Always 2x latency, deterministic access time
+} psram_latency_type_t;
+
+#define PSRAM_LATENCY_MIN           3
+#define PSRAM_LATENCY_MAX           7
+
+// Latency profile: MR0 latency type and read latency code, MR4 write latency code
+typedef struct
+{
+	psram_latency_type_t type;
+	uint8_t read_code;          // PSRAM_LATENCY_MIN..PSRAM_LATENCY_MAX clocks
+	uint8_t write_code;         // PSRAM_LATENCY_MIN..PSRAM_LATENCY_MAX clocks
+} psram_latency_t;
+
+// Transaction shaping: XSPI1 chip select boundary / max transfer / refresh and MR8 burst length
+typedef struct
+{
+	uint32_t cs_boundary;       // HAL_XSPI_BONDARYOF_xxx, chip select released at 2^n bytes
+	uint32_t max_tran;          // Max clocks before yielding the bus, 0 = disabled
+	uint32_t refresh;           // Max clocks with chip select low, 0 = disabled
+	psram_bl_t burst_len;       // Burst length used in linear mode
+} psram_xfer_t;
+
+// Burst mode applied at the end of PSRAM_Init()
+#ifndef PSRAM_BURST_MODE_DEFAULT
+#define PSRAM_BURST_MODE_DEFAULT    PSRAM_BURST_LINEAR
+#endif
+
+// Latency profile applied by PSRAM_Init(), code 7 is required at 200 MHz
+#ifndef PSRAM_LATENCY_TYPE_DEFAULT
+#define PSRAM_LATENCY_TYPE_DEFAULT  PSRAM_LATENCY_VARIABLE
+#endif
+#ifndef PSRAM_READ_LATENCY_DEFAULT
+#define PSRAM_READ_LATENCY_DEFAULT  7
+#endif
+#ifndef PSRAM_WRITE_LATENCY_DEFAULT
+#define PSRAM_WRITE_LATENCY_DEFAULT 7
+#endif
+
+// Transaction shaping applied by PSRAM_Init(), see xspiBenchTune() for a recommendation
+#ifndef PSRAM_XSPI_CS_BOUNDARY
+#define PSRAM_XSPI_CS_BOUNDARY      HAL_XSPI_BONDARYOF_2KB
+#endif
+#ifndef PSRAM_XSPI_MAX_TRAN
+#define PSRAM_XSPI_MAX_TRAN         0
+#endif
+#ifndef PSRAM_XSPI_REFRESH
+#define PSRAM_XSPI_REFRESH          0
+#endif
+#ifndef PSRAM_MR8_BURST_LEN
+#define PSRAM_MR8_BURST_LEN         PSRAM_BL_2K
+#endif
+
 void PSRAM_Init(void);
+uint32_t PSRAM_SetBurstMode(psram_burst_t mode);
+psram_burst_t PSRAM_GetBurstMode(void);
+uint32_t PSRAM_SetXferConfig(const psram_xfer_t *cfg);
+void PSRAM_GetXferConfig(psram_xfer_t *cfg);
+bool PSRAM_XferConfigValid(const psram_xfer_t *cfg);
+uint32_t PSRAM_SetLatency(const psram_latency_t *lat);
+void PSRAM_GetLatency(psram_latency_t *lat);
+bool PSRAM_LatencyValid(const psram_latency_t *lat, uint32_t clock);
 
 #ifdef __cplusplus
 }
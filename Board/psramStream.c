@@ -0,0 +1,158 @@
+/* SPDX-License-Identifier: Unlicense */
+#include "psramStream.h"
+#include "memKernels.h"
+
+enum
+{
+  PHASE_FULL,
+  PHASE_HEAD,
+  PHASE_TAIL,
+  PHASE_DONE,
+};
+
+/**
+* @brief  Provide the largest piece of a transfer the PSRAM serves as a single
+*         burst: the row size, or the XSPI1 chip select boundary if smaller
+* @note   HAL_XSPI_BONDARYOF_2KB is 2 Kbit, i.e. chip select is released every
+*         256 bytes with the default configuration
+* @param  None
+* @retval Segment size in bytes (power of two)
+*/
+uint32_t PSRAM_SegmentSize(void)
+{
+  psram_xfer_t cfg;
+
+  PSRAM_GetXferConfig(&cfg);
+  if (cfg.cs_boundary == HAL_XSPI_BONDARYOF_NONE)
+  {
+    return PSRAM_ROW_SIZE;
+  }
+  return MIN(1UL << cfg.cs_boundary, PSRAM_ROW_SIZE);
+}
+
+/**
+* @brief  Start splitting a transfer into segments
+* @note   The segments come out longest first: every full, boundary aligned
+*         segment in address order, then the partial head and tail. A DMA
+*         linked list built from them needs at most two short nodes, and no
+*         node crosses a boundary.
+* @param  it Iterator
+* @param  addr Start address of the transfer in the PSRAM window
+* @param  size Size in bytes
+* @retval None
+*/
+void PSRAM_SegmentBegin(psram_seg_iter_t *it, uint32_t addr, uint32_t size)
+{
+  uint32_t b = PSRAM_SegmentSize();
+
+  it->start = addr;
+  it->end = addr + size;
+  it->boundary = b;
+  it->head_end = MIN((addr + b - 1) & ~(b - 1), it->end);
+  it->tail_start = MAX(it->end & ~(b - 1), it->head_end);
+  it->next = it->head_end;
+  it->phase = PHASE_FULL;
+}
+
+/**
+* @brief  Provide the next segment of a transfer
+* @param  it Iterator started with PSRAM_SegmentBegin()
+* @param  seg Segment storage
+* @retval false once all segments have been provided
+*/
+bool PSRAM_SegmentNext(psram_seg_iter_t *it, psram_segment_t *seg)
+{
+  while (it->phase != PHASE_DONE)
+  {
+    switch (it->phase)
+    {
+      case PHASE_FULL:
+        if (it->next < it->tail_start)
+        {
+          seg->offset = it->next - it->start;
+          seg->size = it->boundary;
+          it->next += it->boundary;
+          return true;
+        }
+        it->phase = PHASE_HEAD;
+        break;
+
+      case PHASE_HEAD:
+        it->phase = PHASE_TAIL;
+        if (it->head_end > it->start)
+        {
+          seg->offset = 0;
+          seg->size = it->head_end - it->start;
+          return true;
+        }
+        break;
+
+      default:
+        it->phase = PHASE_DONE;
+        if (it->end > it->tail_start)
+        {
+          seg->offset = it->tail_start - it->start;
+          seg->size = it->end - it->tail_start;
+          return true;
+        }
+        break;
+    }
+  }
+  return false;
+}
+
+/**
+* @brief  Copy to, from or within the PSRAM one segment at a time
+* @note   Segments end at the boundaries of the destination only, when it is
+*         in the PSRAM, so that no write burst crosses one. The source is not
+*         split as well: XSPI1 already releases chip select at its boundaries
+*         (CSBOUND) for reads, and with source and destination at different
+*         offsets modulo 4 a second split would give every segment a partial
+*         word at both ends. Each segment is copied with word bursts
+*         (memCopyExt).
+* @param  dst Destination
+* @param  src Source
+* @param  size Size in bytes
+* @retval None
+*/
+void PSRAM_Copy(void *dst, const void *src, uint32_t size)
+{
+  uint32_t b = PSRAM_SegmentSize();
+  uint32_t d = (uint32_t)dst;
+  uint32_t s = (uint32_t)src;
+
+  if ((d - PSRAM_BASE_ADDRESS) >= PSRAM_SIZE)
+  {
+    memCopyExt(dst, src, size);
+    return;
+  }
+
+  while (size)
+  {
+    uint32_t n = MIN(size, b - (d & (b - 1)));
+
+    memCopyExt((void *)d, (const void *)s, n);
+    d += n;
+    s += n;
+    size -= n;
+  }
+}
+
+/**
+* @brief  Fill a PSRAM range one segment at a time
+* @param  dst Destination
+* @param  value Fill byte
+* @param  size Size in bytes
+* @retval None
+*/
+void PSRAM_Fill(void *dst, uint8_t value, uint32_t size)
+{
+  psram_seg_iter_t it;
+  psram_segment_t seg;
+
+  PSRAM_SegmentBegin(&it, (uint32_t)dst, size);
+  while (PSRAM_SegmentNext(&it, &seg))
+  {
+    memSetExt((uint8_t *)dst + seg.offset, value, seg.size);
+  }
+}
@@ -0,0 +1,45 @@
+/* SPDX-License-Identifier: Unlicense */
+
+#ifndef PSRAMSTREAM_H_
+#define PSRAMSTREAM_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "common.h"
+#include "psram.h"
+
+// APS256 row (page) size: bursts crossing it pay the row boundary crossing latency
+#define PSRAM_ROW_SIZE          2048UL
+
+// One contiguous piece of a transfer that crosses neither a row nor a chip select boundary
+typedef struct
+{
+	uint32_t offset;            // From the start of the transfer
+	uint32_t size;
+} psram_segment_t;
+
+// Segment iterator: full segments first, in address order, then the head and tail pieces
+typedef struct
+{
+	uint32_t start;
+	uint32_t end;
+	uint32_t boundary;
+	uint32_t head_end;          // First boundary after start (or end)
+	uint32_t tail_start;        // Last boundary before end (or head_end)
+	uint32_t next;              // Next full segment
+	uint8_t phase;
+} psram_seg_iter_t;
+
+uint32_t PSRAM_SegmentSize(void);
+void PSRAM_SegmentBegin(psram_seg_iter_t *it, uint32_t addr, uint32_t size);
+bool PSRAM_SegmentNext(psram_seg_iter_t *it, psram_segment_t *seg);
+void PSRAM_Copy(void *dst, const void *src, uint32_t size);
+void PSRAM_Fill(void *dst, uint8_t value, uint32_t size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // PSRAMSTREAM_H_
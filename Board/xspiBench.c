@@ -0,0 +1,547 @@
+/* SPDX-License-Identifier: Unlicense */
+
+// -----------------------------------------------------------------------------
+// IMPLEMENTATION NOTES
+//
+// Cache miss latency is measured by invalidating a D-cache line and timing a
+// single load from it with the DWT cycle counter. Loading the first and the
+// last word of the line shows whether the refill delivers the requested word
+// first (wrapped burst) or only once the whole line has arrived (linear burst).
+// Lines are spread 4 KB apart so neither the XSPI nor the memory can serve a
+// miss from an open burst left by the previous one.
+//
+// Bandwidth runs with the D-cache off so every load/store reaches the XSPI.
+// Random addresses come from a fixed-seed LCG so runs are reproducible, and
+// writes are confined to the last BENCH_WRITE_SIZE bytes of the window.
+//
+// The PSRAM tuner sweeps chip select boundary, max transfer, refresh and the
+// MR8 burst length. Among the configurations whose worst random read is within
+// 25% of the best worst case, it recommends the one with the highest
+// sequential read + write bandwidth, printed as defines for psram.h so that
+// PSRAM_Init() applies it from the next build on.
+//
+// The latency profile benchmark times individual uncached random reads under
+// each fixed/variable latency profile valid at the current XSPI1 clock. With
+// variable latency, reads that collide with a refresh take twice as long, which
+// shows up as jitter; fixed latency trades a higher mean for a flat profile.
+//
+// The copy benchmark first checks memCopyExt()/memSetExt() against newlib on
+// the PSRAM for every head alignment and every short size, with guard bytes
+// on both sides, then times both implementations for each alignment pair.
+//
+// The segmented copy benchmark times a large PSRAM to PSRAM copy and fill as
+// one memCopyExt()/memSetExt() call against PSRAM_Copy()/PSRAM_Fill(), which
+// split the transfer at row / chip select boundaries, for several misaligned
+// source and destination offsets.
+//
+// -----------------------------------------------------------------------------
+
+#include "xspiBench.h"
+#include "cycles.h"
+#include "psram.h"
+#include "nor.h"
+#include "memKernels.h"
+#include "psramStream.h"
+#include "stm32.h"
+
+#define CACHE_LINE_SIZE         32
+#define BENCH_LINES             256
+#define BENCH_LINE_STRIDE       4096
+#define BENCH_SEQ_SIZE          (64 * 1024)
+#define BENCH_WRITE_SIZE        (64 * 1024)
+#define BENCH_RANDOM_READS      2048
+#define BENCH_SEED              0x12345678UL
+#define BENCH_JITTER_READS      8192
+#define BENCH_COPY_SIZE         4096
+#define BENCH_CHECK_SIZE        72
+#define BENCH_GUARD             8
+#define BENCH_GUARD_BYTE        0xA5
+#define BENCH_SEG_SIZE          (BENCH_WRITE_SIZE - 256)
+
+static const uint32_t tune_cs_boundary[] = {HAL_XSPI_BONDARYOF_256B, HAL_XSPI_BONDARYOF_512B, HAL_XSPI_BONDARYOF_2KB, HAL_XSPI_BONDARYOF_16KB, HAL_XSPI_BONDARYOF_NONE};
+static const uint32_t tune_max_tran[] = {0, 64};
+static const uint32_t tune_refresh[] = {0, 320, 640};       // 1.6 us / 3.2 us at 200 MHz, tCEM is 4 us
+
+#define TUNE_POINTS             (ARRAY_SIZE(tune_cs_boundary) * ARRAY_SIZE(tune_max_tran) * ARRAY_SIZE(tune_refresh) * (PSRAM_BL_2K + 1))
+
+typedef struct
+{
+	psram_xfer_t cfg;
+	xspi_bandwidth_t bw;
+} tune_point_t;
+
+static tune_point_t tune_points[TUNE_POINTS];
+static const uint32_t seg_offsets[] = {0, 4, 30, 130};
+static uint8_t copy_src[BENCH_COPY_SIZE + sizeof(uint32_t)] __ALIGNED(CACHE_LINE_SIZE);
+
+// -----------------------------------------------------------------------------
+// Description: Integer square root
+//     Returns: floor(sqrt(x))
+//      Inputs: x
+// -----------------------------------------------------------------------------
+static uint32_t isqrt(uint64_t x)
+{
+	uint64_t r = 0;
+	uint64_t bit = 1ULL << 62;
+
+	while(bit > x)
+	{
+		bit >>= 2;
+	}
+	while(bit != 0)
+	{
+		if(x >= r + bit)
+		{
+			x -= r + bit;
+			r = (r >> 1) + bit;
+		}
+		else
+		{
+			r >>= 1;
+		}
+		bit >>= 2;
+	}
+	return (uint32_t)r;
+}
+
+// -----------------------------------------------------------------------------
+// Description: Converts a byte count and cycle count into kB/s
+//     Returns: See above
+//      Inputs: Bytes transferred, elapsed cycles
+// -----------------------------------------------------------------------------
+static uint32_t kbps(uint32_t bytes, uint32_t elapsed)
+{
+	return (uint32_t)(((uint64_t)bytes * (SystemCoreClock / 1000)) / MAX(elapsed, 1));
+}
+
+// -----------------------------------------------------------------------------
+// Description: Times one load from a freshly invalidated cache line
+//     Returns: Elapsed cycles
+//      Inputs: Address of the word to load
+// -----------------------------------------------------------------------------
+static uint32_t missCycles(uint32_t addr)
+{
+	volatile uint32_t *p = (volatile uint32_t *)addr;
+	uint32_t start;
+
+	SCB_CleanInvalidateDCache_by_Addr((void *)(addr & ~(CACHE_LINE_SIZE - 1)), CACHE_LINE_SIZE);
+	__DSB();
+	start = cycles();
+	(void)*p;
+	__DSB();
+	return cyclesElapsed(start);
+}
+
+// -----------------------------------------------------------------------------
+// Description: Measures the cache miss latency of a memory mapped window
+//     Returns: none
+//      Inputs: Window base address, result storage
+// -----------------------------------------------------------------------------
+void xspiBenchMissLatency(uint32_t base, xspi_miss_latency_t *result)
+{
+	bool dcache_was_on = (SCB->CCR & SCB_CCR_DC_Msk) != 0;
+	uint32_t sum_first = 0;
+	uint32_t sum_last = 0;
+
+	result->worst = 0;
+	cyclesInit();
+	if(!dcache_was_on)
+	{
+		SCB_EnableDCache();
+	}
+
+	for(uint32_t i = 0; i < BENCH_LINES; i++)
+	{
+		uint32_t line = base + (i * BENCH_LINE_STRIDE);
+		uint32_t first = missCycles(line);
+		uint32_t last = missCycles(line + CACHE_LINE_SIZE - sizeof(uint32_t));
+
+		sum_first += first;
+		sum_last += last;
+		result->worst = MAX(result->worst, MAX(first, last));
+	}
+
+	if(!dcache_was_on)
+	{
+		SCB_DisableDCache();
+	}
+
+	result->first_word = sum_first / BENCH_LINES;
+	result->last_word = sum_last / BENCH_LINES;
+}
+
+// -----------------------------------------------------------------------------
+// Description: Measures sequential and random bandwidth of a memory mapped window
+//     Returns: none
+//      Inputs: Window base address, window size, result storage
+// -----------------------------------------------------------------------------
+void xspiBenchBandwidth(uint32_t base, uint32_t size, xspi_bandwidth_t *result)
+{
+	bool dcache_was_on = (SCB->CCR & SCB_CCR_DC_Msk) != 0;
+	volatile uint32_t *p;
+	uint32_t seed = BENCH_SEED;
+	uint32_t start, total = 0;
+
+	cyclesInit();
+	if(dcache_was_on)
+	{
+		SCB_DisableDCache();
+	}
+
+	p = (volatile uint32_t *)base;
+	start = cycles();
+	for(uint32_t i = 0; i < BENCH_SEQ_SIZE / sizeof(uint32_t); i += 4)
+	{
+		(void)p[i];
+		(void)p[i + 1];
+		(void)p[i + 2];
+		(void)p[i + 3];
+	}
+	result->seq_read_kbps = kbps(BENCH_SEQ_SIZE, cyclesElapsed(start));
+
+	p = (volatile uint32_t *)(base + size - BENCH_WRITE_SIZE);
+	start = cycles();
+	for(uint32_t i = 0; i < BENCH_WRITE_SIZE / sizeof(uint32_t); i += 4)
+	{
+		p[i] = i;
+		p[i + 1] = i;
+		p[i + 2] = i;
+		p[i + 3] = i;
+	}
+	__DSB();
+	result->seq_write_kbps = kbps(BENCH_WRITE_SIZE, cyclesElapsed(start));
+
+	result->worst = 0;
+	for(uint32_t i = 0; i < BENCH_RANDOM_READS; i++)
+	{
+		uint32_t elapsed;
+
+		seed = (seed * 1664525UL) + 1013904223UL;
+		p = (volatile uint32_t *)(base + ((seed >> 2) & (size - 1) & ~3UL));
+		start = cycles();
+		(void)*p;
+		__DSB();
+		elapsed = cyclesElapsed(start);
+		total += elapsed;
+		result->worst = MAX(result->worst, elapsed);
+	}
+	result->rnd_read_kbps = kbps(BENCH_RANDOM_READS * sizeof(uint32_t), total);
+
+	if(dcache_was_on)
+	{
+		SCB_EnableDCache();
+	}
+}
+
+// -----------------------------------------------------------------------------
+// Description: Measures the spread of single uncached random read latencies
+//     Returns: none
+//      Inputs: Window base address, window size, result storage
+// -----------------------------------------------------------------------------
+void xspiBenchJitter(uint32_t base, uint32_t size, xspi_jitter_t *result)
+{
+	bool dcache_was_on = (SCB->CCR & SCB_CCR_DC_Msk) != 0;
+	uint32_t seed = BENCH_SEED;
+	uint64_t sum = 0, sum_sq = 0;
+
+	cyclesInit();
+	if(dcache_was_on)
+	{
+		SCB_DisableDCache();
+	}
+
+	result->min = UINT32_MAX;
+	result->max = 0;
+	for(uint32_t i = 0; i < BENCH_JITTER_READS; i++)
+	{
+		volatile uint32_t *p;
+		uint32_t start, elapsed;
+
+		seed = (seed * 1664525UL) + 1013904223UL;
+		p = (volatile uint32_t *)(base + ((seed >> 2) & (size - 1) & ~3UL));
+		start = cycles();
+		(void)*p;
+		__DSB();
+		elapsed = cyclesElapsed(start);
+
+		sum += elapsed;
+		sum_sq += (uint64_t)elapsed * elapsed;
+		result->min = MIN(result->min, elapsed);
+		result->max = MAX(result->max, elapsed);
+	}
+
+	if(dcache_was_on)
+	{
+		SCB_EnableDCache();
+	}
+
+	result->mean = (uint32_t)(sum / BENCH_JITTER_READS);
+	result->stddev = isqrt((sum_sq / BENCH_JITTER_READS) - ((uint64_t)result->mean * result->mean));
+}
+
+// -----------------------------------------------------------------------------
+// Description: Reports read latency and jitter for every PSRAM latency profile
+//              supported at the current clock, then restores the original one
+//     Returns: none
+//      Inputs: none
+// -----------------------------------------------------------------------------
+void xspiBenchLatency(void)
+{
+	uint32_t clock = HAL_RCCEx_GetPeriphCLKFreq(RCC_PERIPHCLK_XSPI1);
+	psram_latency_t original, lat;
+	xspi_jitter_t j;
+
+	PSRAM_GetLatency(&original);
+	printf("latency,type,read_code,write_code,mean,stddev,min,max" EOL);
+
+	for(uint32_t type = PSRAM_LATENCY_VARIABLE; type <= PSRAM_LATENCY_FIXED; type++)
+	for(uint8_t code = PSRAM_LATENCY_MIN; code <= PSRAM_LATENCY_MAX; code++)
+	{
+		lat.type = (psram_latency_type_t)type;
+		lat.read_code = code;
+		lat.write_code = code;
+
+		if(!PSRAM_LatencyValid(&lat, clock) || (PSRAM_SetLatency(&lat) != HAL_OK))
+		{
+			continue;
+		}
+		xspiBenchJitter(PSRAM_BASE_ADDRESS, PSRAM_SIZE, &j);
+		printf("latency,%s,%u,%u,%lu,%lu,%lu,%lu" EOL, (type == PSRAM_LATENCY_FIXED) ? "fixed" : "variable",
+			lat.read_code, lat.write_code, j.mean, j.stddev, j.min, j.max);
+	}
+
+	PSRAM_SetLatency(&original);
+}
+
+// -----------------------------------------------------------------------------
+// Description: Sweeps the PSRAM transaction shaping parameters, reports every
+//              point and the recommended configuration, then restores the
+//              configuration that was active on entry
+//     Returns: none
+//      Inputs: none
+// -----------------------------------------------------------------------------
+void xspiBenchTune(void)
+{
+	psram_xfer_t original;
+	tune_point_t *best = NULL;
+	uint32_t count = 0;
+	uint32_t best_worst = UINT32_MAX;
+
+	PSRAM_GetXferConfig(&original);
+	printf("tune,cs_boundary,max_tran,refresh,burst_len,seq_rd_kBps,seq_wr_kBps,rnd_rd_kBps,worst_cycles" EOL);
+
+	for(uint32_t c = 0; c < ARRAY_SIZE(tune_cs_boundary); c++)
+	for(uint32_t m = 0; m < ARRAY_SIZE(tune_max_tran); m++)
+	for(uint32_t r = 0; r < ARRAY_SIZE(tune_refresh); r++)
+	for(uint32_t b = PSRAM_BL_16; b <= PSRAM_BL_2K; b++)
+	{
+		tune_point_t *t = &tune_points[count];
+
+		t->cfg.cs_boundary = tune_cs_boundary[c];
+		t->cfg.max_tran = tune_max_tran[m];
+		t->cfg.refresh = tune_refresh[r];
+		t->cfg.burst_len = (psram_bl_t)b;
+
+		if(!PSRAM_XferConfigValid(&t->cfg) || (PSRAM_SetXferConfig(&t->cfg) != HAL_OK))
+		{
+			continue;
+		}
+		xspiBenchBandwidth(PSRAM_BASE_ADDRESS, PSRAM_SIZE, &t->bw);
+
+		printf("tune,%lu,%lu,%lu,%lu,%lu,%lu,%lu,%lu" EOL, t->cfg.cs_boundary, t->cfg.max_tran, t->cfg.refresh,
+			(uint32_t)t->cfg.burst_len, t->bw.seq_read_kbps, t->bw.seq_write_kbps, t->bw.rnd_read_kbps, t->bw.worst);
+		best_worst = MIN(best_worst, t->bw.worst);
+		count++;
+	}
+
+	PSRAM_SetXferConfig(&original);
+
+	for(uint32_t i = 0; i < count; i++)
+	{
+		tune_point_t *t = &tune_points[i];
+
+		if((t->bw.worst <= best_worst + (best_worst / 4)) &&
+		   ((best == NULL) || (t->bw.seq_read_kbps + t->bw.seq_write_kbps > best->bw.seq_read_kbps + best->bw.seq_write_kbps)))
+		{
+			best = t;
+		}
+	}
+
+	if(best != NULL)
+	{
+		printf("#define PSRAM_XSPI_CS_BOUNDARY %lu" EOL, best->cfg.cs_boundary);
+		printf("#define PSRAM_XSPI_MAX_TRAN %lu" EOL, best->cfg.max_tran);
+		printf("#define PSRAM_XSPI_REFRESH %lu" EOL, best->cfg.refresh);
+		printf("#define PSRAM_MR8_BURST_LEN %lu" EOL, (uint32_t)best->cfg.burst_len);
+	}
+}
+
+// -----------------------------------------------------------------------------
+// Description: Compares linear and 32-byte wrapped refills on PSRAM and NOR,
+//              restoring the burst modes that were active on entry
+//     Returns: none
+//      Inputs: none
+// -----------------------------------------------------------------------------
+void xspiBenchWrap(void)
+{
+	psram_burst_t psram_mode = PSRAM_GetBurstMode();
+	nor_burst_t nor_mode = NOR_GetBurstMode();
+	xspi_miss_latency_t lin, wrap;
+
+	printf("bench,memory,mode,first_word,last_word,worst" EOL);
+
+	PSRAM_SetBurstMode(PSRAM_BURST_LINEAR);
+	xspiBenchMissLatency(PSRAM_BASE_ADDRESS, &lin);
+	PSRAM_SetBurstMode(PSRAM_BURST_WRAP_32);
+	xspiBenchMissLatency(PSRAM_BASE_ADDRESS, &wrap);
+	PSRAM_SetBurstMode(psram_mode);
+	printf("wrap,psram,linear,%lu,%lu,%lu" EOL, lin.first_word, lin.last_word, lin.worst);
+	printf("wrap,psram,wrap32,%lu,%lu,%lu" EOL, wrap.first_word, wrap.last_word, wrap.worst);
+
+	if(NOR_SetBurstMode(NOR_BURST_LINEAR) != HAL_OK)
+	{
+		printf("wrap,nor,unsupported,0,0,0" EOL);
+		return;
+	}
+	xspiBenchMissLatency(NOR_BASE_ADDRESS, &lin);
+	NOR_SetBurstMode(NOR_BURST_WRAP_32);
+	xspiBenchMissLatency(NOR_BASE_ADDRESS, &wrap);
+	NOR_SetBurstMode(nor_mode);
+	printf("wrap,nor,linear,%lu,%lu,%lu" EOL, lin.first_word, lin.last_word, lin.worst);
+	printf("wrap,nor,wrap32,%lu,%lu,%lu" EOL, wrap.first_word, wrap.last_word, wrap.worst);
+}
+
+// -----------------------------------------------------------------------------
+// Description: Checks that a range holds a single byte value
+//     Returns: # of mismatching bytes
+//      Inputs: Range start, size, expected value
+// -----------------------------------------------------------------------------
+static uint32_t checkFill(const uint8_t *p, uint32_t size, uint8_t value)
+{
+	uint32_t errors = 0;
+
+	for(uint32_t i = 0; i < size; i++)
+	{
+		errors += (p[i] != value);
+	}
+	return errors;
+}
+
+// -----------------------------------------------------------------------------
+// Description: Verifies and benchmarks the external memory copy/fill kernels
+//              against newlib with a PSRAM destination
+//     Returns: none
+//      Inputs: none
+// -----------------------------------------------------------------------------
+void xspiBenchMemcpy(void)
+{
+	uint8_t *dst = (uint8_t *)(PSRAM_BASE_ADDRESS + PSRAM_SIZE - BENCH_WRITE_SIZE);
+	uint32_t errors = 0;
+	uint32_t start, lib, ext;
+
+	cyclesInit();
+	for(uint32_t i = 0; i < sizeof(copy_src); i++)
+	{
+		copy_src[i] = (uint8_t)((i * 7) + 1);
+	}
+
+	for(uint32_t dst_off = 0; dst_off < sizeof(uint32_t); dst_off++)
+	for(uint32_t src_off = 0; src_off < sizeof(uint32_t); src_off++)
+	for(uint32_t size = 0; size <= BENCH_CHECK_SIZE; size++)
+	{
+		uint8_t *d = dst + BENCH_GUARD + dst_off;
+		uint32_t tail = BENCH_CHECK_SIZE + BENCH_GUARD - dst_off - size;
+
+		memset(dst, BENCH_GUARD_BYTE, BENCH_CHECK_SIZE + (2 * BENCH_GUARD));
+		memCopyExt(d, copy_src + src_off, size);
+		errors += (memcmp(d, copy_src + src_off, size) != 0);
+		errors += checkFill(dst, BENCH_GUARD + dst_off, BENCH_GUARD_BYTE) + checkFill(d + size, tail, BENCH_GUARD_BYTE);
+
+		memSetExt(d, (int)src_off, size);
+		errors += checkFill(d, size, (uint8_t)src_off);
+		errors += checkFill(dst, BENCH_GUARD + dst_off, BENCH_GUARD_BYTE) + checkFill(d + size, tail, BENCH_GUARD_BYTE);
+	}
+	printf("memcheck,%lu" EOL, errors);
+
+	printf("memcpy,dst_off,src_off,newlib_kBps,ext_kBps" EOL);
+	for(uint32_t dst_off = 0; dst_off < sizeof(uint32_t); dst_off++)
+	for(uint32_t src_off = 0; src_off < sizeof(uint32_t); src_off++)
+	{
+		start = cycles();
+		memcpy(dst + dst_off, copy_src + src_off, BENCH_COPY_SIZE);
+		__DSB();
+		lib = cyclesElapsed(start);
+
+		start = cycles();
+		memCopyExt(dst + dst_off, copy_src + src_off, BENCH_COPY_SIZE);
+		__DSB();
+		ext = cyclesElapsed(start);
+
+		printf("memcpy,%lu,%lu,%lu,%lu" EOL, dst_off, src_off, kbps(BENCH_COPY_SIZE, lib), kbps(BENCH_COPY_SIZE, ext));
+	}
+
+	printf("memset,dst_off,newlib_kBps,ext_kBps" EOL);
+	for(uint32_t dst_off = 0; dst_off < sizeof(uint32_t); dst_off++)
+	{
+		start = cycles();
+		memset(dst + dst_off, 0x5A, BENCH_COPY_SIZE);
+		__DSB();
+		lib = cyclesElapsed(start);
+
+		start = cycles();
+		memSetExt(dst + dst_off, 0x5A, BENCH_COPY_SIZE);
+		__DSB();
+		ext = cyclesElapsed(start);
+
+		printf("memset,%lu,%lu,%lu" EOL, dst_off, kbps(BENCH_COPY_SIZE, lib), kbps(BENCH_COPY_SIZE, ext));
+	}
+}
+
+// -----------------------------------------------------------------------------
+// Description: Compares plain and boundary segmented PSRAM copies and fills on
+//              misaligned buffers
+//     Returns: none
+//      Inputs: none
+// -----------------------------------------------------------------------------
+void xspiBenchSegmented(void)
+{
+	uint8_t *src = (uint8_t *)PSRAM_BASE_ADDRESS;
+	uint8_t *dst = (uint8_t *)(PSRAM_BASE_ADDRESS + PSRAM_SIZE - BENCH_WRITE_SIZE);
+	uint32_t start, plain, seg;
+
+	cyclesInit();
+	printf("segcopy,segment,dst_off,src_off,plain_kBps,segmented_kBps" EOL);
+	for(uint32_t d = 0; d < ARRAY_SIZE(seg_offsets); d++)
+	for(uint32_t s = 0; s < ARRAY_SIZE(seg_offsets); s++)
+	{
+		start = cycles();
+		memCopyExt(dst + seg_offsets[d], src + seg_offsets[s], BENCH_SEG_SIZE);
+		__DSB();
+		plain = cyclesElapsed(start);
+
+		start = cycles();
+		PSRAM_Copy(dst + seg_offsets[d], src + seg_offsets[s], BENCH_SEG_SIZE);
+		__DSB();
+		seg = cyclesElapsed(start);
+
+		printf("segcopy,%lu,%lu,%lu,%lu,%lu" EOL, PSRAM_SegmentSize(), seg_offsets[d], seg_offsets[s],
+		       kbps(BENCH_SEG_SIZE, plain), kbps(BENCH_SEG_SIZE, seg));
+	}
+
+	printf("segfill,segment,dst_off,plain_kBps,segmented_kBps" EOL);
+	for(uint32_t d = 0; d < ARRAY_SIZE(seg_offsets); d++)
+	{
+		start = cycles();
+		memSetExt(dst + seg_offsets[d], 0x5A, BENCH_SEG_SIZE);
+		__DSB();
+		plain = cyclesElapsed(start);
+
+		start = cycles();
+		PSRAM_Fill(dst + seg_offsets[d], 0x5A, BENCH_SEG_SIZE);
+		__DSB();
+		seg = cyclesElapsed(start);
+
+		printf("segfill,%lu,%lu,%lu,%lu" EOL, PSRAM_SegmentSize(), seg_offsets[d],
+		       kbps(BENCH_SEG_SIZE, plain), kbps(BENCH_SEG_SIZE, seg));
+	}
+}
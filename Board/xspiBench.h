@@ -0,0 +1,48 @@
+/* SPDX-License-Identifier: Unlicense */
+
+#ifndef XSPIBENCH_H_
+#define XSPIBENCH_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "common.h"
+
+typedef struct
+{
+	uint32_t first_word;        // Mean cycles for a miss on word 0 of a cache line
+	uint32_t last_word;         // Mean cycles for a miss on word 7 of a cache line
+	uint32_t worst;             // Worst single miss observed
+} xspi_miss_latency_t;
+
+typedef struct
+{
+	uint32_t seq_read_kbps;     // Sequential 32-bit reads
+	uint32_t seq_write_kbps;    // Sequential 32-bit writes
+	uint32_t rnd_read_kbps;     // Random 32-bit reads across the whole device
+	uint32_t worst;             // Worst single random read in cycles
+} xspi_bandwidth_t;
+
+typedef struct
+{
+	uint32_t mean;              // Mean cycles of a single uncached read
+	uint32_t stddev;            // Standard deviation (jitter) in cycles
+	uint32_t min;
+	uint32_t max;
+} xspi_jitter_t;
+
+void xspiBenchMissLatency(uint32_t base, xspi_miss_latency_t *result);
+void xspiBenchBandwidth(uint32_t base, uint32_t size, xspi_bandwidth_t *result);
+void xspiBenchWrap(void);
+void xspiBenchJitter(uint32_t base, uint32_t size, xspi_jitter_t *result);
+void xspiBenchTune(void);
+void xspiBenchLatency(void);
+void xspiBenchMemcpy(void);
+void xspiBenchSegmented(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // XSPIBENCH_H_
@@ -23,7 +23,8 @@
 #include <string.h>
 
 /* USER CODE BEGIN Includes */
-
+#include "bootSlot.h"
+#include "timeline.h"
 /* USER CODE END Includes */
 
 /* USER CODE BEGIN PV */
@@ -73,6 +74,10 @@ void MX_EXTMEM_MANAGER_Init(void)
   EXTMEM_Init(EXTMEMORY_1, HAL_RCCEx_GetPeriphCLKFreq(RCC_PERIPHCLK_XSPI2));
 
   /* USER CODE BEGIN MX_EXTMEM_Init_PostTreatment */
+  timelineMark(TL_EXTMEM);
+  /* Pick the A/B slot while the NOR is still in indirect mode */
+  bootSlotSelect();
   EXTMEM_MemoryMappedMode(EXT_MEMORY_NOR_FLASH, EXTMEM_ENABLE);
+  timelineMark(TL_SLOT);
   /* USER CODE END MX_EXTMEM_Init_PostTreatment */
 }
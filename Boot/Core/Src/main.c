@@ -24,16 +24,48 @@
 /* USER CODE BEGIN Includes */
 #include "common.h"
 #include "psram.h"
+#include "nor.h"
+#include "xspiBench.h"
+#include "memTest.h"
 #include "userLeds.h"
+#include "bootLoad.h"
+#include "bootVerify.h"
+#include "bootSlot.h"
+#include "timeline.h"
+#include "bootHandoff.h"
+#include "bootUpdate.h"
+#include "pcSample.h"
+#include "timerWheel.h"
+#include "logSink.h"
+#include "dlog.h"
+#include "traceRing.h"
 /* USER CODE END Includes */
 
 /* Private typedef -----------------------------------------------------------*/
 /* USER CODE BEGIN PTD */
-#define RAM_TEST_SIZE 16384
 /* USER CODE END PTD */
 
 /* Private define ------------------------------------------------------------*/
 /* USER CODE BEGIN PD */
+/* Set to 1 to print the XSPI benchmarks before jumping to the application */
+#ifndef RUN_XSPI_BENCH
+#define RUN_XSPI_BENCH 0
+#endif
+
+/* Set to 1 to test and benchmark PSRAM and internal RAMs before jumping to the application */
+#ifndef RUN_MEM_TEST
+#define RUN_MEM_TEST 0
+#endif
+
+/* Set to 1 to check the HASH peripheral and the software SHA-256 against known answers */
+#ifndef RUN_VERIFY_TEST
+#define RUN_VERIFY_TEST 0
+#endif
+
+/* Set to a rate in Hz to PC-sample the boot up to the jump, for Tools/pcsample.py */
+#ifndef RUN_PC_SAMPLE
+#define RUN_PC_SAMPLE 0
+#endif
 
 /* USER CODE END PD */
 
@@ -67,6 +99,34 @@ static void MX_XSPI1_Init(void);
 
 /* Private user code ---------------------------------------------------------*/
 /* USER CODE BEGIN 0 */
+/**
+  * @brief  Blink timer callback: toggles the user LED
+  * @param  arg: unused
+  * @retval None
+  */
+static void BlinkLed(void *arg)
+{
+  static bool on;
+
+  (void)arg;
+  on = !on;
+  userLedSet(USER_LED_1, on);
+}
+
+/**
+  * @brief  Wait for an image over UART4 when there is nothing to start
+  * @note   Does not return: the system resets once a slot is written
+  * @param  None
+  * @retval None
+  */
+static void AwaitUpdate(void)
+{
+  printf("Update: no image to start, waiting for Tools/fwupdate.py..." EOL);
+  while (1)
+  {
+    bootUpdate(0);
+  }
+}
 
 /* USER CODE END 0 */
 
@@ -78,26 +138,35 @@ int main(void)
 {
 
   /* USER CODE BEGIN 1 */
-
+  timelineStart();
+  traceRingInit();
   /* USER CODE END 1 */
 
   /* MPU Configuration--------------------------------------------------------*/
   MPU_Config();
 
+  /* Enable the CPU Cache */
+
+  /* Enable I-Cache---------------------------------------------------------*/
+  SCB_EnableICache();
+
+  /* Enable D-Cache---------------------------------------------------------*/
+  SCB_EnableDCache();
+
   /* MCU Configuration--------------------------------------------------------*/
 
   /* Reset of all peripherals, Initializes the Flash interface and the Systick. */
   HAL_Init();
 
   /* USER CODE BEGIN Init */
-
+  timelineMark(TL_HAL_INIT);
   /* USER CODE END Init */
 
   /* Configure the system clock */
   SystemClock_Config();
 
   /* USER CODE BEGIN SysInit */
-
+  timelineMark(TL_CLOCK);
   /* USER CODE END SysInit */
 
   /* Initialize all configured peripherals */
@@ -116,25 +185,91 @@ int main(void)
   printf("==========================" EOL);
   printf("XSPI: Flash Initialized..." EOL);
   printf("XSPI: PSRAM Initialized..." EOL);
+  bootSlotReport();
+  traceRingReport();
+  timelineMark(TL_BANNER);
+#if RUN_PC_SAMPLE
+  pcSampleStart(RUN_PC_SAMPLE);
+#endif
+
+#if RUN_VERIFY_TEST
+  if (!bootVerifySelfTest())
+  {
+    Error_Handler();
+  }
+#endif
+
+  /* Hash the NOR image in the background while the PSRAM comes up */
+  bootLoadVerifyStart();
   PSRAM_Init();
+  timelineMark(TL_PSRAM);
+
+  if (NOR_BURST_MODE_DEFAULT != NOR_BURST_LINEAR)
+  {
+    /* Leaves memory mapped mode for a moment, the image hash must be done with the NOR */
+    bootVerifyWait();
+    if (NOR_SetBurstMode(NOR_BURST_MODE_DEFAULT) != HAL_OK)
+    {
+      Error_Handler();
+    }
+  }
+
+  /* Firmware update over UART4, when the app reset into the bootloader for one */
+  if (bootUpdateRequested())
+  {
+    printf("Update: waiting for Tools/fwupdate.py..." EOL);
+    bootUpdate(BOOT_UPDATE_WAIT_MS);
+  }
+
+#if RUN_XSPI_BENCH
+  bootVerifyWait();
+  xspiBenchWrap();
+  xspiBenchTune();
+  xspiBenchLatency();
+  xspiBenchMemcpy();
+  xspiBenchSegmented();
+#endif
+
+#if RUN_MEM_TEST
+  if (memTestReport() != 0)
+  {
+    Error_Handler();
+  }
+#endif
+
+#if RUN_PC_SAMPLE
+  pcSampleStop();
+  pcSampleFlush();
+#endif
+
+  /* Describe the clocks, XSPI and UART setup for the app to attach to */
+  bootHandoffPublish();
 
-  
   /* USER CODE END 2 */
 
-  /* Launch the application */
+  /* Launch the application: load-and-run if the NOR holds a packed image, XIP otherwise */
+  if (BOOT_LOAD_NO_IMAGE != bootLoadApplication())
+  {
+    AwaitUpdate();
+  }
+  timelineMark(TL_JUMP);
+  TRACE(TRACE_JUMP, 0);
+  logSinkFlush();
   if (BOOT_OK != BOOT_Application())
   {
-    Error_Handler();
+    AwaitUpdate();
   }
   /* Infinite loop */
   /* USER CODE BEGIN WHILE */
+  static soft_timer_t blink;
+
+  timerWheelInit();
+  timerWheelStart(&blink, msToTicks(250), msToTicks(250), BlinkLed, NULL);
   while (1)
   {
-    ticksDelay(msToTicks(250));
-    userLedSet(USER_LED_1, true);
-    ticksDelay(msToTicks(250));
-    userLedSet(USER_LED_1, false);
-   
+    /* Sleep between the timer interrupts */
+    timerWheelIdle();
+
     /* USER CODE END WHILE */
 
     /* USER CODE BEGIN 3 */
@@ -224,7 +359,7 @@ static void MX_SBS_Init(void)
 
   /* USER CODE END SBS_Init 1 */
   /* USER CODE BEGIN SBS_Init 2 */
-
+  timelineMark(TL_SBS);
   /* USER CODE END SBS_Init 2 */
 
 }
@@ -245,7 +380,7 @@ static void MX_UART4_Init(void)
 
   /* USER CODE END UART4_Init 1 */
   huart4.Instance = UART4;
-  huart4.Init.BaudRate = 115200;
+  huart4.Init.BaudRate = 2000000;
   huart4.Init.WordLength = UART_WORDLENGTH_8B;
   huart4.Init.StopBits = UART_STOPBITS_1;
   huart4.Init.Parity = UART_PARITY_NONE;
@@ -267,12 +402,14 @@ static void MX_UART4_Init(void)
   {
     Error_Handler();
   }
-  if (HAL_UARTEx_DisableFifoMode(&huart4) != HAL_OK)
+  if (HAL_UARTEx_EnableFifoMode(&huart4) != HAL_OK)
   {
     Error_Handler();
   }
   /* USER CODE BEGIN UART4_Init 2 */
-
+  timelineMark(TL_UART);
+  logSinkInit();
+  dlogInit();
   /* USER CODE END UART4_Init 2 */
 
 }
@@ -322,7 +459,7 @@ static void MX_XSPI1_Init(void)
     Error_Handler();
   }
   /* USER CODE BEGIN XSPI1_Init 2 */
-
+  timelineMark(TL_XSPI1);
   /* USER CODE END XSPI1_Init 2 */
 
 }
@@ -372,7 +509,7 @@ static void MX_XSPI2_Init(void)
     Error_Handler();
   }
   /* USER CODE BEGIN XSPI2_Init 2 */
-  
+  timelineMark(TL_XSPI2);
   /* USER CODE END XSPI2_Init 2 */
 
 }
@@ -429,6 +566,7 @@ static void MX_GPIO_Init(void)
 
 static void MPU_Config(void)
 {
+  MPU_Region_InitTypeDef MPU_InitStruct = {0};
 
   /* Disables the MPU */
   HAL_MPU_Disable();
@@ -438,6 +576,72 @@ static void MPU_Config(void)
   {
     HAL_MPU_DisableRegion(i);
   }
+
+  /** Initializes and configures the Region and the memory to be protected
+  */
+  MPU_InitStruct.Enable = MPU_REGION_ENABLE;
+  MPU_InitStruct.Number = MPU_REGION_NUMBER0;
+  MPU_InitStruct.BaseAddress = 0x0;
+  MPU_InitStruct.Size = MPU_REGION_SIZE_4GB;
+  MPU_InitStruct.SubRegionDisable = 0x87;
+  MPU_InitStruct.TypeExtField = MPU_TEX_LEVEL0;
+  MPU_InitStruct.AccessPermission = MPU_REGION_NO_ACCESS;
+  MPU_InitStruct.DisableExec = MPU_INSTRUCTION_ACCESS_DISABLE;
+  MPU_InitStruct.IsShareable = MPU_ACCESS_SHAREABLE;
+  MPU_InitStruct.IsCacheable = MPU_ACCESS_NOT_CACHEABLE;
+  MPU_InitStruct.IsBufferable = MPU_ACCESS_NOT_BUFFERABLE;
+
+  HAL_MPU_ConfigRegion(&MPU_InitStruct);
+
+  /** Initializes and configures the Region and the memory to be protected
+  */
+  MPU_InitStruct.Number = MPU_REGION_NUMBER1;
+  MPU_InitStruct.BaseAddress = 0x90000000;
+  MPU_InitStruct.Size = MPU_REGION_SIZE_32MB;
+  MPU_InitStruct.SubRegionDisable = 0x0;
+  MPU_InitStruct.AccessPermission = MPU_REGION_FULL_ACCESS;
+  MPU_InitStruct.DisableExec = MPU_INSTRUCTION_ACCESS_ENABLE;
+  MPU_InitStruct.IsCacheable = MPU_ACCESS_CACHEABLE;
+  MPU_InitStruct.IsBufferable = MPU_ACCESS_BUFFERABLE;
+
+  HAL_MPU_ConfigRegion(&MPU_InitStruct);
+
+  /** Initializes and configures the Region and the memory to be protected
+  */
+  MPU_InitStruct.Number = MPU_REGION_NUMBER2;
+  MPU_InitStruct.BaseAddress = 0x70000000;
+  MPU_InitStruct.Size = MPU_REGION_SIZE_128MB;
+
+  HAL_MPU_ConfigRegion(&MPU_InitStruct);
+
+  /** Initializes and configures the Region and the memory to be protected
+  */
+  MPU_InitStruct.Number = MPU_REGION_NUMBER3;
+  MPU_InitStruct.BaseAddress = 0x24000000;
+  MPU_InitStruct.Size = MPU_REGION_SIZE_512KB;
+
+  HAL_MPU_ConfigRegion(&MPU_InitStruct);
+
+  /** Initializes and configures the Region and the memory to be protected
+  */
+  MPU_InitStruct.Number = MPU_REGION_NUMBER4;
+  MPU_InitStruct.BaseAddress = 0x24071C00;
+  MPU_InitStruct.Size = MPU_REGION_SIZE_1KB;
+  MPU_InitStruct.DisableExec = MPU_INSTRUCTION_ACCESS_DISABLE;
+  MPU_InitStruct.IsShareable = MPU_ACCESS_NOT_SHAREABLE;
+  MPU_InitStruct.IsCacheable = MPU_ACCESS_NOT_CACHEABLE;
+  MPU_InitStruct.IsBufferable = MPU_ACCESS_NOT_BUFFERABLE;
+
+  HAL_MPU_ConfigRegion(&MPU_InitStruct);
+
+  /** Initializes and configures the Region and the memory to be protected
+  */
+  MPU_InitStruct.Number = MPU_REGION_NUMBER5;
+  MPU_InitStruct.BaseAddress = 0x38800000;
+  MPU_InitStruct.Size = MPU_REGION_SIZE_4KB;
+  MPU_InitStruct.TypeExtField = MPU_TEX_LEVEL1;
+
+  HAL_MPU_ConfigRegion(&MPU_InitStruct);
   /* Enables the MPU */
   HAL_MPU_Enable(MPU_PRIVILEGED_DEFAULT);
 
@@ -451,6 +655,7 @@ void Error_Handler(void)
 {
   /* USER CODE BEGIN Error_Handler_Debug */
   /* User can add his own implementation to report the HAL error return state */
+  logSinkFlush();
   __disable_irq();
   while (1)
   {
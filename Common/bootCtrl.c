@@ -0,0 +1,226 @@
+/* SPDX-License-Identifier: Unlicense */
+
+// -----------------------------------------------------------------------------
+// IMPLEMENTATION NOTES
+//
+// App side of the A/B boot-control record (Board/bootSlot.c). On a trial boot
+// bootCtrlConfirm() clears the confirmed field of the record the bootloader
+// booted from, in the NOR, so the confirmation survives a power cycle: the
+// backup registers do not without VBAT.
+//
+// The app runs from the NOR it programs, so the program runs from RAM
+// (.RamFunc, copied with .data) with interrupts masked: memory mapped mode is
+// aborted, write enable / page program / status polling are sent as indirect
+// commands, and the saved read command puts XSPI2 back in memory mapped mode.
+// The commands come from the SFDP parameters the bootloader left in the
+// handoff record (Common/handoff.c); the line modes and the command extension
+// are those of the memory mapped read. Nothing outside the RAM function may
+// run in between, so its helpers are forced inline and the waits are bounded
+// loops rather than calls to HAL_GetTick().
+//
+// Without the handoff record, or if the program fails, the backup register is
+// written instead and the bootloader clears the field on the next reset, as
+// long as the power stays.
+//
+// -----------------------------------------------------------------------------
+
+#include "bootCtrl.h"
+#include "handoff.h"
+
+#define BOOT_CTRL_RAMFUNC       __attribute__((section(".RamFunc"), noinline))
+#define BOOT_CTRL_INLINE        static inline __attribute__((always_inline))
+
+#define BOOT_CTRL_XSPI          XSPI2
+#define BOOT_CTRL_NOR_TIMEOUT   10000000UL      // Polls, well above a page program
+#define BOOT_CTRL_NOR_POLL      0x10            // XSPI clocks between status reads
+#define BOOT_CTRL_XSPI_FLAGS    (XSPI_FCR_CTEF | XSPI_FCR_CTCF | XSPI_FCR_CSMF | XSPI_FCR_CTOF)
+
+typedef struct
+{
+	uint32_t program_cmd;
+	uint32_t write_enable_cmd;
+	uint32_t read_status_cmd;
+	uint8_t wip_mask;
+	uint8_t wip_ready;
+	uint8_t status_dummy;
+} boot_ctrl_nor_t;
+
+// -----------------------------------------------------------------------------
+// Description: Formats a command like the memory mapped read: 8 bits, or 16
+//              bits with the command extension (same or inverted command)
+//     Returns: Instruction register value
+//      Inputs: Mapped read CCR, mapped read IR, command
+// -----------------------------------------------------------------------------
+static uint32_t norInstruction(uint32_t ccr, uint32_t ir, uint8_t cmd)
+{
+	if((ccr & XSPI_CCR_ISIZE) == 0)
+	{
+		return cmd;
+	}
+	return ((uint32_t)cmd << 8) | ((((ir >> 8) ^ ir) & 0xFF) == 0xFF ? (uint8_t)~cmd : cmd);
+}
+
+BOOT_CTRL_INLINE bool norWait(XSPI_TypeDef *xspi, uint32_t flag)
+{
+	for(uint32_t n = 0; n < BOOT_CTRL_NOR_TIMEOUT; n++)
+	{
+		uint32_t sr = xspi->SR;
+
+		if(sr & XSPI_SR_TEF)
+		{
+			return false;
+		}
+		if(sr & flag)
+		{
+			xspi->FCR = flag;
+			return true;
+		}
+	}
+	return false;
+}
+
+BOOT_CTRL_INLINE void norIdle(XSPI_TypeDef *xspi)
+{
+	for(uint32_t n = 0; (n < BOOT_CTRL_NOR_TIMEOUT) && (xspi->SR & XSPI_SR_BUSY); n++)
+	{
+	}
+}
+
+// -----------------------------------------------------------------------------
+// Description: Programs a halfword of the NOR and waits for the write to end,
+//              leaving and then restoring memory mapped mode. Runs from RAM,
+//              interrupts masked by the caller.
+//     Returns: true if the page program completed
+//      Inputs: Commands, NOR offset (even), value
+// -----------------------------------------------------------------------------
+static BOOT_CTRL_RAMFUNC bool bootCtrlNorProgram(const boot_ctrl_nor_t *nor, uint32_t offset, uint16_t value)
+{
+	XSPI_TypeDef *xspi = BOOT_CTRL_XSPI;
+	uint32_t cr, ccr, tcr, ir, inst, addr, data;
+	bool ok;
+
+	xspi->CR |= XSPI_CR_ABORT;
+	for(uint32_t n = 0; (n < BOOT_CTRL_NOR_TIMEOUT) && (xspi->CR & XSPI_CR_ABORT); n++)
+	{
+	}
+	norIdle(xspi);
+	cr = xspi->CR;
+	ccr = xspi->CCR;
+	tcr = xspi->TCR;
+	ir = xspi->IR;
+	inst = ccr & (XSPI_CCR_IMODE | XSPI_CCR_IDTR | XSPI_CCR_ISIZE);
+	addr = ccr & (XSPI_CCR_ADMODE | XSPI_CCR_ADDTR | XSPI_CCR_ADSIZE);
+	data = ccr & (XSPI_CCR_DMODE | XSPI_CCR_DDTR);
+	xspi->FCR = BOOT_CTRL_XSPI_FLAGS;
+
+	// Write enable: instruction only, starts on the IR write
+	xspi->CR = cr & ~(XSPI_CR_FMODE | XSPI_CR_APMS);
+	xspi->CCR = inst;
+	xspi->TCR = tcr & ~XSPI_TCR_DCYC;
+	xspi->IR = nor->write_enable_cmd;
+	ok = norWait(xspi, XSPI_SR_TCF);
+
+	// Page program: starts on the data write
+	if(ok)
+	{
+		xspi->DLR = sizeof(value) - 1;
+		xspi->CCR = inst | addr | data;
+		xspi->IR = nor->program_cmd;
+		xspi->AR = offset;
+		*(volatile uint16_t *)&xspi->DR = value;
+		ok = norWait(xspi, XSPI_SR_TCF);
+	}
+
+	// Automatic polling of the write in progress bit, as the SFDP driver does it:
+	// status register address 0 on 8 lines, no address or dummy cycles on 1
+	if(ok)
+	{
+		bool single = (inst & XSPI_CCR_IMODE) == XSPI_CCR_IMODE_0;
+
+		norIdle(xspi);
+		xspi->PSMKR = nor->wip_mask;
+		xspi->PSMAR = nor->wip_ready;
+		xspi->PIR = BOOT_CTRL_NOR_POLL;
+		xspi->DLR = 0;
+		xspi->CR = (cr & ~XSPI_CR_FMODE) | XSPI_CR_FMODE_1 | XSPI_CR_APMS;
+		xspi->CCR = inst | (single ? XSPI_CCR_DMODE_0 : (addr | data));
+		xspi->TCR = (tcr & ~XSPI_TCR_DCYC) | (single ? 0 : nor->status_dummy);
+		xspi->IR = nor->read_status_cmd;
+		if(!single)
+		{
+			xspi->AR = 0;
+		}
+		ok = norWait(xspi, XSPI_SR_SMF);
+	}
+
+	if(!ok)
+	{
+		xspi->CR |= XSPI_CR_ABORT;
+		for(uint32_t n = 0; (n < BOOT_CTRL_NOR_TIMEOUT) && (xspi->CR & XSPI_CR_ABORT); n++)
+		{
+		}
+	}
+	norIdle(xspi);
+	xspi->FCR = BOOT_CTRL_XSPI_FLAGS;
+	xspi->CCR = ccr;
+	xspi->TCR = tcr;
+	xspi->IR = ir;
+	xspi->CR = cr;
+	__DSB();
+	__ISB();
+	return ok;
+}
+
+// -----------------------------------------------------------------------------
+// Description: Tells the bootloader the running slot works: on a trial boot,
+//              clears the confirmed field of the boot-control record in the
+//              NOR, or failing that sets the backup register the bootloader
+//              checks on the next reset
+//     Returns: true once the confirmation is in the NOR (or nothing was on
+//              trial), false if it only lasts while the power stays
+//      Inputs: none
+// -----------------------------------------------------------------------------
+bool bootCtrlConfirm(void)
+{
+	const handoff_t *h = handoffGet();
+	uint32_t running, offset, primask;
+	boot_ctrl_nor_t nor;
+	bool ok;
+
+	RCC->APB4ENR |= RCC_APB4ENR_RTCAPBEN;
+	PWR->CR1 |= PWR_CR1_DBP;
+	running = BOOT_CTRL_RUNNING;
+	if(!(running & BOOT_CTRL_TRIAL))
+	{
+		return true;
+	}
+	BOOT_CTRL_CONFIRM = BOOT_CTRL_CONFIRM_MAGIC;
+
+	if((h == NULL) || !(h->flags & HANDOFF_NOR_MAPPED) || (h->nor.program_cmd == 0) ||
+	   (h->nor.write_enable_cmd == 0) || (h->nor.read_status_cmd == 0) ||
+	   ((BOOT_CTRL_XSPI->CR & XSPI_CR_FMODE) != XSPI_CR_FMODE))
+	{
+		return false;
+	}
+	nor.program_cmd = norInstruction(h->nor.xspi.ccr, h->nor.xspi.ir, h->nor.program_cmd);
+	nor.write_enable_cmd = norInstruction(h->nor.xspi.ccr, h->nor.xspi.ir, h->nor.write_enable_cmd);
+	nor.read_status_cmd = norInstruction(h->nor.xspi.ccr, h->nor.xspi.ir, h->nor.read_status_cmd);
+	nor.wip_mask = 1U << h->nor.wip_position;
+	nor.wip_ready = h->nor.wip_busy_polarity << h->nor.wip_position;
+	nor.status_dummy = h->nor.dummy_cycles;
+	offset = BOOT_CTRL_RECORD_OFFSET((running & BOOT_CTRL_RECORD) ? 1 : 0) + offsetof(boot_ctrl_t, confirmed);
+
+	primask = __get_PRIMASK();
+	__disable_irq();
+	ok = bootCtrlNorProgram(&nor, offset, 0);
+	__set_PRIMASK(primask);
+
+	SCB_InvalidateDCache_by_Addr((void *)(h->nor.xspi.base + offset), sizeof(uint16_t));
+	ok = ok && (*(volatile uint16_t *)(h->nor.xspi.base + offset) == 0);
+	if(ok)
+	{
+		BOOT_CTRL_CONFIRM = 0;
+		BOOT_CTRL_RUNNING = running & ~BOOT_CTRL_TRIAL;
+	}
+	return ok;
+}
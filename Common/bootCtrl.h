@@ -0,0 +1,91 @@
+/* SPDX-License-Identifier: Unlicense */
+
+#ifndef BOOTCTRL_H_
+#define BOOTCTRL_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// -----------------------------------------------------------------------------
+// Includes
+// -----------------------------------------------------------------------------
+#include "common.h"
+#include "stm32.h"
+
+// -----------------------------------------------------------------------------
+// Constants
+// -----------------------------------------------------------------------------
+// A/B layout of the 128 MB NOR, offsets from its base. Slot A is the plain
+// EXTMEM_XIP_IMAGE_OFFSET image; the two boot-control records take the last
+// 64 KB sector of each half, after each slot.
+#define BOOT_SLOT_A                 0
+#define BOOT_SLOT_B                 1
+#define BOOT_SLOT_B_OFFSET          0x04000000UL
+#define BOOT_SLOT_SIZE              0x03FF0000UL
+#define BOOT_CTRL_OFFSET            0x03FF0000UL    // Record 0
+#define BOOT_CTRL_SECTOR            0x00010000UL
+#define BOOT_CTRL_RECORDS           2
+#define BOOT_CTRL_RECORD_OFFSET(i)  (BOOT_CTRL_OFFSET + ((i) * BOOT_SLOT_B_OFFSET))
+
+#define BOOT_CTRL_MAGIC             0x4C544342UL    // "BCTL"
+#define BOOT_CTRL_ATTEMPTS_MAX      16              // Bits in attempts
+
+// Backup registers shared with the bootloader, kept across a system reset
+#define BOOT_CTRL_CONFIRM_MAGIC     0xC0F1A8EDUL
+#define BOOT_CTRL_CONFIRM           (TAMP->BKP0R)   // Written by the app when it could not confirm in the NOR
+#define BOOT_CTRL_RUNNING           (TAMP->BKP1R)   // Written by the bootloader: slot | BOOT_CTRL_TRIAL | BOOT_CTRL_RECORD
+#define BOOT_CTRL_TRIAL             BIT(8)
+#define BOOT_CTRL_RECORD            BIT(9)          // Booted from record 1
+
+// -----------------------------------------------------------------------------
+// Types
+// -----------------------------------------------------------------------------
+// Boot-control record, one per BOOT_CTRL_RECORD_OFFSET() sector; the valid one
+// with the highest sequence (modulo 2^16) is current. The updater erases the
+// other sector and programs a new record there with attempts and confirmed
+// still erased (all ones) for a trial, or confirmed 0 for a permanent switch,
+// so a power loss leaves the current record in place. From then on only bits
+// are cleared, which NOR programs without an erase: one attempts bit per trial
+// boot by the bootloader, and confirmed by the app (bootCtrlConfirm()). Only
+// the first 8 bytes are covered by the CRC, since the last two fields change
+// in place.
+typedef struct
+{
+	uint32_t magic;             // BOOT_CTRL_MAGIC
+	uint8_t active;             // Slot to boot
+	uint8_t fallback;           // Slot to return to when the trial runs out of attempts
+	uint16_t sequence;          // Bumped by every update
+	uint32_t crc;               // CRC-32 of the fields above
+	uint16_t attempts;          // Trial boots left, one bit each
+	uint16_t confirmed;         // 0xFFFF on trial, 0 once confirmed
+} boot_ctrl_t;
+
+// -----------------------------------------------------------------------------
+// Public Functions
+// -----------------------------------------------------------------------------
+bool bootCtrlConfirm(void);
+
+//------------------------------------------------------------------------------
+// Description: Provides the slot the bootloader started
+//     Returns: BOOT_SLOT_A or BOOT_SLOT_B
+//      Inputs: On trial storage, may be NULL
+//------------------------------------------------------------------------------
+static inline uint32_t bootCtrlRunningSlot(bool *trial)
+{
+	uint32_t running;
+
+	RCC->APB4ENR |= RCC_APB4ENR_RTCAPBEN;
+	running = BOOT_CTRL_RUNNING;
+	if(trial != NULL)
+	{
+		*trial = (running & BOOT_CTRL_TRIAL) != 0;
+	}
+	return running & 1;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // BOOTCTRL_H_
@@ -0,0 +1,50 @@
+/* SPDX-License-Identifier: Unlicense */
+
+#ifndef CRC32_H_
+#define CRC32_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// -----------------------------------------------------------------------------
+// Includes
+// -----------------------------------------------------------------------------
+#include "common.h"
+
+// -----------------------------------------------------------------------------
+// Constants
+// -----------------------------------------------------------------------------
+#define CRC32_POLY                  0xEDB88320UL
+
+// -----------------------------------------------------------------------------
+// Public Functions
+// -----------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+// Description: Continues a CRC-32 (zlib crc32(), start from 0) bit by bit, for
+//              the small records sent to the host tools
+//     Returns: Updated CRC
+//      Inputs: CRC so far, data, size
+//------------------------------------------------------------------------------
+static inline uint32_t crc32Update(uint32_t crc, const void *data, uint32_t size)
+{
+	const uint8_t *p = data;
+
+	crc = ~crc;
+	while(size--)
+	{
+		crc ^= *p++;
+		for(uint32_t b = 0; b < 8; b++)
+		{
+			crc = (crc & 1) ? (crc >> 1) ^ CRC32_POLY : crc >> 1;
+		}
+	}
+	return ~crc;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // CRC32_H_
@@ -0,0 +1,60 @@
+/* SPDX-License-Identifier: Unlicense */
+
+#ifndef CYCLES_H_
+#define CYCLES_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// -----------------------------------------------------------------------------
+// Includes
+// -----------------------------------------------------------------------------
+#include "common.h"
+#include "stm32.h"
+
+// -----------------------------------------------------------------------------
+// Public Functions
+// -----------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+// Description: Enables the DWT cycle counter (safe to call more than once)
+//     Returns: none
+//      Inputs: none
+//------------------------------------------------------------------------------
+static inline void cyclesInit(void)
+{
+	CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+	DWT->LAR = 0xC5ACCE55;
+	if(!(DWT->CTRL & DWT_CTRL_CYCCNTENA_Msk))
+	{
+		DWT->CYCCNT = 0;
+		DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+	}
+}
+
+//------------------------------------------------------------------------------
+// Description: Provides the raw CPU cycle count (wraps every 2^32 cycles)
+//     Returns: See above
+//      Inputs: none
+//------------------------------------------------------------------------------
+static inline uint32_t cycles(void)
+{
+	return DWT->CYCCNT;
+}
+
+//------------------------------------------------------------------------------
+// Description: Provides the # of cycles that have elapsed w.r.t. a previous count
+//     Returns: See above
+//      Inputs: The previous cycle count in question
+//------------------------------------------------------------------------------
+static inline uint32_t cyclesElapsed(uint32_t then)
+{
+	return DWT->CYCCNT - then;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // CYCLES_H_
@@ -1,9 +1,17 @@
 /* SPDX-License-Identifier: Unlicense */
 #include "common.h"
+#include "logSink.h"
 
 int __io_putchar(int ch)
 {
     uint8_t c = ch & 0xFF;
-    HAL_UART_Transmit(&huart4, &c, 1, HAL_MAX_DELAY);
+    logSinkWrite(&c, 1);
     return ch;
-}
\ No newline at end of file
+}
+
+// Whole buffers at once, rather than the byte at a time of the weak one in syscalls.c
+int _write(int file, char *ptr, int len)
+{
+    (void)file;
+    return (int)logSinkWrite(ptr, (uint32_t)len);
+}
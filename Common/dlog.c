@@ -0,0 +1,133 @@
+/* SPDX-License-Identifier: Unlicense */
+
+// -----------------------------------------------------------------------------
+// IMPLEMENTATION NOTES
+//
+// Deferred logging: DLOG("adc,%u,%d", raw, offset) formats nothing on the
+// target. The format string goes to the .dlog section, which the linker
+// scripts keep in the ELF at address 0 without loading it, so its address is
+// an id that costs no flash. The record sent is that id, the DWT cycle count
+// and the raw argument words: a dozen stores and a copy to the log sink
+// (Common/logSink.c), a few hundred cycles where printf() takes thousands.
+// Tools/dlog.py formats the records with the strings of the ELF and prints
+// them among the console text.
+//
+// Records go through logSinkTryWrite(), which never waits: a record that
+// does not fit is dropped (and counted in the sink statistics) rather than
+// stalling the interrupt handler that logs it. They are self-delimited in the
+// text output by a start byte that ASCII text never has, and a check byte.
+//
+// dlogInit() sends a sync record with the vector table address, which tells
+// the host which ELF the following ids belong to (Boot or Appli), and the core
+// clock for the timestamps. Its id, DLOG_ID_SYNC, is the one 16-bit value no
+// format string may have: the linker scripts assert that the .dlog section
+// ends below it, and dlogWrite() drops a record that would claim it anyway
+// (a format string not in .dlog), as the host would take it for a sync. The
+// cycle count wraps every 7 s at 600 MHz; the host unwraps it assuming records
+// come closer together than that.
+//
+// -----------------------------------------------------------------------------
+
+#include "dlog.h"
+#include "cycles.h"
+#include "logSink.h"
+#include "stm32.h"
+
+#define BENCH_RUNS              32
+
+// The linker scripts assert SIZEOF(.dlog) < 0xFFFF
+_Static_assert(DLOG_ID_SYNC == 0xFFFFU, "DLOG_ID_SYNC out of step with the .dlog ASSERT of the linker scripts");
+
+// -----------------------------------------------------------------------------
+// Description: Sends one record, sync included
+//     Returns: none
+//      Inputs: Record id, argument words, their number
+// -----------------------------------------------------------------------------
+static void dlogSend(uint32_t id, const uint32_t *args, uint32_t count)
+{
+	uint32_t record[2 + DLOG_ARGS_MAX + 1];
+	uint32_t check;
+
+	record[0] = DLOG_START | (count << 8) | (id << 16);
+	record[1] = cycles();
+	check = record[0] ^ record[1];
+	for(uint32_t i = 0; i < count; i++)
+	{
+		record[2 + i] = args[i];
+		check ^= args[i];
+	}
+	check ^= check >> 16;
+	check ^= check >> 8;
+	((uint8_t *)record)[8 + 4 * count] = (uint8_t)check;
+	logSinkTryWrite(record, DLOG_RECORD_SIZE(count));
+}
+
+// -----------------------------------------------------------------------------
+// Description: Sends one record, for DLOG(). An id from DLOG_ID_SYNC up is not
+//              a .dlog offset and is dropped.
+//     Returns: none
+//      Inputs: Format string id, argument words, their number
+// -----------------------------------------------------------------------------
+void dlogWrite(uint32_t id, const uint32_t *args, uint32_t count)
+{
+	assert(id < DLOG_ID_SYNC);
+	if(id >= DLOG_ID_SYNC)
+	{
+		return;
+	}
+	dlogSend(id, args, count);
+}
+
+// -----------------------------------------------------------------------------
+// Description: Starts the cycle counter and sends the sync record
+//     Returns: none
+//      Inputs: none
+// -----------------------------------------------------------------------------
+void dlogInit(void)
+{
+	const uint32_t sync[] = {SCB->VTOR, SystemCoreClock};
+
+	cyclesInit();
+	dlogSend(DLOG_ID_SYNC, sync, ARRAYSIZE(sync));
+}
+
+// -----------------------------------------------------------------------------
+// Description: Compares the cost of a DLOG() with formatting the same message
+//     Returns: none
+//      Inputs: none
+// -----------------------------------------------------------------------------
+void dlogBench(void)
+{
+	char text[64];
+	uint32_t t0, dlog0, dlog3, printf3;
+
+	logSinkFlush();
+	t0 = cycles();
+	for(uint32_t i = 0; i < BENCH_RUNS; i++)
+	{
+		DLOG("dlog,bench");
+	}
+	dlog0 = cyclesElapsed(t0) / BENCH_RUNS;
+	logSinkFlush();
+
+	t0 = cycles();
+	for(uint32_t i = 0; i < BENCH_RUNS; i++)
+	{
+		DLOG("dlog,bench,%lu,%ld,0x%08lX", i, -(int32_t)i, t0);
+	}
+	dlog3 = cyclesElapsed(t0) / BENCH_RUNS;
+	logSinkFlush();
+
+	t0 = cycles();
+	for(uint32_t i = 0; i < BENCH_RUNS; i++)
+	{
+		int n = snprintf(text, sizeof(text), "dlog,bench,%lu,%ld,0x%08lX" EOL, i, -(int32_t)i, t0);
+
+		logSinkTryWrite(text, (uint32_t)n);
+	}
+	printf3 = cyclesElapsed(t0) / BENCH_RUNS;
+	logSinkFlush();
+
+	printf("dlog,runs,dlog0_cycles,dlog3_cycles,printf3_cycles" EOL);
+	printf("dlog,%u,%lu,%lu,%lu" EOL, BENCH_RUNS, dlog0, dlog3, printf3);
+}
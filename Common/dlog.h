@@ -0,0 +1,80 @@
+/* SPDX-License-Identifier: Unlicense */
+
+#ifndef DLOG_H_
+#define DLOG_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// -----------------------------------------------------------------------------
+// Includes
+// -----------------------------------------------------------------------------
+#include "common.h"
+
+// -----------------------------------------------------------------------------
+// Constants
+// -----------------------------------------------------------------------------
+// Set to 0 to compile DLOG() out
+#ifndef DLOG_ENABLE
+#define DLOG_ENABLE                 1
+#endif
+
+#define DLOG_ARGS_MAX               8
+#define DLOG_START                  0xDBU           // First byte of a record, never in the text output
+#define DLOG_ID_SYNC                0xFFFFU         // Record from dlogInit(): vtor, core_hz
+
+// Record, little endian, among the console text. Decoded by Tools/dlog.py.
+//
+//   0  start      DLOG_START
+//   1  args       # of argument words
+//   2  id         u16, offset of the format string in the .dlog section of the ELF
+//   4  cycles     DWT cycle count
+//   8  args       u32 each
+//   .  check      u8, XOR of the bytes of the words above
+#define DLOG_RECORD_SIZE(args)      (8 + 4 * (args) + 1)
+
+// -----------------------------------------------------------------------------
+// Macros
+// -----------------------------------------------------------------------------
+// printf() style, formatted on the host. Arguments are 32-bit words: integers
+// and characters as is, pointers cast to uint32_t, floats through dlogFloat().
+// %s prints the address only, the string itself is not sent.
+#if DLOG_ENABLE
+#define DLOG(fmt, ...)                                                                          \
+	do                                                                                          \
+	{                                                                                           \
+		static const char dlog_fmt_[] __attribute__((section(".dlog"), used)) = fmt;            \
+		const uint32_t dlog_args_[] = {0, ##__VA_ARGS__};                                       \
+		_Static_assert(ARRAYSIZE(dlog_args_) - 1 <= DLOG_ARGS_MAX, "DLOG: too many arguments"); \
+		dlogWrite((uint32_t)dlog_fmt_, &dlog_args_[1], ARRAYSIZE(dlog_args_) - 1);              \
+	} while(0)
+#else
+#define DLOG(fmt, ...)              do { } while(0)
+#endif
+
+// -----------------------------------------------------------------------------
+// Public Functions
+// -----------------------------------------------------------------------------
+void dlogInit(void);
+void dlogWrite(uint32_t id, const uint32_t *args, uint32_t count);
+void dlogBench(void);
+
+//------------------------------------------------------------------------------
+// Description: Passes a float to DLOG() for %f, %e or %g
+//     Returns: Its bits
+//      Inputs: Value
+//------------------------------------------------------------------------------
+static inline uint32_t dlogFloat(float value)
+{
+	uint32_t bits;
+
+	memcpy(&bits, &value, sizeof(bits));
+	return bits;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // DLOG_H_
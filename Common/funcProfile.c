@@ -0,0 +1,267 @@
+/* SPDX-License-Identifier: Unlicense */
+
+// -----------------------------------------------------------------------------
+// IMPLEMENTATION NOTES
+//
+// Per-function call counts and self time, collected by the compiler's entry /
+// exit hooks. Build the application with
+//
+//     -finstrument-functions
+//     -finstrument-functions-exclude-file-list=cmsis_gcc.h,core_cm7.h,funcProfile
+//
+// run the workload between funcProfileStart() and funcProfileStop(), then
+// funcProfileDump() prints one "fprof" CSV record per function. The host tool
+// Tools/placement.py maps the addresses back to function names with the ELF
+// and turns the profile into hot (ITCM) / warm (AXI SRAM) placement files for
+// the linker scripts. Build without the flags afterwards: the hooks are then
+// never called and cost nothing.
+//
+// The hooks keep a shadow call stack: on every entry or exit the cycles since
+// the previous event are charged to the function on top of it, so each
+// function gets its self time, callees excluded. Interrupt handlers nest on
+// the same stack, which keeps their time out of the interrupted function.
+// Functions are kept in an open addressing hash table indexed by address.
+//
+// The hooks cannot call anything that is itself instrumented, including
+// inline functions, hence the raw register accesses below instead of the
+// CMSIS helpers and cycles().
+//
+// -----------------------------------------------------------------------------
+
+#include "funcProfile.h"
+#include "stm32.h"
+
+#define HASH_MULT               2654435761UL
+#define HASH_SHIFT              (32 - __builtin_ctz(FUNC_PROFILE_MAX))
+#define NO_ENTRY                0xFFFF
+
+static func_profile_entry_t entries[FUNC_PROFILE_MAX];
+static uint16_t stack[FUNC_PROFILE_DEPTH];
+static uint32_t depth;
+static uint32_t count;
+static uint32_t last;
+static uint32_t dropped;                    // Calls to functions that did not fit the table
+static volatile bool active;
+
+FUNC_PROFILE_NOINSTR static inline uint32_t profLock(void)
+{
+	uint32_t primask;
+
+	__asm volatile ("mrs %0, primask\n cpsid i" : "=r" (primask) :: "memory");
+	return primask;
+}
+
+FUNC_PROFILE_NOINSTR static inline void profUnlock(uint32_t primask)
+{
+	__asm volatile ("msr primask, %0" :: "r" (primask) : "memory");
+}
+
+FUNC_PROFILE_NOINSTR static inline uint32_t profCycles(void)
+{
+	return DWT->CYCCNT;
+}
+
+// -----------------------------------------------------------------------------
+// Description: Finds or adds the table entry of a function
+//     Returns: Entry index, NO_ENTRY if the table is full
+//      Inputs: Function address
+// -----------------------------------------------------------------------------
+FUNC_PROFILE_NOINSTR static uint32_t profLookup(uint32_t addr)
+{
+	uint32_t i = (addr * HASH_MULT) >> HASH_SHIFT;
+
+	for(uint32_t n = 0; n < FUNC_PROFILE_MAX; n++)
+	{
+		if(entries[i].addr == addr)
+		{
+			return i;
+		}
+		if(entries[i].addr == 0)
+		{
+			if(count >= FUNC_PROFILE_MAX - 1)
+			{
+				break;
+			}
+			entries[i].addr = addr;
+			count++;
+			return i;
+		}
+		i = (i + 1) & (FUNC_PROFILE_MAX - 1);
+	}
+	return NO_ENTRY;
+}
+
+// -----------------------------------------------------------------------------
+// Description: Charges the cycles since the previous event to the function on
+//              top of the shadow stack
+//     Returns: none
+//      Inputs: Current cycle count
+// -----------------------------------------------------------------------------
+FUNC_PROFILE_NOINSTR static inline void profCharge(uint32_t now)
+{
+	if((depth > 0) && (depth <= FUNC_PROFILE_DEPTH))
+	{
+		uint16_t top = stack[depth - 1];
+
+		if(top != NO_ENTRY)
+		{
+			entries[top].self_cycles += now - last;
+		}
+	}
+}
+
+FUNC_PROFILE_NOINSTR void __cyg_profile_func_enter(void *fn, void *call_site)
+{
+	uint32_t primask, idx;
+
+	if(!active)
+	{
+		return;
+	}
+
+	primask = profLock();
+	profCharge(profCycles());
+	idx = profLookup((uint32_t)fn & ~1UL);
+	if(idx != NO_ENTRY)
+	{
+		entries[idx].calls++;
+	}
+	else
+	{
+		dropped++;
+	}
+	if(depth < FUNC_PROFILE_DEPTH)
+	{
+		stack[depth] = idx;
+	}
+	depth++;
+	last = profCycles();
+	profUnlock(primask);
+}
+
+FUNC_PROFILE_NOINSTR void __cyg_profile_func_exit(void *fn, void *call_site)
+{
+	uint32_t primask;
+
+	if(!active)
+	{
+		return;
+	}
+
+	primask = profLock();
+	// Functions entered before funcProfileStart() return with an empty stack
+	if(depth > 0)
+	{
+		profCharge(profCycles());
+		depth--;
+	}
+	last = profCycles();
+	profUnlock(primask);
+}
+
+// -----------------------------------------------------------------------------
+// Description: Clears the profile
+//     Returns: none
+//      Inputs: none
+// -----------------------------------------------------------------------------
+FUNC_PROFILE_NOINSTR void funcProfileReset(void)
+{
+	uint32_t primask = profLock();
+
+	memset(entries, 0, sizeof(entries));
+	depth = 0;
+	count = 0;
+	dropped = 0;
+	profUnlock(primask);
+}
+
+// -----------------------------------------------------------------------------
+// Description: Starts (or resumes) collecting. Functions already on the call
+//              stack are not tracked until they are called again.
+//     Returns: none
+//      Inputs: none
+// -----------------------------------------------------------------------------
+FUNC_PROFILE_NOINSTR void funcProfileStart(void)
+{
+	CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+	DWT->LAR = 0xC5ACCE55;
+	DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+
+	depth = 0;
+	last = profCycles();
+	active = true;
+}
+
+FUNC_PROFILE_NOINSTR void funcProfileStop(void)
+{
+	active = false;
+}
+
+FUNC_PROFILE_NOINSTR uint32_t funcProfileCount(void)
+{
+	return count;
+}
+
+// -----------------------------------------------------------------------------
+// Description: Provides a profile entry
+//     Returns: false past the last entry
+//      Inputs: Index (0 to funcProfileCount() - 1), entry storage
+// -----------------------------------------------------------------------------
+FUNC_PROFILE_NOINSTR bool funcProfileGet(uint32_t index, func_profile_entry_t *entry)
+{
+	for(uint32_t i = 0; i < FUNC_PROFILE_MAX; i++)
+	{
+		if((entries[i].addr != 0) && (index-- == 0))
+		{
+			*entry = entries[i];
+			return true;
+		}
+	}
+	return false;
+}
+
+// -----------------------------------------------------------------------------
+// Description: Formats a 64-bit count in decimal with 32-bit conversions only:
+//              newlib-nano's printf() has no %llu. Exact below 2^32 * 10^9.
+//     Returns: The text, in the storage given
+//      Inputs: Storage (at least 20 bytes), count
+// -----------------------------------------------------------------------------
+FUNC_PROFILE_NOINSTR static const char *profCount(char *text, uint64_t value)
+{
+	uint32_t high = (uint32_t)(value / 1000000000U);
+	uint32_t low = (uint32_t)(value % 1000000000U);
+
+	if(high != 0)
+	{
+		sprintf(text, "%lu%09lu", high, low);
+	}
+	else
+	{
+		sprintf(text, "%lu", low);
+	}
+	return text;
+}
+
+// -----------------------------------------------------------------------------
+// Description: Prints the profile as CSV, for Tools/placement.py
+//     Returns: none
+//      Inputs: none
+// -----------------------------------------------------------------------------
+FUNC_PROFILE_NOINSTR void funcProfileDump(void)
+{
+	bool was_active = active;
+	func_profile_entry_t e;
+	uint64_t total = 0;
+	char text[20];
+
+	active = false;
+	printf("fprof,addr,calls,self_cycles" EOL);
+	for(uint32_t i = 0; funcProfileGet(i, &e); i++)
+	{
+		printf("fprof,0x%08lX,%lu,%s" EOL, e.addr, e.calls, profCount(text, e.self_cycles));
+		total += e.self_cycles;
+	}
+	printf("fprof_total,functions,dropped_calls,self_cycles" EOL);
+	printf("fprof_total,%lu,%lu,%s" EOL, count, dropped, profCount(text, total));
+	active = was_active;
+}
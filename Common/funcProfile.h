@@ -0,0 +1,52 @@
+/* SPDX-License-Identifier: Unlicense */
+
+#ifndef FUNCPROFILE_H_
+#define FUNCPROFILE_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// -----------------------------------------------------------------------------
+// Includes
+// -----------------------------------------------------------------------------
+#include "common.h"
+
+// -----------------------------------------------------------------------------
+// Constants
+// -----------------------------------------------------------------------------
+// Distinct functions tracked, power of two
+#ifndef FUNC_PROFILE_MAX
+#define FUNC_PROFILE_MAX            512
+#endif
+
+// Call depth tracked, deeper calls are charged to the deepest tracked function
+#ifndef FUNC_PROFILE_DEPTH
+#define FUNC_PROFILE_DEPTH          48
+#endif
+
+#define FUNC_PROFILE_NOINSTR        __attribute__((no_instrument_function))
+
+typedef struct
+{
+	uint32_t addr;                  // Function address (Thumb bit cleared)
+	uint32_t calls;
+	uint64_t self_cycles;           // Cycles spent in the function itself, callees excluded
+} func_profile_entry_t;
+
+// -----------------------------------------------------------------------------
+// Public Functions
+// -----------------------------------------------------------------------------
+// The hooks only run in code built with -finstrument-functions, see funcProfile.c
+void funcProfileReset(void);
+void funcProfileStart(void);
+void funcProfileStop(void);
+uint32_t funcProfileCount(void);
+bool funcProfileGet(uint32_t index, func_profile_entry_t *entry);
+void funcProfileDump(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // FUNCPROFILE_H_
@@ -0,0 +1,57 @@
+/* SPDX-License-Identifier: Unlicense */
+
+// -----------------------------------------------------------------------------
+// IMPLEMENTATION NOTES
+//
+// Application side of the UART4 update: the app cannot program the NOR it
+// runs from, so it only spots the START frame of Tools/fwupdate.py on the
+// console and resets into the bootloader (Board/bootUpdate.c), which does the
+// transfer. The host repeats START until it is answered, so the frame the app
+// swallows costs one retry.
+//
+// Only the magic and the command byte are matched, straight from the UART
+// registers: cheap enough to poll from the main loop, and independent of
+// whatever the app does with the HAL handle.
+//
+// -----------------------------------------------------------------------------
+
+#include "fwUpdate.h"
+
+static const uint8_t start_pattern[] =
+{
+	(uint8_t)FW_UPDATE_MAGIC, (uint8_t)(FW_UPDATE_MAGIC >> 8), (uint8_t)(FW_UPDATE_MAGIC >> 16),
+	(uint8_t)(FW_UPDATE_MAGIC >> 24), FW_UPDATE_START,
+};
+
+//------------------------------------------------------------------------------
+// Description: Polls UART4 for an update START frame and resets into the
+//              bootloader when one comes in
+//     Returns: none (not on a request)
+//      Inputs: none
+//------------------------------------------------------------------------------
+void fwUpdateListen(void)
+{
+	static uint32_t matched;
+
+	if(UART4->ISR & USART_ISR_ORE)
+	{
+		UART4->ICR = USART_ICR_ORECF;
+	}
+	while(UART4->ISR & USART_ISR_RXNE_RXFNE)
+	{
+		uint8_t c = (uint8_t)UART4->RDR;
+
+		if(c == start_pattern[matched])
+		{
+			matched++;
+		}
+		else
+		{
+			matched = (c == start_pattern[0]) ? 1 : 0;
+		}
+		if(matched == sizeof(start_pattern))
+		{
+			fwUpdateRequest();
+		}
+	}
+}
@@ -0,0 +1,120 @@
+/* SPDX-License-Identifier: Unlicense */
+
+#ifndef FWUPDATE_H_
+#define FWUPDATE_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// -----------------------------------------------------------------------------
+// Includes
+// -----------------------------------------------------------------------------
+#include "common.h"
+#include "stm32.h"
+
+// -----------------------------------------------------------------------------
+// Constants
+// -----------------------------------------------------------------------------
+// UART4 update protocol between Tools/fwupdate.py and Board/bootUpdate.c, all
+// fields little endian. The host sends a START frame at the console rate, the
+// bootloader answers READY with the chunk size and both switch to the update
+// rate. DATA frames then all have the same size, the last one padded, and are
+// answered by ACK once programmed or NAK to resend from a sequence number.
+// With FW_UPDATE_DELTA the frames carry a patch (Board/bootDelta.h) against
+// the running slot instead of the image itself.
+#define FW_UPDATE_MAGIC             0x50555746UL    // "FWUP"
+#define FW_UPDATE_SYNC              0x23            // '#', first byte of a reply
+
+// Frame commands
+#define FW_UPDATE_START             1               // Payload: fw_update_start_t
+#define FW_UPDATE_DATA              2               // Payload: chunk size bytes
+
+// Frame flags
+#define FW_UPDATE_LOOPBACK          BIT(0)          // START: check and acknowledge only, nothing is written
+#define FW_UPDATE_LAST              BIT(1)          // DATA: last chunk of the image
+#define FW_UPDATE_DELTA             BIT(2)          // START: the image is a patch of the running slot
+
+#define FW_UPDATE_SLOT_INACTIVE     0xFF            // Slot other than the one running
+
+// Reply status
+#define FW_UPDATE_READY             'R'             // value: chunk size
+#define FW_UPDATE_ACK               'A'             // seq: chunk programmed, value: image bytes done
+#define FW_UPDATE_NAK               'N'             // seq: chunk to resend from, value: fw_update_error_t
+#define FW_UPDATE_DONE              'D'             // value: CRC-32 of the image as read back
+#define FW_UPDATE_FAIL              'F'             // value: fw_update_error_t, update abandoned
+
+// Backup register the app sets before resetting into the bootloader's update mode
+#define FW_UPDATE_REQUEST_MAGIC     0x55504454UL
+#define FW_UPDATE_REQUEST           (TAMP->BKP2R)
+
+// -----------------------------------------------------------------------------
+// Types
+// -----------------------------------------------------------------------------
+typedef enum
+{
+	FW_UPDATE_OK,
+	FW_UPDATE_ERR_CRC,          // Frame CRC
+	FW_UPDATE_ERR_SEQ,          // Unexpected chunk
+	FW_UPDATE_ERR_TIMEOUT,      // Frame cut short, or the host went quiet
+	FW_UPDATE_ERR_SIZE,         // Image larger than a slot, bad chunk length
+	FW_UPDATE_ERR_ERASE,
+	FW_UPDATE_ERR_PROGRAM,
+	FW_UPDATE_ERR_VERIFY,       // Read back CRC differs from the START one
+	FW_UPDATE_ERR_ACTIVATE,     // Boot-control record not written
+	FW_UPDATE_ERR_BAUD,         // Update rate out of reach of UART4
+	FW_UPDATE_ERR_BASE,         // Patch made for another image than the running one
+	FW_UPDATE_ERR_PATCH,        // Malformed patch
+} fw_update_error_t;
+
+typedef struct
+{
+	uint32_t magic;             // FW_UPDATE_MAGIC
+	uint8_t cmd;                // FW_UPDATE_START or FW_UPDATE_DATA
+	uint8_t flags;
+	uint16_t seq;               // Chunk #, from 0
+	uint32_t length;            // Valid payload bytes
+	uint32_t crc;               // CRC-32 of the fields above and the whole payload
+} fw_update_frame_t;
+
+typedef struct
+{
+	uint32_t image_size;        // Of the patch for a delta update
+	uint32_t image_crc;         // CRC-32 of the image (or patch)
+	uint32_t baud;              // Rate of the DATA frames, 0 to stay at the console rate
+	uint8_t slot;               // BOOT_SLOT_A, BOOT_SLOT_B or FW_UPDATE_SLOT_INACTIVE
+	uint8_t trials;             // Trial boots of the new image, 0 for a permanent switch
+	uint16_t reserved;
+} fw_update_start_t;
+
+typedef struct
+{
+	uint8_t sync;               // FW_UPDATE_SYNC
+	uint8_t status;             // FW_UPDATE_READY...
+	uint16_t seq;
+	uint32_t value;
+} fw_update_reply_t;
+
+// -----------------------------------------------------------------------------
+// Public Functions
+// -----------------------------------------------------------------------------
+void fwUpdateListen(void);
+
+//------------------------------------------------------------------------------
+// Description: Resets into the update mode of the bootloader
+//     Returns: none (does not return)
+//      Inputs: none
+//------------------------------------------------------------------------------
+static inline void fwUpdateRequest(void)
+{
+	RCC->APB4ENR |= RCC_APB4ENR_RTCAPBEN;
+	PWR->CR1 |= PWR_CR1_DBP;
+	FW_UPDATE_REQUEST = FW_UPDATE_REQUEST_MAGIC;
+	NVIC_SystemReset();
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // FWUPDATE_H_
@@ -0,0 +1,123 @@
+/* SPDX-License-Identifier: Unlicense */
+
+// -----------------------------------------------------------------------------
+// IMPLEMENTATION NOTES
+//
+// Bootloader to app handoff: right before the jump the bootloader fills a
+// versioned record in the backup SRAM, after the boot timeline, with the clock
+// tree, the XSPI registers of both memory mapped windows and what it learnt
+// from the NOR SFDP tables (Board/bootHandoff.c). The app copies it at the top
+// of main() and attaches to that setup instead of doing it again: the LED pins
+// and UART4 (kernel clock mux, pins, baud rate) are left as they are and only
+// the HAL handle is filled in. The NOR parameters are there for app code that
+// has to talk to the flash without the EXTMEM middleware and its SFDP parsing.
+//
+// The record is consumed by the copy (magic cleared), so an app started later
+// by the debugger without going through the bootloader initialises everything
+// itself. MPU_Config() and HAL_Init() are not skipped: the app's MPU map is its
+// own and the HAL tick is restarted for the app's vector table.
+//
+// The gain shows in the app_init stage of the boot timeline, with
+// ATTACH_BOOT_HANDOFF set to 1 and then 0 in Appli/Core/Src/main.c.
+//
+// -----------------------------------------------------------------------------
+
+#include "handoff.h"
+
+static handoff_t attached;
+static bool valid;
+
+//------------------------------------------------------------------------------
+// Description: Takes over the record left by the bootloader, if any, and sets
+//              SystemCoreClock from it
+//     Returns: true when attached
+//      Inputs: none
+//------------------------------------------------------------------------------
+bool handoffAttach(void)
+{
+	handoff_t *h = HANDOFF;
+
+	RCC->AHB4ENR |= RCC_AHB4ENR_BKPRAMEN;
+	PWR->CR1 |= PWR_CR1_DBP;
+	(void)RCC->AHB4ENR;
+
+	valid = (h->magic == HANDOFF_MAGIC) && (h->version == HANDOFF_VERSION) && (h->size >= sizeof(handoff_t));
+	if(valid)
+	{
+		memcpy(&attached, h, sizeof(attached));
+		if(attached.flags & HANDOFF_CLOCKS)
+		{
+			SystemCoreClock = attached.clocks.cpu_hz;
+		}
+	}
+	h->magic = 0;
+	return valid;
+}
+
+const handoff_t *handoffGet(void)
+{
+	return valid ? &attached : NULL;
+}
+
+bool handoffHas(uint32_t flags)
+{
+	return valid && ((attached.flags & flags) == flags);
+}
+
+//------------------------------------------------------------------------------
+// Description: Fills a UART4 handle from the running peripheral, in place of
+//              HAL_UART_Init() (which would also stop it mid-character)
+//     Returns: true when attached, false when the caller must initialise it
+//      Inputs: Handle
+//------------------------------------------------------------------------------
+bool handoffAttachUart4(UART_HandleTypeDef *huart)
+{
+	USART_TypeDef *uart = UART4;
+
+	if(!handoffHas(HANDOFF_UART4 | HANDOFF_CLOCKS) || ((uart->CR1 & USART_CR1_UE) == 0))
+	{
+		return false;
+	}
+
+	huart->Instance = uart;
+	huart->Init.BaudRate = attached.uart_baud;
+	huart->Init.WordLength = uart->CR1 & USART_CR1_M;
+	huart->Init.StopBits = uart->CR2 & USART_CR2_STOP;
+	huart->Init.Parity = uart->CR1 & (USART_CR1_PCE | USART_CR1_PS);
+	huart->Init.Mode = uart->CR1 & (USART_CR1_TE | USART_CR1_RE);
+	huart->Init.HwFlowCtl = uart->CR3 & (USART_CR3_RTSE | USART_CR3_CTSE);
+	huart->Init.OverSampling = uart->CR1 & USART_CR1_OVER8;
+	huart->Init.OneBitSampling = uart->CR3 & USART_CR3_ONEBIT;
+	huart->Init.ClockPrescaler = uart->PRESC & USART_PRESC_PRESCALER;
+	huart->AdvancedInit.AdvFeatureInit = UART_ADVFEATURE_NO_INIT;
+	huart->FifoMode = uart->CR1 & USART_CR1_FIFOEN;
+	huart->NbTxDataToProcess = 1;
+	huart->NbRxDataToProcess = 1;
+	UART_MASK_COMPUTATION(huart);
+	huart->ErrorCode = HAL_UART_ERROR_NONE;
+	huart->gState = HAL_UART_STATE_READY;
+	huart->RxState = HAL_UART_STATE_READY;
+	return true;
+}
+
+//------------------------------------------------------------------------------
+// Description: Prints the attached record as CSV
+//     Returns: none
+//      Inputs: none
+//------------------------------------------------------------------------------
+void handoffReport(void)
+{
+	const handoff_t *h = handoffGet();
+
+	if(h == NULL)
+	{
+		printf("handoff,none" EOL);
+		return;
+	}
+
+	printf("handoff,version,flags,cpu_hz,hclk_hz,xspi2_hz,nor_base,nor_size,nor_slot,nor_read_cmd,nor_dummy,nor_burst,psram_base,psram_size,uart_baud" EOL);
+	printf("handoff,%u,0x%02lX,%lu,%lu,%lu,0x%08lX,%lu,0x%08lX,0x%02X,%u,%u,0x%08lX,%lu,%lu" EOL,
+	       h->version, h->flags, h->clocks.cpu_hz, h->clocks.hclk_hz, h->clocks.xspi2_hz,
+	       h->nor.xspi.base, h->nor.xspi.size, h->nor.slot_offset, h->nor.read_cmd, h->nor.dummy_cycles, h->nor.burst_mode,
+	       h->psram.base, h->psram.size, h->uart_baud);
+}
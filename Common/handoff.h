@@ -0,0 +1,123 @@
+/* SPDX-License-Identifier: Unlicense */
+
+#ifndef HANDOFF_H_
+#define HANDOFF_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// -----------------------------------------------------------------------------
+// Includes
+// -----------------------------------------------------------------------------
+#include "common.h"
+#include "stm32.h"
+
+// -----------------------------------------------------------------------------
+// Constants
+// -----------------------------------------------------------------------------
+#define HANDOFF_ADDRESS             (BKPSRAM_BASE + 0x400)  // After the boot timeline
+#define HANDOFF_MAGIC               0x46444E48UL    // "HNDF"
+#define HANDOFF_VERSION             1               // Bumped when a field changes meaning, fields are only appended
+
+#define HANDOFF                     ((handoff_t *)HANDOFF_ADDRESS)
+
+// What the bootloader left configured for the app
+#define HANDOFF_CLOCKS              BIT(0)          // SystemClock_Config() done, see clocks
+#define HANDOFF_GPIO                BIT(1)          // LED pins configured as outputs
+#define HANDOFF_UART4               BIT(2)          // UART4 and its pins running at uart_baud
+#define HANDOFF_NOR_MAPPED          BIT(3)          // XSPI2 in memory mapped mode
+#define HANDOFF_PSRAM_MAPPED        BIT(4)          // XSPI1 in memory mapped mode
+
+// -----------------------------------------------------------------------------
+// Types
+// -----------------------------------------------------------------------------
+typedef struct
+{
+	uint32_t sysclk_hz;
+	uint32_t cpu_hz;            // SystemCoreClock
+	uint32_t hclk_hz;
+	uint32_t pclk1_hz;
+	uint32_t pclk2_hz;
+	uint32_t pclk4_hz;
+	uint32_t pclk5_hz;
+	uint32_t xspi1_hz;          // Kernel clocks
+	uint32_t xspi2_hz;
+	uint32_t uart4_hz;
+	uint32_t cfgr;              // RCC registers behind the above
+	uint32_t cdcfgr;
+	uint32_t bmcfgr;
+	uint32_t apbcfgr;
+	uint32_t pllckselr;
+	uint32_t pllcfgr;
+	uint32_t pll1divr1;
+	uint32_t pll2divr1;
+	uint32_t ccipr1;
+	uint32_t ccipr2;
+} handoff_clocks_t;
+
+// XSPI registers as the memory mapped window uses them
+typedef struct
+{
+	uint32_t base;              // Mapped address
+	uint32_t size;              // Bytes
+	uint32_t cr;
+	uint32_t dcr1;
+	uint32_t dcr2;
+	uint32_t dcr3;
+	uint32_t dcr4;
+	uint32_t ccr;               // Read command
+	uint32_t tcr;
+	uint32_t ir;
+	uint32_t wccr;              // Write command
+	uint32_t wtcr;
+	uint32_t wir;
+} handoff_xspi_t;
+
+// NOR parameters discovered from its SFDP tables, 0 for an unsupported command
+typedef struct
+{
+	handoff_xspi_t xspi;
+	uint32_t page_size;
+	uint32_t slot_offset;       // Offset of the booted A/B slot
+	uint8_t manufacturer_id;
+	uint8_t phy_link;           // SAL_XSPI_PhysicalLinkTypeDef
+	uint8_t dummy_cycles;       // Read command
+	uint8_t burst_mode;         // nor_burst_t
+	uint8_t read_cmd;
+	uint8_t program_cmd;
+	uint8_t write_enable_cmd;
+	uint8_t read_status_cmd;    // Write in progress
+	uint8_t wip_position;
+	uint8_t wip_busy_polarity;
+	uint8_t reserved[2];
+	uint8_t erase_size[4];      // Power of two, 0 for an unused erase type
+	uint8_t erase_cmd[4];
+} handoff_nor_t;
+
+typedef struct
+{
+	uint32_t magic;             // HANDOFF_MAGIC, written last
+	uint16_t version;           // HANDOFF_VERSION
+	uint16_t size;              // sizeof(handoff_t) of the bootloader
+	uint32_t flags;
+	handoff_clocks_t clocks;
+	handoff_nor_t nor;
+	handoff_xspi_t psram;
+	uint32_t uart_baud;
+} handoff_t;
+
+// -----------------------------------------------------------------------------
+// Public Functions
+// -----------------------------------------------------------------------------
+bool handoffAttach(void);
+const handoff_t *handoffGet(void);
+bool handoffHas(uint32_t flags);
+bool handoffAttachUart4(UART_HandleTypeDef *huart);
+void handoffReport(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // HANDOFF_H_
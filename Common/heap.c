@@ -0,0 +1,800 @@
+/* SPDX-License-Identifier: Unlicense */
+
+// -----------------------------------------------------------------------------
+// IMPLEMENTATION NOTES
+//
+// Two-level segregated fit (TLSF) allocator managing several independent
+// regions, each tagged with attributes (fast, DMA reachable, large). Every
+// region has its own control structure, kept here in internal RAM so that the
+// bitmap searches for the PSRAM region never touch external memory.
+//
+// Free blocks are binned by size: the first level is the power of two, the
+// second level splits that range into HEAP_SL_COUNT linear classes. A request
+// is rounded up to the next class boundary, so any block found in a non-empty
+// class is large enough and both allocation and free are O(1): two bitmap
+// scans, no list walks. Adjacent free blocks are merged immediately on free.
+//
+// Each block carries an 8-byte header (previous physical block + size/flags)
+// which keeps payloads 8-byte aligned. A zero-size used sentinel terminates
+// every region so merging never runs off the end.
+//
+// Placement: a hint selects an ordered set of passes over the regions. DMA
+// requests are strict (only HEAP_ATTR_DMA regions) and are aligned and padded
+// to the D-cache line so cache maintenance on the buffer can never clobber a
+// neighbouring allocation or block header.
+//
+// All operations run with interrupts masked; they are short and bounded. The
+// DWT cycle counter records per-call allocation and free latency.
+//
+// -----------------------------------------------------------------------------
+
+#include "heap.h"
+#include "cycles.h"
+#include "stm32.h"
+
+#define HEAP_ALIGN_LOG2         3
+#define HEAP_SL_LOG2            4
+#define HEAP_SL_COUNT           (1 << HEAP_SL_LOG2)
+#define HEAP_FL_SHIFT           (HEAP_SL_LOG2 + HEAP_ALIGN_LOG2)
+#define HEAP_FL_MAX             25          // Blocks up to 32 MB
+#define HEAP_FL_COUNT           (HEAP_FL_MAX - HEAP_FL_SHIFT + 1)
+#define HEAP_SMALL_BLOCK        (1 << HEAP_FL_SHIFT)
+
+#define BLOCK_FREE              0x1U
+#define BLOCK_SIZE_MASK         (~(uint32_t)(HEAP_ALIGN - 1))
+#define BLOCK_HEADER            offsetof(heap_block_t, next_free)
+#define BLOCK_MIN               (sizeof(heap_block_t) - BLOCK_HEADER)
+#define BLOCK_MAX               ((1UL << HEAP_FL_MAX) - HEAP_ALIGN)
+
+#define ALIGN_UP(x, a)          (((x) + ((a) - 1)) & ~((a) - 1))
+#define ALIGN_DOWN(x, a)        ((x) & ~((a) - 1))
+
+typedef struct heap_block_s
+{
+	struct heap_block_s *prev_phys;         // Previous block in memory, NULL for the first
+	uint32_t size;                          // Payload bytes | BLOCK_FREE
+	struct heap_block_s *next_free;         // Payload area, only valid while free
+	struct heap_block_s *prev_free;
+} heap_block_t;
+
+typedef struct
+{
+	const char *name;
+	uint8_t *base;
+	uint8_t *end;
+	uint32_t attrs;
+	uint32_t fl_bitmap;
+	uint32_t sl_bitmap[HEAP_FL_COUNT];
+	heap_block_t *free_list[HEAP_FL_COUNT][HEAP_SL_COUNT];
+	uint32_t used;
+	uint32_t peak;
+	uint32_t allocs;
+	uint32_t frees;
+} heap_region_t;
+
+typedef struct
+{
+	uint32_t want;                          // Attributes the region must have
+	uint32_t avoid;                         // Attributes the region must not have
+} heap_pass_t;
+
+static const heap_pass_t pass_small[] = {{0, HEAP_ATTR_LARGE}, {0, 0}};
+static const heap_pass_t pass_large[] = {{HEAP_ATTR_LARGE, 0}, {0, 0}};
+static const heap_pass_t pass_fast[] = {{HEAP_ATTR_FAST, 0}, {0, HEAP_ATTR_LARGE}, {0, 0}};
+static const heap_pass_t pass_dma[] = {{HEAP_ATTR_DMA, 0}};
+
+static heap_region_t regions[HEAP_MAX_REGIONS];
+static uint32_t region_count;
+static bool regions_ready;
+static heap_latency_t alloc_latency = {.min = UINT32_MAX};
+static heap_latency_t free_latency = {.min = UINT32_MAX};
+static uint32_t alloc_failures;                 // Requests no region could satisfy
+
+// -----------------------------------------------------------------------------
+// Description: Masks interrupts around a heap operation
+//     Returns: The previous PRIMASK, to be handed to heapUnlock()
+//      Inputs: none
+// -----------------------------------------------------------------------------
+static inline uint32_t heapLock(void)
+{
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+	return primask;
+}
+
+static inline void heapUnlock(uint32_t primask)
+{
+	__set_PRIMASK(primask);
+}
+
+static inline uint32_t bitFls(uint32_t x)
+{
+	return 31 - __builtin_clz(x);
+}
+
+static inline uint32_t bitFfs(uint32_t x)
+{
+	return __builtin_ctz(x);
+}
+
+static inline uint32_t blockSize(const heap_block_t *b)
+{
+	return b->size & BLOCK_SIZE_MASK;
+}
+
+static inline bool blockIsFree(const heap_block_t *b)
+{
+	return (b->size & BLOCK_FREE) != 0;
+}
+
+static inline uint8_t *blockPayload(const heap_block_t *b)
+{
+	return (uint8_t *)b + BLOCK_HEADER;
+}
+
+static inline heap_block_t *blockFromPayload(const void *p)
+{
+	return (heap_block_t *)((uint8_t *)p - BLOCK_HEADER);
+}
+
+static inline heap_block_t *blockNext(const heap_block_t *b)
+{
+	return (heap_block_t *)(blockPayload(b) + blockSize(b));
+}
+
+static void latencyRecord(heap_latency_t *l, uint32_t elapsed)
+{
+	l->count++;
+	l->total += elapsed;
+	l->min = MIN(l->min, elapsed);
+	l->max = MAX(l->max, elapsed);
+}
+
+// -----------------------------------------------------------------------------
+// Description: Maps a block size onto its first/second level class
+//     Returns: none
+//      Inputs: Block size, storage for the first and second level indices
+// -----------------------------------------------------------------------------
+static void mapping(uint32_t size, uint32_t *fl, uint32_t *sl)
+{
+	if(size < HEAP_SMALL_BLOCK)
+	{
+		*fl = 0;
+		*sl = size / (HEAP_SMALL_BLOCK / HEAP_SL_COUNT);
+	}
+	else
+	{
+		uint32_t f = bitFls(size);
+		*sl = (size >> (f - HEAP_SL_LOG2)) ^ HEAP_SL_COUNT;
+		*fl = f - (HEAP_FL_SHIFT - 1);
+	}
+}
+
+// -----------------------------------------------------------------------------
+// Description: Removes a block from its free list
+//     Returns: none
+//      Inputs: Region, free block
+// -----------------------------------------------------------------------------
+static void freeListRemove(heap_region_t *r, heap_block_t *b)
+{
+	uint32_t fl, sl;
+
+	mapping(blockSize(b), &fl, &sl);
+	if(b->next_free)
+	{
+		b->next_free->prev_free = b->prev_free;
+	}
+	if(b->prev_free)
+	{
+		b->prev_free->next_free = b->next_free;
+	}
+	else
+	{
+		r->free_list[fl][sl] = b->next_free;
+		if(!r->free_list[fl][sl])
+		{
+			r->sl_bitmap[fl] &= ~(1UL << sl);
+			if(!r->sl_bitmap[fl])
+			{
+				r->fl_bitmap &= ~(1UL << fl);
+			}
+		}
+	}
+}
+
+// -----------------------------------------------------------------------------
+// Description: Pushes a block onto the head of its free list
+//     Returns: none
+//      Inputs: Region, free block
+// -----------------------------------------------------------------------------
+static void freeListInsert(heap_region_t *r, heap_block_t *b)
+{
+	uint32_t fl, sl;
+
+	mapping(blockSize(b), &fl, &sl);
+	b->prev_free = NULL;
+	b->next_free = r->free_list[fl][sl];
+	if(b->next_free)
+	{
+		b->next_free->prev_free = b;
+	}
+	r->free_list[fl][sl] = b;
+	r->sl_bitmap[fl] |= 1UL << sl;
+	r->fl_bitmap |= 1UL << fl;
+}
+
+// -----------------------------------------------------------------------------
+// Description: Finds a free block of at least the requested size
+//     Returns: The block (still on its free list), NULL if none fits
+//      Inputs: Region, payload size
+// -----------------------------------------------------------------------------
+static heap_block_t *freeListFind(heap_region_t *r, uint32_t size)
+{
+	uint32_t fl, sl, sl_map;
+
+	// Round up to the next class so that every block in the class fits
+	if(size >= HEAP_SMALL_BLOCK)
+	{
+		size += (1UL << (bitFls(size) - HEAP_SL_LOG2)) - 1;
+	}
+	mapping(size, &fl, &sl);
+	if(fl >= HEAP_FL_COUNT)
+	{
+		return NULL;
+	}
+
+	sl_map = r->sl_bitmap[fl] & (~0UL << sl);
+	if(!sl_map)
+	{
+		uint32_t fl_map = r->fl_bitmap & (~0UL << (fl + 1));
+		if(!fl_map)
+		{
+			return NULL;
+		}
+		fl = bitFfs(fl_map);
+		sl_map = r->sl_bitmap[fl];
+	}
+	return r->free_list[fl][bitFfs(sl_map)];
+}
+
+// -----------------------------------------------------------------------------
+// Description: Splits the tail off a block if it is large enough to stand alone
+//     Returns: The remainder block (not yet on a free list), NULL if not split
+//      Inputs: Block, payload size to keep
+// -----------------------------------------------------------------------------
+static heap_block_t *blockSplit(heap_block_t *b, uint32_t size)
+{
+	heap_block_t *rem;
+
+	if(blockSize(b) < size + BLOCK_HEADER + BLOCK_MIN)
+	{
+		return NULL;
+	}
+	rem = (heap_block_t *)(blockPayload(b) + size);
+	rem->size = blockSize(b) - size - BLOCK_HEADER;
+	rem->prev_phys = b;
+	blockNext(rem)->prev_phys = rem;
+	b->size = size | (b->size & BLOCK_FREE);
+	return rem;
+}
+
+// -----------------------------------------------------------------------------
+// Description: Marks a block free, merges it with free neighbours and bins it
+//     Returns: none
+//      Inputs: Region, block
+// -----------------------------------------------------------------------------
+static void blockRelease(heap_region_t *r, heap_block_t *b)
+{
+	heap_block_t *next;
+
+	b->size |= BLOCK_FREE;
+	if(b->prev_phys && blockIsFree(b->prev_phys))
+	{
+		heap_block_t *prev = b->prev_phys;
+		freeListRemove(r, prev);
+		prev->size += blockSize(b) + BLOCK_HEADER;
+		b = prev;
+		blockNext(b)->prev_phys = b;
+	}
+	next = blockNext(b);
+	if(blockIsFree(next))
+	{
+		freeListRemove(r, next);
+		b->size += blockSize(next) + BLOCK_HEADER;
+		blockNext(b)->prev_phys = b;
+	}
+	freeListInsert(r, b);
+}
+
+// -----------------------------------------------------------------------------
+// Description: Allocates from a single region
+//     Returns: Payload pointer, NULL if the region has no suitable block
+//      Inputs: Region, payload size (multiple of HEAP_ALIGN), alignment
+// -----------------------------------------------------------------------------
+static void *regionAlloc(heap_region_t *r, uint32_t size, uint32_t align)
+{
+	uint32_t search = size;
+	heap_block_t *b, *rem;
+
+	// Leave room to carve a leading free block off when realigning
+	if(align > HEAP_ALIGN)
+	{
+		search += align + BLOCK_HEADER + BLOCK_MIN;
+	}
+	b = freeListFind(r, search);
+	if(!b)
+	{
+		return NULL;
+	}
+	freeListRemove(r, b);
+
+	if(align > HEAP_ALIGN)
+	{
+		uint32_t p = (uint32_t)blockPayload(b);
+		uint32_t a = ALIGN_UP(p, align);
+
+		if((a != p) && (a - p < BLOCK_HEADER + BLOCK_MIN))
+		{
+			a = ALIGN_UP(p + BLOCK_HEADER + BLOCK_MIN, align);
+		}
+		if(a != p)
+		{
+			heap_block_t *ab = blockFromPayload((void *)a);
+			uint32_t gap = a - p;
+
+			ab->size = blockSize(b) - gap;
+			ab->prev_phys = b;
+			blockNext(ab)->prev_phys = ab;
+			b->size = (gap - BLOCK_HEADER) | BLOCK_FREE;
+			freeListInsert(r, b);
+			b = ab;
+		}
+	}
+
+	rem = blockSplit(b, size);
+	if(rem)
+	{
+		rem->size |= BLOCK_FREE;
+		freeListInsert(r, rem);
+	}
+	b->size &= ~BLOCK_FREE;
+
+	r->used += blockSize(b) + BLOCK_HEADER;
+	r->peak = MAX(r->peak, r->used);
+	r->allocs++;
+	return blockPayload(b);
+}
+
+// -----------------------------------------------------------------------------
+// Description: Finds the region owning a pointer
+//     Returns: The region, NULL if the pointer is outside every region
+//      Inputs: Pointer
+// -----------------------------------------------------------------------------
+static heap_region_t *regionOf(const void *ptr)
+{
+	for(uint32_t i = 0; i < region_count; i++)
+	{
+		if(((const uint8_t *)ptr >= regions[i].base) && ((const uint8_t *)ptr < regions[i].end))
+		{
+			return &regions[i];
+		}
+	}
+	return NULL;
+}
+
+// -----------------------------------------------------------------------------
+// Description: Rounds a request up to a valid payload size
+//     Returns: Payload size, 0 if the request can never be satisfied
+//      Inputs: Requested size, alignment
+// -----------------------------------------------------------------------------
+static uint32_t adjustSize(size_t size, uint32_t align)
+{
+	if(size > BLOCK_MAX)
+	{
+		return 0;
+	}
+	size = ALIGN_UP(MAX(size, BLOCK_MIN), MAX(align, HEAP_ALIGN));
+	return (size > BLOCK_MAX) ? 0 : size;
+}
+
+// -----------------------------------------------------------------------------
+// Description: Runs the region passes selected by a hint
+//     Returns: Payload pointer, NULL if nothing fits
+//      Inputs: Payload size, alignment, hint
+// -----------------------------------------------------------------------------
+static void *hintedAlloc(uint32_t size, uint32_t align, heap_hint_t hint)
+{
+	const heap_pass_t *passes;
+	uint32_t pass_count, tried = 0;
+
+	switch(hint)
+	{
+		case HEAP_HINT_FAST:
+			passes = pass_fast;
+			pass_count = ARRAY_SIZE(pass_fast);
+			break;
+		case HEAP_HINT_DMA:
+			passes = pass_dma;
+			pass_count = ARRAY_SIZE(pass_dma);
+			break;
+		case HEAP_HINT_LARGE:
+			passes = pass_large;
+			pass_count = ARRAY_SIZE(pass_large);
+			break;
+		default:
+			passes = (size >= HEAP_LARGE_THRESHOLD) ? pass_large : pass_small;
+			pass_count = (size >= HEAP_LARGE_THRESHOLD) ? ARRAY_SIZE(pass_large) : ARRAY_SIZE(pass_small);
+			break;
+	}
+
+	for(uint32_t p = 0; p < pass_count; p++)
+	{
+		for(uint32_t i = 0; i < region_count; i++)
+		{
+			heap_region_t *r = &regions[i];
+			void *ptr;
+
+			if((tried & BIT(i)) || ((r->attrs & passes[p].want) != passes[p].want) || (r->attrs & passes[p].avoid))
+			{
+				continue;
+			}
+			tried |= BIT(i);
+			ptr = regionAlloc(r, size, align);
+			if(ptr)
+			{
+				return ptr;
+			}
+		}
+	}
+	return NULL;
+}
+
+// -----------------------------------------------------------------------------
+// Description: Registers the application's regions, called once before the
+//              first allocation with interrupts masked. Override to call
+//              heapAddRegion().
+//     Returns: none
+//      Inputs: none
+// -----------------------------------------------------------------------------
+__weak void heapInitRegions(void)
+{
+}
+
+// -----------------------------------------------------------------------------
+// Description: Hands a memory range to the allocator
+//     Returns: true if the region was added
+//      Inputs: Name (for reports), base address, size in bytes, HEAP_ATTR_x flags
+// -----------------------------------------------------------------------------
+bool heapAddRegion(const char *name, void *base, size_t size, uint32_t attrs)
+{
+	uint32_t start = ALIGN_UP((uint32_t)base, HEAP_ALIGN);
+	uint32_t end = ALIGN_DOWN((uint32_t)base + size, HEAP_ALIGN);
+	heap_region_t *r;
+	heap_block_t *first, *sentinel;
+	uint32_t primask;
+
+	if((region_count >= HEAP_MAX_REGIONS) || (end <= start) || (end - start < (2 * BLOCK_HEADER) + BLOCK_MIN))
+	{
+		return false;
+	}
+	end = MIN(end, start + (2 * BLOCK_HEADER) + BLOCK_MAX);
+
+	cyclesInit();
+	primask = heapLock();
+	r = &regions[region_count];
+	memset(r, 0, sizeof(*r));
+	r->name = name;
+	r->base = (uint8_t *)start;
+	r->end = (uint8_t *)end;
+	r->attrs = attrs;
+
+	first = (heap_block_t *)start;
+	first->prev_phys = NULL;
+	first->size = end - start - (2 * BLOCK_HEADER);
+	sentinel = blockNext(first);
+	sentinel->prev_phys = first;
+	sentinel->size = 0;
+	blockRelease(r, first);
+
+	region_count++;
+	heapUnlock(primask);
+	return true;
+}
+
+// -----------------------------------------------------------------------------
+// Description: Allocates memory according to a placement hint
+//     Returns: Pointer to the allocation, NULL if no suitable region has room
+//      Inputs: Size in bytes, placement hint
+// -----------------------------------------------------------------------------
+void *heapAlloc(size_t size, heap_hint_t hint)
+{
+	return heapAllocAligned(size, (hint == HEAP_HINT_DMA) ? HEAP_DMA_ALIGN : HEAP_ALIGN, hint);
+}
+
+// -----------------------------------------------------------------------------
+// Description: Allocates memory with an explicit alignment
+//     Returns: Pointer to the allocation, NULL if no suitable region has room
+//      Inputs: Size in bytes, alignment (power of two), placement hint
+// -----------------------------------------------------------------------------
+void *heapAllocAligned(size_t size, size_t align, heap_hint_t hint)
+{
+	uint32_t adjusted, primask, start;
+	void *ptr;
+
+	if(!regions_ready)
+	{
+		// Under the lock, so that an interrupt allocating meanwhile finds the
+		// regions all registered; flagged first, for an override that allocates
+		primask = heapLock();
+		if(!regions_ready)
+		{
+			regions_ready = true;
+			heapInitRegions();
+		}
+		heapUnlock(primask);
+	}
+	// 0: the request can never be satisfied
+	adjusted = ((align & (align - 1)) == 0) ? adjustSize(size, (hint == HEAP_HINT_DMA) ? HEAP_DMA_ALIGN : HEAP_ALIGN) : 0;
+	if(hint == HEAP_HINT_DMA)
+	{
+		align = MAX(align, HEAP_DMA_ALIGN);
+	}
+
+	primask = heapLock();
+	ptr = NULL;
+	if(adjusted)
+	{
+		start = cycles();
+		ptr = hintedAlloc(adjusted, MAX(align, HEAP_ALIGN), hint);
+		latencyRecord(&alloc_latency, cyclesElapsed(start));
+	}
+	// Counted once per request, however many regions were tried
+	if(!ptr)
+	{
+		alloc_failures++;
+	}
+	heapUnlock(primask);
+	return ptr;
+}
+
+// -----------------------------------------------------------------------------
+// Description: Returns an allocation to its region (NULL is ignored)
+//     Returns: none
+//      Inputs: Pointer from heapAlloc()/heapAllocAligned()/heapRealloc()
+// -----------------------------------------------------------------------------
+void heapFree(void *ptr)
+{
+	heap_region_t *r;
+	heap_block_t *b;
+	uint32_t primask, start;
+
+	if(!ptr)
+	{
+		return;
+	}
+	r = regionOf(ptr);
+	assert(r);
+	if(!r)
+	{
+		return;
+	}
+	b = blockFromPayload(ptr);
+	assert(!blockIsFree(b));
+	if(blockIsFree(b))
+	{
+		return;
+	}
+
+	primask = heapLock();
+	start = cycles();
+	r->used -= blockSize(b) + BLOCK_HEADER;
+	r->frees++;
+	blockRelease(r, b);
+	latencyRecord(&free_latency, cyclesElapsed(start));
+	heapUnlock(primask);
+}
+
+// -----------------------------------------------------------------------------
+// Description: Resizes an allocation, in place when the next block allows it.
+//              A moved allocation stays in a region with the same attributes
+//              when possible.
+//     Returns: Pointer to the resized allocation, NULL on failure (the
+//              original allocation is then left untouched)
+//      Inputs: Pointer (may be NULL), new size in bytes
+// -----------------------------------------------------------------------------
+void *heapRealloc(void *ptr, size_t size)
+{
+	heap_region_t *r;
+	heap_block_t *b, *next, *rem;
+	uint32_t adjusted, cur, primask;
+	uint32_t align = HEAP_ALIGN;
+	void *moved;
+
+	if(!ptr)
+	{
+		return heapAlloc(size, HEAP_HINT_ANY);
+	}
+	if(!size)
+	{
+		heapFree(ptr);
+		return NULL;
+	}
+	r = regionOf(ptr);
+	assert(r);
+	if(!r)
+	{
+		return NULL;
+	}
+
+	// Keep the cache line padding of DMA buffers
+	if((r->attrs & HEAP_ATTR_DMA) && !((uint32_t)ptr & (HEAP_DMA_ALIGN - 1)))
+	{
+		align = HEAP_DMA_ALIGN;
+	}
+	adjusted = adjustSize(size, align);
+	if(!adjusted)
+	{
+		return NULL;
+	}
+
+	primask = heapLock();
+	b = blockFromPayload(ptr);
+	cur = blockSize(b);
+	next = blockNext(b);
+	if((adjusted > cur) && blockIsFree(next) && (cur + BLOCK_HEADER + blockSize(next) >= adjusted))
+	{
+		freeListRemove(r, next);
+		b->size += blockSize(next) + BLOCK_HEADER;
+		blockNext(b)->prev_phys = b;
+	}
+	if(blockSize(b) >= adjusted)
+	{
+		rem = blockSplit(b, adjusted);
+		if(rem)
+		{
+			blockRelease(r, rem);
+		}
+		r->used += blockSize(b) - cur;
+		r->peak = MAX(r->peak, r->used);
+		heapUnlock(primask);
+		return ptr;
+	}
+	heapUnlock(primask);
+
+	if(align == HEAP_DMA_ALIGN)
+	{
+		moved = heapAlloc(size, HEAP_HINT_DMA);
+	}
+	else
+	{
+		moved = heapAlloc(size, (r->attrs & HEAP_ATTR_FAST) ? HEAP_HINT_FAST :
+		                        (r->attrs & HEAP_ATTR_LARGE) ? HEAP_HINT_LARGE : HEAP_HINT_ANY);
+	}
+	if(moved)
+	{
+		memcpy(moved, ptr, MIN(cur, size));
+		heapFree(ptr);
+	}
+	return moved;
+}
+
+// -----------------------------------------------------------------------------
+// Description: Provides the usable size of an allocation
+//     Returns: See above (0 for NULL)
+//      Inputs: Pointer
+// -----------------------------------------------------------------------------
+size_t heapUsableSize(const void *ptr)
+{
+	return ptr ? blockSize(blockFromPayload(ptr)) : 0;
+}
+
+uint32_t heapRegionCount(void)
+{
+	return region_count;
+}
+
+// -----------------------------------------------------------------------------
+// Description: Collects usage and fragmentation statistics of a region. Walks
+//              the free lists, so it is not O(1) and is meant for reports.
+//     Returns: false if the region index is out of range
+//      Inputs: Region index, stats storage
+// -----------------------------------------------------------------------------
+bool heapGetRegionStats(uint32_t region, heap_region_stats_t *stats)
+{
+	heap_region_t *r;
+	uint32_t primask;
+
+	if(region >= region_count)
+	{
+		return false;
+	}
+	r = &regions[region];
+	memset(stats, 0, sizeof(*stats));
+
+	primask = heapLock();
+	stats->name = r->name;
+	stats->attrs = r->attrs;
+	stats->size = r->end - r->base;
+	stats->used = r->used;
+	stats->peak = r->peak;
+	stats->allocs = r->allocs;
+	stats->frees = r->frees;
+	for(uint32_t fl = 0; fl < HEAP_FL_COUNT; fl++)
+	{
+		for(uint32_t sl = 0; sl < HEAP_SL_COUNT; sl++)
+		{
+			for(heap_block_t *b = r->free_list[fl][sl]; b; b = b->next_free)
+			{
+				stats->free_bytes += blockSize(b);
+				stats->largest_free = MAX(stats->largest_free, blockSize(b));
+				stats->free_blocks++;
+			}
+		}
+	}
+	heapUnlock(primask);
+
+	if(stats->free_bytes)
+	{
+		stats->frag_permille = 1000 - (uint32_t)(((uint64_t)stats->largest_free * 1000) / stats->free_bytes);
+	}
+	return true;
+}
+
+// -----------------------------------------------------------------------------
+// Description: Provides the allocation and free latency statistics
+//     Returns: none
+//      Inputs: Storage for each (either may be NULL)
+// -----------------------------------------------------------------------------
+void heapGetLatency(heap_latency_t *alloc, heap_latency_t *release)
+{
+	uint32_t primask = heapLock();
+
+	if(alloc)
+	{
+		*alloc = alloc_latency;
+	}
+	if(release)
+	{
+		*release = free_latency;
+	}
+	heapUnlock(primask);
+}
+
+// -----------------------------------------------------------------------------
+// Description: Provides the number of allocation requests that failed
+//     Returns: Failed requests since start up, each counted once
+//      Inputs: none
+// -----------------------------------------------------------------------------
+uint32_t heapFailureCount(void)
+{
+	return alloc_failures;
+}
+
+// -----------------------------------------------------------------------------
+// Description: Prints region and latency statistics as CSV
+//     Returns: none
+//      Inputs: none
+// -----------------------------------------------------------------------------
+void heapPrintStats(void)
+{
+	heap_region_stats_t s;
+	heap_latency_t lat[2];
+
+	printf("heap,region,attrs,size,used,peak,free,largest_free,free_blocks,frag_permille,allocs,frees" EOL);
+	for(uint32_t i = 0; heapGetRegionStats(i, &s); i++)
+	{
+		printf("heap,%s,%lu,%lu,%lu,%lu,%lu,%lu,%lu,%lu,%lu,%lu" EOL, s.name, s.attrs, s.size, s.used, s.peak,
+		       s.free_bytes, s.largest_free, s.free_blocks, s.frag_permille, s.allocs, s.frees);
+	}
+	printf("heap_failures,count" EOL);
+	printf("heap_failures,%lu" EOL, heapFailureCount());
+
+	heapGetLatency(&lat[0], &lat[1]);
+	printf("heap_latency,op,count,mean,min,max" EOL);
+	for(uint32_t i = 0; i < ARRAY_SIZE(lat); i++)
+	{
+		printf("heap_latency,%s,%lu,%lu,%lu,%lu" EOL, i ? "free" : "alloc", lat[i].count,
+		       lat[i].count ? (uint32_t)(lat[i].total / lat[i].count) : 0,
+		       lat[i].count ? lat[i].min : 0, lat[i].max);
+	}
+}
@@ -0,0 +1,97 @@
+/* SPDX-License-Identifier: Unlicense */
+
+#ifndef HEAP_H_
+#define HEAP_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// -----------------------------------------------------------------------------
+// Includes
+// -----------------------------------------------------------------------------
+#include <stddef.h>
+#include "common.h"
+
+// -----------------------------------------------------------------------------
+// Constants
+// -----------------------------------------------------------------------------
+#ifndef HEAP_MAX_REGIONS
+#define HEAP_MAX_REGIONS            4
+#endif
+
+// Allocations at or above this size prefer a HEAP_ATTR_LARGE region when no hint is given
+#ifndef HEAP_LARGE_THRESHOLD
+#define HEAP_LARGE_THRESHOLD        (16 * 1024)
+#endif
+
+#define HEAP_ALIGN                  8
+#define HEAP_DMA_ALIGN              32          // D-cache line size
+
+// Region attributes
+#define HEAP_ATTR_FAST              BIT(0)      // Zero wait state (TCM)
+#define HEAP_ATTR_DMA               BIT(1)      // Reachable by the DMA masters
+#define HEAP_ATTR_LARGE             BIT(2)      // Bulk storage (external memory)
+
+typedef enum
+{
+	HEAP_HINT_ANY,                  // Small/medium in internal RAM, large in external RAM
+	HEAP_HINT_FAST,                 // Prefer TCM, fall back to any region
+	HEAP_HINT_DMA,                  // DMA reachable only, cache line aligned and padded
+	HEAP_HINT_LARGE,                // Prefer external RAM, fall back to any region
+} heap_hint_t;
+
+typedef struct
+{
+	const char *name;
+	uint32_t attrs;
+	uint32_t size;                  // Bytes managed, including block headers
+	uint32_t used;                  // Bytes in allocated blocks, including block headers
+	uint32_t peak;                  // High watermark of used
+	uint32_t free_bytes;            // Bytes available in free blocks
+	uint32_t largest_free;          // Largest single allocation that would succeed
+	uint32_t free_blocks;
+	uint32_t frag_permille;         // 1000 * (1 - largest_free / free_bytes)
+	uint32_t allocs;
+	uint32_t frees;
+} heap_region_stats_t;
+
+typedef struct
+{
+	uint32_t count;
+	uint32_t min;                   // CPU cycles
+	uint32_t max;
+	uint64_t total;
+} heap_latency_t;
+
+// -----------------------------------------------------------------------------
+// Public Functions
+// -----------------------------------------------------------------------------
+void heapInitRegions(void);
+bool heapAddRegion(const char *name, void *base, size_t size, uint32_t attrs);
+void *heapAlloc(size_t size, heap_hint_t hint);
+void *heapAllocAligned(size_t size, size_t align, heap_hint_t hint);
+void *heapRealloc(void *ptr, size_t size);
+void heapFree(void *ptr);
+size_t heapUsableSize(const void *ptr);
+uint32_t heapRegionCount(void);
+bool heapGetRegionStats(uint32_t region, heap_region_stats_t *stats);
+void heapGetLatency(heap_latency_t *alloc, heap_latency_t *release);
+uint32_t heapFailureCount(void);
+void heapPrintStats(void);
+
+//------------------------------------------------------------------------------
+// Description: Allocates memory with a placement hint (see heap_hint_t)
+//     Returns: Pointer to the allocation, NULL when no suitable region has room
+//      Inputs: Size in bytes, placement hint
+//------------------------------------------------------------------------------
+static inline void *malloc_hint(size_t size, heap_hint_t hint)
+{
+	return heapAlloc(size, hint);
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // HEAP_H_
@@ -0,0 +1,406 @@
+/* SPDX-License-Identifier: Unlicense */
+
+// -----------------------------------------------------------------------------
+// IMPLEMENTATION NOTES
+//
+// printf() output (Common/debug.c) goes to a ring buffer, and GPDMA1 channel 2
+// drains it to UART4 in the background, so a write costs a copy instead of
+// the time the bytes take on the wire (10 ms for the boot banner at 115200).
+//
+// Writers reserve space by moving reserve_at with LDREX/STREX: an interrupt
+// between the two clears the reservation and the loop tries again, so thread
+// code and any interrupt handler can write at the same time without masking
+// interrupts. Reserved space becomes visible to the DMA (commit_at) only when
+// the last writer in progress is done: interrupts nest, so the first writer
+// to start is the last to finish and publishes for all of them.
+//
+//   free_at <= send_at <= commit_at <= reserve_at     (modulo 2^32)
+//   [free_at, send_at)       in flight (or dropped by an overwrite meanwhile)
+//   [send_at, commit_at)     waiting for the DMA
+//   [commit_at, reserve_at)  being copied by writers
+//
+// The DMA side (sinkService()) runs with interrupts masked, from the channel
+// interrupt and from writers waiting for room, so it makes progress whatever
+// the priority of the waiting code. Transfers stop at the end of the ring and
+// at LOG_SINK_CHUNK bytes, which bounds how long a full buffer waits on the
+// transfer in flight.
+//
+// A write that does not fit follows the policy: drop it, drop the oldest
+// output not in flight, or wait for the DMA. Overwrite drops no more than the
+// write needs: behind a transfer in flight, dropped output is only freed when
+// the transfer ends, so it drops what the transfer leaves missing and waits
+// for it. When the output not in flight is not enough, or the writer may not
+// wait, the new write is dropped instead and the old output kept.
+//
+// A writer that interrupted another one can wait for nothing but the transfer
+// in flight, since the one it interrupted holds back the commit; it drops its
+// output once the DMA is idle. Output is kept whole per write up to half the
+// buffer. logSinkTryWrite() never waits, whatever the policy: for handlers
+// with deadlines (Common/dlog.c).
+// logSinkWriteRecord() always waits, whatever the policy: for binary dumps that
+// must arrive whole and in order with the text around them (Common/pcSample.c,
+// Common/zoneProfile.c).
+//
+// Output written before logSinkInit() is buffered and sent by it. Code that
+// sends to UART4 directly (firmware update replies) or changes its rate calls
+// logSinkFlush() first.
+//
+// -----------------------------------------------------------------------------
+
+#include "logSink.h"
+#include "stm32.h"
+
+#define LOG_SINK_DMA            GPDMA1_Channel2
+#define LOG_SINK_DMA_IRQn       GPDMA1_Channel2_IRQn
+#define LOG_SINK_DMA_ERRORS     (DMA_CSR_DTEF | DMA_CSR_ULEF | DMA_CSR_USEF)
+#define LOG_SINK_DMA_FLAGS      (DMA_CFCR_TCF | DMA_CFCR_HTF | DMA_CFCR_DTEF | DMA_CFCR_ULEF | \
+                                 DMA_CFCR_USEF | DMA_CFCR_SUSPF | DMA_CFCR_TOF)
+#define LOG_SINK_MASK           (LOG_SINK_SIZE - 1)
+
+static uint8_t ring[LOG_SINK_SIZE] __attribute__((aligned(__SCB_DCACHE_LINE_SIZE)));
+static volatile uint32_t free_at;
+static volatile uint32_t send_at;
+static volatile uint32_t commit_at;
+static volatile uint32_t reserve_at;
+static volatile uint32_t writers;               // Between reserve and publish
+static volatile bool busy;                      // DMA transfer in flight
+static bool started;
+static volatile log_sink_policy_t policy = LOG_SINK_POLICY;
+static log_sink_stats_t stats;
+
+static inline uint32_t sinkLock(void)
+{
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+	return primask;
+}
+
+static inline void sinkUnlock(uint32_t primask)
+{
+	__set_PRIMASK(primask);
+}
+
+static uint32_t sinkAtomicAdd(volatile uint32_t *value, uint32_t n)
+{
+	uint32_t v;
+
+	do
+	{
+		v = __LDREXW(value) + n;
+	} while(__STREXW(v, value) != 0);
+	return v;
+}
+
+// -----------------------------------------------------------------------------
+// Description: Retires the transfer in flight if done and starts the next one.
+//              Interrupts masked.
+//     Returns: none
+//      Inputs: none
+// -----------------------------------------------------------------------------
+static void sinkService(void)
+{
+	DMA_Channel_TypeDef *ch = LOG_SINK_DMA;
+	uint32_t s, index, len, line;
+
+	if(busy)
+	{
+		uint32_t csr = ch->CSR;
+
+		if(!(csr & (DMA_CSR_TCF | LOG_SINK_DMA_ERRORS)))
+		{
+			return;
+		}
+		ch->CFCR = LOG_SINK_DMA_FLAGS;
+		if(csr & LOG_SINK_DMA_ERRORS)
+		{
+			stats.errors++;
+		}
+		free_at = send_at;
+		busy = false;
+	}
+
+	s = send_at;
+	if(!started || (commit_at == s))
+	{
+		return;
+	}
+	index = s & LOG_SINK_MASK;
+	len = MIN(MIN(commit_at - s, LOG_SINK_SIZE - index), LOG_SINK_CHUNK);
+	line = index & ~(__SCB_DCACHE_LINE_SIZE - 1);
+	SCB_CleanDCache_by_Addr(&ring[line], (int32_t)(len + index - line));
+
+	ch->CBR1 = len;
+	ch->CSAR = (uint32_t)&ring[index];
+	ch->CCR = DMA_CCR_EN | DMA_CCR_TCIE | DMA_CCR_DTEIE | DMA_CCR_ULEIE | DMA_CCR_USEIE;
+	send_at = s + len;
+	busy = true;
+	stats.transfers++;
+}
+
+void GPDMA1_Channel2_IRQHandler(void)
+{
+	uint32_t primask = sinkLock();
+
+	sinkService();
+	sinkUnlock(primask);
+}
+
+// -----------------------------------------------------------------------------
+// Description: Applies an overflow policy to a write that does not fit
+//     Returns: true when it may fit now, false to drop it
+//      Inputs: Bytes to write, policy, whether it may wait for the DMA
+// -----------------------------------------------------------------------------
+static bool sinkMakeRoom(uint32_t n, log_sink_policy_t p, bool wait)
+{
+	for(;;)
+	{
+		uint32_t primask = sinkLock();
+		uint32_t room;
+		bool waiting;
+
+		sinkService();
+		room = LOG_SINK_SIZE - (reserve_at - free_at);
+		if(room >= n)
+		{
+			sinkUnlock(primask);
+			return true;
+		}
+		if(p == LOG_SINK_OVERWRITE)
+		{
+			// Output dropped behind a transfer in flight is freed with it:
+			// drop what that still leaves missing, or else the new output
+			uint32_t freed = send_at - free_at;
+			uint32_t lost = (n - room > freed) ? n - room - freed : 0;
+
+			if((busy && !wait) || (lost > commit_at - send_at))
+			{
+				sinkUnlock(primask);
+				return false;
+			}
+			send_at += lost;
+			if(!busy)
+			{
+				free_at = send_at;
+			}
+			stats.overwritten += lost;
+			sinkUnlock(primask);
+			continue;
+		}
+		// Only the transfer in flight can free space
+		waiting = wait && busy && (p != LOG_SINK_DROP);
+		sinkUnlock(primask);
+		if(!waiting)
+		{
+			return false;
+		}
+	}
+}
+
+// -----------------------------------------------------------------------------
+// Description: Ends a write, and hands the output to the DMA after the last
+//              writer in progress
+//     Returns: none
+//      Inputs: none
+// -----------------------------------------------------------------------------
+static void sinkPublish(void)
+{
+	uint32_t end;
+
+	if(sinkAtomicAdd(&writers, (uint32_t)-1) != 0)
+	{
+		return;
+	}
+	do
+	{
+		(void)__LDREXW(&commit_at);
+		end = reserve_at;
+	} while(__STREXW(end, &commit_at) != 0);
+
+	if(!busy)
+	{
+		NVIC_SetPendingIRQ(LOG_SINK_DMA_IRQn);
+	}
+}
+
+static bool sinkPut(const uint8_t *data, uint32_t n, log_sink_policy_t p, bool wait)
+{
+	uint32_t r, index, first;
+
+	sinkAtomicAdd(&writers, 1);
+	for(;;)
+	{
+		r = __LDREXW(&reserve_at);
+		if((LOG_SINK_SIZE - (r - free_at)) < n)
+		{
+			__CLREX();
+			if(!sinkMakeRoom(n, p, wait))
+			{
+				sinkPublish();
+				return false;
+			}
+		}
+		else if(__STREXW(r + n, &reserve_at) == 0)
+		{
+			break;
+		}
+	}
+
+	index = r & LOG_SINK_MASK;
+	first = MIN(n, LOG_SINK_SIZE - index);
+	memcpy(&ring[index], data, first);
+	memcpy(&ring[0], data + first, n - first);
+	stats.max_fill = MAX(stats.max_fill, r + n - free_at);
+	sinkAtomicAdd(&stats.written, n);
+	sinkPublish();
+	return true;
+}
+
+// -----------------------------------------------------------------------------
+// Description: Starts the DMA to UART4, once the UART is set up
+//     Returns: none
+//      Inputs: none
+// -----------------------------------------------------------------------------
+void logSinkInit(void)
+{
+	DMA_Channel_TypeDef *ch = LOG_SINK_DMA;
+	uint32_t primask;
+
+	RCC->AHB1ENR |= RCC_AHB1ENR_GPDMA1EN;
+	(void)RCC->AHB1ENR;
+
+	primask = sinkLock();
+	ch->CCR = DMA_CCR_RESET;
+	ch->CFCR = LOG_SINK_DMA_FLAGS;
+	ch->CTR1 = DMA_CTR1_SINC;
+	ch->CTR2 = (GPDMA1_REQUEST_UART4_TX << DMA_CTR2_REQSEL_Pos) | DMA_CTR2_DREQ;
+	ch->CDAR = (uint32_t)&UART4->TDR;
+	ch->CLLR = 0;
+	UART4->CR3 |= USART_CR3_DMAT;
+	busy = false;
+	free_at = send_at;
+	started = true;
+	HAL_NVIC_SetPriority(LOG_SINK_DMA_IRQn, LOG_SINK_PRIORITY, 0);
+	HAL_NVIC_EnableIRQ(LOG_SINK_DMA_IRQn);
+	sinkService();
+	sinkUnlock(primask);
+}
+
+void logSinkSetPolicy(log_sink_policy_t p)
+{
+	policy = p;
+}
+
+// -----------------------------------------------------------------------------
+// Description: Queues output for UART4, from any context
+//     Returns: Bytes accepted, short of size when the policy dropped some
+//      Inputs: Output, its size
+// -----------------------------------------------------------------------------
+uint32_t logSinkWrite(const void *data, uint32_t size)
+{
+	const uint8_t *p = data;
+	uint32_t done = 0;
+
+	while(done < size)
+	{
+		uint32_t n = MIN(size - done, LOG_SINK_SIZE / 2);
+
+		if(!sinkPut(p + done, n, policy, true))
+		{
+			sinkAtomicAdd(&stats.dropped, size - done);
+			break;
+		}
+		done += n;
+	}
+	return done;
+}
+
+// -----------------------------------------------------------------------------
+// Description: Queues output for UART4 without ever waiting: the block policy
+//              drops instead, and so does overwrite while a transfer is in
+//              flight. For interrupt handlers with deadlines.
+//     Returns: true when accepted whole
+//      Inputs: Output, its size (up to LOG_SINK_SIZE / 2)
+// -----------------------------------------------------------------------------
+bool logSinkTryWrite(const void *data, uint32_t size)
+{
+	if((size > LOG_SINK_SIZE / 2) || !sinkPut(data, size, policy, false))
+	{
+		sinkAtomicAdd(&stats.dropped, size);
+		return false;
+	}
+	return true;
+}
+
+// -----------------------------------------------------------------------------
+// Description: Queues a binary record for UART4 whole, after the output
+//              written so far: waits for room whatever the policy, so that no
+//              part of it or of an earlier record is dropped. Thread code.
+//     Returns: true when accepted, false when it can never fit (the record
+//              is then dropped whole)
+//      Inputs: Record, its size (up to LOG_SINK_SIZE / 2)
+// -----------------------------------------------------------------------------
+bool logSinkWriteRecord(const void *data, uint32_t size)
+{
+	if((size > LOG_SINK_SIZE / 2) || !sinkPut(data, size, LOG_SINK_BLOCK, true))
+	{
+		sinkAtomicAdd(&stats.dropped, size);
+		return false;
+	}
+	return true;
+}
+
+// -----------------------------------------------------------------------------
+// Description: Waits until the output written so far is on the wire. Works
+//              with interrupts masked.
+//     Returns: none
+//      Inputs: none
+// -----------------------------------------------------------------------------
+void logSinkFlush(void)
+{
+	bool waiting;
+
+	if(!started)
+	{
+		return;
+	}
+	do
+	{
+		uint32_t primask = sinkLock();
+
+		sinkService();
+		waiting = busy;
+		sinkUnlock(primask);
+	} while(waiting);
+
+	while(!(UART4->ISR & USART_ISR_TC))
+	{
+	}
+}
+
+// -----------------------------------------------------------------------------
+// Description: Provides a snapshot of the sink statistics
+//     Returns: none
+//      Inputs: Statistics storage
+// -----------------------------------------------------------------------------
+void logSinkGetStats(log_sink_stats_t *s)
+{
+	uint32_t primask = sinkLock();
+
+	*s = stats;
+	sinkUnlock(primask);
+}
+
+// -----------------------------------------------------------------------------
+// Description: Prints the sink statistics as CSV
+//     Returns: none
+//      Inputs: none
+// -----------------------------------------------------------------------------
+void logSinkReport(void)
+{
+	log_sink_stats_t s;
+
+	logSinkGetStats(&s);
+	printf("log,written,dropped,overwritten,max_fill,size,transfers,errors,baud" EOL);
+	printf("log,%lu,%lu,%lu,%lu,%u,%lu,%lu,%lu" EOL,
+	       s.written, s.dropped, s.overwritten, s.max_fill, LOG_SINK_SIZE, s.transfers, s.errors, huart4.Init.BaudRate);
+}
@@ -0,0 +1,75 @@
+/* SPDX-License-Identifier: Unlicense */
+
+#ifndef LOGSINK_H_
+#define LOGSINK_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// -----------------------------------------------------------------------------
+// Includes
+// -----------------------------------------------------------------------------
+#include "common.h"
+
+// -----------------------------------------------------------------------------
+// Constants
+// -----------------------------------------------------------------------------
+// Buffered output, power of two
+#ifndef LOG_SINK_SIZE
+#define LOG_SINK_SIZE               8192
+#endif
+
+// Longest DMA transfer: bounds the wait of a full buffer on the transfer in flight
+#ifndef LOG_SINK_CHUNK
+#define LOG_SINK_CHUNK              256
+#endif
+
+// DMA completion interrupt priority
+#ifndef LOG_SINK_PRIORITY
+#define LOG_SINK_PRIORITY           15
+#endif
+
+// Overflow policy at start up, see log_sink_policy_t
+#ifndef LOG_SINK_POLICY
+#define LOG_SINK_POLICY             LOG_SINK_BLOCK
+#endif
+
+// -----------------------------------------------------------------------------
+// Types
+// -----------------------------------------------------------------------------
+// What a write does when the buffer is full
+typedef enum
+{
+	LOG_SINK_DROP,                  // Drops the new output
+	LOG_SINK_OVERWRITE,             // Drops the oldest output not yet sent, or the new output if that is not enough
+	LOG_SINK_BLOCK,                 // Waits for the UART, drops only when waiting cannot help
+} log_sink_policy_t;
+
+typedef struct
+{
+	uint32_t written;               // Bytes accepted
+	uint32_t dropped;               // Bytes of new output lost
+	uint32_t overwritten;           // Bytes of old output lost
+	uint32_t max_fill;              // Bytes, highest buffer level
+	uint32_t transfers;             // DMA transfers
+	uint32_t errors;                // DMA transfer errors
+} log_sink_stats_t;
+
+// -----------------------------------------------------------------------------
+// Public Functions
+// -----------------------------------------------------------------------------
+void logSinkInit(void);
+void logSinkSetPolicy(log_sink_policy_t policy);
+uint32_t logSinkWrite(const void *data, uint32_t size);
+bool logSinkTryWrite(const void *data, uint32_t size);
+bool logSinkWriteRecord(const void *data, uint32_t size);
+void logSinkFlush(void);
+void logSinkGetStats(log_sink_stats_t *stats);
+void logSinkReport(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // LOGSINK_H_
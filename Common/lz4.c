@@ -0,0 +1,146 @@
+/* SPDX-License-Identifier: Unlicense */
+
+// -----------------------------------------------------------------------------
+// IMPLEMENTATION NOTES
+//
+// Decoder for the LZ4 block format (no frame): a sequence is a token (literal
+// length : match length, 4 bits each, 15 = extended by 255-run bytes), the
+// literals, then a 16-bit little endian match offset. The last sequence only
+// has literals. Images are packed by Tools/imagepack.py.
+//
+// Every length and offset is checked against both buffers, so a corrupted
+// block fails instead of writing out of bounds. Copies move 8 bytes per step
+// with unaligned word accesses and may write up to 7 bytes past the end of a
+// literal run or match, which is only allowed while at least 8 bytes of the
+// output buffer are left; the tail of the buffer is written byte by byte.
+//
+// -----------------------------------------------------------------------------
+
+#include "lz4.h"
+#include "stm32.h"
+
+#define LZ4_MIN_MATCH           4
+#define LZ4_WILD                8           // Bytes per copy step
+
+static inline void lz4Copy8(uint8_t *dst, const uint8_t *src)
+{
+	uint32_t a = __UNALIGNED_UINT32_READ(src);
+	uint32_t b = __UNALIGNED_UINT32_READ(src + 4);
+
+	__UNALIGNED_UINT32_WRITE(dst, a);
+	__UNALIGNED_UINT32_WRITE(dst + 4, b);
+}
+
+// -----------------------------------------------------------------------------
+// Description: Reads the 255-run extension of a length field
+//     Returns: false if the input ends first
+//      Inputs: Input cursor, input end, length to extend
+// -----------------------------------------------------------------------------
+static inline bool lz4Length(const uint8_t **ip, const uint8_t *iend, uint32_t *len)
+{
+	uint32_t b;
+
+	do
+	{
+		if(*ip >= iend)
+		{
+			return false;
+		}
+		b = *(*ip)++;
+		*len += b;
+	} while(b == 255);
+	return true;
+}
+
+// -----------------------------------------------------------------------------
+// Description: Decompresses one LZ4 block
+//     Returns: Bytes written, LZ4_ERROR if the block is malformed or does not
+//              fit the output buffer
+//      Inputs: Block, block size, output buffer, output buffer size
+// -----------------------------------------------------------------------------
+int32_t lz4Decompress(const uint8_t *src, uint32_t src_size, uint8_t *dst, uint32_t dst_size)
+{
+	const uint8_t *ip = src;
+	const uint8_t *iend = src + src_size;
+	uint8_t *op = dst;
+	uint8_t *oend = dst + dst_size;
+
+	while(ip < iend)
+	{
+		uint32_t token = *ip++;
+		uint32_t len = token >> 4;
+		uint32_t offset;
+		const uint8_t *match;
+
+		// Literals
+		if((len == 15) && !lz4Length(&ip, iend, &len))
+		{
+			return LZ4_ERROR;
+		}
+		if((len > (uint32_t)(iend - ip)) || (len > (uint32_t)(oend - op)))
+		{
+			return LZ4_ERROR;
+		}
+		if(((len + LZ4_WILD) <= (uint32_t)(oend - op)) && ((len + LZ4_WILD) <= (uint32_t)(iend - ip)))
+		{
+			for(uint32_t n = 0; n < len; n += LZ4_WILD)
+			{
+				lz4Copy8(op + n, ip + n);
+			}
+		}
+		else
+		{
+			for(uint32_t n = 0; n < len; n++)
+			{
+				op[n] = ip[n];
+			}
+		}
+		op += len;
+		ip += len;
+		if(ip >= iend)
+		{
+			break;
+		}
+
+		// Match
+		if((iend - ip) < 2)
+		{
+			return LZ4_ERROR;
+		}
+		offset = ip[0] | ((uint32_t)ip[1] << 8);
+		ip += 2;
+		if((offset == 0) || (offset > (uint32_t)(op - dst)))
+		{
+			return LZ4_ERROR;
+		}
+		len = token & 15;
+		if((len == 15) && !lz4Length(&ip, iend, &len))
+		{
+			return LZ4_ERROR;
+		}
+		len += LZ4_MIN_MATCH;
+		if(len > (uint32_t)(oend - op))
+		{
+			return LZ4_ERROR;
+		}
+
+		match = op - offset;
+		if((offset >= LZ4_WILD) && ((len + LZ4_WILD) <= (uint32_t)(oend - op)))
+		{
+			for(uint32_t n = 0; n < len; n += LZ4_WILD)
+			{
+				lz4Copy8(op + n, match + n);
+			}
+		}
+		else
+		{
+			// Overlapping match (run) or end of buffer
+			for(uint32_t n = 0; n < len; n++)
+			{
+				op[n] = match[n];
+			}
+		}
+		op += len;
+	}
+	return (int32_t)(op - dst);
+}
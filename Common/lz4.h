@@ -0,0 +1,29 @@
+/* SPDX-License-Identifier: Unlicense */
+
+#ifndef LZ4_H_
+#define LZ4_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// -----------------------------------------------------------------------------
+// Includes
+// -----------------------------------------------------------------------------
+#include "common.h"
+
+// -----------------------------------------------------------------------------
+// Constants
+// -----------------------------------------------------------------------------
+#define LZ4_ERROR                   (-1)
+
+// -----------------------------------------------------------------------------
+// Public Functions
+// -----------------------------------------------------------------------------
+int32_t lz4Decompress(const uint8_t *src, uint32_t src_size, uint8_t *dst, uint32_t dst_size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // LZ4_H_
@@ -0,0 +1,246 @@
+/* SPDX-License-Identifier: Unlicense */
+
+// -----------------------------------------------------------------------------
+// IMPLEMENTATION NOTES
+//
+// Copy/fill kernels for the XSPI mapped windows. Each byte or halfword store to
+// the PSRAM becomes its own masked write transaction, and a store to the NOR
+// write window must be a whole word, so these kernels:
+//  - only ever store whole words in the body, 32 bytes (one cache line, one
+//    wrapped PSRAM burst) per iteration: eight loads then eight stores, which
+//    the compiler turns into LDM/STM or LDRD/STRD pairs
+//  - align the destination first and use unaligned word loads for a
+//    misaligned source (the M7 handles those in hardware for normal memory)
+//    instead of shuffling bytes
+//  - limit partial-word stores to at most one byte + one halfword at the head
+//    and at the tail
+//
+// Loop distribution is disabled for the kernels so the compiler cannot turn
+// them back into calls to memcpy()/memset(). There is nothing target specific
+// in here, so the file also builds on a host.
+//
+// -----------------------------------------------------------------------------
+
+#include "memKernels.h"
+
+#define MEM_KERNEL              __attribute__((optimize("no-tree-loop-distribute-patterns")))
+
+typedef uint32_t __attribute__((may_alias)) mem_u32_t;
+typedef uint16_t __attribute__((may_alias)) mem_u16_t;
+
+static inline uint32_t loadU32(const uint8_t *p)
+{
+	uint32_t v;
+	memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+static inline uint16_t loadU16(const uint8_t *p)
+{
+	uint16_t v;
+	memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+// -----------------------------------------------------------------------------
+// Description: Copies whole words from a source of any alignment
+//     Returns: none
+//      Inputs: Word aligned destination, source, # of words
+// -----------------------------------------------------------------------------
+static MEM_KERNEL void copyWordsUnaligned(mem_u32_t *dst, const uint8_t *src, uint32_t words)
+{
+	while(words >= 8)
+	{
+		uint32_t a = loadU32(src), b = loadU32(src + 4), c = loadU32(src + 8), d = loadU32(src + 12);
+		uint32_t e = loadU32(src + 16), f = loadU32(src + 20), g = loadU32(src + 24), h = loadU32(src + 28);
+
+		dst[0] = a; dst[1] = b; dst[2] = c; dst[3] = d;
+		dst[4] = e; dst[5] = f; dst[6] = g; dst[7] = h;
+		dst += 8;
+		src += 32;
+		words -= 8;
+	}
+	while(words--)
+	{
+		*dst++ = loadU32(src);
+		src += 4;
+	}
+}
+
+// -----------------------------------------------------------------------------
+// Description: Copies whole words between word aligned buffers
+//     Returns: none
+//      Inputs: Destination, source, # of words
+// -----------------------------------------------------------------------------
+MEM_KERNEL void memCopyWords(uint32_t *dst, const uint32_t *src, uint32_t words)
+{
+	mem_u32_t *d = dst;
+	const mem_u32_t *s = src;
+
+	while(words >= 8)
+	{
+		uint32_t a = s[0], b = s[1], c = s[2], e = s[3];
+		uint32_t f = s[4], g = s[5], h = s[6], i = s[7];
+
+		d[0] = a; d[1] = b; d[2] = c; d[3] = e;
+		d[4] = f; d[5] = g; d[6] = h; d[7] = i;
+		d += 8;
+		s += 8;
+		words -= 8;
+	}
+	while(words--)
+	{
+		*d++ = *s++;
+	}
+}
+
+// -----------------------------------------------------------------------------
+// Description: Copies bytes to a word-only destination (e.g. the NOR write
+//              window). The size is rounded up to whole words, so up to three
+//              bytes past the end of the source are read.
+//     Returns: none
+//      Inputs: Word aligned destination, source of any alignment, size in bytes
+// -----------------------------------------------------------------------------
+void memCopyToWords(uint32_t *dst, const void *src, uint32_t size)
+{
+	uint32_t words = (size + sizeof(uint32_t) - 1) / sizeof(uint32_t);
+
+	if(((uintptr_t)src & 3) == 0)
+	{
+		memCopyWords(dst, src, words);
+	}
+	else
+	{
+		copyWordsUnaligned(dst, src, words);
+	}
+}
+
+// -----------------------------------------------------------------------------
+// Description: Fills whole words
+//     Returns: none
+//      Inputs: Word aligned destination, fill value, # of words
+// -----------------------------------------------------------------------------
+MEM_KERNEL void memFillWords(uint32_t *dst, uint32_t value, uint32_t words)
+{
+	mem_u32_t *d = dst;
+
+	while(words >= 8)
+	{
+		d[0] = value; d[1] = value; d[2] = value; d[3] = value;
+		d[4] = value; d[5] = value; d[6] = value; d[7] = value;
+		d += 8;
+		words -= 8;
+	}
+	while(words--)
+	{
+		*d++ = value;
+	}
+}
+
+// -----------------------------------------------------------------------------
+// Description: memcpy() for XSPI destinations: word stores only, except for at
+//              most one byte and one halfword at each end
+//     Returns: dst
+//      Inputs: Destination, source, size in bytes
+// -----------------------------------------------------------------------------
+MEM_KERNEL void *memCopyExt(void *dst, const void *src, size_t size)
+{
+	uint8_t *d = dst;
+	const uint8_t *s = src;
+	uint32_t words;
+
+	if(size < 8)
+	{
+		while(size--)
+		{
+			*d++ = *s++;
+		}
+		return dst;
+	}
+
+	if((uintptr_t)d & 1)
+	{
+		*d++ = *s++;
+		size--;
+	}
+	if((uintptr_t)d & 2)
+	{
+		*(mem_u16_t *)d = loadU16(s);
+		d += 2;
+		s += 2;
+		size -= 2;
+	}
+
+	words = size / sizeof(uint32_t);
+	if(((uintptr_t)s & 3) == 0)
+	{
+		memCopyWords((uint32_t *)d, (const uint32_t *)s, words);
+	}
+	else
+	{
+		copyWordsUnaligned((mem_u32_t *)d, s, words);
+	}
+	d += words * sizeof(uint32_t);
+	s += words * sizeof(uint32_t);
+
+	if(size & 2)
+	{
+		*(mem_u16_t *)d = loadU16(s);
+		d += 2;
+		s += 2;
+	}
+	if(size & 1)
+	{
+		*d = *s;
+	}
+	return dst;
+}
+
+// -----------------------------------------------------------------------------
+// Description: memset() for XSPI destinations: word stores only, except for at
+//              most one byte and one halfword at each end
+//     Returns: dst
+//      Inputs: Destination, fill byte, size in bytes
+// -----------------------------------------------------------------------------
+MEM_KERNEL void *memSetExt(void *dst, int c, size_t size)
+{
+	uint8_t *d = dst;
+	uint32_t value = (uint8_t)c * 0x01010101UL;
+	uint32_t words;
+
+	if(size < 8)
+	{
+		while(size--)
+		{
+			*d++ = (uint8_t)c;
+		}
+		return dst;
+	}
+
+	if((uintptr_t)d & 1)
+	{
+		*d++ = (uint8_t)c;
+		size--;
+	}
+	if((uintptr_t)d & 2)
+	{
+		*(mem_u16_t *)d = (uint16_t)value;
+		d += 2;
+		size -= 2;
+	}
+
+	words = size / sizeof(uint32_t);
+	memFillWords((uint32_t *)d, value, words);
+	d += words * sizeof(uint32_t);
+
+	if(size & 2)
+	{
+		*(mem_u16_t *)d = (uint16_t)value;
+		d += 2;
+	}
+	if(size & 1)
+	{
+		*d = (uint8_t)c;
+	}
+	return dst;
+}
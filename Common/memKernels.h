@@ -0,0 +1,106 @@
+/* SPDX-License-Identifier: Unlicense */
+
+#ifndef MEMKERNELS_H_
+#define MEMKERNELS_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// -----------------------------------------------------------------------------
+// Includes
+// -----------------------------------------------------------------------------
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+// -----------------------------------------------------------------------------
+// Constants
+// -----------------------------------------------------------------------------
+#define MEM_XSPI2_BASE              0x70000000UL    // NOR window
+#define MEM_XSPI1_BASE              0x90000000UL    // PSRAM window
+#define MEM_XSPI_WINDOW_SIZE        0x10000000UL
+
+// Copies up to this size with a compile time constant length stay with the compiler's inline memcpy
+#define MEM_INLINE_MAX              16
+
+// -----------------------------------------------------------------------------
+// Public Functions
+// -----------------------------------------------------------------------------
+void memCopyWords(uint32_t *dst, const uint32_t *src, uint32_t words);
+void memCopyToWords(uint32_t *dst, const void *src, uint32_t size);
+void memFillWords(uint32_t *dst, uint32_t value, uint32_t words);
+void *memCopyExt(void *dst, const void *src, size_t size);
+void *memSetExt(void *dst, int c, size_t size);
+
+//------------------------------------------------------------------------------
+// Description: Tells whether an address lies in one of the XSPI mapped windows
+//     Returns: See above
+//      Inputs: Address
+//------------------------------------------------------------------------------
+static inline bool memIsXspi(const void *addr)
+{
+	uint32_t a = (uint32_t)(uintptr_t)addr;
+	return ((a - MEM_XSPI2_BASE) < MEM_XSPI_WINDOW_SIZE) || ((a - MEM_XSPI1_BASE) < MEM_XSPI_WINDOW_SIZE);
+}
+
+//------------------------------------------------------------------------------
+// Description: memcpy() to a destination in an XSPI window, the kernel picked
+//              at compile time: a constant size up to MEM_INLINE_MAX stays with
+//              the inline memcpy, anything else gets the word burst kernel
+//     Returns: dst
+//      Inputs: XSPI destination, source, size in bytes
+//------------------------------------------------------------------------------
+static inline void *memCopyXspi(void *dst, const void *src, size_t size)
+{
+	if(__builtin_constant_p(size) && (size <= MEM_INLINE_MAX))
+	{
+		return memcpy(dst, src, size);
+	}
+	return memCopyExt(dst, src, size);
+}
+
+//------------------------------------------------------------------------------
+// Description: memset() to a destination in an XSPI window, see memCopyXspi()
+//     Returns: dst
+//      Inputs: XSPI destination, fill byte, size in bytes
+//------------------------------------------------------------------------------
+static inline void *memSetXspi(void *dst, int c, size_t size)
+{
+	if(__builtin_constant_p(size) && (size <= MEM_INLINE_MAX))
+	{
+		return memset(dst, c, size);
+	}
+	return memSetExt(dst, c, size);
+}
+
+//------------------------------------------------------------------------------
+// Description: memcpy() for a destination only known at run time, picked by
+//              address: XSPI windows get memCopyXspi(), internal RAM keeps
+//              newlib's copy. Prefer memCopyXspi() or memcpy() when the
+//              memory is known, the address test costs a compare and branch.
+//     Returns: dst
+//      Inputs: Destination, source, size in bytes
+//------------------------------------------------------------------------------
+static inline void *memCopy(void *dst, const void *src, size_t size)
+{
+	return memIsXspi(dst) ? memCopyXspi(dst, src, size) : memcpy(dst, src, size);
+}
+
+//------------------------------------------------------------------------------
+// Description: memset() for a destination only known at run time, see
+//              memCopy()
+//     Returns: dst
+//      Inputs: Destination, fill byte, size in bytes
+//------------------------------------------------------------------------------
+static inline void *memSet(void *dst, int c, size_t size)
+{
+	return memIsXspi(dst) ? memSetXspi(dst, c, size) : memset(dst, c, size);
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // MEMKERNELS_H_
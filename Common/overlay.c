@@ -0,0 +1,365 @@
+/* SPDX-License-Identifier: Unlicense */
+
+// -----------------------------------------------------------------------------
+// IMPLEMENTATION NOTES
+//
+// Code overlays: functions tagged OVERLAY(name) go to an orphan section
+// "ovl_<name>" which the linker places in the NOR with the rest of the code, so
+// they are linked at, and can always run from, their XIP address. The linker
+// also defines __start_ovl_<name>/__stop_ovl_<name>, and OVERLAY_DEFINE() puts
+// a descriptor holding those bounds in the "overlay_table" section: the table
+// of all overlays is therefore assembled at link time, with no registration
+// code and nothing to keep in sync by hand.
+//
+// On a call through OVERLAY_CALL() the overlay is looked up in its RAM state.
+// If it is not resident, the least recently used ITCM slot (an empty one
+// first) is overwritten with a copy of the section and the function pointer
+// is translated to the copy. The copy starts on a word boundary of the source
+// so PC relative literal loads, which align the PC down to a word, see the
+// same layout as in place. ITCM is neither cached nor reachable by the
+// I-cache, so a barrier is all that is needed before executing the copy.
+//
+// OVERLAY_CALL() pins the slot for the duration of the call: a count per slot,
+// taken by overlayFunc() and dropped by overlayRelease() when the call returns
+// (a cleanup variable, so every return path drops it). The variable holds the
+// slot that was pinned, or OVERLAY_NO_SLOT for a call run in place, not the
+// overlay: the overlay may have been loaded meanwhile by a nested call or an
+// interrupt handler, into a slot this call never pinned. A pinned slot is never
+// chosen as a victim, flushed or evicted, so an interrupt handler or an
+// overlay that calls OVERLAY_CALL() cannot pull the code from under a call in
+// progress. With every slot pinned the call runs in place.
+//
+// An overlay too large for a slot is not an error: the call runs in place.
+//
+// -----------------------------------------------------------------------------
+
+#include "overlay.h"
+#include "cycles.h"
+#include "stm32.h"
+
+typedef struct
+{
+	const overlay_t *owner;
+	uint32_t last_use;
+	uint32_t pins;                  // Calls in progress, not evicted while non-zero
+} overlay_slot_t;
+
+// Slot storage: the linker script places .itcm_overlay in ITCM (NOLOAD)
+static uint8_t slot_mem[OVERLAY_SLOTS][OVERLAY_SLOT_SIZE] __attribute__((section(".itcm_overlay"), aligned(8)));
+static overlay_slot_t slots[OVERLAY_SLOTS];
+static uint32_t use_clock;
+static overlay_stats_t stats;
+
+// Table bounds, weak so that images without any overlay still link
+extern const overlay_t __start_overlay_table[] __attribute__((weak));
+extern const overlay_t __stop_overlay_table[] __attribute__((weak));
+
+static inline uint32_t overlayLock(void)
+{
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+	return primask;
+}
+
+static inline void overlayUnlock(uint32_t primask)
+{
+	__set_PRIMASK(primask);
+}
+
+// -----------------------------------------------------------------------------
+// Description: Provides the word aligned source range of an overlay
+//     Returns: Size to copy in bytes
+//      Inputs: Overlay, start address storage
+// -----------------------------------------------------------------------------
+static uint32_t overlaySpan(const overlay_t *ovl, uint32_t *start)
+{
+	uint32_t end = ((uint32_t)ovl->end + 3) & ~3UL;
+
+	*start = (uint32_t)ovl->start & ~3UL;
+	return end - *start;
+}
+
+// -----------------------------------------------------------------------------
+// Description: Picks the slot to load into: an empty one, else the least
+//              recently used of those not pinned
+//     Returns: Slot index, OVERLAY_NO_SLOT if every slot is pinned
+//      Inputs: none
+// -----------------------------------------------------------------------------
+static uint32_t overlayVictim(void)
+{
+	uint32_t victim = OVERLAY_NO_SLOT;
+
+	for(uint32_t i = 0; i < OVERLAY_SLOTS; i++)
+	{
+		if(slots[i].owner == NULL)
+		{
+			return i;
+		}
+		if((slots[i].pins == 0) &&
+		   ((victim == OVERLAY_NO_SLOT) || ((int32_t)(slots[i].last_use - slots[victim].last_use) < 0)))
+		{
+			victim = i;
+		}
+	}
+	return victim;
+}
+
+// -----------------------------------------------------------------------------
+// Description: overlayLoad() with interrupts already masked
+//     Returns: Slot index, -1 if the overlay cannot be loaded
+//      Inputs: Overlay
+// -----------------------------------------------------------------------------
+static int32_t overlayLoadLocked(const overlay_t *ovl)
+{
+	overlay_state_t *state = ovl->state;
+	uint32_t start, size, slot, t0;
+
+	slot = state->slot;
+	if((slot != OVERLAY_NO_SLOT) && (slots[slot].owner == ovl))
+	{
+		slots[slot].last_use = ++use_clock;
+		state->hits++;
+		stats.hits++;
+		return slot;
+	}
+
+	size = overlaySpan(ovl, &start);
+	if(size > OVERLAY_SLOT_SIZE)
+	{
+		stats.failures++;
+		return -1;
+	}
+
+	t0 = cycles();
+	slot = overlayVictim();
+	if(slot == OVERLAY_NO_SLOT)
+	{
+		stats.busy++;
+		return -1;
+	}
+	if(slots[slot].owner != NULL)
+	{
+		slots[slot].owner->state->slot = OVERLAY_NO_SLOT;
+		stats.evictions++;
+	}
+	memcpy(slot_mem[slot], (const void *)start, size);
+	__DSB();
+	__ISB();
+
+	slots[slot].owner = ovl;
+	slots[slot].last_use = ++use_clock;
+	state->slot = slot;
+	state->loads++;
+	stats.loads++;
+	stats.load_cycles += cyclesElapsed(t0);
+	return slot;
+}
+
+// -----------------------------------------------------------------------------
+// Description: Empties all slots and resets the statistics
+//     Returns: none
+//      Inputs: none
+// -----------------------------------------------------------------------------
+void overlayInit(void)
+{
+	cyclesInit();
+	overlayFlush();
+	memset(&stats, 0, sizeof(stats));
+	for(const overlay_t *ovl = __start_overlay_table; ovl < __stop_overlay_table; ovl++)
+	{
+		ovl->state->loads = 0;
+		ovl->state->hits = 0;
+	}
+}
+
+// -----------------------------------------------------------------------------
+// Description: Makes an overlay resident in ITCM, copying it from the NOR into
+//              the least recently used slot if it is not already there. The
+//              slot is not pinned, see overlayFunc() to run the code.
+//     Returns: Slot index, -1 if the overlay does not fit in a slot or every
+//              slot is pinned
+//      Inputs: Overlay
+// -----------------------------------------------------------------------------
+int32_t overlayLoad(const overlay_t *ovl)
+{
+	uint32_t primask = overlayLock();
+	int32_t slot = overlayLoadLocked(ovl);
+
+	overlayUnlock(primask);
+	return slot;
+}
+
+// -----------------------------------------------------------------------------
+// Description: Translates a function of an overlay to its ITCM copy, loading
+//              the overlay first if needed, and pins the slot until the
+//              matching overlayRelease()
+//     Returns: Function pointer to call (Thumb bit kept), the XIP address if
+//              the overlay cannot be loaded
+//      Inputs: Overlay, function of that overlay, storage for the slot pinned
+//              (OVERLAY_NO_SLOT when the call runs in place)
+// -----------------------------------------------------------------------------
+const void *overlayFunc(const overlay_t *ovl, const void *fn, uint32_t *pinned)
+{
+	uint32_t primask, start;
+	int32_t slot;
+
+	primask = overlayLock();
+	slot = overlayLoadLocked(ovl);
+	if(slot >= 0)
+	{
+		slots[slot].pins++;
+	}
+	*pinned = (slot >= 0) ? (uint32_t)slot : OVERLAY_NO_SLOT;
+	overlayUnlock(primask);
+
+	if(slot < 0)
+	{
+		return fn;
+	}
+	overlaySpan(ovl, &start);
+	return &slot_mem[slot][(uint32_t)fn - start];
+}
+
+// -----------------------------------------------------------------------------
+// Description: Drops the pin taken by overlayFunc(), nothing if the call ran
+//              in place
+//     Returns: none
+//      Inputs: Slot pinned by overlayFunc(), or OVERLAY_NO_SLOT
+// -----------------------------------------------------------------------------
+void overlayRelease(uint32_t slot)
+{
+	uint32_t primask;
+
+	if(slot == OVERLAY_NO_SLOT)
+	{
+		return;
+	}
+	primask = overlayLock();
+	assert((slot < OVERLAY_SLOTS) && (slots[slot].pins > 0));
+	slots[slot].pins--;
+	overlayUnlock(primask);
+}
+
+// -----------------------------------------------------------------------------
+// Description: Releases the slot held by an overlay, unless a call holds it
+//     Returns: false if the slot is pinned and stays resident
+//      Inputs: Overlay
+// -----------------------------------------------------------------------------
+bool overlayEvict(const overlay_t *ovl)
+{
+	uint32_t primask = overlayLock();
+	uint32_t slot = ovl->state->slot;
+	bool evicted = true;
+
+	if((slot != OVERLAY_NO_SLOT) && (slots[slot].owner == ovl))
+	{
+		evicted = (slots[slot].pins == 0);
+		if(evicted)
+		{
+			slots[slot].owner = NULL;
+			ovl->state->slot = OVERLAY_NO_SLOT;
+		}
+	}
+	overlayUnlock(primask);
+	return evicted;
+}
+
+// -----------------------------------------------------------------------------
+// Description: Releases all slots, except those pinned by a call in progress
+//     Returns: none
+//      Inputs: none
+// -----------------------------------------------------------------------------
+void overlayFlush(void)
+{
+	uint32_t primask = overlayLock();
+
+	for(uint32_t i = 0; i < OVERLAY_SLOTS; i++)
+	{
+		if((slots[i].owner != NULL) && (slots[i].pins == 0))
+		{
+			slots[i].owner->state->slot = OVERLAY_NO_SLOT;
+			slots[i].owner = NULL;
+		}
+	}
+	use_clock = 0;
+	overlayUnlock(primask);
+}
+
+// -----------------------------------------------------------------------------
+// Description: Maps an address in an ITCM slot back to the overlay code it
+//              was copied from, for profilers. Interrupt safe: slots only
+//              change with interrupts masked.
+//     Returns: Linked (XIP) address, the address itself outside the slots
+//      Inputs: Code address
+// -----------------------------------------------------------------------------
+uint32_t overlayLinkedAddress(uint32_t addr)
+{
+	uint32_t offset = addr - (uint32_t)slot_mem;
+
+	if(offset < sizeof(slot_mem))
+	{
+		const overlay_t *owner = slots[offset / OVERLAY_SLOT_SIZE].owner;
+
+		if(owner != NULL)
+		{
+			return ((uint32_t)owner->start & ~3UL) + (offset % OVERLAY_SLOT_SIZE);
+		}
+	}
+	return addr;
+}
+
+// -----------------------------------------------------------------------------
+// Description: Provides the # of overlays in the link time table
+//     Returns: See above
+//      Inputs: none
+// -----------------------------------------------------------------------------
+uint32_t overlayCount(void)
+{
+	return __stop_overlay_table - __start_overlay_table;
+}
+
+// -----------------------------------------------------------------------------
+// Description: Provides an entry of the overlay table
+//     Returns: Overlay, NULL past the end of the table
+//      Inputs: Table index
+// -----------------------------------------------------------------------------
+const overlay_t *overlayGet(uint32_t index)
+{
+	return (index < overlayCount()) ? &__start_overlay_table[index] : NULL;
+}
+
+// -----------------------------------------------------------------------------
+// Description: Provides a snapshot of the loader statistics
+//     Returns: none
+//      Inputs: Statistics storage
+// -----------------------------------------------------------------------------
+void overlayGetStats(overlay_stats_t *s)
+{
+	uint32_t primask = overlayLock();
+	*s = stats;
+	overlayUnlock(primask);
+}
+
+// -----------------------------------------------------------------------------
+// Description: Prints the overlay table and the loader statistics as CSV
+//     Returns: none
+//      Inputs: none
+// -----------------------------------------------------------------------------
+void overlayPrintStats(void)
+{
+	overlay_stats_t s;
+	const overlay_t *ovl;
+
+	printf("overlay,name,xip_addr,size,slot,loads,hits" EOL);
+	for(uint32_t i = 0; (ovl = overlayGet(i)) != NULL; i++)
+	{
+		printf("overlay,%s,0x%08lX,%lu,%d,%lu,%lu" EOL, ovl->name, (uint32_t)ovl->start,
+		       (uint32_t)(ovl->end - ovl->start), (ovl->state->slot == OVERLAY_NO_SLOT) ? -1 : ovl->state->slot,
+		       ovl->state->loads, ovl->state->hits);
+	}
+
+	overlayGetStats(&s);
+	printf("overlay_stats,slots,slot_size,loads,hits,evictions,failures,busy,load_cycles" EOL);
+	printf("overlay_stats,%u,%u,%lu,%lu,%lu,%lu,%lu,%lu" EOL, OVERLAY_SLOTS, OVERLAY_SLOT_SIZE, s.loads, s.hits,
+	       s.evictions, s.failures, s.busy, s.load_cycles);
+}
@@ -0,0 +1,117 @@
+/* SPDX-License-Identifier: Unlicense */
+
+#ifndef OVERLAY_H_
+#define OVERLAY_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// -----------------------------------------------------------------------------
+// Includes
+// -----------------------------------------------------------------------------
+#include "common.h"
+
+// -----------------------------------------------------------------------------
+// Constants
+// -----------------------------------------------------------------------------
+// ITCM reserved for overlays (.itcm_overlay), the rest of the 64 KB stays free for resident code
+#ifndef OVERLAY_SLOTS
+#define OVERLAY_SLOTS               4
+#endif
+
+#ifndef OVERLAY_SLOT_SIZE
+#define OVERLAY_SLOT_SIZE           (4 * 1024)
+#endif
+
+#define OVERLAY_NO_SLOT             0xFF
+
+// -----------------------------------------------------------------------------
+// Macros
+// -----------------------------------------------------------------------------
+// Places a function in overlay <id>. Overlay code runs both in place from the
+// NOR and from an ITCM slot, so it must be position independent: calls only to
+// functions of the same overlay, or through pointers / long_call. Loop
+// distribution is disabled so the compiler cannot insert memcpy()/memset() calls.
+#define OVERLAY(id)                 __attribute__((section("ovl_" #id), noinline, \
+                                    optimize("no-tree-loop-distribute-patterns")))
+
+// Adds overlay <id> to the overlay table, once per overlay. The section bounds
+// are provided by the linker (__start_/__stop_ of the orphan section).
+#define OVERLAY_DEFINE(id)                                                          \
+	extern const uint8_t __start_ovl_##id[], __stop_ovl_##id[];                     \
+	static overlay_state_t overlay_state_##id = {.slot = OVERLAY_NO_SLOT};          \
+	const overlay_t overlay_##id __attribute__((section("overlay_table"), used)) =  \
+	{                                                                               \
+		.name = #id,                                                                \
+		.start = __start_ovl_##id,                                                  \
+		.end = __stop_ovl_##id,                                                     \
+		.state = &overlay_state_##id,                                               \
+	}
+
+#define OVERLAY_DECLARE(id)         extern const overlay_t overlay_##id
+
+// Calls fn (a function of overlay <id>) from ITCM, loading the overlay first if
+// needed. The slot stays pinned until the call returns.
+#define OVERLAY_CALL(id, fn, ...)                                                   \
+	({                                                                              \
+		uint32_t overlay_pin_                                                       \
+			__attribute__((cleanup(overlayReleasePin))) = OVERLAY_NO_SLOT;          \
+		((__typeof__(&(fn)))overlayFunc(&overlay_##id, (const void *)(fn),          \
+		                                &overlay_pin_))(__VA_ARGS__);               \
+	})
+
+// -----------------------------------------------------------------------------
+// Types
+// -----------------------------------------------------------------------------
+typedef struct
+{
+	uint8_t slot;                   // ITCM slot holding the overlay, OVERLAY_NO_SLOT if none
+	uint32_t loads;
+	uint32_t hits;
+} overlay_state_t;
+
+typedef struct
+{
+	const char *name;
+	const uint8_t *start;           // Linked (XIP) address in the NOR
+	const uint8_t *end;
+	overlay_state_t *state;
+} overlay_t;
+
+typedef struct
+{
+	uint32_t loads;
+	uint32_t hits;
+	uint32_t evictions;
+	uint32_t failures;              // Overlays too large for a slot, run in place instead
+	uint32_t busy;                  // Every slot pinned, run in place instead
+	uint32_t load_cycles;           // Total CPU cycles spent copying
+} overlay_stats_t;
+
+// -----------------------------------------------------------------------------
+// Public Functions
+// -----------------------------------------------------------------------------
+void overlayInit(void);
+int32_t overlayLoad(const overlay_t *ovl);
+const void *overlayFunc(const overlay_t *ovl, const void *fn, uint32_t *pinned);
+void overlayRelease(uint32_t slot);
+bool overlayEvict(const overlay_t *ovl);
+void overlayFlush(void);
+uint32_t overlayCount(void);
+const overlay_t *overlayGet(uint32_t index);
+uint32_t overlayLinkedAddress(uint32_t addr);
+void overlayGetStats(overlay_stats_t *stats);
+void overlayPrintStats(void);
+
+// Cleanup handler of OVERLAY_CALL()
+static inline void overlayReleasePin(const uint32_t *slot)
+{
+	overlayRelease(*slot);
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // OVERLAY_H_
@@ -0,0 +1,206 @@
+/* SPDX-License-Identifier: Unlicense */
+
+// -----------------------------------------------------------------------------
+// IMPLEMENTATION NOTES
+//
+// Statistical profiler: TIM7 interrupts at the sampling rate and records the
+// PC and LR that the exception entry stacked for the interrupted code, so no
+// code needs instrumenting (HAL and middleware included). Run
+//
+//     pcSampleStart(1000);
+//     ... workload, calling pcSampleFlush() now and then ...
+//     pcSampleStop();
+//     pcSampleFlush();
+//
+// and Tools/pcsample.py maps the samples to functions with the ELF of the
+// image. Works the same in the Boot and the Appli: each block carries VTOR,
+// which the host tool matches against the vector table of the ELFs it is
+// given.
+//
+// The handler finds the stacked frame on MSP or PSP from EXC_RETURN and the PC
+// and LR in words 6 and 5 of it (the same with or without an FPU frame).
+// With the highest priority it also samples the other interrupt handlers, but
+// not code running with interrupts masked: that time is charged to the first
+// instruction after the unmask.
+//
+// Samples go to a ring in DTCM (single writer: the handler, single reader:
+// pcSampleFlush()), which costs no cache line and no bus wait in the handler.
+// A full ring drops new samples and counts them. pcSampleFlush() sends the
+// pending samples to UART4 in blocks with a CRC, through the log sink
+// (Common/logSink.c) so that printf() output from other code cannot land in
+// the middle of a block: each block is copied whole into a staging buffer and
+// queued with logSinkWriteRecord(), which waits for room whatever the sink
+// policy. The copies and the DMA then show in the profile, flush between
+// workload runs to keep them out.
+//
+// Code is found wherever the ELF links it: XIP NOR, ITCM or RAM. The one
+// exception is overlay code copied to an ITCM slot at run time, mapped back to
+// its linked address in the handler (overlayLinkedAddress()).
+//
+// -----------------------------------------------------------------------------
+
+#include "pcSample.h"
+#include "crc32.h"
+#include "logSink.h"
+#include "overlay.h"
+#include "scatterLoad.h"
+#include "stm32.h"
+
+#define TIM_CNT_FREQ            1000000U
+#define PC_SAMPLE_RECORD        (sizeof(pc_sample_header_t) + (PC_SAMPLE_BLOCK * sizeof(pc_sample_t)) + sizeof(uint32_t))
+
+_Static_assert(PC_SAMPLE_RECORD <= LOG_SINK_SIZE / 2, "PC_SAMPLE_BLOCK too large for the log sink");
+
+static pc_sample_t ring[PC_SAMPLE_DEPTH] DTCM_BSS;
+static volatile uint32_t head;                  // Written by the handler only
+static volatile uint32_t tail;                  // Written by pcSampleFlush() only
+static uint32_t dropped;
+static uint32_t rate;
+static uint8_t record[PC_SAMPLE_RECORD] __attribute__((aligned(4)));   // Block staging, pcSampleFlush() only
+
+void TIM7_IRQHandler(void) __attribute__((naked));
+void pcSampleTake(const uint32_t *frame) __attribute__((used));
+
+// -----------------------------------------------------------------------------
+// Description: Records one sample, called by TIM7_IRQHandler()
+//     Returns: none
+//      Inputs: Exception frame of the interrupted code
+// -----------------------------------------------------------------------------
+void pcSampleTake(const uint32_t *frame)
+{
+	uint32_t h = head;
+
+	TIM7->SR = ~(uint32_t)TIM_SR_UIF;
+	if((h - tail) < PC_SAMPLE_DEPTH)
+	{
+		pc_sample_t *s = &ring[h & (PC_SAMPLE_DEPTH - 1)];
+
+		s->pc = overlayLinkedAddress(frame[6]);
+		s->lr = overlayLinkedAddress(frame[5]);
+		head = h + 1;
+	}
+	else
+	{
+		dropped++;
+	}
+	__DSB();
+}
+
+void TIM7_IRQHandler(void)
+{
+	__asm volatile(
+		"tst lr, #4\n"
+		"ite eq\n"
+		"mrseq r0, msp\n"
+		"mrsne r0, psp\n"
+		"b pcSampleTake\n");
+}
+
+// -----------------------------------------------------------------------------
+// Description: Provides the TIM7 kernel clock
+//     Returns: See above
+//      Inputs: none
+// -----------------------------------------------------------------------------
+static uint32_t pcSampleTimerClock(void)
+{
+	RCC_ClkInitTypeDef clkconfig;
+	uint32_t latency;
+
+	HAL_RCC_GetClockConfig(&clkconfig, &latency);
+	if(clkconfig.APB1CLKDivider == RCC_APB1_DIV1)
+	{
+		return HAL_RCC_GetPCLK1Freq();
+	}
+	if((clkconfig.APB1CLKDivider == RCC_APB1_DIV2) || (__HAL_RCC_GET_TIMCLKPRESCALER() == RCC_TIMPRES_DISABLE))
+	{
+		return 2UL * HAL_RCC_GetPCLK1Freq();
+	}
+	return 4UL * HAL_RCC_GetPCLK1Freq();
+}
+
+// -----------------------------------------------------------------------------
+// Description: Empties the buffer and starts sampling
+//     Returns: false for a rate out of PC_SAMPLE_RATE_MIN..PC_SAMPLE_RATE_MAX
+//      Inputs: Samples per second
+// -----------------------------------------------------------------------------
+bool pcSampleStart(uint32_t rate_hz)
+{
+	if((rate_hz < PC_SAMPLE_RATE_MIN) || (rate_hz > PC_SAMPLE_RATE_MAX))
+	{
+		return false;
+	}
+
+	pcSampleStop();
+	head = 0;
+	tail = 0;
+	dropped = 0;
+	rate = rate_hz;
+
+	__HAL_RCC_TIM7_CLK_ENABLE();
+	TIM7->CR1 = TIM_CR1_URS;
+	TIM7->PSC = (pcSampleTimerClock() / TIM_CNT_FREQ) - 1;
+	TIM7->ARR = (TIM_CNT_FREQ / rate_hz) - 1;
+	TIM7->EGR = TIM_EGR_UG;
+	TIM7->SR = 0;
+	TIM7->DIER = TIM_DIER_UIE;
+	HAL_NVIC_SetPriority(TIM7_IRQn, PC_SAMPLE_PRIORITY, 0);
+	HAL_NVIC_EnableIRQ(TIM7_IRQn);
+	TIM7->CR1 |= TIM_CR1_CEN;
+	return true;
+}
+
+// -----------------------------------------------------------------------------
+// Description: Stops sampling, the buffered samples are kept for pcSampleFlush()
+//     Returns: none
+//      Inputs: none
+// -----------------------------------------------------------------------------
+void pcSampleStop(void)
+{
+	TIM7->CR1 &= ~TIM_CR1_CEN;
+	HAL_NVIC_DisableIRQ(TIM7_IRQn);
+	TIM7->SR = 0;
+}
+
+// -----------------------------------------------------------------------------
+// Description: Queues the samples buffered so far for UART4, PC_SAMPLE_BLOCK at
+//              most per block, and waits for them to be sent. Thread code.
+//     Returns: # of samples sent
+//      Inputs: none
+// -----------------------------------------------------------------------------
+uint32_t pcSampleFlush(void)
+{
+	uint32_t end = head;
+	uint32_t sent = 0;
+
+	// Samples taken meanwhile wait for the next flush, the UART is slower than sampling
+	while(tail != end)
+	{
+		pc_sample_header_t h = {0};
+		uint32_t t = tail;
+		uint32_t index = t & (PC_SAMPLE_DEPTH - 1);
+		uint32_t crc, size;
+
+		// One contiguous run of the ring per block
+		h.count = (uint16_t)MIN(MIN(end - t, PC_SAMPLE_BLOCK), PC_SAMPLE_DEPTH - index);
+		h.magic = PC_SAMPLE_MAGIC;
+		h.version = PC_SAMPLE_VERSION;
+		h.first = t;
+		h.dropped = dropped;
+		h.rate_hz = rate;
+		h.vtor = SCB->VTOR;
+
+		size = h.count * sizeof(pc_sample_t);
+		memcpy(record, &h, sizeof(h));
+		memcpy(record + sizeof(h), &ring[index], size);
+		crc = crc32Update(0, record, sizeof(h) + size);
+		memcpy(record + sizeof(h) + size, &crc, sizeof(crc));
+		if(!logSinkWriteRecord(record, sizeof(h) + size + sizeof(crc)))
+		{
+			break;
+		}
+		tail = t + h.count;
+		sent += h.count;
+	}
+	logSinkFlush();
+	return sent;
+}
@@ -0,0 +1,68 @@
+/* SPDX-License-Identifier: Unlicense */
+
+#ifndef PCSAMPLE_H_
+#define PCSAMPLE_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// -----------------------------------------------------------------------------
+// Includes
+// -----------------------------------------------------------------------------
+#include "common.h"
+
+// -----------------------------------------------------------------------------
+// Constants
+// -----------------------------------------------------------------------------
+// Samples buffered in DTCM between flushes, power of two
+#ifndef PC_SAMPLE_DEPTH
+#define PC_SAMPLE_DEPTH             2048
+#endif
+
+// Samples per block sent by pcSampleFlush()
+#ifndef PC_SAMPLE_BLOCK
+#define PC_SAMPLE_BLOCK             256
+#endif
+
+// Sampling interrupt priority: 0 also samples the other interrupt handlers
+#ifndef PC_SAMPLE_PRIORITY
+#define PC_SAMPLE_PRIORITY          0
+#endif
+
+#define PC_SAMPLE_RATE_MIN          16              // 16-bit timer at 1 MHz
+#define PC_SAMPLE_RATE_MAX          100000
+
+#define PC_SAMPLE_MAGIC             0x4D534350UL    // "PCSM"
+#define PC_SAMPLE_VERSION           1
+
+typedef struct
+{
+	uint32_t pc;                    // Interrupted instruction
+	uint32_t lr;                    // Its link register: the caller of a leaf function
+} pc_sample_t;
+
+// Block header, then count samples, then the CRC-32 of both. Decoded by Tools/pcsample.py.
+typedef struct
+{
+	uint32_t magic;                 // PC_SAMPLE_MAGIC
+	uint16_t version;               // PC_SAMPLE_VERSION
+	uint16_t count;
+	uint32_t first;                 // Index of the first sample since pcSampleStart()
+	uint32_t dropped;               // Samples lost to a full buffer since pcSampleStart()
+	uint32_t rate_hz;
+	uint32_t vtor;                  // Vector table of the image, tells Boot and Appli apart
+} pc_sample_header_t;
+
+// -----------------------------------------------------------------------------
+// Public Functions
+// -----------------------------------------------------------------------------
+bool pcSampleStart(uint32_t rate_hz);
+void pcSampleStop(void);
+uint32_t pcSampleFlush(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // PCSAMPLE_H_
@@ -0,0 +1,513 @@
+/* SPDX-License-Identifier: Unlicense */
+
+// -----------------------------------------------------------------------------
+// IMPLEMENTATION NOTES
+//
+// Table driven startup initialisation. The linker scripts emit one
+// {load, run, size, flags} entry per region to set up (.scatter_table): code
+// copied to ITCM / AXI SRAM, .data and .bss, and the extra data sections in
+// DTCM, SRAMAHB and the PSRAM (see scatterLoad.h). Reset_Handler calls
+// scatterLoad() right after SystemInit(), in place of the .data / .bss loops.
+//
+// Regions of SCATTER_DMA_MIN bytes or more whose source and destination are
+// both reachable from the AXI bus (AXI SRAM, internal flash, XSPI windows) are
+// moved by HPDMA1 channel 0 in 16-beat bursts; zeroing reads a constant zero
+// word. HPDMA1 cannot reach the TCMs or SRAMAHB, so those are done by the CPU,
+// 8 words per iteration, as are small regions where the channel setup costs
+// more than it saves. A DMA error hands the rest of the region to the CPU.
+//
+// Lazy entries (the PSRAM .bss, which can be megabytes) are not waited for:
+// once everything else is done HPDMA1 channel 1 zeroes them in 64 KB blocks,
+// chained from its interrupt, while the application boots. Code touching
+// .extram_bss calls scatterLazyWait() first, which also finishes the job with
+// the CPU if the channel failed.
+//
+// scatterLoad() runs before .data and .bss exist: until the end it only uses
+// locals, the constant table and plain loops (loop distribution is disabled
+// so the compiler does not turn them into memcpy() / memset(), which may have
+// been placed in ITCM). Everything it calls is named scatter*, which
+// Tools/placement.py never moves, or is a macro (MIN) or a CMSIS inline helper
+// (SCB_*, NVIC_*): the placement script only sees functions from the profile,
+// and an -O0 build keeps those helpers as local copies in this file's .text.
+//
+// The caches may still be on from the boot stage: the D-cache is cleaned and
+// invalidated around the DMA transfers, and without DMA cleaned over the
+// copied regions, so that the code copied to AXI SRAM is in memory; the
+// I-cache is then invalidated, whichever way the code was copied. Once the lazy regions are zeroed they
+// are invalidated again, by address, since the CPU may have fetched lines of
+// the PSRAM (speculatively) while the channel was writing it.
+//
+// Without a table (e.g. the OEMiROT layout), .data and .bss are set up from
+// the classic _sidata / _sdata / _edata / _sbss / _ebss symbols.
+//
+// -----------------------------------------------------------------------------
+
+#include "scatterLoad.h"
+#include "stm32.h"
+
+#define SCATTER_NOLIBC          __attribute__((optimize("no-tree-loop-distribute-patterns")))
+
+#define SCATTER_DMA             HPDMA1_Channel0
+#define SCATTER_LAZY_DMA        HPDMA1_Channel1
+#define SCATTER_LAZY_IRQn       HPDMA1_Channel1_IRQn
+#define SCATTER_DMA_BURST       16                  // Beats of 32 bits
+#define SCATTER_DMA_BLOCK       0xFFC0UL            // Bytes per block: BNDT is 16 bits, whole bursts
+#define SCATTER_DMA_ERRORS      (DMA_CSR_DTEF | DMA_CSR_ULEF | DMA_CSR_USEF)
+#define SCATTER_DMA_FLAGS       (DMA_CFCR_TCF | DMA_CFCR_HTF | DMA_CFCR_DTEF | DMA_CFCR_ULEF | \
+                                 DMA_CFCR_USEF | DMA_CFCR_SUSPF | DMA_CFCR_TOF)
+
+#define AXI_SRAM_BASE           0x24000000UL
+#define AXI_SRAM_SIZE           0x00080000UL
+#define FLASH_INT_BASE          0x08000000UL
+#define FLASH_INT_SIZE          0x00010000UL
+#define XSPI_BASE               0x70000000UL        // XSPI2 (NOR) up to the end of XSPI1 (PSRAM)
+#define XSPI_SIZE               0x30000000UL
+#define SRAMAHB_BASE            0x30000000UL
+#define SRAMAHB_SIZE            0x00008000UL
+
+typedef struct
+{
+	uint32_t index;                 // Table entry being zeroed
+	uint32_t offset;                // Bytes of it done
+	uint32_t block;                 // Bytes of the DMA block in flight, 0 if none
+	bool dma;                       // Channel usable
+	volatile bool done;
+} scatter_lazy_t;
+
+// Provided by the linker scripts that have a scatter table
+extern const scatter_entry_t __scatter_table_start[] __attribute__((weak));
+extern const scatter_entry_t __scatter_table_end[] __attribute__((weak));
+extern uint32_t _sidata[], _sdata[], _edata[], _sbss[], _ebss[];
+
+static const uint32_t zero_word = 0;                // DMA source when zeroing, in flash
+static scatter_stats_t stats;
+static scatter_lazy_t lazy = {.done = true};
+
+SCATTER_NOLIBC static uint32_t scatterCount(void)
+{
+	return (uint32_t)(__scatter_table_end - __scatter_table_start);
+}
+
+SCATTER_NOLIBC static bool scatterInRange(uint32_t addr, uint32_t size, uint32_t base, uint32_t length)
+{
+	return ((addr - base) < length) && (size <= (length - (addr - base)));
+}
+
+SCATTER_NOLIBC static bool scatterDmaReach(uint32_t addr, uint32_t size)
+{
+	return scatterInRange(addr, size, AXI_SRAM_BASE, AXI_SRAM_SIZE) ||
+	       scatterInRange(addr, size, FLASH_INT_BASE, FLASH_INT_SIZE) ||
+	       scatterInRange(addr, size, XSPI_BASE, XSPI_SIZE);
+}
+
+// -----------------------------------------------------------------------------
+// Description: Checks whether an entry can be done by HPDMA1
+//     Returns: true for large regions with both ends on the AXI bus
+//      Inputs: Table entry
+// -----------------------------------------------------------------------------
+SCATTER_NOLIBC static bool scatterUseDma(const scatter_entry_t *e)
+{
+	if(e->size < SCATTER_DMA_MIN)
+	{
+		return false;
+	}
+	if(!scatterDmaReach(e->run, e->size))
+	{
+		return false;
+	}
+	return (e->flags & SCATTER_ZERO) || scatterDmaReach(e->load, e->size);
+}
+
+SCATTER_NOLIBC static void scatterCpuCopy(uint32_t dst, uint32_t src, uint32_t size)
+{
+	uint32_t *d = (uint32_t *)dst;
+	const uint32_t *s = (const uint32_t *)src;
+	uint32_t words = size / 4;
+
+	for(; words >= 8; words -= 8)
+	{
+		d[0] = s[0]; d[1] = s[1]; d[2] = s[2]; d[3] = s[3];
+		d[4] = s[4]; d[5] = s[5]; d[6] = s[6]; d[7] = s[7];
+		d += 8;
+		s += 8;
+	}
+	while(words--)
+	{
+		*d++ = *s++;
+	}
+	for(uint32_t i = size & ~3UL; i < size; i++)
+	{
+		((uint8_t *)dst)[i] = ((const uint8_t *)src)[i];
+	}
+}
+
+SCATTER_NOLIBC static void scatterCpuZero(uint32_t dst, uint32_t size)
+{
+	uint32_t *d = (uint32_t *)dst;
+	uint32_t words = size / 4;
+
+	for(; words >= 8; words -= 8)
+	{
+		d[0] = 0; d[1] = 0; d[2] = 0; d[3] = 0;
+		d[4] = 0; d[5] = 0; d[6] = 0; d[7] = 0;
+		d += 8;
+	}
+	while(words--)
+	{
+		*d++ = 0;
+	}
+	for(uint32_t i = size & ~3UL; i < size; i++)
+	{
+		((uint8_t *)dst)[i] = 0;
+	}
+}
+
+SCATTER_NOLIBC static void scatterDCacheClean(void)
+{
+	if(SCB->CCR & SCB_CCR_DC_Msk)
+	{
+		SCB_CleanInvalidateDCache();
+	}
+}
+
+// Regions are cache line aligned by the linker scripts
+SCATTER_NOLIBC static void scatterDCacheCleanRange(uint32_t addr, uint32_t size)
+{
+	if((SCB->CCR & SCB_CCR_DC_Msk) && (size != 0))
+	{
+		SCB_CleanDCache_by_Addr((void *)addr, (int32_t)size);
+	}
+}
+
+static void scatterDCacheInvalidate(uint32_t addr, uint32_t size)
+{
+	if(SCB->CCR & SCB_CCR_DC_Msk)
+	{
+		SCB_InvalidateDCache_by_Addr((void *)addr, (int32_t)size);
+	}
+}
+
+SCATTER_NOLIBC static void scatterDmaReset(DMA_Channel_TypeDef *ch)
+{
+	ch->CCR = DMA_CCR_RESET;
+	ch->CFCR = SCATTER_DMA_FLAGS;
+}
+
+// -----------------------------------------------------------------------------
+// Description: Starts one memory to memory block on a HPDMA1 channel
+//     Returns: none
+//      Inputs: Channel, destination, source (or NULL to zero), bytes (multiple
+//              of 4, at most SCATTER_DMA_BLOCK), interrupt on completion
+// -----------------------------------------------------------------------------
+SCATTER_NOLIBC static void scatterDmaStart(DMA_Channel_TypeDef *ch, uint32_t dst, uint32_t src, uint32_t size, bool irq)
+{
+	ch->CFCR = SCATTER_DMA_FLAGS;
+	ch->CTR1 = (2UL << DMA_CTR1_SDW_LOG2_Pos) | ((SCATTER_DMA_BURST - 1UL) << DMA_CTR1_SBL_1_Pos) |
+	           (2UL << DMA_CTR1_DDW_LOG2_Pos) | ((SCATTER_DMA_BURST - 1UL) << DMA_CTR1_DBL_1_Pos) |
+	           DMA_CTR1_DINC | ((src != 0) ? DMA_CTR1_SINC : 0);
+	ch->CTR2 = DMA_CTR2_SWREQ;
+	ch->CBR1 = size;
+	ch->CSAR = (src != 0) ? src : (uint32_t)&zero_word;
+	ch->CDAR = dst;
+	ch->CLLR = 0;
+	ch->CCR = DMA_CCR_EN | (irq ? (DMA_CCR_TCIE | DMA_CCR_DTEIE | DMA_CCR_ULEIE | DMA_CCR_USEIE) : 0);
+}
+
+// -----------------------------------------------------------------------------
+// Description: Copies or zeroes a region with HPDMA1 channel 0, block by block
+//     Returns: Bytes done, short of size after a DMA error
+//      Inputs: Destination, source (or 0 to zero), bytes
+// -----------------------------------------------------------------------------
+SCATTER_NOLIBC static uint32_t scatterDmaRun(uint32_t dst, uint32_t src, uint32_t size)
+{
+	DMA_Channel_TypeDef *ch = SCATTER_DMA;
+	uint32_t done = 0;
+
+	while((size - done) >= 4)
+	{
+		uint32_t block = MIN(size - done, SCATTER_DMA_BLOCK) & ~3UL;
+		uint32_t csr;
+
+		scatterDmaStart(ch, dst + done, (src != 0) ? src + done : 0, block, false);
+		do
+		{
+			csr = ch->CSR;
+		} while(!(csr & (DMA_CSR_TCF | SCATTER_DMA_ERRORS)));
+
+		if(!(csr & DMA_CSR_TCF) || (csr & SCATTER_DMA_ERRORS))
+		{
+			scatterDmaReset(ch);
+			break;
+		}
+		done += block;
+	}
+	ch->CFCR = SCATTER_DMA_FLAGS;
+	return done;
+}
+
+// -----------------------------------------------------------------------------
+// Description: Advances the background zeroing of the lazy entries: collects
+//              the finished block and starts the next one
+//     Returns: true once every lazy entry is zeroed
+//      Inputs: Allow zeroing with the CPU (when the channel is unusable)
+// -----------------------------------------------------------------------------
+static bool scatterLazyStep(bool cpu)
+{
+	DMA_Channel_TypeDef *ch = SCATTER_LAZY_DMA;
+	uint32_t count = scatterCount();
+
+	if(lazy.done)
+	{
+		return true;
+	}
+
+	if(lazy.block != 0)
+	{
+		uint32_t csr = ch->CSR;
+
+		if(csr & SCATTER_DMA_ERRORS)
+		{
+			scatterDmaReset(ch);
+			lazy.dma = false;
+			stats.dma_errors++;
+		}
+		else if(csr & DMA_CSR_TCF)
+		{
+			lazy.offset += lazy.block;
+		}
+		else
+		{
+			return false;
+		}
+		ch->CFCR = SCATTER_DMA_FLAGS;
+		lazy.block = 0;
+	}
+
+	for(; lazy.index < count; lazy.index++, lazy.offset = 0)
+	{
+		const scatter_entry_t *e = &__scatter_table_start[lazy.index];
+		uint32_t left;
+
+		if(!(e->flags & SCATTER_LAZY) || (lazy.offset >= e->size))
+		{
+			continue;
+		}
+
+		left = e->size - lazy.offset;
+		if(lazy.dma && (left >= 4))
+		{
+			lazy.block = MIN(left, SCATTER_DMA_BLOCK) & ~3UL;
+			scatterDmaStart(ch, e->run + lazy.offset, 0, lazy.block, true);
+			return false;
+		}
+		if(!cpu && (left >= 4))
+		{
+			return false;
+		}
+		scatterCpuZero(e->run + lazy.offset, left);
+	}
+
+	NVIC_DisableIRQ(SCATTER_LAZY_IRQn);
+	for(uint32_t i = 0; i < count; i++)
+	{
+		const scatter_entry_t *e = &__scatter_table_start[i];
+
+		if(e->flags & SCATTER_LAZY)
+		{
+			scatterDCacheInvalidate(e->run, e->size);
+		}
+	}
+	lazy.done = true;
+	return true;
+}
+
+void HPDMA1_Channel1_IRQHandler(void)
+{
+	scatterLazyStep(false);
+}
+
+// -----------------------------------------------------------------------------
+// Description: Initialises every region of the scatter table, then starts the
+//              background zeroing of the lazy ones
+//     Returns: none
+//      Inputs: none
+// -----------------------------------------------------------------------------
+SCATTER_NOLIBC void scatterLoad(void)
+{
+	uint32_t entry_cycles[SCATTER_STATS_MAX];
+	uint32_t count = scatterCount();
+	uint32_t dma_bytes = 0, cpu_bytes = 0, dma_errors = 0, lazy_bytes = 0;
+	bool dma = false;
+	uint32_t t0;
+
+	CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+	DWT->LAR = 0xC5ACCE55;
+	DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+	t0 = DWT->CYCCNT;
+
+	if(count == 0)
+	{
+		scatterCpuCopy((uint32_t)_sdata, (uint32_t)_sidata, (uint32_t)_edata - (uint32_t)_sdata);
+		scatterCpuZero((uint32_t)_sbss, (uint32_t)_ebss - (uint32_t)_sbss);
+		stats.cycles = DWT->CYCCNT - t0;
+		return;
+	}
+
+	for(uint32_t i = 0; i < count; i++)
+	{
+		const scatter_entry_t *e = &__scatter_table_start[i];
+
+		if(scatterInRange(e->run, e->size, SRAMAHB_BASE, SRAMAHB_SIZE) && (e->size != 0))
+		{
+			RCC->AHB2ENR |= RCC_AHB2ENR_SRAM1EN | RCC_AHB2ENR_SRAM2EN;
+			(void)RCC->AHB2ENR;
+		}
+		if(((e->flags & SCATTER_LAZY) || scatterUseDma(e)) && !dma)
+		{
+			RCC->AHB5ENR |= RCC_AHB5ENR_HPDMA1EN;
+			(void)RCC->AHB5ENR;
+			scatterDCacheClean();
+			dma = true;
+		}
+	}
+
+	for(uint32_t i = 0; i < count; i++)
+	{
+		const scatter_entry_t *e = &__scatter_table_start[i];
+		uint32_t src = (e->flags & SCATTER_ZERO) ? 0 : e->load;
+		uint32_t t = DWT->CYCCNT;
+		uint32_t done = 0;
+
+		if(e->flags & SCATTER_LAZY)
+		{
+			lazy_bytes += e->size;
+			continue;
+		}
+		if(scatterUseDma(e))
+		{
+			done = scatterDmaRun(e->run, src, e->size);
+			dma_bytes += done;
+			if(done < (e->size & ~3UL))
+			{
+				dma_errors++;
+			}
+		}
+		if(src != 0)
+		{
+			scatterCpuCopy(e->run + done, src + done, e->size - done);
+		}
+		else
+		{
+			scatterCpuZero(e->run + done, e->size - done);
+		}
+		cpu_bytes += e->size - done;
+		if(i < SCATTER_STATS_MAX)
+		{
+			entry_cycles[i] = DWT->CYCCNT - t;
+		}
+	}
+	// Code copied by the CPU may still be dirty in the D-cache, and the
+	// I-cache may hold lines of what was there before
+	if(dma)
+	{
+		scatterDCacheClean();
+	}
+	else
+	{
+		for(uint32_t i = 0; i < count; i++)
+		{
+			const scatter_entry_t *e = &__scatter_table_start[i];
+
+			if(!(e->flags & SCATTER_ZERO))
+			{
+				scatterDCacheCleanRange(e->run, e->size);
+			}
+		}
+	}
+	__DSB();
+	if(SCB->CCR & SCB_CCR_IC_Msk)
+	{
+		SCB_InvalidateICache();
+	}
+	__DSB();
+	__ISB();
+
+	// .bss is valid from here on
+	stats.entries = count;
+	stats.dma_bytes = dma_bytes;
+	stats.cpu_bytes = cpu_bytes;
+	stats.dma_errors = dma_errors;
+	stats.lazy_bytes = lazy_bytes;
+	for(uint32_t i = 0; (i < count) && (i < SCATTER_STATS_MAX); i++)
+	{
+		stats.entry_cycles[i] = (__scatter_table_start[i].flags & SCATTER_LAZY) ? 0 : entry_cycles[i];
+	}
+
+	lazy.index = 0;
+	lazy.offset = 0;
+	lazy.block = 0;
+	lazy.dma = dma;
+	lazy.done = (lazy_bytes == 0);
+	if(!lazy.done)
+	{
+		NVIC_ClearPendingIRQ(SCATTER_LAZY_IRQn);
+		NVIC_EnableIRQ(SCATTER_LAZY_IRQn);
+		scatterLazyStep(false);
+	}
+	stats.cycles = DWT->CYCCNT - t0;
+}
+
+// -----------------------------------------------------------------------------
+// Description: Checks whether the lazy regions (.extram_bss) are zeroed yet
+//     Returns: See above
+//      Inputs: none
+// -----------------------------------------------------------------------------
+bool scatterLazyDone(void)
+{
+	return lazy.done;
+}
+
+// -----------------------------------------------------------------------------
+// Description: Waits for the lazy regions to be zeroed, finishing with the CPU
+//              if the DMA failed. Also works with interrupts masked.
+//     Returns: none
+//      Inputs: none
+// -----------------------------------------------------------------------------
+void scatterLazyWait(void)
+{
+	while(!lazy.done)
+	{
+		uint32_t primask = __get_PRIMASK();
+
+		__disable_irq();
+		scatterLazyStep(true);
+		__set_PRIMASK(primask);
+	}
+}
+
+const scatter_stats_t *scatterGetStats(void)
+{
+	return &stats;
+}
+
+// -----------------------------------------------------------------------------
+// Description: Prints the scatter table and the startup timings as CSV
+//     Returns: none
+//      Inputs: none
+// -----------------------------------------------------------------------------
+void scatterPrintStats(void)
+{
+	uint32_t count = scatterCount();
+
+	printf("scatter,load,run,size,flags,cycles" EOL);
+	for(uint32_t i = 0; i < count; i++)
+	{
+		const scatter_entry_t *e = &__scatter_table_start[i];
+
+		printf("scatter,0x%08lX,0x%08lX,%lu,%lu,%lu" EOL, e->load, e->run, e->size, e->flags,
+		       (i < SCATTER_STATS_MAX) ? stats.entry_cycles[i] : 0);
+	}
+	printf("scatter_total,entries,cycles,dma_bytes,cpu_bytes,dma_errors,lazy_bytes,lazy_done" EOL);
+	printf("scatter_total,%lu,%lu,%lu,%lu,%lu,%lu,%u" EOL, stats.entries, stats.cycles, stats.dma_bytes,
+	       stats.cpu_bytes, stats.dma_errors, stats.lazy_bytes, lazy.done);
+}
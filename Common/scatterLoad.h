@@ -0,0 +1,81 @@
+/* SPDX-License-Identifier: Unlicense */
+
+#ifndef SCATTERLOAD_H_
+#define SCATTERLOAD_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// -----------------------------------------------------------------------------
+// Includes
+// -----------------------------------------------------------------------------
+#include "common.h"
+
+// -----------------------------------------------------------------------------
+// Constants
+// -----------------------------------------------------------------------------
+// Entry flags, as emitted by the linker scripts (.scatter_table)
+#define SCATTER_COPY                0x0     // Copy size bytes from load to run
+#define SCATTER_ZERO                0x1     // Zero size bytes at run, load unused
+#define SCATTER_LAZY                0x2     // With SCATTER_ZERO: zeroed in the background after startup
+
+// Regions smaller than this are always done by the CPU
+#ifndef SCATTER_DMA_MIN
+#define SCATTER_DMA_MIN             (8 * 1024)
+#endif
+
+// Per-entry timings kept for scatterPrintStats()
+#define SCATTER_STATS_MAX           16
+
+// -----------------------------------------------------------------------------
+// Macros
+// -----------------------------------------------------------------------------
+// Variables outside the default .data / .bss, initialised by scatterLoad().
+// The SRAMAHB and EXTRAM sections only exist in the linker scripts that
+// declare those regions. EXTRAM_BSS is zeroed lazily: call scatterLazyWait()
+// before the first access.
+#define ITCM_DATA                   __attribute__((section(".itcm_data")))
+#define DTCM_DATA                   __attribute__((section(".dtcm_data")))
+#define DTCM_BSS                    __attribute__((section(".dtcm_bss")))
+#define SRAMAHB_DATA                __attribute__((section(".sramahb_data")))
+#define SRAMAHB_BSS                 __attribute__((section(".sramahb_bss")))
+#define EXTRAM_DATA                 __attribute__((section(".extram_data")))
+#define EXTRAM_BSS                  __attribute__((section(".extram_bss")))
+
+// -----------------------------------------------------------------------------
+// Types
+// -----------------------------------------------------------------------------
+typedef struct
+{
+	uint32_t load;                  // Source (initial values), unused when zeroing
+	uint32_t run;                   // Destination
+	uint32_t size;                  // Bytes
+	uint32_t flags;                 // SCATTER_xxx
+} scatter_entry_t;
+
+typedef struct
+{
+	uint32_t entries;
+	uint32_t cycles;                // Whole scatterLoad() run
+	uint32_t dma_bytes;
+	uint32_t cpu_bytes;
+	uint32_t dma_errors;
+	uint32_t lazy_bytes;
+	uint32_t entry_cycles[SCATTER_STATS_MAX];
+} scatter_stats_t;
+
+// -----------------------------------------------------------------------------
+// Public Functions
+// -----------------------------------------------------------------------------
+void scatterLoad(void);             // Called by Reset_Handler only
+bool scatterLazyDone(void);
+void scatterLazyWait(void);
+const scatter_stats_t *scatterGetStats(void);
+void scatterPrintStats(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // SCATTERLOAD_H_
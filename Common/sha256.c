@@ -0,0 +1,156 @@
+/* SPDX-License-Identifier: Unlicense */
+
+// -----------------------------------------------------------------------------
+// IMPLEMENTATION NOTES
+//
+// Software SHA-256 (FIPS 180-4), the fallback when the HASH peripheral is not
+// available. Whole blocks are compressed straight from the input, only the
+// partial head and tail go through the context buffer. The message schedule
+// is kept as a rolling 16-word window to stay within a few hundred bytes of
+// stack.
+//
+// -----------------------------------------------------------------------------
+
+#include "sha256.h"
+
+#define ROR(x, n)               (((x) >> (n)) | ((x) << (32 - (n))))
+#define CH(x, y, z)             (((x) & (y)) ^ (~(x) & (z)))
+#define MAJ(x, y, z)            (((x) & (y)) ^ ((x) & (z)) ^ ((y) & (z)))
+#define SIGMA0(x)               (ROR(x, 2) ^ ROR(x, 13) ^ ROR(x, 22))
+#define SIGMA1(x)               (ROR(x, 6) ^ ROR(x, 11) ^ ROR(x, 25))
+#define GAMMA0(x)               (ROR(x, 7) ^ ROR(x, 18) ^ ((x) >> 3))
+#define GAMMA1(x)               (ROR(x, 17) ^ ROR(x, 19) ^ ((x) >> 10))
+
+static const uint32_t k[64] =
+{
+	0x428A2F98, 0x71374491, 0xB5C0FBCF, 0xE9B5DBA5, 0x3956C25B, 0x59F111F1, 0x923F82A4, 0xAB1C5ED5,
+	0xD807AA98, 0x12835B01, 0x243185BE, 0x550C7DC3, 0x72BE5D74, 0x80DEB1FE, 0x9BDC06A7, 0xC19BF174,
+	0xE49B69C1, 0xEFBE4786, 0x0FC19DC6, 0x240CA1CC, 0x2DE92C6F, 0x4A7484AA, 0x5CB0A9DC, 0x76F988DA,
+	0x983E5152, 0xA831C66D, 0xB00327C8, 0xBF597FC7, 0xC6E00BF3, 0xD5A79147, 0x06CA6351, 0x14292967,
+	0x27B70A85, 0x2E1B2138, 0x4D2C6DFC, 0x53380D13, 0x650A7354, 0x766A0ABB, 0x81C2C92E, 0x92722C85,
+	0xA2BFE8A1, 0xA81A664B, 0xC24B8B70, 0xC76C51A3, 0xD192E819, 0xD6990624, 0xF40E3585, 0x106AA070,
+	0x19A4C116, 0x1E376C08, 0x2748774C, 0x34B0BCB5, 0x391C0CB3, 0x4ED8AA4A, 0x5B9CCA4F, 0x682E6FF3,
+	0x748F82EE, 0x78A5636F, 0x84C87814, 0x8CC70208, 0x90BEFFFA, 0xA4506CEB, 0xBEF9A3F7, 0xC67178F2,
+};
+
+static void sha256Block(uint32_t state[8], const uint8_t *p)
+{
+	uint32_t w[16];
+	uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+	uint32_t e = state[4], f = state[5], g = state[6], h = state[7];
+
+	for(uint32_t i = 0; i < 64; i++)
+	{
+		uint32_t t1, t2;
+
+		if(i < 16)
+		{
+			w[i] = ((uint32_t)p[4 * i] << 24) | ((uint32_t)p[4 * i + 1] << 16) |
+			       ((uint32_t)p[4 * i + 2] << 8) | p[4 * i + 3];
+		}
+		else
+		{
+			w[i & 15] += GAMMA1(w[(i - 2) & 15]) + w[(i - 7) & 15] + GAMMA0(w[(i - 15) & 15]);
+		}
+		t1 = h + SIGMA1(e) + CH(e, f, g) + k[i] + w[i & 15];
+		t2 = SIGMA0(a) + MAJ(a, b, c);
+		h = g;
+		g = f;
+		f = e;
+		e = d + t1;
+		d = c;
+		c = b;
+		b = a;
+		a = t1 + t2;
+	}
+
+	state[0] += a;
+	state[1] += b;
+	state[2] += c;
+	state[3] += d;
+	state[4] += e;
+	state[5] += f;
+	state[6] += g;
+	state[7] += h;
+}
+
+void sha256Init(sha256_ctx_t *ctx)
+{
+	static const uint32_t iv[8] =
+	{
+		0x6A09E667, 0xBB67AE85, 0x3C6EF372, 0xA54FF53A, 0x510E527F, 0x9B05688C, 0x1F83D9AB, 0x5BE0CD19,
+	};
+
+	memcpy(ctx->state, iv, sizeof(iv));
+	ctx->length = 0;
+	ctx->fill = 0;
+}
+
+void sha256Update(sha256_ctx_t *ctx, const void *data, uint32_t size)
+{
+	const uint8_t *p = data;
+
+	ctx->length += size;
+	if(ctx->fill != 0)
+	{
+		uint32_t n = MIN(size, SHA256_BLOCK_SIZE - ctx->fill);
+
+		memcpy(&ctx->block[ctx->fill], p, n);
+		ctx->fill += n;
+		p += n;
+		size -= n;
+		if(ctx->fill < SHA256_BLOCK_SIZE)
+		{
+			return;
+		}
+		sha256Block(ctx->state, ctx->block);
+		ctx->fill = 0;
+	}
+	for(; size >= SHA256_BLOCK_SIZE; size -= SHA256_BLOCK_SIZE, p += SHA256_BLOCK_SIZE)
+	{
+		sha256Block(ctx->state, p);
+	}
+	memcpy(ctx->block, p, size);
+	ctx->fill = size;
+}
+
+void sha256Final(sha256_ctx_t *ctx, uint8_t digest[SHA256_DIGEST_SIZE])
+{
+	uint64_t bits = ctx->length * 8;
+
+	ctx->block[ctx->fill++] = 0x80;
+	if(ctx->fill > SHA256_BLOCK_SIZE - 8)
+	{
+		memset(&ctx->block[ctx->fill], 0, SHA256_BLOCK_SIZE - ctx->fill);
+		sha256Block(ctx->state, ctx->block);
+		ctx->fill = 0;
+	}
+	memset(&ctx->block[ctx->fill], 0, SHA256_BLOCK_SIZE - 8 - ctx->fill);
+	for(uint32_t i = 0; i < 8; i++)
+	{
+		ctx->block[SHA256_BLOCK_SIZE - 1 - i] = (uint8_t)(bits >> (8 * i));
+	}
+	sha256Block(ctx->state, ctx->block);
+
+	for(uint32_t i = 0; i < 8; i++)
+	{
+		digest[4 * i] = (uint8_t)(ctx->state[i] >> 24);
+		digest[4 * i + 1] = (uint8_t)(ctx->state[i] >> 16);
+		digest[4 * i + 2] = (uint8_t)(ctx->state[i] >> 8);
+		digest[4 * i + 3] = (uint8_t)ctx->state[i];
+	}
+}
+
+// -----------------------------------------------------------------------------
+// Description: Hashes a buffer in one go
+//     Returns: none
+//      Inputs: Data, size, digest storage
+// -----------------------------------------------------------------------------
+void sha256(const void *data, uint32_t size, uint8_t digest[SHA256_DIGEST_SIZE])
+{
+	sha256_ctx_t ctx;
+
+	sha256Init(&ctx);
+	sha256Update(&ctx, data, size);
+	sha256Final(&ctx, digest);
+}
@@ -0,0 +1,44 @@
+/* SPDX-License-Identifier: Unlicense */
+
+#ifndef SHA256_H_
+#define SHA256_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// -----------------------------------------------------------------------------
+// Includes
+// -----------------------------------------------------------------------------
+#include "common.h"
+
+// -----------------------------------------------------------------------------
+// Constants
+// -----------------------------------------------------------------------------
+#define SHA256_DIGEST_SIZE          32
+#define SHA256_BLOCK_SIZE           64
+
+// -----------------------------------------------------------------------------
+// Types
+// -----------------------------------------------------------------------------
+typedef struct
+{
+	uint32_t state[8];
+	uint64_t length;                // Bytes hashed so far
+	uint8_t block[SHA256_BLOCK_SIZE];
+	uint32_t fill;                  // Bytes pending in block
+} sha256_ctx_t;
+
+// -----------------------------------------------------------------------------
+// Public Functions
+// -----------------------------------------------------------------------------
+void sha256Init(sha256_ctx_t *ctx);
+void sha256Update(sha256_ctx_t *ctx, const void *data, uint32_t size);
+void sha256Final(sha256_ctx_t *ctx, uint8_t digest[SHA256_DIGEST_SIZE]);
+void sha256(const void *data, uint32_t size, uint8_t digest[SHA256_DIGEST_SIZE]);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // SHA256_H_
@@ -2,22 +2,41 @@
 
 // -----------------------------------------------------------------------------
 // IMPLEMENTATION NOTES
-// 
-// A 16-bit basic timer is initialized where 1LSB = 1us
-// It interrupts on the natural 16-bit rollover (every 65.536 ms)
-// During the interrupt a 32-bit software counter is incremented, creating a 48-bit timer.
-// The "ticker" system utilizes the lower 32-bits, offering 1us timing
-//  resolution with a rollover at 4294.967 sec rollover, or a 2147.483 sec "event window"
-// The STM32 Cube Libraries ("HAL") expect a 1ms tick, so HAL_GetTick() offers
-//  the upper 32-bits. There's a slight inaccuracy here as this bit position will
-//  actually represent 1.024ms. But we'd rather have a slightly longer tick for
-//  the STM32 "HAL" than a less accurate 1us for our more critical timing
+//
+// TIM5, a 32-bit general purpose timer, counts at 1 MHz (1LSB = 1us) from 0 to
+// 0xFFFFFFFF and interrupts on that rollover only, every 4294.967 sec instead
+// of every 65.536 ms with the former 16-bit TIM6: 65536 times fewer interrupts.
+// The interrupt increments a 32-bit software counter, making a 64-bit timer.
+//
+// ticks() is the hardware counter itself: 1us resolution, a 4294.967 sec
+// rollover and a 2147.483 sec "event window", with no read race at all.
+// ticks64() adds the software counter without a lock: it reads upper, counter,
+// upper again and retries if the interrupt ran in between. A rollover whose
+// interrupt has not run yet (called with interrupts masked, or from a higher
+// priority handler) is still pending in UIF; it is counted when the counter
+// value is from after the wrap, i.e. in its lower half. The interrupt clears
+// UIF and increments upper with interrupts masked, so that no reader can see
+// one without the other.
+//
+// The STM32 Cube Libraries ("HAL") expect a 1ms tick: HAL_GetTick() is
+// ticks64() / 1000, exact (the former 1.024ms tick ran 2.4% slow), and wraps
+// modulo 2^32 ms as the HAL expects.
+//
+// HAL_InitTick() runs again on every HAL_RCC_ClockConfig(): once the timer is
+// running only its prescaler is reloaded and the count is put back, so time
+// stays monotonic across clock changes.
+//
+// Channel 1 of TIM5 compares against the counter: ticksAlarmSet() arms it at
+// an absolute tick count and ticksAlarmCallback() runs from the same interrupt
+// when the count is reached. Common/timerWheel.c programs it to the next timer
+// deadline, so that no periodic tick is needed.
 //
 // -----------------------------------------------------------------------------
 
 /* Includes ------------------------------------------------------------------*/
 #include "stm32.h"
 #include "main.h"
+#include "timebase.h"
 /** @addtogroup STM32H7RSxx_HAL_Driver
   * @{
   */
@@ -29,23 +48,21 @@
 /* Private typedef -----------------------------------------------------------*/
 /* Private define ------------------------------------------------------------*/
 #define TIM_CNT_FREQ 1000000U   /* Timer counter frequency : 1 MHz */
+#define TIMEBASE_TIM TIM5
+#define TIMEBASE_IRQn TIM5_IRQn
 
 /* Private macro -------------------------------------------------------------*/
 /* Private variables ---------------------------------------------------------*/
-static TIM_HandleTypeDef TimHandle;
-volatile uint32_t ticks_upper;
+static volatile uint32_t ticks_upper;
 
 /* Private function prototypes -----------------------------------------------*/
-void TIM6_IRQHandler(void);
-#if (USE_HAL_TIM_REGISTER_CALLBACKS == 1U)
-void TimeBase_TIM_PeriodElapsedCallback(TIM_HandleTypeDef *htim);
-#endif /* USE_HAL_TIM_REGISTER_CALLBACKS */
+void TIM5_IRQHandler(void);
 /* Private functions ---------------------------------------------------------*/
 
 /**
-  * @brief  This function configures the TIM6 as a time base source.
-  *         The time source is configured  to have 1ms time base with a dedicated
-  *         Tick interrupt priority.
+  * @brief  This function configures the TIM5 as a time base source.
+  *         The time source is configured to have a 1us count and a 1ms HAL
+  *         tick derived from it, with a dedicated rollover interrupt priority.
   * @note   This function is called  automatically at the beginning of program after
   *         reset by HAL_Init() or at any time when clock is configured, by HAL_RCC_ClockConfig().
   * @param  TickPriority Tick interrupt priority.
@@ -58,10 +75,17 @@ HAL_StatusTypeDef HAL_InitTick(uint32_t TickPriority)
   uint32_t              uwAPB1Prescaler;
   uint32_t              uwPrescalerValue;
   uint32_t              pFLatency;
-  HAL_StatusTypeDef     Status;
+  uint32_t              primask;
+  uint32_t              count;
+  TIM_TypeDef           *tim = TIMEBASE_TIM;
+
+  if (TickPriority >= (1UL << __NVIC_PRIO_BITS))
+  {
+    return HAL_ERROR;
+  }
 
-  /* Enable TIM6 clock */
-  __HAL_RCC_TIM6_CLK_ENABLE();
+  /* Enable TIM5 clock */
+  __HAL_RCC_TIM5_CLK_ENABLE();
 
   /* Get clock configuration */
   HAL_RCC_GetClockConfig(&clkconfig, &pFLatency);
@@ -69,7 +93,7 @@ HAL_StatusTypeDef HAL_InitTick(uint32_t TickPriority)
   /* Get APB1 prescaler */
   uwAPB1Prescaler = clkconfig.APB1CLKDivider;
 
-  /* Compute TIM6 clock */
+  /* Compute TIM5 clock */
   if (uwAPB1Prescaler == RCC_APB1_DIV1)
   {
     uwTimclock = HAL_RCC_GetPCLK1Freq();
@@ -90,102 +114,128 @@ HAL_StatusTypeDef HAL_InitTick(uint32_t TickPriority)
     }
   }
 
-  /* Compute the prescaler value to have TIM6 counter clock equal to TIM_CNT_FREQ */
+  /* Compute the prescaler value to have TIM5 counter clock equal to TIM_CNT_FREQ */
   uwPrescalerValue = (uint32_t)((uwTimclock / TIM_CNT_FREQ) - 1U);
 
-  /* Initialize TIM6 */
-  TimHandle.Instance = TIM6;
-
-  /* Initialize TIMx peripheral as follow:
-  + Period = 0xFFFF for full rollover
-  + Prescaler = (uwTimclock/TIM_CNT_FREQ - 1) to have a TIM_CNT_FREQ counter clock.
-  + ClockDivision = 0
-  + Counter direction = Up
-  */
-  TimHandle.Init.Period = 0xFFFF;
-  TimHandle.Init.Prescaler = uwPrescalerValue;
-  TimHandle.Init.ClockDivision = 0;
-  TimHandle.Init.CounterMode = TIM_COUNTERMODE_UP;
-  TimHandle.Init.AutoReloadPreload = TIM_AUTORELOAD_PRELOAD_DISABLE;
-  Status = HAL_TIM_Base_Init(&TimHandle);
-  if (Status == HAL_OK)
+  if (tim->CR1 & TIM_CR1_CEN)
   {
-#if (USE_HAL_TIM_REGISTER_CALLBACKS == 1U)
-    HAL_TIM_RegisterCallback(&TimHandle, HAL_TIM_PERIOD_ELAPSED_CB_ID, TimeBase_TIM_PeriodElapsedCallback);
-#endif /* USE_HAL_TIM_REGISTER_CALLBACKS */
-
-    /* Start the TIM time Base generation in interrupt mode */
-    Status = HAL_TIM_Base_Start_IT(&TimHandle);
-    if (Status == HAL_OK)
-    {
-      if (TickPriority < (1UL << __NVIC_PRIO_BITS))
-      {
-        /* Configure the TIM6 global Interrupt priority */
-        HAL_NVIC_SetPriority(TIM6_IRQn, TickPriority, 0);
-
-        /* Enable the TIM6 global Interrupt */
-        HAL_NVIC_EnableIRQ(TIM6_IRQn);
-
-        uwTickPrio = TickPriority;
-      }
-      else
-      {
-        Status = HAL_ERROR;
-      }
-    }
+    /* Clock change: the new prescaler only loads on an update event, which
+       also clears the counter, so put the count back straight away */
+    primask = __get_PRIMASK();
+    __disable_irq();
+    count = tim->CNT;
+    tim->PSC = uwPrescalerValue;
+    tim->EGR = TIM_EGR_UG;
+    tim->CNT = count;
+    __set_PRIMASK(primask);
+  }
+  else
+  {
+    /* Free running over the whole 32-bit range, update interrupt on overflow only (URS) */
+    ticks_upper = 0;
+    tim->CR1 = TIM_CR1_URS;
+    tim->PSC = uwPrescalerValue;
+    tim->ARR = 0xFFFFFFFFUL;
+    tim->EGR = TIM_EGR_UG;
+    tim->CNT = 0;
+    tim->SR = 0;
+    tim->DIER = TIM_DIER_UIE;
+    tim->CR1 |= TIM_CR1_CEN;
   }
 
+  /* Configure the TIM5 global Interrupt priority */
+  HAL_NVIC_SetPriority(TIMEBASE_IRQn, TickPriority, 0);
+
+  /* Enable the TIM5 global Interrupt */
+  HAL_NVIC_EnableIRQ(TIMEBASE_IRQn);
+
+  uwTickPrio = TickPriority;
+
   /* Return function status */
-  return Status;
+  return HAL_OK;
 }
 
 /**
   * @brief  Suspend Tick increment.
-  * @note   Disable the tick increment by disabling TIM6 update interrupt.
+  * @note   Disable the rollover interrupt of TIM5. The count goes on, and
+  *         ticks64() accounts for one pending rollover.
   * @retval None
   */
 void HAL_SuspendTick(void)
 {
-  /* Disable TIM6 update interrupt */
-  __HAL_TIM_DISABLE_IT(&TimHandle, TIM_IT_UPDATE);
+  /* Disable TIM5 update interrupt */
+  TIMEBASE_TIM->DIER &= ~TIM_DIER_UIE;
 }
 
 /**
   * @brief  Resume Tick increment.
-  * @note   Enable the tick increment by enabling TIM6 update interrupt.
+  * @note   Enable the rollover interrupt of TIM5.
   * @retval None
   */
 void HAL_ResumeTick(void)
 {
-  /* Enable TIM6 update interrupt */
-  __HAL_TIM_ENABLE_IT(&TimHandle, TIM_IT_UPDATE);
+  /* Enable TIM5 update interrupt */
+  TIMEBASE_TIM->DIER |= TIM_DIER_UIE;
 }
 
 /**
-  * @brief  Period elapsed callback in non blocking mode
-  * @note   This function is called  when TIM6 interrupt took place, inside
-  * HAL_TIM6_IRQHandler().
-  * @param  htim TIM handle
+  * @brief  This function handles TIM5 interrupt request: the 32-bit rollover.
   * @retval None
   */
-#if (USE_HAL_TIM_REGISTER_CALLBACKS == 1U)
-void TimeBase_TIM_PeriodElapsedCallback(TIM_HandleTypeDef *htim)
-#else
-void HAL_TIM_PeriodElapsedCallback(TIM_HandleTypeDef *htim)
-#endif /* USE_HAL_TIM_REGISTER_CALLBACKS */
+void TIM5_IRQHandler(void)
 {
-  /* Prevent unused argument(s) compilation warning */
-  UNUSED(htim);
-  ticks_upper++;
+  uint32_t primask = __get_PRIMASK();
+  uint32_t sr;
+
+  __disable_irq();
+  sr = TIMEBASE_TIM->SR;
+  if (sr & TIM_SR_UIF)
+  {
+    TIMEBASE_TIM->SR = ~(uint32_t)TIM_SR_UIF;
+    ticks_upper++;
+  }
+  __DSB();
+  __set_PRIMASK(primask);
+
+  if ((sr & TIM_SR_CC1IF) && (TIMEBASE_TIM->DIER & TIM_DIER_CC1IE))
+  {
+    TIMEBASE_TIM->SR = ~(uint32_t)TIM_SR_CC1IF;
+    ticksAlarmCallback();
+    __DSB();
+  }
 }
 
-/**
-  * @brief  This function handles TIM6 interrupt request.
-  * @retval None
-  */
-void TIM6_IRQHandler(void)
+//------------------------------------------------------------------------------
+// Description: Arms the compare interrupt, at once if the time has passed
+//     Returns: none
+//      Inputs: Absolute tick count, within 2^31 ticks of now
+//------------------------------------------------------------------------------
+void ticksAlarmSet(uint32_t at)
+{
+	TIMEBASE_TIM->CCR1 = at;
+	TIMEBASE_TIM->SR = ~(uint32_t)TIM_SR_CC1IF;
+	TIMEBASE_TIM->DIER |= TIM_DIER_CC1IE;
+	// The counter may have passed it before the compare was armed
+	if((int32_t)(at - TIMEBASE_TIM->CNT) <= 0)
+	{
+		TIMEBASE_TIM->EGR = TIM_EGR_CC1G;
+	}
+}
+
+void ticksAlarmStop(void)
+{
+	TIMEBASE_TIM->DIER &= ~TIM_DIER_CC1IE;
+	TIMEBASE_TIM->SR = ~(uint32_t)TIM_SR_CC1IF;
+}
+
+//------------------------------------------------------------------------------
+// Description: Called from the TIM5 interrupt when the alarm time is reached,
+//              to be overridden
+//     Returns: none
+//      Inputs: none
+//------------------------------------------------------------------------------
+__weak void ticksAlarmCallback(void)
 {
-  HAL_TIM_IRQHandler(&TimHandle);
 }
 
 //------------------------------------------------------------------------------
@@ -195,25 +245,29 @@ void TIM6_IRQHandler(void)
 //------------------------------------------------------------------------------
 uint32_t ticks(void)
 {
-	// Getting L, U, L allows us to detect and account for roll-over happening
-	// by an IRQ firing within this routine
-	uint32_t lower1 = TimHandle.Instance->CNT;
-	uint32_t upper1 = ticks_upper;
-	uint32_t lower2 = TimHandle.Instance->CNT;
-
-	// Account for roll-over, creating a 32-bit counter of 1us ticks
-	// by taking all 16-bits of the timer register and the lower
-	// 16-bits of the soft-counter
-	if(lower2 < lower1)
-	{
-		// Rollover happened, lower2 is post-rollover. Unsure of upper1 validity, re-get.
-		return (ticks_upper << 16)+(lower2 & 0xFFFF);
-	}
-	else
+	return TIMEBASE_TIM->CNT;
+}
+
+//------------------------------------------------------------------------------
+// Description: Provides the 64-bit ticker count, which does not roll over
+//     Returns: See above
+//      Inputs: none
+//------------------------------------------------------------------------------
+uint64_t ticks64(void)
+{
+	uint32_t upper;
+	uint32_t lower;
+	uint32_t pending;
+
+	do
 	{
-		// No rollover
-		return (upper1 << 16)+(lower2 & 0xFFFF);
-	}
+		upper = ticks_upper;
+		lower = TIMEBASE_TIM->CNT;
+		// A rollover not counted yet, read after the wrap
+		pending = ((TIMEBASE_TIM->SR & TIM_SR_UIF) != 0) && (lower < 0x80000000UL);
+	} while(upper != ticks_upper);
+
+	return ((uint64_t)(upper + pending) << 32) | lower;
 }
 
 // -----------------------------------------------------------------------------
@@ -223,25 +277,7 @@ uint32_t ticks(void)
 // -----------------------------------------------------------------------------
 uint32_t HAL_GetTick(void)
 {
-	// Getting L, U, L allows us to detect and account for roll-over happening
-	// by an IRQ firing within this routine
-	uint32_t lower1 = TimHandle.Instance->CNT;
-	uint32_t upper1 = ticks_upper;
-	uint32_t lower2 = TimHandle.Instance->CNT;
-
-	// Account for roll-over, creating a 32-bit counter of ~1ms ticks
-	// by taking the upper 6-bits of the timer register and the lower
-	// 26-bits of the soft-counter
-	if(lower2 < lower1)
-	{
-		// Rollover happened, lower2 is post-rollover. Unsure of upper1 validity, re-get.
-		return (ticks_upper << 6)+( (lower2 >> 10) & 0x003F);
-	}
-	else
-	{
-		// No rollover
-		return (upper1 << 6)+( (lower2 >> 10) & 0x003F);
-	}
+	return (uint32_t)(ticks64() / TICKS_PER_MS);
 }
 
 /**
@@ -31,6 +31,10 @@ extern "C" {
 // Public Functions
 // -----------------------------------------------------------------------------
 uint32_t ticks(void);
+uint64_t ticks64(void);
+void ticksAlarmSet(uint32_t at);
+void ticksAlarmStop(void);
+void ticksAlarmCallback(void);
 
 //------------------------------------------------------------------------------
 // Description: Calculates the delta between two timestamps
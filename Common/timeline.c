@@ -0,0 +1,128 @@
+/* SPDX-License-Identifier: Unlicense */
+
+// -----------------------------------------------------------------------------
+// IMPLEMENTATION NOTES
+//
+// Boot timeline: the bootloader and the app append one entry per finished
+// stage to a fixed struct at the start of the backup SRAM, which neither image
+// links anything into and which survives the jump (and a system reset, so the
+// bootloader starts it afresh). The app finds the entries of the bootloader
+// there and carries on after them, then prints the whole boot.
+//
+// Timestamps are DWT cycles, which keep counting across the jump, converted to
+// microseconds at each mark with the core clock of the interval it closes
+// (SystemCoreClockUpdate() is cheap next to any stage). The clock switch makes
+// TL_CLOCK only approximate: it is counted at the reset clock. Time before the
+// bootloader's main() (startup code, .data copy) is not visible to the DWT
+// and not included.
+//
+// A mark costs a few register accesses and a division, so marks can be left in
+// the normal boot path.
+//
+// -----------------------------------------------------------------------------
+
+#include "timeline.h"
+#include "cycles.h"
+
+#define TIMELINE                ((timeline_t *)TIMELINE_ADDRESS)
+
+static const char *const stage_names[TL_STAGES] =
+{
+	"boot_start", "hal_init", "clock", "gpio_uart", "sbs", "xspi2", "xspi1", "extmem", "slot_select",
+	"banner", "psram", "verify", "load", "jump", "app_start", "app_init", "app_ready",
+};
+
+static void timelineAccess(void)
+{
+	RCC->AHB4ENR |= RCC_AHB4ENR_BKPRAMEN;
+	PWR->CR1 |= PWR_CR1_DBP;
+	(void)RCC->AHB4ENR;
+}
+
+//------------------------------------------------------------------------------
+// Description: Starts a new timeline at TL_BOOT_START, time 0
+//     Returns: none
+//      Inputs: none
+//------------------------------------------------------------------------------
+void timelineStart(void)
+{
+	timeline_t *tl = TIMELINE;
+
+	timelineAccess();
+	cyclesInit();
+	SystemCoreClockUpdate();
+
+	tl->magic = TIMELINE_MAGIC;
+	tl->hz = SystemCoreClock;
+	tl->entries[0].stage = TL_BOOT_START;
+	tl->entries[0].cycles = cycles();
+	tl->entries[0].us = 0;
+	tl->count = 1;
+}
+
+//------------------------------------------------------------------------------
+// Description: Records the end of a stage, ignored without a started timeline
+//              (app loaded by the debugger) or once it is full
+//     Returns: none
+//      Inputs: Stage
+//------------------------------------------------------------------------------
+void timelineMark(timeline_stage_t stage)
+{
+	timeline_t *tl = TIMELINE;
+	uint32_t now = cycles();
+	timeline_entry_t *last, *e;
+
+	timelineAccess();
+	if((tl->magic != TIMELINE_MAGIC) || (tl->count == 0) || (tl->count >= TIMELINE_MAX))
+	{
+		return;
+	}
+
+	last = &tl->entries[tl->count - 1];
+	e = &tl->entries[tl->count];
+	e->stage = (uint8_t)stage;
+	e->cycles = now;
+	e->us = last->us + (uint32_t)(((uint64_t)(now - last->cycles) * 1000000U) / tl->hz);
+	tl->count++;
+
+	SystemCoreClockUpdate();
+	tl->hz = SystemCoreClock;
+}
+
+const timeline_t *timelineGet(void)
+{
+	timeline_t *tl = TIMELINE;
+
+	timelineAccess();
+	return (tl->magic == TIMELINE_MAGIC) ? tl : NULL;
+}
+
+//------------------------------------------------------------------------------
+// Description: Prints the time of every stage as CSV, then the total
+//     Returns: none
+//      Inputs: none
+//------------------------------------------------------------------------------
+void timelineReport(void)
+{
+	const timeline_t *tl = timelineGet();
+	uint32_t total;
+
+	if((tl == NULL) || (tl->count == 0))
+	{
+		printf("timeline,none" EOL);
+		return;
+	}
+
+	total = tl->entries[tl->count - 1].us;
+	printf("timeline,stage,at_us,stage_us,permille" EOL);
+	for(uint32_t i = 0; i < tl->count; i++)
+	{
+		const timeline_entry_t *e = &tl->entries[i];
+		uint32_t stage_us = (i != 0) ? e->us - tl->entries[i - 1].us : 0;
+
+		printf("timeline,%s,%lu,%lu,%lu" EOL, (e->stage < TL_STAGES) ? stage_names[e->stage] : "user",
+		       e->us, stage_us, (total != 0) ? (uint32_t)(((uint64_t)stage_us * 1000U) / total) : 0);
+	}
+	printf("timeline_total,stages,total_us" EOL);
+	printf("timeline_total,%lu,%lu" EOL, tl->count - 1, total);
+}
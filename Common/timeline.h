@@ -0,0 +1,77 @@
+/* SPDX-License-Identifier: Unlicense */
+
+#ifndef TIMELINE_H_
+#define TIMELINE_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// -----------------------------------------------------------------------------
+// Includes
+// -----------------------------------------------------------------------------
+#include "common.h"
+#include "stm32.h"
+
+// -----------------------------------------------------------------------------
+// Constants
+// -----------------------------------------------------------------------------
+#define TIMELINE_ADDRESS            BKPSRAM_BASE    // Shared by the bootloader and the app
+#define TIMELINE_MAGIC              0x454D4954UL    // "TIME"
+#define TIMELINE_MAX                32
+
+// Boot stages, each marked when it ends
+typedef enum
+{
+	TL_BOOT_START,              // Bootloader main(), time 0
+	TL_HAL_INIT,                // MPU_Config(), HAL_Init()
+	TL_CLOCK,                   // SystemClock_Config()
+	TL_UART,                    // GPIO and UART4 init
+	TL_SBS,
+	TL_XSPI2,
+	TL_XSPI1,
+	TL_EXTMEM,                  // NOR SFDP discovery
+	TL_SLOT,                    // A/B slot selection, NOR memory mapped
+	TL_BANNER,                  // Banner and reports on the UART
+	TL_PSRAM,                   // PSRAM_Init(), the image hash overlapping it
+	TL_VERIFY,                  // Rest of the image hash
+	TL_LOAD,                    // Load-and-run copy or decompression
+	TL_JUMP,                    // Last bootloader code
+	TL_APP_START,               // App startup code: scatter load, C runtime, to main()
+	TL_APP_INIT,                // App HAL and peripheral init
+	TL_APP_READY,               // App main loop reached
+	TL_STAGES
+} timeline_stage_t;
+
+// -----------------------------------------------------------------------------
+// Types
+// -----------------------------------------------------------------------------
+typedef struct
+{
+	uint8_t stage;              // timeline_stage_t
+	uint8_t reserved[3];
+	uint32_t cycles;            // DWT->CYCCNT at the mark
+	uint32_t us;                // Since TL_BOOT_START
+} timeline_entry_t;
+
+typedef struct
+{
+	uint32_t magic;             // TIMELINE_MAGIC
+	uint32_t count;
+	uint32_t hz;                // Core clock at the last mark
+	timeline_entry_t entries[TIMELINE_MAX];
+} timeline_t;
+
+// -----------------------------------------------------------------------------
+// Public Functions
+// -----------------------------------------------------------------------------
+void timelineStart(void);
+void timelineMark(timeline_stage_t stage);
+const timeline_t *timelineGet(void);
+void timelineReport(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // TIMELINE_H_
@@ -0,0 +1,367 @@
+/* SPDX-License-Identifier: Unlicense */
+
+// -----------------------------------------------------------------------------
+// IMPLEMENTATION NOTES
+//
+// Software timers on the timebase (Common/timebase.c), without a periodic
+// tick: the TIM5 compare interrupt is programmed to the next deadline only,
+// and timerWheelIdle() sleeps in WFI until then. Callbacks run from that
+// interrupt (TICK_INT_PRIORITY), so they must be short; they may start and
+// stop timers, themselves included.
+//
+// Timers live in a hierarchical wheel of 4 levels of 256 slots, one per byte
+// of the 32-bit tick count (1 us). A timer goes to the level of the highest
+// byte where its expiry differs from the wheel time, in the slot given by
+// that byte of the expiry: level 0 holds the exact tick, level 1 the 256 tick
+// block, and so on. Start and stop are therefore O(1): a list insertion or an
+// unlink, and a bit in the bitmap of occupied slots.
+//
+// The wheel time only moves forward to the start of the next occupied slot.
+// Every slot of a level is ahead of the wheel time in that level, so the
+// first occupied slot of the lowest occupied level is the next event: the
+// bitmap gives it in a few word scans. Reaching a level 0 slot runs its
+// timers; reaching a higher level slot moves its timers down (cascade, at
+// most 3 times per timer) with no callback. Deadlines are exact to the tick,
+// the error is the interrupt latency only.
+//
+// The alarm is never more than TIMER_WHEEL_MAX_DELAY / 2 ahead, so the wheel
+// time stays well within 2^31 ticks of every expiry and the wrap of the 32-bit
+// count is handled by the modular arithmetic (level 3 is searched circularly).
+//
+// Periodic timers are re-armed from their expiry, not from the callback
+// time, so they do not drift; a timer late by more than its period skips the
+// missed periods and counts an overrun. Callbacks later than TRACE_LATE_TICKS
+// leave an event in the trace ring (Common/traceRing.c) for post-mortems.
+//
+// -----------------------------------------------------------------------------
+
+#include "timerWheel.h"
+#include "traceRing.h"
+#include "stm32.h"
+
+#define SLOT_MASK               (TIMER_WHEEL_SLOTS - 1)
+#define BITMAP_WORDS            (TIMER_WHEEL_SLOTS / 32)
+#define SLOT_FIRING             0xFFFF      // Taken out of the wheel, callback pending
+
+static soft_timer_t *slots[TIMER_WHEEL_LEVELS * TIMER_WHEEL_SLOTS];
+static uint32_t occupied[TIMER_WHEEL_LEVELS][BITMAP_WORDS];
+static uint32_t wheel_now;                  // Every expiry is at or after it
+static timer_wheel_stats_t stats;
+
+static inline uint32_t wheelLock(void)
+{
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+	return primask;
+}
+
+static inline void wheelUnlock(uint32_t primask)
+{
+	__set_PRIMASK(primask);
+}
+
+// -----------------------------------------------------------------------------
+// Description: Links a timer in the slot its expiry falls in
+//     Returns: none
+//      Inputs: Timer, with its expiry set
+// -----------------------------------------------------------------------------
+static void wheelInsert(soft_timer_t *t)
+{
+	uint32_t diff, level, index;
+
+	if((int32_t)(t->expiry - wheel_now) < 0)
+	{
+		// Late: due at the current wheel time
+		t->expiry = wheel_now;
+	}
+	diff = t->expiry ^ wheel_now;
+	level = (diff == 0) ? 0 : (31 - __builtin_clz(diff)) / TIMER_WHEEL_BITS;
+	index = (level * TIMER_WHEEL_SLOTS) + ((t->expiry >> (level * TIMER_WHEEL_BITS)) & SLOT_MASK);
+
+	t->slot = (uint16_t)index;
+	t->next = slots[index];
+	if(t->next != NULL)
+	{
+		t->next->pprev = &t->next;
+	}
+	t->pprev = &slots[index];
+	slots[index] = t;
+	occupied[level][(index & SLOT_MASK) / 32] |= 1UL << (index % 32);
+}
+
+static void wheelUnlink(soft_timer_t *t)
+{
+	*t->pprev = t->next;
+	if(t->next != NULL)
+	{
+		t->next->pprev = t->pprev;
+	}
+	if((t->slot != SLOT_FIRING) && (slots[t->slot] == NULL))
+	{
+		occupied[t->slot / TIMER_WHEEL_SLOTS][(t->slot & SLOT_MASK) / 32] &= ~(1UL << (t->slot % 32));
+	}
+	t->pprev = NULL;
+}
+
+// -----------------------------------------------------------------------------
+// Description: Finds the first occupied slot of a level, from a slot on
+//     Returns: Slot, TIMER_WHEEL_SLOTS if none
+//      Inputs: Level, first slot
+// -----------------------------------------------------------------------------
+static uint32_t wheelScan(uint32_t level, uint32_t from)
+{
+	for(uint32_t w = from / 32; w < BITMAP_WORDS; w++)
+	{
+		uint32_t bits = occupied[level][w];
+
+		if(w == from / 32)
+		{
+			bits &= ~0UL << (from % 32);
+		}
+		if(bits != 0)
+		{
+			return (w * 32) + __builtin_ctz(bits);
+		}
+	}
+	return TIMER_WHEEL_SLOTS;
+}
+
+// -----------------------------------------------------------------------------
+// Description: Finds the next occupied slot
+//     Returns: false when the wheel is empty
+//      Inputs: Storage for its index in slots[] and its start time
+// -----------------------------------------------------------------------------
+static bool wheelNext(uint32_t *index, uint32_t *at)
+{
+	for(uint32_t level = 0; level < TIMER_WHEEL_LEVELS; level++)
+	{
+		uint32_t shift = level * TIMER_WHEEL_BITS;
+		uint32_t slot = wheelScan(level, (wheel_now >> shift) & SLOT_MASK);
+		uint32_t base;
+
+		if((slot == TIMER_WHEEL_SLOTS) && (level == TIMER_WHEEL_LEVELS - 1))
+		{
+			// Past the 32-bit wrap
+			slot = wheelScan(level, 0);
+		}
+		if(slot == TIMER_WHEEL_SLOTS)
+		{
+			continue;
+		}
+		base = (shift + TIMER_WHEEL_BITS < 32) ? wheel_now & ~((1UL << (shift + TIMER_WHEEL_BITS)) - 1) : 0;
+		*index = (level * TIMER_WHEEL_SLOTS) + slot;
+		*at = base + (slot << shift);
+		return true;
+	}
+	return false;
+}
+
+// -----------------------------------------------------------------------------
+// Description: Programs the alarm to the next slot, or stops it
+//     Returns: none
+//      Inputs: Current tick count
+// -----------------------------------------------------------------------------
+static void wheelArm(uint32_t now)
+{
+	uint32_t index, at;
+
+	if(!wheelNext(&index, &at))
+	{
+		ticksAlarmStop();
+		return;
+	}
+	if((int32_t)(at - now) > (int32_t)(TIMER_WHEEL_MAX_DELAY / 2))
+	{
+		// Keeps the wheel time close enough to now for the wrap
+		at = now + (TIMER_WHEEL_MAX_DELAY / 2);
+	}
+	ticksAlarmSet(at);
+}
+
+// -----------------------------------------------------------------------------
+// Description: Empties the wheel
+//     Returns: none
+//      Inputs: none
+// -----------------------------------------------------------------------------
+void timerWheelInit(void)
+{
+	uint32_t primask = wheelLock();
+
+	ticksAlarmStop();
+	memset(slots, 0, sizeof(slots));
+	memset(occupied, 0, sizeof(occupied));
+	memset(&stats, 0, sizeof(stats));
+	wheel_now = ticks();
+	wheelUnlock(primask);
+}
+
+// -----------------------------------------------------------------------------
+// Description: Starts (or restarts) a timer
+//     Returns: false for a delay or period over TIMER_WHEEL_MAX_DELAY
+//      Inputs: Timer, ticks to the first expiry, ticks between the next ones
+//              (0 for one-shot), callback and its argument
+// -----------------------------------------------------------------------------
+bool timerWheelStart(soft_timer_t *t, uint32_t delay, uint32_t period, soft_timer_callback_t callback, void *arg)
+{
+	uint32_t primask, now;
+
+	if((delay > TIMER_WHEEL_MAX_DELAY) || (period > TIMER_WHEEL_MAX_DELAY))
+	{
+		return false;
+	}
+
+	primask = wheelLock();
+	now = ticks();
+	if(t->pprev != NULL)
+	{
+		wheelUnlink(t);
+		stats.active--;
+	}
+	if(stats.active == 0)
+	{
+		wheel_now = now;
+	}
+	t->expiry = now + delay;
+	t->period = period;
+	t->callback = callback;
+	t->arg = arg;
+	wheelInsert(t);
+	stats.active++;
+	wheelArm(now);
+	wheelUnlock(primask);
+	return true;
+}
+
+// -----------------------------------------------------------------------------
+// Description: Stops a timer, if running. Its callback does not run afterwards,
+//              unless called from a higher priority interrupt while it runs.
+//     Returns: none
+//      Inputs: Timer
+// -----------------------------------------------------------------------------
+void timerWheelStop(soft_timer_t *t)
+{
+	uint32_t primask = wheelLock();
+
+	if(t->pprev != NULL)
+	{
+		wheelUnlink(t);
+		stats.active--;
+		// The alarm may now be early, which costs one empty interrupt
+	}
+	wheelUnlock(primask);
+}
+
+bool timerWheelActive(const soft_timer_t *t)
+{
+	return t->pprev != NULL;
+}
+
+// -----------------------------------------------------------------------------
+// Description: Runs the callbacks of the timers due and programs the next
+//              alarm. Called from the alarm interrupt.
+//     Returns: none
+//      Inputs: Current tick count
+// -----------------------------------------------------------------------------
+void timerWheelProcess(uint32_t now)
+{
+	uint32_t primask = wheelLock();
+	uint32_t index, at;
+
+	while(wheelNext(&index, &at) && ((int32_t)(at - now) <= 0))
+	{
+		soft_timer_t *pending = slots[index];
+		soft_timer_t *t;
+
+		wheel_now = at;
+		slots[index] = NULL;
+		occupied[index / TIMER_WHEEL_SLOTS][(index & SLOT_MASK) / 32] &= ~(1UL << (index % 32));
+		pending->pprev = &pending;
+		for(t = pending; t != NULL; t = t->next)
+		{
+			t->slot = SLOT_FIRING;
+		}
+
+		if(index >= TIMER_WHEEL_SLOTS)
+		{
+			// Higher level slot reached: down to the levels below
+			while(pending != NULL)
+			{
+				t = pending;
+				wheelUnlink(t);
+				wheelInsert(t);
+				stats.cascaded++;
+			}
+			continue;
+		}
+
+		// Level 0: every timer of the slot is due now. Callbacks may stop
+		// timers still in the pending list, which unlinks them from it.
+		while(pending != NULL)
+		{
+			uint32_t late;
+
+			t = pending;
+			wheelUnlink(t);
+			stats.active--;
+			late = ticks() - at;
+			stats.max_late = MAX(stats.max_late, late);
+			if(late > TRACE_LATE_TICKS)
+			{
+				TRACE(TRACE_TIMER_LATE, late);
+			}
+			if(t->period != 0)
+			{
+				uint32_t skipped = (now - at) / t->period;
+
+				t->expiry += (skipped + 1) * t->period;
+				stats.overruns += skipped;
+				wheelInsert(t);
+				stats.active++;
+			}
+			stats.fired++;
+			wheelUnlock(primask);
+			t->callback(t->arg);
+			primask = wheelLock();
+		}
+	}
+	wheel_now = now;
+	wheelArm(now);
+	wheelUnlock(primask);
+}
+
+void ticksAlarmCallback(void)
+{
+	timerWheelProcess(ticks());
+}
+
+// -----------------------------------------------------------------------------
+// Description: Idle hook: sleeps until the next interrupt, the next timer at
+//              the latest. Call it from the main loop when there is nothing to do.
+//     Returns: none
+//      Inputs: none
+// -----------------------------------------------------------------------------
+void timerWheelIdle(void)
+{
+	uint32_t t0;
+
+	// Masked, so that the wake up interrupt runs after the sleep is measured
+	__disable_irq();
+	t0 = ticks();
+	__DSB();
+	__WFI();
+	stats.idle_ticks += ticksElapsed(t0);
+	__enable_irq();
+}
+
+// -----------------------------------------------------------------------------
+// Description: Provides a snapshot of the wheel statistics
+//     Returns: none
+//      Inputs: Statistics storage
+// -----------------------------------------------------------------------------
+void timerWheelGetStats(timer_wheel_stats_t *s)
+{
+	uint32_t primask = wheelLock();
+
+	*s = stats;
+	wheelUnlock(primask);
+}
@@ -0,0 +1,67 @@
+/* SPDX-License-Identifier: Unlicense */
+
+#ifndef TIMERWHEEL_H_
+#define TIMERWHEEL_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// -----------------------------------------------------------------------------
+// Includes
+// -----------------------------------------------------------------------------
+#include "common.h"
+
+// -----------------------------------------------------------------------------
+// Constants
+// -----------------------------------------------------------------------------
+#define TIMER_WHEEL_LEVELS          4
+#define TIMER_WHEEL_BITS            8               // Slots per level: 2^8, 4 levels cover 32-bit ticks
+#define TIMER_WHEEL_SLOTS           (1UL << TIMER_WHEEL_BITS)
+
+// Longest delay or period in ticks (17.9 min at 1 MHz)
+#define TIMER_WHEEL_MAX_DELAY       0x40000000UL
+
+// -----------------------------------------------------------------------------
+// Types
+// -----------------------------------------------------------------------------
+typedef void (*soft_timer_callback_t)(void *arg);
+
+// Zeroed (static storage or memset) before its first timerWheelStart()
+typedef struct soft_timer_s
+{
+	struct soft_timer_s *next;
+	struct soft_timer_s **pprev;    // Link pointing to this timer, NULL when stopped
+	uint32_t expiry;                // Absolute tick count
+	uint32_t period;                // Ticks, 0 for a one-shot timer
+	soft_timer_callback_t callback;
+	void *arg;
+	uint16_t slot;                  // Level * TIMER_WHEEL_SLOTS + slot
+} soft_timer_t;
+
+typedef struct
+{
+	uint32_t active;                // Timers running
+	uint32_t fired;                 // Callbacks run
+	uint32_t cascaded;              // Timers moved down a level
+	uint32_t overruns;              // Periods skipped: the callback ran late by more than a period
+	uint32_t max_late;              // Ticks, worst deadline to callback delay
+	uint64_t idle_ticks;            // Spent in timerWheelIdle()
+} timer_wheel_stats_t;
+
+// -----------------------------------------------------------------------------
+// Public Functions
+// -----------------------------------------------------------------------------
+void timerWheelInit(void);
+bool timerWheelStart(soft_timer_t *t, uint32_t delay, uint32_t period, soft_timer_callback_t callback, void *arg);
+void timerWheelStop(soft_timer_t *t);
+bool timerWheelActive(const soft_timer_t *t);
+void timerWheelProcess(uint32_t now);
+void timerWheelIdle(void);
+void timerWheelGetStats(timer_wheel_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // TIMERWHEEL_H_
@@ -0,0 +1,201 @@
+/* SPDX-License-Identifier: Unlicense */
+
+// -----------------------------------------------------------------------------
+// IMPLEMENTATION NOTES
+//
+// Crash-persistent trace: TRACE(id, arg) stores the DWT cycle count, the id
+// and the argument in a ring in the backup SRAM, after the boot timeline and
+// the handoff. The backup SRAM keeps its content across resets (watchdog,
+// lockup, software or pin), so after a stall or a fault the bootloader prints
+// the last TRACE_RING_SIZE events that led to it on the next boot.
+//
+// The ring position is not kept in the backup SRAM: every entry carries the
+// low 16 bits of its sequence number, and traceRingInit() finds the newest
+// one. Both images call it, so the app carries on after the events of the
+// bootloader. A writer claims a sequence number with LDREX/STREX on a RAM
+// counter (no interrupt masking, so interrupt and fault handlers can trace
+// too) and writes the tag word last: a reset in the middle of an event leaves
+// the entry with its old tag, which sorts as the oldest. An event costs the
+// call, the claim and three stores, which the MPU makes posted writes
+// (normal non-cacheable memory): a dozen or so instructions.
+//
+// Timestamps are raw DWT cycles at the clock of the moment: the boot before
+// SystemClock_Config() counts at the reset clock, and the counter wraps every
+// 7 s at 600 MHz, so only the distance between close events is meaningful.
+// They run on across the jump to the app, not across a reset.
+//
+// The backup SRAM is lost with the power (no VBAT), which traceRingInit()
+// detects by the magic word and answers with an empty ring.
+//
+// -----------------------------------------------------------------------------
+
+#include "traceRing.h"
+#include "cycles.h"
+
+#define TRACE_RING              ((trace_ring_t *)TRACE_RING_ADDRESS)
+#define TRACE_RING_MASK         (TRACE_RING_SIZE - 1)
+#define TRACE_SEQ_MASK          0xFFFFUL
+
+_Static_assert((TRACE_RING_SIZE & TRACE_RING_MASK) == 0, "TRACE_RING_SIZE must be a power of two");
+_Static_assert(TRACE_RING_ADDRESS + sizeof(trace_ring_t) <= BKPSRAM_BASE + 0x1000, "Trace ring past the backup SRAM");
+
+static const char *const event_names[TRACE_USER] =
+{
+	[TRACE_NONE] = "none", [TRACE_START] = "start", [TRACE_JUMP] = "jump", [TRACE_UPDATE] = "update",
+	[TRACE_FAULT] = "fault", [TRACE_FAULT_ADDRESS] = "fault_address", [TRACE_TIMER_LATE] = "timer_late",
+};
+
+static volatile uint32_t next;                  // Sequence number of the next event
+static uint32_t run_start;                      // First event of this image
+static volatile bool ready;
+
+static void traceAccess(void)
+{
+	RCC->AHB4ENR |= RCC_AHB4ENR_BKPRAMEN;
+	PWR->CR1 |= PWR_CR1_DBP;
+	(void)RCC->AHB4ENR;
+}
+
+//------------------------------------------------------------------------------
+// Description: Finds the newest event in the backup SRAM (or clears it after a
+//              power loss) and starts tracing after it with a TRACE_START event
+//              that holds the reset flags, which it then clears
+//     Returns: none
+//      Inputs: none
+//------------------------------------------------------------------------------
+void traceRingInit(void)
+{
+	trace_ring_t *tr = TRACE_RING;
+	uint32_t newest = 0;
+	bool found = false;
+
+	traceAccess();
+	cyclesInit();
+	if((tr->magic != TRACE_RING_MAGIC) || (tr->size != TRACE_RING_SIZE))
+	{
+		for(uint32_t i = 0; i < TRACE_RING_SIZE; i++)
+		{
+			tr->entries[i].cycles = 0;
+			tr->entries[i].arg = 0;
+			tr->entries[i].tag = TRACE_NONE;
+		}
+		tr->size = TRACE_RING_SIZE;
+		tr->magic = TRACE_RING_MAGIC;
+	}
+
+	for(uint32_t i = 0; i < TRACE_RING_SIZE; i++)
+	{
+		uint32_t tag = tr->entries[i].tag;
+		uint32_t seq = tag & TRACE_SEQ_MASK;
+
+		if((tag >> 16) == TRACE_NONE)
+		{
+			continue;
+		}
+		if(!found || ((int16_t)(seq - newest) > 0))
+		{
+			newest = seq;
+			found = true;
+		}
+	}
+
+	next = found ? newest + 1 : 0;
+	run_start = next;
+	ready = true;
+	traceRingEvent(TRACE_START, RCC->RSR & ~RCC_RSR_RMVF);
+	RCC->RSR = RCC_RSR_RMVF;
+}
+
+//------------------------------------------------------------------------------
+// Description: Records an event, from any context. Ignored before
+//              traceRingInit().
+//     Returns: none
+//      Inputs: Event id (trace_event_t or from TRACE_USER), argument
+//------------------------------------------------------------------------------
+void traceRingEvent(uint32_t id, uint32_t arg)
+{
+	trace_entry_t *e;
+	uint32_t n;
+
+	if(!ready)
+	{
+		return;
+	}
+	do
+	{
+		n = __LDREXW(&next);
+	} while(__STREXW(n + 1, &next) != 0);
+
+	e = &TRACE_RING->entries[n & TRACE_RING_MASK];
+	e->cycles = cycles();
+	e->arg = arg;
+	e->tag = (id << 16) | (n & TRACE_SEQ_MASK);
+}
+
+//------------------------------------------------------------------------------
+// Description: Records the fault status, and the fault address when valid,
+//              from a fault handler. Waits for the stores to complete, the
+//              reset that follows may be near.
+//     Returns: none
+//      Inputs: none
+//------------------------------------------------------------------------------
+void traceRingFault(void)
+{
+	uint32_t cfsr = SCB->CFSR;
+
+	traceRingEvent(TRACE_FAULT, cfsr);
+	if(cfsr & SCB_CFSR_BFARVALID_Msk)
+	{
+		traceRingEvent(TRACE_FAULT_ADDRESS, SCB->BFAR);
+	}
+	else if(cfsr & SCB_CFSR_MMARVALID_Msk)
+	{
+		traceRingEvent(TRACE_FAULT_ADDRESS, SCB->MMFAR);
+	}
+	__DSB();
+}
+
+//------------------------------------------------------------------------------
+// Description: Prints the events recorded before traceRingInit() as CSV,
+//              oldest first: in the bootloader, the runs before the reset,
+//              each opening with a start event. back counts the events to
+//              traceRingInit().
+//     Returns: none
+//      Inputs: none
+//------------------------------------------------------------------------------
+void traceRingReport(void)
+{
+	const trace_ring_t *tr = TRACE_RING;
+	uint32_t printed = 0;
+	uint32_t last = 0;
+
+	if(!ready)
+	{
+		printf("trace,none" EOL);
+		return;
+	}
+
+	printf("trace,back,id,event,arg,cycles,delta_cycles" EOL);
+	for(uint32_t n = run_start - TRACE_RING_SIZE; n != run_start; n++)
+	{
+		const trace_entry_t *e = &tr->entries[n & TRACE_RING_MASK];
+		uint32_t tag = e->tag;
+		uint32_t id = tag >> 16;
+		uint32_t at = e->cycles;
+		int32_t delta;
+
+		// Empty, or already overwritten by this image
+		if((id == TRACE_NONE) || ((tag & TRACE_SEQ_MASK) != (n & TRACE_SEQ_MASK)))
+		{
+			continue;
+		}
+		// Cycles do not carry across a reset
+		delta = ((printed == 0) || ((id == TRACE_START) && (e->arg != 0))) ? 0 : (int32_t)(at - last);
+		last = at;
+		printed++;
+		printf("trace,%lu,%lu,%s,0x%08lX,%lu,%ld" EOL, run_start - n, id,
+		       (id < TRACE_USER) && (event_names[id] != NULL) ? event_names[id] : "user", e->arg, at, delta);
+	}
+	printf("trace_total,events,size" EOL);
+	printf("trace_total,%lu,%u" EOL, printed, TRACE_RING_SIZE);
+}
@@ -0,0 +1,89 @@
+/* SPDX-License-Identifier: Unlicense */
+
+#ifndef TRACERING_H_
+#define TRACERING_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// -----------------------------------------------------------------------------
+// Includes
+// -----------------------------------------------------------------------------
+#include "common.h"
+#include "stm32.h"
+
+// -----------------------------------------------------------------------------
+// Constants
+// -----------------------------------------------------------------------------
+// Set to 0 to compile TRACE() out
+#ifndef TRACE_RING_ENABLE
+#define TRACE_RING_ENABLE           1
+#endif
+
+// Events kept, power of two
+#ifndef TRACE_RING_SIZE
+#define TRACE_RING_SIZE             128
+#endif
+
+// Timer wheel callbacks later than this (TIM5 ticks, us) are traced
+#ifndef TRACE_LATE_TICKS
+#define TRACE_LATE_TICKS            100
+#endif
+
+#define TRACE_RING_ADDRESS          (BKPSRAM_BASE + 0x800)  // After the boot handoff
+#define TRACE_RING_MAGIC            0x43415254UL    // "TRAC"
+
+// Event ids, the application's from TRACE_USER up to 0xFFFF
+typedef enum
+{
+	TRACE_NONE,                 // Empty entry
+	TRACE_START,                // traceRingInit(), arg: RCC->RSR reset flags, 0 after the jump
+	TRACE_JUMP,                 // Bootloader to app, arg: app vector table, 0 for BOOT_Application()
+	TRACE_UPDATE,               // Firmware update session started, arg: start frame flags
+	TRACE_FAULT,                // Fault handler, arg: SCB->CFSR
+	TRACE_FAULT_ADDRESS,        // arg: SCB->BFAR or SCB->MMFAR when valid
+	TRACE_TIMER_LATE,           // Timer wheel callback, arg: ticks late
+	TRACE_USER = 0x100
+} trace_event_t;
+
+// -----------------------------------------------------------------------------
+// Types
+// -----------------------------------------------------------------------------
+typedef struct
+{
+	uint32_t cycles;            // DWT->CYCCNT
+	uint32_t arg;
+	uint32_t tag;               // id << 16 | sequence, written last
+} trace_entry_t;
+
+typedef struct
+{
+	uint32_t magic;             // TRACE_RING_MAGIC
+	uint32_t size;              // TRACE_RING_SIZE
+	uint32_t reserved[2];
+	trace_entry_t entries[TRACE_RING_SIZE];
+} trace_ring_t;
+
+// -----------------------------------------------------------------------------
+// Macros
+// -----------------------------------------------------------------------------
+#if TRACE_RING_ENABLE
+#define TRACE(id, arg)              traceRingEvent((uint32_t)(id), (uint32_t)(arg))
+#else
+#define TRACE(id, arg)              do { } while(0)
+#endif
+
+// -----------------------------------------------------------------------------
+// Public Functions
+// -----------------------------------------------------------------------------
+void traceRingInit(void);
+void traceRingEvent(uint32_t id, uint32_t arg);
+void traceRingFault(void);
+void traceRingReport(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // TRACERING_H_
@@ -0,0 +1,308 @@
+/* SPDX-License-Identifier: Unlicense */
+
+// -----------------------------------------------------------------------------
+// IMPLEMENTATION NOTES
+//
+// Cycle accurate timing of code zones marked in the source:
+//
+//     PROFILE_BEGIN(ZONE_CONTROL);
+//     ...
+//     PROFILE_END(ZONE_CONTROL);
+//
+// Build with ZONE_PROFILE_ENABLE = 1 (the macros cost nothing otherwise), call
+// zoneProfileReset() and optionally zoneProfileName() for each zone, run the
+// workload, then zoneProfileDump() sends the profile to UART4 in binary for
+// Tools/zoneprof.py, through the log sink (Common/logSink.c): the dump is
+// staged whole and queued with logSinkWriteRecord(), so that printf() output
+// from interrupt handlers cannot land in the middle of it. Each zone gets its calls, inclusive cycles (nested zones
+// included), exclusive cycles (nested zones excluded) and the largest of both.
+//
+// Open zones are kept on one stack shared with interrupt handlers, which nest
+// like calls: a zone in a handler is charged as a nested zone of whatever
+// zone it interrupted, so that its time stays out of its exclusive cycles.
+// Handlers without a zone are charged to the zone they interrupt. Begin and
+// end mask interrupts for a few instructions so that the stack, the counters
+// and the cycle count read stay consistent.
+//
+// The DWT cycle counter wraps every 2^32 cycles (7 s at 600 MHz): a single
+// zone must be shorter than that, totals are kept on 64 bits.
+//
+// zoneProfileReset() measures the profiler itself with an empty zone: the
+// bias seen in every inclusive time, and the cost of a begin / end pair to
+// the enclosing zone. Both go in the dump header, the decoder takes the bias
+// out of the times it prints. It uses a slot of its own after the application
+// zones, which PROFILE_BEGIN() / PROFILE_END() do not accept: ids from
+// ZONE_PROFILE_MAX up are counted as dropped.
+//
+// -----------------------------------------------------------------------------
+
+#include "zoneProfile.h"
+#include "cycles.h"
+#include "crc32.h"
+#include "logSink.h"
+#include "stm32.h"
+
+#define ZONE_CALIBRATE          ZONE_PROFILE_MAX    // Extra slot, for zoneProfileReset()
+#define CALIBRATE_RUNS          16
+#define ZONE_DUMP_MAX           (sizeof(zone_profile_header_t) + sizeof(uint32_t) + \
+                                 (ZONE_PROFILE_MAX * (sizeof(zone_profile_record_t) + ZONE_PROFILE_NAME_MAX)))
+
+_Static_assert(ZONE_PROFILE_NAME_MAX <= 255, "ZONE_PROFILE_NAME_MAX past the u8 name length");
+_Static_assert(ZONE_DUMP_MAX <= LOG_SINK_SIZE / 2, "Zone profile dump too large for the log sink");
+
+typedef struct
+{
+	uint32_t id;
+	uint32_t start;                 // Cycle count at begin
+	uint32_t nested;                // Inclusive cycles of the zones nested in it
+} zone_frame_t;
+
+static zone_profile_record_t zones[ZONE_PROFILE_MAX + 1];
+static const char *names[ZONE_PROFILE_MAX];
+static zone_frame_t stack[ZONE_PROFILE_DEPTH];
+static uint32_t depth;
+static uint32_t dropped;
+static uint32_t bias_cycles;
+static uint32_t pair_cycles;
+static uint8_t dump[ZONE_DUMP_MAX] __attribute__((aligned(4)));  // Staging, zoneProfileDump() only
+
+// -----------------------------------------------------------------------------
+// Description: Opens a zone, ZONE_CALIBRATE included
+//     Returns: none
+//      Inputs: Slot
+// -----------------------------------------------------------------------------
+static void zoneBegin(uint32_t id)
+{
+	uint32_t primask = __get_PRIMASK();
+
+	__disable_irq();
+	if(depth < ZONE_PROFILE_DEPTH)
+	{
+		zone_frame_t *f = &stack[depth];
+
+		f->id = id;
+		f->nested = 0;
+		f->start = DWT->CYCCNT;
+	}
+	depth++;
+	__set_PRIMASK(primask);
+}
+
+// -----------------------------------------------------------------------------
+// Description: Closes the zone opened last, which must be the one given,
+//              ZONE_CALIBRATE included
+//     Returns: none
+//      Inputs: Slot
+// -----------------------------------------------------------------------------
+static void zoneEnd(uint32_t id)
+{
+	uint32_t primask = __get_PRIMASK();
+	uint32_t now, incl, excl;
+	zone_frame_t *f;
+	zone_profile_record_t *z;
+
+	__disable_irq();
+	now = DWT->CYCCNT;
+	if(depth == 0)
+	{
+		dropped++;
+		__set_PRIMASK(primask);
+		return;
+	}
+	depth--;
+	if((depth >= ZONE_PROFILE_DEPTH) || (stack[depth].id != id))
+	{
+		dropped++;
+		__set_PRIMASK(primask);
+		return;
+	}
+
+	f = &stack[depth];
+	z = &zones[id];
+	incl = now - f->start;
+	excl = incl - f->nested;
+	z->calls++;
+	z->incl_cycles += incl;
+	z->excl_cycles += excl;
+	if(incl > z->max_incl)
+	{
+		z->max_incl = incl;
+	}
+	if(excl > z->max_excl)
+	{
+		z->max_excl = excl;
+	}
+	if(depth > 0)
+	{
+		stack[depth - 1].nested += incl;
+	}
+	__set_PRIMASK(primask);
+}
+
+// -----------------------------------------------------------------------------
+// Description: Opens a zone. An id out of range is counted as dropped and
+//              opens nothing.
+//     Returns: none
+//      Inputs: Zone id, below ZONE_PROFILE_MAX
+// -----------------------------------------------------------------------------
+void zoneProfileBegin(uint32_t id)
+{
+	uint32_t primask;
+
+	if(id < ZONE_PROFILE_MAX)
+	{
+		zoneBegin(id);
+		return;
+	}
+	primask = __get_PRIMASK();
+	__disable_irq();
+	dropped++;
+	__set_PRIMASK(primask);
+}
+
+// -----------------------------------------------------------------------------
+// Description: Closes the zone opened last, which must be the one given. An id
+//              out of range was dropped by zoneProfileBegin() and closes
+//              nothing.
+//     Returns: none
+//      Inputs: Zone id, below ZONE_PROFILE_MAX
+// -----------------------------------------------------------------------------
+void zoneProfileEnd(uint32_t id)
+{
+	if(id < ZONE_PROFILE_MAX)
+	{
+		zoneEnd(id);
+	}
+}
+
+// -----------------------------------------------------------------------------
+// Description: Clears the profile and measures the profiler overhead. Call it
+//              with no zone open.
+//     Returns: none
+//      Inputs: none
+// -----------------------------------------------------------------------------
+void zoneProfileReset(void)
+{
+	uint32_t pair = UINT32_MAX;
+	uint32_t empty = UINT32_MAX;
+	uint32_t primask;
+
+	cyclesInit();
+	for(uint32_t i = 0; i < CALIBRATE_RUNS; i++)
+	{
+		uint32_t t0 = cycles();
+
+		empty = MIN(empty, cyclesElapsed(t0));
+		t0 = cycles();
+		zoneBegin(ZONE_CALIBRATE);
+		zoneEnd(ZONE_CALIBRATE);
+		pair = MIN(pair, cyclesElapsed(t0));
+	}
+
+	primask = __get_PRIMASK();
+	__disable_irq();
+	bias_cycles = (uint32_t)(zones[ZONE_CALIBRATE].incl_cycles / CALIBRATE_RUNS);
+	pair_cycles = pair - empty;
+	memset(zones, 0, sizeof(zones));
+	depth = 0;
+	dropped = 0;
+	__set_PRIMASK(primask);
+}
+
+// -----------------------------------------------------------------------------
+// Description: Names a zone in the dump
+//     Returns: none
+//      Inputs: Zone id, name (kept by reference)
+// -----------------------------------------------------------------------------
+void zoneProfileName(uint32_t id, const char *name)
+{
+	if(id < ZONE_PROFILE_MAX)
+	{
+		names[id] = name;
+	}
+}
+
+// -----------------------------------------------------------------------------
+// Description: Provides the counters of a zone
+//     Returns: false for a zone never entered
+//      Inputs: Zone id, record storage
+// -----------------------------------------------------------------------------
+bool zoneProfileGet(uint32_t id, zone_profile_record_t *record)
+{
+	uint32_t primask;
+	const char *name;
+
+	if(id >= ZONE_PROFILE_MAX)
+	{
+		return false;
+	}
+	primask = __get_PRIMASK();
+	__disable_irq();
+	*record = zones[id];
+	__set_PRIMASK(primask);
+
+	name = names[id];
+	record->id = (uint8_t)id;
+	record->name_len = (name != NULL) ? (uint8_t)MIN(strlen(name), ZONE_PROFILE_NAME_MAX) : 0;
+	return record->calls != 0;
+}
+
+static uint32_t zoneStage(uint32_t at, const void *data, uint32_t size)
+{
+	memcpy(&dump[at], data, size);
+	return at + size;
+}
+
+// -----------------------------------------------------------------------------
+// Description: Sends the zones entered so far to UART4, in binary after a
+//              "zprof" CSV record giving its size
+//     Returns: none
+//      Inputs: none
+// -----------------------------------------------------------------------------
+void zoneProfileDump(void)
+{
+	zone_profile_header_t h = {0};
+	zone_profile_record_t r;
+	bool entered[ZONE_PROFILE_MAX];
+	uint32_t crc, at;
+
+	h.magic = ZONE_PROFILE_MAGIC;
+	h.version = ZONE_PROFILE_VERSION;
+	h.size = sizeof(h) + sizeof(crc);
+	h.core_hz = SystemCoreClock;
+	h.bias_cycles = bias_cycles;
+	h.pair_cycles = pair_cycles;
+	h.dropped = dropped;
+	for(uint32_t id = 0; id < ZONE_PROFILE_MAX; id++)
+	{
+		entered[id] = zoneProfileGet(id, &r);
+		if(entered[id])
+		{
+			h.zones++;
+			h.size += sizeof(r) + r.name_len;
+		}
+	}
+
+	printf("zprof,zones,bytes" EOL);
+	printf("zprof,%u,%lu" EOL, h.zones, h.size);
+	fflush(stdout);
+
+	at = zoneStage(0, &h, sizeof(h));
+	for(uint32_t id = 0; id < ZONE_PROFILE_MAX; id++)
+	{
+		// Zones first entered since the count are left out, the size must hold
+		if(entered[id])
+		{
+			zoneProfileGet(id, &r);
+			at = zoneStage(at, &r, sizeof(r));
+			if(r.name_len != 0)
+			{
+				at = zoneStage(at, names[id], r.name_len);
+			}
+		}
+	}
+	crc = crc32Update(0, dump, at);
+	at = zoneStage(at, &crc, sizeof(crc));
+	logSinkWriteRecord(dump, at);
+	printf(EOL);
+}
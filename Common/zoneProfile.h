@@ -0,0 +1,93 @@
+/* SPDX-License-Identifier: Unlicense */
+
+#ifndef ZONEPROFILE_H_
+#define ZONEPROFILE_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// -----------------------------------------------------------------------------
+// Includes
+// -----------------------------------------------------------------------------
+#include "common.h"
+
+// -----------------------------------------------------------------------------
+// Constants
+// -----------------------------------------------------------------------------
+// Set to 1 to compile PROFILE_BEGIN() / PROFILE_END() in, they expand to nothing otherwise
+#ifndef ZONE_PROFILE_ENABLE
+#define ZONE_PROFILE_ENABLE         0
+#endif
+
+// Zone ids are 0 to ZONE_PROFILE_MAX - 1, assigned by the application
+#ifndef ZONE_PROFILE_MAX
+#define ZONE_PROFILE_MAX            32
+#endif
+
+// Open zones, interrupt handlers included
+#ifndef ZONE_PROFILE_DEPTH
+#define ZONE_PROFILE_DEPTH          16
+#endif
+
+// Name bytes sent per zone, longer names are cut
+#ifndef ZONE_PROFILE_NAME_MAX
+#define ZONE_PROFILE_NAME_MAX       32
+#endif
+
+#define ZONE_PROFILE_MAGIC          0x4E4F5A50UL    // "PZON"
+#define ZONE_PROFILE_VERSION        1
+
+// Dump header, then one zone_profile_record_t and its name per zone entered,
+// then the CRC-32 of everything before it. Decoded by Tools/zoneprof.py.
+typedef struct
+{
+	uint32_t magic;                 // ZONE_PROFILE_MAGIC
+	uint16_t version;               // ZONE_PROFILE_VERSION
+	uint16_t zones;                 // Records that follow
+	uint32_t size;                  // Bytes, header to CRC included
+	uint32_t core_hz;               // Cycles per second
+	uint32_t bias_cycles;           // Measured by an empty zone, in every inclusive time
+	uint32_t pair_cycles;           // Cost of an empty zone to the enclosing one
+	uint32_t dropped;               // Zones not recorded: too deep, bad id or unbalanced
+	uint32_t reserved;
+} zone_profile_header_t;
+
+typedef struct
+{
+	uint64_t incl_cycles;           // Zone and the zones nested in it
+	uint64_t excl_cycles;           // Zone itself, nested zones excluded
+	uint32_t calls;
+	uint32_t max_incl;
+	uint32_t max_excl;
+	uint8_t id;
+	uint8_t name_len;               // Name bytes following the record, no terminator
+	uint16_t reserved;
+} zone_profile_record_t;
+
+// -----------------------------------------------------------------------------
+// Macros
+// -----------------------------------------------------------------------------
+#if ZONE_PROFILE_ENABLE
+#define PROFILE_BEGIN(id)           zoneProfileBegin(id)
+#define PROFILE_END(id)             zoneProfileEnd(id)
+#else
+#define PROFILE_BEGIN(id)           do { } while(0)
+#define PROFILE_END(id)             do { } while(0)
+#endif
+
+// -----------------------------------------------------------------------------
+// Public Functions
+// -----------------------------------------------------------------------------
+void zoneProfileReset(void);
+void zoneProfileName(uint32_t id, const char *name);
+void zoneProfileBegin(uint32_t id);
+void zoneProfileEnd(uint32_t id);
+bool zoneProfileGet(uint32_t id, zone_profile_record_t *record);
+void zoneProfileDump(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // ZONEPROFILE_H_
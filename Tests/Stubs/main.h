@@ -0,0 +1,229 @@
+/* SPDX-License-Identifier: Unlicense */
+
+#ifndef MAIN_H_
+#define MAIN_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// -----------------------------------------------------------------------------
+// Host stand-in for Core/Inc/main.h and the HAL/CMSIS headers it pulls in, with
+// just what the Common/ code under test uses. Interrupt masking is a no-op: the
+// tests run single threaded.
+// -----------------------------------------------------------------------------
+#include <stdint.h>
+#include <stdbool.h>
+#include <time.h>
+
+#define __weak                      __attribute__((weak))
+
+static inline uint32_t __get_PRIMASK(void) { return 0; }
+static inline void __set_PRIMASK(uint32_t primask) { (void)primask; }
+static inline void __disable_irq(void) { }
+static inline void __enable_irq(void) { }
+static inline void __DSB(void) { }
+static inline void __ISB(void) { }
+static inline void __WFI(void) { }
+static inline uint32_t __LDREXW(volatile uint32_t *addr) { return *addr; }
+static inline uint32_t __STREXW(uint32_t value, volatile uint32_t *addr) { *addr = value; return 0; }
+static inline void __CLREX(void) { }
+
+// Caches: the host has none to maintain
+#define __SCB_DCACHE_LINE_SIZE      32
+static inline void SCB_CleanDCache_by_Addr(volatile void *addr, int32_t size) { (void)addr; (void)size; }
+
+// DWT cycle counter: host nanoseconds
+typedef struct
+{
+	uint32_t CTRL;
+	uint32_t CYCCNT;
+	uint32_t LAR;
+} DWT_Type;
+
+typedef struct
+{
+	uint32_t DEMCR;
+} CoreDebug_Type;
+
+#define DWT_CTRL_CYCCNTENA_Msk      (1UL << 0)
+#define CoreDebug_DEMCR_TRCENA_Msk  (1UL << 24)
+
+static inline DWT_Type *hostDwt(void)
+{
+	static DWT_Type dwt;
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	dwt.CYCCNT = (uint32_t)((uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec);
+	return &dwt;
+}
+
+static inline CoreDebug_Type *hostCoreDebug(void)
+{
+	static CoreDebug_Type core_debug;
+	return &core_debug;
+}
+
+#define DWT                         (hostDwt())
+#define CoreDebug                   (hostCoreDebug())
+
+// HAL and RCC, as HAL_InitTick() uses them: TIM5 at 2 x 150 MHz
+typedef enum
+{
+	HAL_OK,
+	HAL_ERROR,
+	HAL_BUSY,
+	HAL_TIMEOUT
+} HAL_StatusTypeDef;
+
+typedef enum
+{
+	TIM5_IRQn = 50,
+	GPDMA1_Channel2_IRQn = 23,
+} IRQn_Type;
+
+typedef struct
+{
+	uint32_t APB1CLKDivider;
+} RCC_ClkInitTypeDef;
+
+#define __NVIC_PRIO_BITS            4
+#define RCC_APB1_DIV1               0
+#define RCC_APB1_DIV2               1
+#define RCC_TIMPRES_DISABLE         0
+#define __HAL_RCC_GET_TIMCLKPRESCALER() RCC_TIMPRES_DISABLE
+#define __HAL_RCC_TIM5_CLK_ENABLE() do { } while(0)
+
+__attribute__((weak)) uint32_t uwTickPrio;
+
+static inline void HAL_RCC_GetClockConfig(RCC_ClkInitTypeDef *clk, uint32_t *latency)
+{
+	clk->APB1CLKDivider = RCC_APB1_DIV2;
+	*latency = 0;
+}
+
+static inline uint32_t HAL_RCC_GetPCLK1Freq(void) { return 150000000UL; }
+static inline void HAL_NVIC_SetPriority(IRQn_Type irq, uint32_t prio, uint32_t sub) { (void)irq; (void)prio; (void)sub; }
+static inline void HAL_NVIC_EnableIRQ(IRQn_Type irq) { (void)irq; }
+void NVIC_SetPendingIRQ(IRQn_Type irq);
+
+typedef struct
+{
+	volatile uint32_t AHB1ENR;
+} RCC_TypeDef;
+
+#define RCC_AHB1ENR_GPDMA1EN        (1UL << 0)
+
+static inline RCC_TypeDef *hostRcc(void)
+{
+	static RCC_TypeDef rcc;
+	return &rcc;
+}
+
+#define RCC                         (hostRcc())
+
+// TIM5: each access goes through hostTim5(), which a test provides to move
+// the counter and raise the interrupt between accesses
+typedef struct
+{
+	volatile uint32_t CR1;
+	volatile uint32_t DIER;
+	volatile uint32_t SR;           // rc_w0: the model ANDs what is written
+	volatile uint32_t EGR;
+	volatile uint32_t CNT;
+	volatile uint32_t PSC;
+	volatile uint32_t ARR;
+	volatile uint32_t CCR1;
+} TIM_TypeDef;
+
+#define TIM_CR1_CEN                 (1UL << 0)
+#define TIM_CR1_URS                 (1UL << 2)
+#define TIM_EGR_UG                  (1UL << 0)
+#define TIM_EGR_CC1G                (1UL << 1)
+#define TIM_DIER_UIE                (1UL << 0)
+#define TIM_DIER_CC1IE              (1UL << 1)
+#define TIM_SR_UIF                  (1UL << 0)
+#define TIM_SR_CC1IF                (1UL << 1)
+
+TIM_TypeDef *hostTim5(void);
+#define TIM5                        (hostTim5())
+
+// GPDMA1 channel 2 and UART4, as Common/logSink.c drives them: each access to
+// the channel goes through hostGpdma1Channel2(), which a test provides to move
+// the transfer on. The UART is always done sending.
+typedef struct
+{
+	volatile uint32_t CLBAR;
+	volatile uint32_t CFCR;         // The model clears these CSR flags
+	volatile uint32_t CSR;
+	volatile uint32_t CCR;
+	volatile uint32_t CTR1;
+	volatile uint32_t CTR2;
+	volatile uint32_t CBR1;
+	volatile uint32_t CSAR;
+	volatile uint32_t CDAR;
+	volatile uint32_t CLLR;
+} DMA_Channel_TypeDef;
+
+#define DMA_CSR_TCF                 (1UL << 8)
+#define DMA_CSR_HTF                 (1UL << 9)
+#define DMA_CSR_DTEF                (1UL << 10)
+#define DMA_CSR_ULEF                (1UL << 11)
+#define DMA_CSR_USEF                (1UL << 12)
+#define DMA_CFCR_TCF                DMA_CSR_TCF
+#define DMA_CFCR_HTF                DMA_CSR_HTF
+#define DMA_CFCR_DTEF               DMA_CSR_DTEF
+#define DMA_CFCR_ULEF               DMA_CSR_ULEF
+#define DMA_CFCR_USEF               DMA_CSR_USEF
+#define DMA_CFCR_SUSPF              (1UL << 13)
+#define DMA_CFCR_TOF                (1UL << 14)
+#define DMA_CCR_EN                  (1UL << 0)
+#define DMA_CCR_RESET               (1UL << 1)
+#define DMA_CCR_TCIE                (1UL << 8)
+#define DMA_CCR_DTEIE               (1UL << 10)
+#define DMA_CCR_ULEIE               (1UL << 11)
+#define DMA_CCR_USEIE               (1UL << 12)
+#define DMA_CTR1_SINC               (1UL << 3)
+#define DMA_CTR2_REQSEL_Pos         0
+#define DMA_CTR2_DREQ               (1UL << 10)
+#define GPDMA1_REQUEST_UART4_TX     23
+
+DMA_Channel_TypeDef *hostGpdma1Channel2(void);
+#define GPDMA1_Channel2             (hostGpdma1Channel2())
+
+typedef struct
+{
+	volatile uint32_t CR3;
+	volatile uint32_t ISR;
+	volatile uint32_t TDR;
+} USART_TypeDef;
+
+#define USART_CR3_DMAT              (1UL << 7)
+#define USART_ISR_TC                (1UL << 6)
+
+static inline USART_TypeDef *hostUart4(void)
+{
+	static USART_TypeDef uart4 = {.ISR = USART_ISR_TC};
+	return &uart4;
+}
+
+#define UART4                       (hostUart4())
+
+typedef struct
+{
+	uint32_t BaudRate;
+} UART_InitTypeDef;
+
+typedef struct
+{
+	UART_InitTypeDef Init;
+} UART_HandleTypeDef;
+
+extern UART_HandleTypeDef huart4;
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // MAIN_H_
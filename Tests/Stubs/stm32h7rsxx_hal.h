@@ -0,0 +1,9 @@
+/* SPDX-License-Identifier: Unlicense */
+
+#ifndef STM32H7RSXX_HAL_H_
+#define STM32H7RSXX_HAL_H_
+
+// Host stand-in for the HAL umbrella header, see main.h
+#include "main.h"
+
+#endif // STM32H7RSXX_HAL_H_
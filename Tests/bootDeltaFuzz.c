@@ -0,0 +1,386 @@
+/* SPDX-License-Identifier: Unlicense */
+
+// -----------------------------------------------------------------------------
+// Host fuzz test for the streaming patch applier of Board/bootDelta.c: random
+// patches are built here along with the image they must produce, then fed to
+// bootDeltaFeed() in random pieces (single bytes included) with random staging
+// block sizes. The output is compared byte for byte, and every flush must be
+// block aligned and in order. Op lengths and COPY source deltas are drawn
+// around the varint byte boundaries (2^7, 2^14, 2^21) and the zigzag sign.
+//
+// Malformed patches must be refused with the right status and without output
+// past the new image: bad header, wrong old image, zero or oversized op
+// lengths, COPY sources outside the old image, overlong varints, trailing
+// bytes, failed flushes; truncated patches must never report done. Random
+// byte corruption must not crash.
+//
+// Usage: bootDeltaFuzz [seed] [iterations]
+// -----------------------------------------------------------------------------
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include "crc32.h"
+#include "../Board/bootDelta.c"
+
+#define OLD_MAX                     (96 * 1024)
+#define NEW_MAX                     (128 * 1024)
+#define PATCH_MAX                   (NEW_MAX + (NEW_MAX / 2) + 1024)
+
+static uint8_t old_image[OLD_MAX];
+static uint8_t new_image[NEW_MAX];
+static uint8_t output[NEW_MAX + 64];
+static uint8_t block[65536];
+static uint8_t patch[PATCH_MAX];
+static uint32_t patch_size;
+static uint32_t crc_table[256];
+
+static struct
+{
+	uint32_t block_size;
+	uint32_t next;                  // Offset the next flush must have
+	uint32_t fail_at;               // Flush number that fails, 0 for none
+	uint32_t flushes;
+	bool misplaced;
+} sink;
+
+static unsigned long applied, refused, pieces;
+
+// Table driven, the bitwise one of bootLoad.c would dominate the run time
+uint32_t bootCrc32Update(uint32_t crc, const void *data, uint32_t size)
+{
+	const uint8_t *p = data;
+
+	crc = ~crc;
+	while(size--)
+	{
+		crc = crc_table[(crc ^ *p++) & 0xFF] ^ (crc >> 8);
+	}
+	return ~crc;
+}
+
+uint32_t bootCrc32(const void *data, uint32_t size)
+{
+	return bootCrc32Update(0, data, size);
+}
+
+static int fail(const char *what, long iteration)
+{
+	printf("boot_delta_fuzz,FAIL,%s,iteration %ld" EOL, what, iteration);
+	return 1;
+}
+
+static bool flush(void *ctx, uint32_t offset, const uint8_t *data, uint32_t size)
+{
+	(void)ctx;
+	sink.flushes++;
+	if((sink.fail_at != 0) && (sink.flushes == sink.fail_at))
+	{
+		return false;
+	}
+	if((offset != sink.next) || (offset % sink.block_size) || (size > sink.block_size) ||
+	   (offset + size > NEW_MAX))
+	{
+		sink.misplaced = true;
+		return true;
+	}
+	memcpy(&output[offset], data, size);
+	sink.next += size;
+	return true;
+}
+
+// -----------------------------------------------------------------------------
+// Patch building
+// -----------------------------------------------------------------------------
+static void put(uint8_t c)
+{
+	patch[patch_size++] = c;
+}
+
+static void putVarint(uint32_t value)
+{
+	while(value >= 0x80)
+	{
+		put((uint8_t)(value | 0x80));
+		value >>= 7;
+	}
+	put((uint8_t)value);
+}
+
+static uint32_t zigzag(int32_t value)
+{
+	return ((uint32_t)value << 1) ^ (uint32_t)(value >> 31);
+}
+
+// Around a varint byte boundary now and then, small otherwise
+static uint32_t randomLength(uint32_t max)
+{
+	static const uint32_t edges[] = {1, 63, 64, 127, 128, 129, 8191, 8192, 16383, 16384, 16385};
+	uint32_t n;
+
+	switch(rand() % 4)
+	{
+		case 0:
+			n = edges[rand() % ARRAYSIZE(edges)];
+			break;
+		case 1:
+			n = 1 + (uint32_t)(rand() % 40000);
+			break;
+		default:
+			n = 1 + (uint32_t)(rand() % 300);
+			break;
+	}
+	return MIN(n, max);
+}
+
+static void putHeader(uint32_t old_size, uint32_t new_size)
+{
+	boot_delta_header_t h = {0};
+
+	h.magic = BOOT_DELTA_MAGIC;
+	h.version = BOOT_DELTA_VERSION;
+	h.header_size = sizeof(h);
+	h.old_size = old_size;
+	h.old_crc = bootCrc32(old_image, old_size);
+	h.new_size = new_size;
+	h.new_crc = bootCrc32(new_image, new_size);
+	h.header_crc = bootCrc32(&h, offsetof(boot_delta_header_t, header_crc));
+	memcpy(patch, &h, sizeof(h));
+	patch_size = sizeof(h);
+}
+
+// -----------------------------------------------------------------------------
+// Description: Builds a random valid patch and the new image it produces
+//     Returns: none
+//      Inputs: Old image size, new image size
+// -----------------------------------------------------------------------------
+static void buildPatch(uint32_t old_size, uint32_t new_size)
+{
+	static const int32_t deltas[] = {0, -1, 1, -63, 63, -64, 64, -65, 65, -8191, 8191, -8192, 8192, 8193};
+	uint32_t ops_at, produced = 0, src = 0;
+	static uint8_t ops[PATCH_MAX];
+	uint32_t ops_size;
+
+	patch_size = sizeof(boot_delta_header_t);
+	ops_at = patch_size;
+	while(produced < new_size)
+	{
+		uint32_t n = randomLength(new_size - produced);
+
+		if((rand() % 2) && (n <= old_size))
+		{
+			// COPY: a delta from the edge table when it lands in the old image
+			int32_t delta = deltas[rand() % ARRAYSIZE(deltas)];
+			int64_t at = (int64_t)src + delta;
+
+			if((at < 0) || (at + n > old_size))
+			{
+				at = rand() % (old_size - n + 1);
+				delta = (int32_t)(at - src);
+			}
+			putVarint((n << 1) | BOOT_DELTA_OP_COPY);
+			putVarint(zigzag(delta));
+			memcpy(&new_image[produced], &old_image[at], n);
+			src = (uint32_t)at + n;
+		}
+		else
+		{
+			putVarint((n << 1) | BOOT_DELTA_OP_DATA);
+			for(uint32_t i = 0; i < n; i++)
+			{
+				new_image[produced + i] = (uint8_t)rand();
+				put(new_image[produced + i]);
+			}
+		}
+		produced += n;
+	}
+
+	// The header needs the CRC of the new image, now known
+	ops_size = patch_size - ops_at;
+	memcpy(ops, &patch[ops_at], ops_size);
+	putHeader(old_size, new_size);
+	memcpy(&patch[patch_size], ops, ops_size);
+	patch_size += ops_size;
+}
+
+// -----------------------------------------------------------------------------
+// Description: Feeds a patch in random pieces
+//     Returns: Last status
+//      Inputs: Patch, size, old image size, staging block size
+// -----------------------------------------------------------------------------
+static boot_delta_status_t feed(const uint8_t *p, uint32_t size, uint32_t old_max, uint32_t block_size)
+{
+	boot_delta_t d = {.old = old_image, .old_max = old_max, .block = block, .block_size = block_size,
+	                  .flush = flush, .ctx = NULL};
+	boot_delta_status_t status = BOOT_DELTA_MORE;
+	uint32_t mode = (uint32_t)rand() % 3;
+
+	sink.block_size = block_size;
+	sink.next = 0;
+	sink.flushes = 0;
+	sink.misplaced = false;
+	bootDeltaInit(&d);
+	while(size != 0)
+	{
+		uint32_t n = (mode == 0) ? 1 : (mode == 1) ? 1 + (uint32_t)(rand() % 64) : 1 + (uint32_t)(rand() % 5000);
+
+		n = MIN(n, size);
+		status = bootDeltaFeed(&d, p, n);
+		pieces++;
+		if(status != BOOT_DELTA_MORE)
+		{
+			break;
+		}
+		p += n;
+		size -= n;
+	}
+	return status;
+}
+
+static uint32_t randomBlockSize(void)
+{
+	static const uint32_t sizes[] = {1, 7, 256, 1000, 4096, 65536};
+
+	return sizes[rand() % ARRAYSIZE(sizes)];
+}
+
+// -----------------------------------------------------------------------------
+// Description: A hand made patch with one op after a valid header
+//     Returns: Status of feeding it whole
+//      Inputs: Op bytes, their number
+// -----------------------------------------------------------------------------
+static boot_delta_status_t feedOps(const uint8_t *op, uint32_t size)
+{
+	memset(new_image, 0x5A, 64);
+	putHeader(1024, 64);
+	memcpy(&patch[patch_size], op, size);
+	return feed(patch, patch_size + size, OLD_MAX, 16);
+}
+
+static int malformed(void)
+{
+	static const uint8_t zero_length[] = {0x00};
+	static const uint8_t too_long[] = {0x82, 0x01};                              // DATA of 65, new image is 64
+	static const uint8_t copy_past_old[] = {0x81, 0x01, 0x80, 0x10};             // COPY 64 from 1024
+	static const uint8_t copy_before_old[] = {0x81, 0x01, 0x01};                 // COPY 64 from -1
+	static const uint8_t overlong[] = {0x82, 0x80, 0x80, 0x80, 0x80, 0x00};      // DATA of 1, six bytes
+	static const uint8_t trailing[] = {0x81, 0x01, 0x00, 0x00};                  // COPY 64 from 0, then a byte
+	uint32_t size;
+
+	for(uint32_t i = 0; i < 1024; i++)
+	{
+		old_image[i] = (uint8_t)(i * 13);
+	}
+	if((feedOps(zero_length, sizeof(zero_length)) != BOOT_DELTA_BAD_OP) ||
+	   (feedOps(too_long, sizeof(too_long)) != BOOT_DELTA_BAD_OP) ||
+	   (feedOps(copy_past_old, sizeof(copy_past_old)) != BOOT_DELTA_BAD_OP) ||
+	   (feedOps(copy_before_old, sizeof(copy_before_old)) != BOOT_DELTA_BAD_OP) ||
+	   (feedOps(overlong, sizeof(overlong)) != BOOT_DELTA_BAD_OP) ||
+	   (feedOps(trailing, sizeof(trailing)) != BOOT_DELTA_BAD_OP))
+	{
+		return fail("malformed op accepted", -1);
+	}
+
+	buildPatch(4096, 20000);
+	size = patch_size;
+	patch[0] ^= 1;
+	if(feed(patch, size, OLD_MAX, 4096) != BOOT_DELTA_BAD_HEADER)
+	{
+		return fail("bad magic accepted", -1);
+	}
+	patch[0] ^= 1;
+	patch[offsetof(boot_delta_header_t, new_size)] ^= 1;
+	if(feed(patch, size, OLD_MAX, 4096) != BOOT_DELTA_BAD_HEADER)
+	{
+		return fail("bad header CRC accepted", -1);
+	}
+	patch[offsetof(boot_delta_header_t, new_size)] ^= 1;
+	old_image[4095] ^= 1;
+	if(feed(patch, size, OLD_MAX, 4096) != BOOT_DELTA_BAD_BASE)
+	{
+		return fail("wrong old image accepted", -1);
+	}
+	old_image[4095] ^= 1;
+	if(feed(patch, size, 4095, 4096) != BOOT_DELTA_BAD_BASE)
+	{
+		return fail("old image past old_max accepted", -1);
+	}
+	sink.fail_at = 2;
+	if(feed(patch, size, OLD_MAX, 4096) != BOOT_DELTA_FLUSH_FAILED)
+	{
+		return fail("failed flush not reported", -1);
+	}
+	sink.fail_at = 0;
+	refused += 11;
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	unsigned seed = (argc > 1) ? (unsigned)strtoul(argv[1], NULL, 0) : 1;
+	long iterations = (argc > 2) ? strtol(argv[2], NULL, 0) : 1000;
+
+	for(uint32_t i = 0; i < 256; i++)
+	{
+		uint32_t c = i;
+
+		for(uint32_t b = 0; b < 8; b++)
+		{
+			c = (c & 1) ? (c >> 1) ^ CRC32_POLY : c >> 1;
+		}
+		crc_table[i] = c;
+	}
+
+	srand(seed);
+	if(malformed())
+	{
+		return 1;
+	}
+
+	for(long it = 0; it < iterations; it++)
+	{
+		uint32_t old_size = 1 + (uint32_t)(rand() % OLD_MAX);
+		uint32_t new_size = 1 + (uint32_t)(rand() % NEW_MAX);
+		uint32_t block_size = randomBlockSize();
+		boot_delta_status_t status;
+
+		for(uint32_t i = 0; i < old_size; i++)
+		{
+			old_image[i] = (uint8_t)rand();
+		}
+		buildPatch(old_size, new_size);
+
+		memset(output, 0xEE, sizeof(output));
+		status = feed(patch, patch_size, old_size, block_size);
+		if((status != BOOT_DELTA_DONE) || sink.misplaced || (sink.next != new_size))
+		{
+			return fail("valid patch not applied", it);
+		}
+		if(memcmp(output, new_image, new_size) != 0)
+		{
+			return fail("output differs", it);
+		}
+		applied++;
+
+		// Truncated: never done, nothing past what the patch carries
+		if(feed(patch, (uint32_t)(rand() % patch_size), old_size, block_size) != BOOT_DELTA_MORE)
+		{
+			return fail("truncated patch not waiting for more", it);
+		}
+
+		// One corrupt op byte: any status, output within the new image
+		patch[sizeof(boot_delta_header_t) + (rand() % (patch_size - sizeof(boot_delta_header_t)))] ^=
+			(uint8_t)(1 + (rand() % 255));
+		status = feed(patch, patch_size, old_size, block_size);
+		if(sink.misplaced || (sink.next > new_size))
+		{
+			return fail("corrupt patch wrote past the new image", it);
+		}
+		refused += (status != BOOT_DELTA_DONE);
+	}
+
+	printf("boot_delta_fuzz,seed,iterations,applied,refused,pieces" EOL);
+	printf("boot_delta_fuzz,%u,%ld,%lu,%lu,%lu" EOL, seed, iterations, applied, refused, pieces);
+	printf("boot_delta_fuzz,PASS" EOL);
+	return 0;
+}
@@ -0,0 +1,215 @@
+/* SPDX-License-Identifier: Unlicense */
+
+// -----------------------------------------------------------------------------
+// Host stress and fragmentation benchmark for Common/heap.c: three regions laid
+// out like the target's (DTCM, AXI SRAM, PSRAM, odd bases included), a random
+// mix of allocations, reallocations, aligned allocations and frees with every
+// hint, and a fill pattern per block checked before it is touched again. Ends
+// with the allocator's own report: fragmentation per region and latency, in
+// host nanoseconds instead of CPU cycles.
+//
+// Usage: heapStress [seed] [iterations]
+// -----------------------------------------------------------------------------
+
+#include <stdlib.h>
+#include "../Common/heap.c"
+
+#define SLOTS                       2000
+#define PSRAM_SIZE                  (16 * 1024 * 1024)
+
+static uint8_t dtcm[64 * 1024];
+static uint8_t axi[466 * 1024];
+static uint8_t psram[PSRAM_SIZE];
+
+static struct
+{
+	uint8_t *ptr;
+	size_t size;
+	uint8_t fill;
+} slots[SLOTS];
+
+static unsigned long failed_requests;
+
+static int fail(const char *what, long iteration)
+{
+	printf("heap_stress,FAIL,%s,iteration %ld" EOL, what, iteration);
+	return 1;
+}
+
+static bool intact(const uint8_t *p, size_t size, uint8_t fill)
+{
+	for(size_t i = 0; i < size; i++)
+	{
+		if(p[i] != fill)
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+static size_t randomSize(void)
+{
+	return (rand() % 4 == 0) ? (size_t)(rand() % 100000) : (size_t)(rand() % 256);
+}
+
+// -----------------------------------------------------------------------------
+// Description: One request that no region can satisfy, with every region
+//              tried, counts as one failure
+//     Returns: 0 on success
+//      Inputs: none
+// -----------------------------------------------------------------------------
+static int checkFailureCount(void)
+{
+	uint32_t before = heapFailureCount();
+
+	if(heapAlloc(2 * PSRAM_SIZE, HEAP_HINT_ANY) != NULL)
+	{
+		return fail("oversized allocation succeeded", -1);
+	}
+	if(heapAllocAligned(64, 3, HEAP_HINT_DMA) != NULL)
+	{
+		return fail("bad alignment accepted", -1);
+	}
+	if(heapFailureCount() - before != 2)
+	{
+		return fail("failures not counted once per request", -1);
+	}
+	failed_requests += 2;
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	unsigned seed = (argc > 1) ? (unsigned)strtoul(argv[1], NULL, 0) : 1;
+	long iterations = (argc > 2) ? strtol(argv[2], NULL, 0) : 1000000;
+	unsigned long allocs = 0, reallocs = 0, frees = 0;
+	struct timespec t0, t1;
+
+	if(!heapAddRegion("dtcm", dtcm + 3, sizeof(dtcm) - 3, HEAP_ATTR_FAST) ||
+	   !heapAddRegion("axi", axi + 5, sizeof(axi) - 5, HEAP_ATTR_DMA) ||
+	   !heapAddRegion("psram", psram, sizeof(psram), HEAP_ATTR_LARGE))
+	{
+		return fail("region setup", -1);
+	}
+	if(checkFailureCount())
+	{
+		return 1;
+	}
+
+	srand(seed);
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	for(long it = 0; it < iterations; it++)
+	{
+		int i = rand() % SLOTS;
+
+		if(slots[i].ptr)
+		{
+			size_t size;
+			uint8_t *q;
+
+			if(!intact(slots[i].ptr, slots[i].size, slots[i].fill))
+			{
+				return fail("block corrupted", it);
+			}
+			if(rand() % 3 == 0)
+			{
+				heapFree(slots[i].ptr);
+				slots[i].ptr = NULL;
+				frees++;
+				continue;
+			}
+
+			size = (rand() % 3 == 0) ? (size_t)(rand() % 70000) : (size_t)(rand() % 300);
+			q = heapRealloc(slots[i].ptr, size);
+			reallocs++;
+			if(size == 0)
+			{
+				slots[i].ptr = NULL;
+				continue;
+			}
+			if(!q)
+			{
+				failed_requests++;
+				continue;
+			}
+			if(!intact(q, MIN(size, slots[i].size), slots[i].fill))
+			{
+				return fail("content lost by realloc", it);
+			}
+			if(heapUsableSize(q) < size)
+			{
+				return fail("realloc usable size", it);
+			}
+			slots[i].ptr = q;
+			slots[i].size = size;
+		}
+		else
+		{
+			heap_hint_t hint = (heap_hint_t)(rand() % 4);
+			size_t size = randomSize();
+			size_t align = HEAP_ALIGN;
+			uint8_t *q;
+
+			if(rand() % 5 == 0)
+			{
+				align = (size_t)1 << (rand() % 10);
+				q = heapAllocAligned(size, align, hint);
+			}
+			else
+			{
+				q = heapAlloc(size, hint);
+			}
+			allocs++;
+			if(!q)
+			{
+				failed_requests++;
+				continue;
+			}
+			if((hint == HEAP_HINT_DMA) && ((uintptr_t)q & (HEAP_DMA_ALIGN - 1)))
+			{
+				return fail("DMA alignment", it);
+			}
+			if((uintptr_t)q & (MAX(align, HEAP_ALIGN) - 1))
+			{
+				return fail("alignment", it);
+			}
+			if(heapUsableSize(q) < size)
+			{
+				return fail("usable size", it);
+			}
+			slots[i].ptr = q;
+			slots[i].size = size;
+			slots[i].fill = (uint8_t)rand();
+		}
+		memset(slots[i].ptr, slots[i].fill, slots[i].size);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+
+	// Fragmentation under load, then everything handed back
+	heapPrintStats();
+	if(heapFailureCount() != failed_requests)
+	{
+		return fail("failure count", iterations);
+	}
+	for(int i = 0; i < SLOTS; i++)
+	{
+		heapFree(slots[i].ptr);
+	}
+	for(uint32_t r = 0; r < heapRegionCount(); r++)
+	{
+		heap_region_stats_t stats;
+
+		heapGetRegionStats(r, &stats);
+		if((stats.free_blocks != 1) || (stats.used != 0))
+		{
+			return fail("free blocks not coalesced", iterations);
+		}
+	}
+
+	printf("heap_stress,seed,iterations,allocs,reallocs,frees,failed,ns" EOL);
+	printf("heap_stress,%u,%ld,%lu,%lu,%lu,%lu,%lu" EOL, seed, iterations, allocs, reallocs, frees, failed_requests,
+	       (unsigned long)((t1.tv_sec - t0.tv_sec) * 1000000000L + (t1.tv_nsec - t0.tv_nsec)));
+	printf("heap_stress,PASS" EOL);
+	return 0;
+}
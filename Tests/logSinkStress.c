@@ -0,0 +1,444 @@
+/* SPDX-License-Identifier: Unlicense */
+
+// -----------------------------------------------------------------------------
+// Host stress test for the DMA log ring of Common/logSink.c. GPDMA1 channel 2
+// is faked: each access to it may end the transfer in flight, after a latency
+// that changes as the test runs, by copying the bytes from the ring to a wire
+// buffer and raising the channel interrupt. Copying only at the end catches a
+// writer that reuses ring space still in flight.
+//
+// Interrupts are modelled too: PRIMASK is a flag, and every LDREX, STREX,
+// CLREX and PRIMASK restore is a point where an interrupt may run. The channel
+// interrupt runs there when pending, and so do writer interrupts at two nested
+// levels, which clear the exclusive monitor as a real exception entry does.
+// They land between reserve and publish of the writer they interrupt.
+//
+// Each write is a line tagged with its writer and a sequence number, so the
+// wire can be checked: with the drop and block policies it must be whole lines
+// in order per writer, thread writes and binary records never lost under
+// block, records never lost under drop. With overwrite, what arrives is
+// accounted for, no write drops more old output than its own size (interrupts
+// off), and the last line arrives whole. Output written before logSinkInit()
+// must arrive too.
+//
+// Usage: logSinkStress [seed] [iterations]
+// -----------------------------------------------------------------------------
+
+#include <stdlib.h>
+#include <stdio.h>
+#include "common.h"
+
+// Exclusive accesses and interrupt masking go through the model
+#define __LDREXW(addr)              hostLdrex(addr)
+#define __STREXW(value, addr)       hostStrex(value, addr)
+#define __CLREX()                   hostClrex()
+#define __get_PRIMASK()             hostGetPrimask()
+#define __set_PRIMASK(primask)      hostSetPrimask(primask)
+#define __disable_irq()             hostDisableIrq()
+
+static uint32_t hostLdrex(volatile uint32_t *addr);
+static uint32_t hostStrex(uint32_t value, volatile uint32_t *addr);
+static void hostClrex(void);
+static uint32_t hostGetPrimask(void);
+static void hostSetPrimask(uint32_t primask);
+static void hostDisableIrq(void);
+
+#include "../Common/logSink.c"
+
+#define WIRE_SIZE                   (1u << 23)
+#define TAGS                        "IRTYAB"    // Before init, record, thread, try, interrupt levels 1 and 2
+
+UART_HandleTypeDef huart4 = {.Init = {.BaudRate = 2000000}};
+
+static uint8_t wire[WIRE_SIZE];
+static uint32_t wire_size;
+
+static struct
+{
+	DMA_Channel_TypeDef regs;
+	uint32_t latency;               // Accesses a transfer takes
+	uint32_t polls;
+	bool bad;                       // Transfer outside the ring or too long
+	bool masked;
+	bool pending;                   // Channel interrupt
+	bool exclusive;                 // Exclusive monitor
+	uint32_t depth;                 // Interrupts running
+	uint32_t isr_rate;              // 1 in isr_rate interrupt points runs a writer, 0 for none
+} sim;
+
+static struct
+{
+	uint32_t issued;                // Lines written
+	uint32_t accepted;              // Lines the sink took
+} tags[sizeof(TAGS) - 1];
+
+static uint32_t attempted;          // Bytes written
+static unsigned long isr_writes;
+
+static int fail(const char *what, const char *policy)
+{
+	printf("log_sink_stress,FAIL,%s,%s" EOL, policy, what);
+	return 1;
+}
+
+// -----------------------------------------------------------------------------
+// Description: One access to the channel: clears the flags written to CFCR,
+//              and ends the transfer in flight when its time has come
+//     Returns: Channel registers
+//      Inputs: none
+// -----------------------------------------------------------------------------
+DMA_Channel_TypeDef *hostGpdma1Channel2(void)
+{
+	DMA_Channel_TypeDef *ch = &sim.regs;
+
+	ch->CSR &= ~ch->CFCR;
+	ch->CFCR = 0;
+	if(ch->CCR & DMA_CCR_RESET)
+	{
+		ch->CCR = 0;
+	}
+	if((ch->CCR & DMA_CCR_EN) && (++sim.polls >= sim.latency))
+	{
+		uintptr_t from = ch->CSAR;
+
+		if((ch->CBR1 == 0) || (ch->CBR1 > LOG_SINK_CHUNK) || (from < (uintptr_t)ring) ||
+		   (from + ch->CBR1 > (uintptr_t)ring + LOG_SINK_SIZE) || (wire_size + ch->CBR1 > WIRE_SIZE))
+		{
+			sim.bad = true;
+		}
+		else
+		{
+			memcpy(&wire[wire_size], (const void *)from, ch->CBR1);
+			wire_size += ch->CBR1;
+		}
+		ch->CCR &= ~DMA_CCR_EN;
+		ch->CSR |= DMA_CSR_TCF;
+		sim.pending |= (ch->CCR & DMA_CCR_TCIE) != 0;
+		sim.polls = 0;
+	}
+	return ch;
+}
+
+void NVIC_SetPendingIRQ(IRQn_Type irq)
+{
+	if(irq == LOG_SINK_DMA_IRQn)
+	{
+		sim.pending = true;
+	}
+}
+
+// -----------------------------------------------------------------------------
+// Line making and checking
+// -----------------------------------------------------------------------------
+static uint32_t makeLine(char *line, uint32_t tag, uint32_t seq)
+{
+	uint32_t n = (uint32_t)sprintf(line, "%c%06lu ", TAGS[tag], (unsigned long)seq);
+	uint32_t payload = (seq * 7 + tag * 13) % 90;
+
+	for(uint32_t i = 0; i < payload; i++)
+	{
+		line[n++] = (char)('a' + ((seq + i) % 26));
+	}
+	line[n++] = '\n';
+	return n;
+}
+
+// -----------------------------------------------------------------------------
+// Description: Writes the next line of a writer through one of the entry
+//              points, and counts what the sink took
+//     Returns: none
+//      Inputs: Writer tag index, entry point: 0 write, 1 try write, 2 record
+// -----------------------------------------------------------------------------
+static void writeLine(uint32_t tag, uint32_t how)
+{
+	char line[128];
+	uint32_t n = makeLine(line, tag, tags[tag].issued++);
+	bool taken;
+
+	attempted += n;
+	switch(how)
+	{
+		case 1:
+			taken = logSinkTryWrite(line, n);
+			break;
+		case 2:
+			taken = logSinkWriteRecord(line, n);
+			break;
+		default:
+			taken = logSinkWrite(line, n) == n;
+			break;
+	}
+	tags[tag].accepted += taken;
+}
+
+// -----------------------------------------------------------------------------
+// Description: Splits the wire into lines and checks them
+//     Returns: Lines found whole
+//      Inputs: Whether every line must be whole (drop and block policies),
+//              lines found per writer (added to)
+// -----------------------------------------------------------------------------
+static int32_t parseWire(bool whole, uint32_t *seen)
+{
+	int32_t next[sizeof(TAGS) - 1];
+	uint32_t at = 0;
+	int32_t good = 0;
+
+	memset(next, 0, sizeof(next));
+	while(at < wire_size)
+	{
+		const uint8_t *end = memchr(&wire[at], '\n', wire_size - at);
+		uint32_t len = end ? (uint32_t)(end - &wire[at]) + 1 : wire_size - at;
+		const char *tag = (len > 8) ? strchr(TAGS, wire[at]) : NULL;
+		char line[128];
+		bool ok = false;
+
+		if((tag != NULL) && (*tag != 0) && (len <= sizeof(line)))
+		{
+			uint32_t t = (uint32_t)(tag - TAGS);
+			uint32_t seq = (uint32_t)strtoul((const char *)&wire[at + 1], NULL, 10);
+
+			if((makeLine(line, t, seq) == len) && (memcmp(line, &wire[at], len) == 0))
+			{
+				// In order per writer
+				if((int32_t)seq < next[t])
+				{
+					return -1;
+				}
+				next[t] = (int32_t)seq + 1;
+				seen[t]++;
+				ok = true;
+				good++;
+			}
+		}
+		if(!ok && whole)
+		{
+			return -1;
+		}
+		at += len;
+	}
+	return good;
+}
+
+// -----------------------------------------------------------------------------
+// Interrupt model
+// -----------------------------------------------------------------------------
+static void interruptPoint(void)
+{
+	if(sim.masked)
+	{
+		return;
+	}
+	if(sim.pending && (sim.depth == 0))
+	{
+		// Lowest priority: only from thread code
+		sim.pending = false;
+		sim.exclusive = false;
+		sim.depth++;
+		GPDMA1_Channel2_IRQHandler();
+		sim.depth--;
+	}
+	if((sim.isr_rate != 0) && (sim.depth < 2) && ((rand() % sim.isr_rate) == 0))
+	{
+		sim.exclusive = false;
+		sim.depth++;
+		writeLine(strchr(TAGS, 'A') - TAGS + sim.depth - 1, (rand() % 3) == 0);
+		isr_writes++;
+		sim.depth--;
+		sim.exclusive = false;
+	}
+}
+
+static uint32_t hostLdrex(volatile uint32_t *addr)
+{
+	interruptPoint();
+	sim.exclusive = true;
+	return *addr;
+}
+
+static uint32_t hostStrex(uint32_t value, volatile uint32_t *addr)
+{
+	interruptPoint();
+	if(!sim.exclusive)
+	{
+		return 1;
+	}
+	sim.exclusive = false;
+	*addr = value;
+	return 0;
+}
+
+static void hostClrex(void)
+{
+	sim.exclusive = false;
+	interruptPoint();
+}
+
+static uint32_t hostGetPrimask(void)
+{
+	return sim.masked;
+}
+
+static void hostSetPrimask(uint32_t primask)
+{
+	sim.masked = primask != 0;
+	interruptPoint();
+}
+
+static void hostDisableIrq(void)
+{
+	sim.masked = true;
+}
+
+// -----------------------------------------------------------------------------
+// Description: Runs thread writes with interrupts around them under one policy,
+//              flushes, and checks the wire
+//     Returns: 0 on pass
+//      Inputs: Policy, iterations
+// -----------------------------------------------------------------------------
+static int runPolicy(log_sink_policy_t policy, long iterations)
+{
+	static const char *names[] = {"drop", "overwrite", "block"};
+	const char *name = names[policy];
+	uint32_t seen[sizeof(TAGS) - 1] = {0};
+	uint32_t end = strchr(TAGS, 'T') - TAGS;
+	log_sink_stats_t start, before, after;
+	int32_t good;
+
+	logSinkFlush();
+	wire_size = 0;
+	attempted = 0;
+	memset(tags, 0, sizeof(tags));
+	logSinkGetStats(&start);
+	logSinkSetPolicy(policy);
+
+	for(long it = 0; it < iterations; it++)
+	{
+		uint32_t r = (uint32_t)rand() % 16;
+
+		if((it % 500) == 0)
+		{
+			// Fast wire, or one the writers outrun
+			sim.latency = (rand() % 2) ? 1 + (rand() % 4) : 50 + (rand() % 400);
+		}
+		sim.isr_rate = ((policy == LOG_SINK_OVERWRITE) && (it < iterations / 2)) ? 0 : 64;
+
+		if((policy == LOG_SINK_OVERWRITE) && (sim.isr_rate == 0))
+		{
+			// Drops no more old output than the write needs
+			char line[128];
+			uint32_t n = makeLine(line, end, tags[end].issued++);
+
+			attempted += n;
+			logSinkGetStats(&before);
+			tags[end].accepted += logSinkWrite(line, n) == n;
+			logSinkGetStats(&after);
+			if(after.overwritten - before.overwritten > n)
+			{
+				return fail("overwrite dropped more than the write", name);
+			}
+		}
+		else if(r == 0)
+		{
+			writeLine(strchr(TAGS, 'R') - TAGS, 2);
+		}
+		else if(r == 1)
+		{
+			writeLine(strchr(TAGS, 'Y') - TAGS, 1);
+		}
+		else
+		{
+			writeLine(end, 0);
+		}
+		(void)hostGpdma1Channel2();
+		interruptPoint();
+	}
+
+	// The last line always arrives whole
+	sim.isr_rate = 0;
+	writeLine(end, 0);
+	logSinkFlush();
+	if(sim.bad)
+	{
+		return fail("transfer outside the ring", name);
+	}
+	{
+		char line[128];
+		uint32_t n = makeLine(line, end, tags[end].issued - 1);
+
+		if((wire_size < n) || (memcmp(&wire[wire_size - n], line, n) != 0))
+		{
+			return fail("last line lost", name);
+		}
+	}
+
+	// Every byte is sent, dropped or overwritten
+	logSinkGetStats(&after);
+	after.written -= start.written;
+	after.dropped -= start.dropped;
+	after.overwritten -= start.overwritten;
+	after.transfers -= start.transfers;
+	if((after.written + after.dropped != attempted) || (after.written - after.overwritten != wire_size))
+	{
+		return fail("bytes unaccounted for", name);
+	}
+	good = parseWire(policy != LOG_SINK_OVERWRITE, seen);
+	if(good < 0)
+	{
+		return fail("broken or out of order output", name);
+	}
+	for(uint32_t t = 0; (t < sizeof(TAGS) - 1) && (policy != LOG_SINK_OVERWRITE); t++)
+	{
+		if(seen[t] != tags[t].accepted)
+		{
+			return fail("accepted output missing", name);
+		}
+	}
+	if((policy == LOG_SINK_BLOCK) && (tags[end].accepted != tags[end].issued))
+	{
+		return fail("thread output dropped", name);
+	}
+	if((policy != LOG_SINK_OVERWRITE) &&
+	   (tags[strchr(TAGS, 'R') - TAGS].accepted != tags[strchr(TAGS, 'R') - TAGS].issued))
+	{
+		return fail("record dropped", name);
+	}
+	printf("log_sink_stress,%s,%lu,%lu,%lu,%lu,%lu,%lu,%ld" EOL, name, attempted, wire_size, after.dropped,
+	       after.overwritten, after.transfers, isr_writes, (long)good);
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	unsigned seed = (argc > 1) ? (unsigned)strtoul(argv[1], NULL, 0) : 1;
+	long iterations = (argc > 2) ? strtol(argv[2], NULL, 0) : 20000;
+	uint32_t seen[sizeof(TAGS) - 1] = {0};
+	uint32_t init = 0;
+
+	srand(seed);
+	sim.latency = 3;
+
+	// Buffered until the DMA is set up
+	for(uint32_t i = 0; i < 40; i++)
+	{
+		writeLine(init, 0);
+	}
+	if(wire_size != 0)
+	{
+		return fail("sent before init", "init");
+	}
+	logSinkInit();
+	logSinkFlush();
+	if((parseWire(true, seen) != 40) || (seen[init] != 40))
+	{
+		return fail("output before init lost", "init");
+	}
+
+	printf("log_sink_stress,policy,bytes,wire,dropped,overwritten,transfers,isr_writes,lines" EOL);
+	if(runPolicy(LOG_SINK_BLOCK, iterations) || runPolicy(LOG_SINK_DROP, iterations) ||
+	   runPolicy(LOG_SINK_OVERWRITE, iterations))
+	{
+		return 1;
+	}
+	printf("log_sink_stress,PASS" EOL);
+	return 0;
+}
@@ -0,0 +1,131 @@
+/* SPDX-License-Identifier: Unlicense */
+
+// -----------------------------------------------------------------------------
+// Host fuzz test for Common/memKernels.c against newlib's reference: random
+// source and destination alignments, sizes across the head/burst/tail paths
+// and fill values, with guard bytes around the destination so that a store
+// past either end is caught. memCopyExt()/memSetExt() go through the
+// memCopyXspi()/memSetXspi() entry points, constant sizes included; the word
+// kernels are checked against the same reference.
+//
+// Usage: memKernelsFuzz [seed] [iterations]
+// -----------------------------------------------------------------------------
+
+#include <stdlib.h>
+#include <stdio.h>
+#include "../Common/memKernels.c"
+
+#define GUARD                       64
+#define MAX_SIZE                    600
+#define BUFFER_SIZE                 (GUARD + 8 + MAX_SIZE + GUARD)
+
+static uint8_t src[MAX_SIZE + 8];
+static uint8_t dst[BUFFER_SIZE] __attribute__((aligned(32)));
+static uint8_t ref[BUFFER_SIZE] __attribute__((aligned(32)));
+
+static int fail(const char *what, long iteration, uint32_t src_off, uint32_t dst_off, uint32_t size)
+{
+	printf("mem_kernels_fuzz,FAIL,%s,iteration %ld,src_off %lu,dst_off %lu,size %lu\n", what, iteration,
+	       (unsigned long)src_off, (unsigned long)dst_off, (unsigned long)size);
+	return 1;
+}
+
+static void randomFill(uint8_t *p, uint32_t size)
+{
+	for(uint32_t i = 0; i < size; i++)
+	{
+		p[i] = (uint8_t)rand();
+	}
+}
+
+// Sizes up to MAX_SIZE, weighted towards the short head/tail cases
+static uint32_t randomSize(void)
+{
+	return (rand() % 4 == 0) ? (uint32_t)(rand() % 40) : (uint32_t)(rand() % MAX_SIZE);
+}
+
+// Constant sizes take the inline path of memCopyXspi()/memSetXspi()
+static void constantSizes(uint8_t *d, const uint8_t *s, int c)
+{
+	memCopyXspi(d, s, 3);
+	memSetXspi(d + 3, c, 1);
+	memCopyXspi(d + 4, s + 4, MEM_INLINE_MAX);
+	memSetXspi(d + 4 + MEM_INLINE_MAX, c, MEM_INLINE_MAX + 1);
+	memCopyXspi(d + 5 + (2 * MEM_INLINE_MAX), s, 64);
+}
+
+int main(int argc, char **argv)
+{
+	unsigned seed = (argc > 1) ? (unsigned)strtoul(argv[1], NULL, 0) : 1;
+	long iterations = (argc > 2) ? strtol(argv[2], NULL, 0) : 1000000;
+
+	srand(seed);
+	for(long it = 0; it < iterations; it++)
+	{
+		uint32_t src_off = (uint32_t)(rand() % 8);
+		uint32_t dst_off = (uint32_t)(rand() % 8);
+		uint32_t size = randomSize();
+		uint32_t words = size / sizeof(uint32_t);
+		int c = rand() & 0xFF;
+		uint8_t *d = dst + GUARD + dst_off;
+		uint8_t *r = ref + GUARD + dst_off;
+
+		randomFill(src, sizeof(src));
+		randomFill(dst, sizeof(dst));
+		memcpy(ref, dst, sizeof(ref));
+
+		switch(rand() % 5)
+		{
+			case 0:
+				memCopyXspi(d, src + src_off, size);
+				memcpy(r, src + src_off, size);
+				break;
+			case 1:
+				memSetXspi(d, c, size);
+				memset(r, c, size);
+				break;
+			case 2:
+				// Word aligned on both sides
+				d = dst + GUARD;
+				r = ref + GUARD;
+				memCopyWords((uint32_t *)d, (const uint32_t *)src, words);
+				memcpy(r, src, words * sizeof(uint32_t));
+				break;
+			case 3:
+				// Rounded up to whole words, reads up to three bytes past the source
+				d = dst + GUARD;
+				r = ref + GUARD;
+				memCopyToWords((uint32_t *)d, src + src_off, size);
+				memcpy(r, src + src_off, (size + 3) & ~3UL);
+				break;
+			default:
+				d = dst + GUARD;
+				r = ref + GUARD;
+				memFillWords((uint32_t *)d, 0x01010101UL * (uint32_t)c, words);
+				memset(r, c, words * sizeof(uint32_t));
+				break;
+		}
+		if(memcmp(dst, ref, sizeof(dst)) != 0)
+		{
+			return fail("result differs from reference", it, src_off, dst_off, size);
+		}
+	}
+
+	randomFill(dst, sizeof(dst));
+	memcpy(ref, dst, sizeof(ref));
+	constantSizes(dst + GUARD + 1, src + 3, 0x5A);
+	memcpy(ref + GUARD + 1, src + 3, 3);
+	memset(ref + GUARD + 1 + 3, 0x5A, 1);
+	memcpy(ref + GUARD + 1 + 4, src + 3 + 4, MEM_INLINE_MAX);
+	memset(ref + GUARD + 1 + 4 + MEM_INLINE_MAX, 0x5A, MEM_INLINE_MAX + 1);
+	memcpy(ref + GUARD + 1 + 5 + (2 * MEM_INLINE_MAX), src + 3, 64);
+	if(memcmp(dst, ref, sizeof(dst)) != 0)
+	{
+		return fail("constant size entry points", -1, 3, 1, 0);
+	}
+
+	printf("mem_kernels_fuzz,seed,iterations\n");
+	printf("mem_kernels_fuzz,%u,%ld\n", seed, iterations);
+	printf("mem_kernels_fuzz,PASS\n");
+	return 0;
+}
@@ -0,0 +1,229 @@
+/* SPDX-License-Identifier: Unlicense */
+
+// -----------------------------------------------------------------------------
+// Host test for the lock-free read of ticks64() in Common/timebase.c around
+// the 32-bit rollover of TIM5. The counter, its status register and the
+// software upper half are faked: every access to TIM5 or to ticks_upper moves
+// the count on, sets UIF on the wrap and may run TIM5_IRQHandler() first, as
+// the interrupt would between two instructions. Each read must return the true
+// 64-bit count at the moment the counter was sampled, for every position of
+// the interrupt, masked interrupts included.
+//
+// Fixed cases: UIF set with the counter below 0x80000000 (wrapped, interrupt
+// not run yet: counted), and UIF set by a wrap after a counter value above it
+// (sampled before the wrap: not counted). A UIF left pending for more than
+// half a period is outside the event window and is not tested.
+//
+// Usage: ticks64Race [seed] [iterations]
+// -----------------------------------------------------------------------------
+
+#include <stdlib.h>
+#include <stdio.h>
+
+// Reads and writes of the upper half go through the model too
+#define ticks_upper                 (*hostUpper())
+#include "../Common/timebase.c"
+#undef ticks_upper
+
+static struct
+{
+	TIM_TypeDef regs;
+	uint64_t now;                   // True count
+	uint32_t sr;                    // Status flags, regs.SR takes the writes
+	uint32_t upper;                 // ticks_upper
+	uint32_t rate;                  // Ticks per access
+	uint32_t accesses;              // Since the read started
+	uint32_t irq_at;                // First access the interrupt may run before
+	bool masked;
+	bool busy;
+} sim;
+
+// -----------------------------------------------------------------------------
+// Description: One access by the code under test: moves the count on, sets
+//              UIF on the wrap, and runs the interrupt when it is due. Accesses
+//              from the interrupt itself take no time.
+//     Returns: none
+//      Inputs: none
+// -----------------------------------------------------------------------------
+static void access(void)
+{
+	uint32_t before;
+
+	if(sim.busy)
+	{
+		return;
+	}
+	sim.busy = true;
+	sim.sr &= sim.regs.SR;
+	if(sim.regs.CNT != (uint32_t)sim.now)
+	{
+		sim.now = (sim.now & ~0xFFFFFFFFULL) | sim.regs.CNT;
+	}
+	before = (uint32_t)sim.now;
+	sim.now += sim.rate;
+	if((uint32_t)sim.now < before)
+	{
+		sim.sr |= TIM_SR_UIF;
+	}
+	sim.regs.CNT = (uint32_t)sim.now;
+	sim.regs.SR = sim.sr;
+	if(!sim.masked && (sim.regs.DIER & TIM_DIER_UIE) && (sim.sr & TIM_SR_UIF) && (sim.accesses >= sim.irq_at))
+	{
+		TIM5_IRQHandler();
+		sim.sr &= sim.regs.SR;
+		sim.regs.SR = sim.sr;
+	}
+	sim.accesses++;
+	sim.busy = false;
+}
+
+TIM_TypeDef *hostTim5(void)
+{
+	access();
+	return &sim.regs;
+}
+
+static volatile uint32_t *hostUpper(void)
+{
+	access();
+	return &sim.upper;
+}
+
+static int fail(const char *what, uint64_t now, uint32_t rate, uint32_t irq_at, bool masked, uint64_t got)
+{
+	printf("ticks64_race,FAIL,%s,now 0x%016llX,rate %lu,irq_at %lu,masked %d,got 0x%016llX\n", what,
+	       (unsigned long long)now, (unsigned long)rate, (unsigned long)irq_at, masked, (unsigned long long)got);
+	return 1;
+}
+
+// -----------------------------------------------------------------------------
+// Description: Sets the true count, with the rollover to it pending in UIF
+//              when the upper half is behind, and reads it once
+//     Returns: 0 when ticks64() returned the count at the counter sample
+//      Inputs: True count, upper half, ticks per access, interrupt position,
+//              interrupts masked, result
+// -----------------------------------------------------------------------------
+static int readAt(uint64_t now, uint32_t upper, uint32_t rate, uint32_t irq_at, bool masked, uint64_t *got)
+{
+	uint64_t start, end, truth;
+	uint32_t lower;
+
+	sim.now = now;
+	sim.upper = upper;
+	sim.sr = ((now >> 32) != upper) ? TIM_SR_UIF : 0;
+	sim.regs.CNT = (uint32_t)now;
+	sim.regs.SR = sim.sr;
+	sim.rate = rate;
+	sim.accesses = 0;
+	sim.irq_at = irq_at;
+	sim.masked = masked;
+
+	start = sim.now;
+	*got = ticks64();
+	end = sim.now;
+
+	// The one count between start and end with these low 32 bits
+	lower = (uint32_t)*got;
+	truth = (end & ~0xFFFFFFFFULL) | lower;
+	if(truth > end)
+	{
+		truth -= 0x100000000ULL;
+	}
+	if((truth < start) || (*got != truth))
+	{
+		return fail("not the sampled count", now, rate, irq_at, masked, *got);
+	}
+	return 0;
+}
+
+static int fixedCases(void)
+{
+	uint64_t got;
+
+	// Wrapped, interrupt masked: counted from UIF
+	if(readAt(0x500000010ULL, 4, 0, 0, true, &got) || (got != 0x500000010ULL))
+	{
+		return fail("UIF with the counter below half", 0x500000010ULL, 0, 0, true, got);
+	}
+	// Counter sampled at 0xFFFFFFF8, the wrap sets UIF before SR is read
+	if(readAt(0x4FFFFFFE8ULL, 4, 8, 0, true, &got) || (got != 0x4FFFFFFF8ULL))
+	{
+		return fail("UIF with the counter above half", 0x4FFFFFFE8ULL, 8, 0, true, got);
+	}
+	// Same, the interrupt taken before the upper half is read again: retried,
+	// the counter sampled again at 0x18
+	if(readAt(0x4FFFFFFE8ULL, 4, 8, 3, false, &got) || (got != 0x500000018ULL))
+	{
+		return fail("interrupt between the reads", 0x4FFFFFFE8ULL, 8, 3, false, got);
+	}
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	unsigned seed = (argc > 1) ? (unsigned)strtoul(argv[1], NULL, 0) : 1;
+	long iterations = (argc > 2) ? strtol(argv[2], NULL, 0) : 1000000;
+	uint64_t got, last = 0;
+	long reads = 0;
+
+	if((HAL_InitTick(15) != HAL_OK) || (sim.regs.PSC != 299) || !(sim.regs.DIER & TIM_DIER_UIE))
+	{
+		return fail("HAL_InitTick()", sim.now, 0, 0, false, 0);
+	}
+	if(fixedCases())
+	{
+		return 1;
+	}
+
+	// Every interrupt position, every step size, around the wrap
+	for(uint32_t rate = 1; rate <= 64; rate++)
+	{
+		for(int32_t offset = -8 * (int32_t)rate; offset <= 2 * (int32_t)rate; offset++)
+		{
+			uint64_t now = 0x700000000ULL + (int64_t)offset;
+
+			for(uint32_t irq_at = 0; irq_at <= 8; irq_at++)
+			{
+				if(readAt(now, 6, rate, irq_at, false, &got) || readAt(now, 6, rate, irq_at, true, &got))
+				{
+					return 1;
+				}
+				reads += 2;
+			}
+		}
+	}
+
+	// A long run across many wraps, the interrupt late by a random number of accesses
+	srand(seed);
+	sim.now = 0xFFFFF000ULL;
+	sim.upper = 0;
+	sim.sr = 0;
+	sim.regs.SR = 0;
+	sim.regs.CNT = (uint32_t)sim.now;
+	for(long it = 0; it < iterations; it++)
+	{
+		uint64_t start = sim.now;
+
+		sim.rate = (rand() % 8 == 0) ? (uint32_t)rand() % 0x4000000 : (uint32_t)rand() % 0x1000;
+		sim.accesses = 0;
+		sim.irq_at = (uint32_t)rand() % 6;
+		sim.masked = (rand() % 4) == 0;
+		got = ticks64();
+		if((got < last) || (got < start) || (got > sim.now))
+		{
+			return fail("not monotonic", start, sim.rate, sim.irq_at, sim.masked, got);
+		}
+		last = got;
+		reads++;
+	}
+	sim.rate = 0;
+	if(HAL_GetTick() != (uint32_t)(ticks64() / TICKS_PER_MS))
+	{
+		return fail("HAL_GetTick()", sim.now, 0, 0, false, 0);
+	}
+
+	printf("ticks64_race,seed,iterations,reads,wraps\n");
+	printf("ticks64_race,%u,%ld,%ld,%llu\n", seed, iterations, reads, (unsigned long long)(sim.now >> 32));
+	printf("ticks64_race,PASS\n");
+	return 0;
+}
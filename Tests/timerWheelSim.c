@@ -0,0 +1,236 @@
+/* SPDX-License-Identifier: Unlicense */
+
+// -----------------------------------------------------------------------------
+// Host simulation of Common/timerWheel.c across the 32-bit wrap of the tick
+// count: a 1 MHz counter starting 16.8 s before the wrap, 10000 timers
+// (one-shot and periodic, delays from a few ticks to TIMER_WHEEL_MAX_DELAY),
+// and the alarm interrupt taken with a random latency. Callbacks stop and
+// restart random timers, as application code would. No callback may run
+// early, later than the interrupt latency, or for a stopped timer, no running
+// timer may be left overdue, and the wheel must count the same running timers
+// as the model.
+//
+// ticks() and the TIM5 alarm of Common/timebase.c are faked here.
+//
+// Usage: timerWheelSim [seed] [callbacks]
+// -----------------------------------------------------------------------------
+
+#include <stdlib.h>
+#include <stdio.h>
+
+#define TRACE_RING_ENABLE           0
+#include "../Common/timerWheel.c"
+
+#define TIMERS                      10000
+#define LATENCY_MAX                 8           // Interrupt latency, ticks
+#define START_TICKS                 0xFF000000UL
+
+static uint32_t now;
+static uint32_t alarm_at;
+static bool alarm_on;
+static uint64_t rng;
+
+static soft_timer_t timers[TIMERS];
+static struct
+{
+	uint32_t due;
+	bool running;
+} model[TIMERS];
+
+static unsigned long callbacks, restarts, stops;
+static const char *failure;
+
+uint32_t ticks(void)
+{
+	return now;
+}
+
+void ticksAlarmSet(uint32_t at)
+{
+	alarm_at = at;
+	alarm_on = true;
+}
+
+void ticksAlarmStop(void)
+{
+	alarm_on = false;
+}
+
+static uint32_t random32(void)
+{
+	rng ^= rng << 13;
+	rng ^= rng >> 7;
+	rng ^= rng << 17;
+	return (uint32_t)rng;
+}
+
+// Delays from a few ticks to the longest, weighted towards the short ones
+static uint32_t randomDelay(void)
+{
+	switch(random32() % 4)
+	{
+		case 0:
+			return random32() % 300;
+		case 1:
+			return random32() % 70000;
+		case 2:
+			return random32() % 20000000;
+		default:
+			return random32() % TIMER_WHEEL_MAX_DELAY;
+	}
+}
+
+static void callback(void *arg);
+
+static bool start(uint32_t i, uint32_t delay, uint32_t period)
+{
+	if(!timerWheelStart(&timers[i], delay, period, callback, (void *)(uintptr_t)i))
+	{
+		return false;
+	}
+	model[i].due = now + delay;
+	model[i].running = true;
+	return true;
+}
+
+// -----------------------------------------------------------------------------
+// Description: Timer callback: checks the deadline against the model, moves a
+//              periodic timer to its next expiry, then stops or restarts a
+//              random timer
+//     Returns: none
+//      Inputs: Timer index
+// -----------------------------------------------------------------------------
+static void callback(void *arg)
+{
+	uint32_t i = (uint32_t)(uintptr_t)arg;
+	int32_t late = (int32_t)(now - model[i].due);
+	uint32_t action = random32() % 10;
+	uint32_t j = random32() % TIMERS;
+
+	callbacks++;
+	if(!model[i].running)
+	{
+		failure = "callback of a stopped timer";
+	}
+	else if(late < 0)
+	{
+		failure = "callback early";
+	}
+	else if(late > LATENCY_MAX)
+	{
+		failure = "callback late";
+	}
+	if(timers[i].period != 0)
+	{
+		model[i].due += timers[i].period * (((uint32_t)late / timers[i].period) + 1);
+	}
+	else
+	{
+		model[i].running = false;
+	}
+
+	if(action == 0)
+	{
+		timerWheelStop(&timers[j]);
+		model[j].running = false;
+		stops++;
+	}
+	else if(action < 3)
+	{
+		uint32_t period = (random32() & 1) ? 50 + (random32() % 5000000) : 0;
+
+		if(!start(j, randomDelay(), period))
+		{
+			failure = "restart refused";
+		}
+		restarts++;
+	}
+}
+
+static int fail(const char *what, uint64_t elapsed)
+{
+	printf("timer_wheel_sim,FAIL,%s,ticks 0x%08lX,callbacks %lu,elapsed %llu\n", what, (unsigned long)now, callbacks,
+	       (unsigned long long)elapsed);
+	return 1;
+}
+
+int main(int argc, char **argv)
+{
+	unsigned seed = (argc > 1) ? (unsigned)strtoul(argv[1], NULL, 0) : 1;
+	long target = (argc > 2) ? strtol(argv[2], NULL, 0) : 3000000;
+	uint64_t elapsed = 0;
+	unsigned long interrupts = 0;
+	bool wrapped = false;
+	timer_wheel_stats_t s;
+	uint32_t running = 0;
+
+	rng = 88172645463325252ULL ^ seed;
+	now = START_TICKS;
+	timerWheelInit();
+	for(uint32_t i = 0; i < TIMERS; i++)
+	{
+		if(!start(i, randomDelay(), (i % 3 == 0) ? 100 + (random32() % 10000000) : 0))
+		{
+			return fail("start refused", elapsed);
+		}
+	}
+
+	while((long)callbacks < target)
+	{
+		uint32_t step, before = now;
+
+		if(!alarm_on)
+		{
+			return fail("alarm off with timers running", elapsed);
+		}
+		// To the alarm, then the interrupt latency
+		step = ((int32_t)(alarm_at - now) > 0) ? alarm_at - now : 0;
+		step += random32() % (LATENCY_MAX + 1);
+		now += step;
+		elapsed += step;
+		wrapped = wrapped || (now < before);
+		alarm_on = false;
+		interrupts++;
+		ticksAlarmCallback();
+		if(failure)
+		{
+			return fail(failure, elapsed);
+		}
+
+		// Nothing left overdue once the interrupt is done
+		if((interrupts % 1024) == 0)
+		{
+			for(uint32_t i = 0; i < TIMERS; i++)
+			{
+				if(model[i].running && ((int32_t)(now - model[i].due) > 0))
+				{
+					return fail("timer overdue", elapsed);
+				}
+			}
+		}
+	}
+
+	timerWheelGetStats(&s);
+	for(uint32_t i = 0; i < TIMERS; i++)
+	{
+		running += model[i].running;
+		if(model[i].running != timerWheelActive(&timers[i]))
+		{
+			return fail("running state differs", elapsed);
+		}
+	}
+	if(running != s.active)
+	{
+		return fail("active count differs", elapsed);
+	}
+	if(!wrapped)
+	{
+		return fail("no wrap", elapsed);
+	}
+
+	printf("timer_wheel_sim,seed,callbacks,interrupts,sim_s,restarts,stops,cascaded,overruns,max_late,active\n");
+	printf("timer_wheel_sim,%u,%lu,%lu,%.1f,%lu,%lu,%lu,%lu,%lu,%lu\n", seed, callbacks, interrupts, elapsed / 1e6,
+	       restarts, stops, s.cascaded, s.overruns, s.max_late, s.active);
+	printf("timer_wheel_sim,PASS\n");
+	return 0;
+}
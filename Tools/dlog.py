@@ -0,0 +1,344 @@
+#!/usr/bin/env python3
+# SPDX-License-Identifier: Unlicense
+"""Formats the deferred log records of Common/dlog.c with the strings of the ELF.
+
+DLOG() sends records among the console text (little endian):
+
+      0  start        0xDB, a byte the ASCII text never has
+      1  args         u8, argument words that follow the header
+      2  id           u16, offset of the format string in the .dlog section
+      4  cycles       DWT cycle count
+      8  args         u32 each
+      .  check        u8, XOR of the bytes of the words above
+
+The .dlog section is not loaded on the target: the strings only exist in the
+ELF, read here with objdump. The sync record that dlogInit() sends (id
+0xFFFF: vector table, core clock) selects the ELF of the ids that follow, so
+the Boot and the Appli can log on the same capture. Timestamps are seconds of
+the cycle count, unwrapped across its 32-bit wraps.
+
+decode: prints a console capture, records formatted, text as is.
+read: prints the console live, until the timeout or Ctrl-C.
+selftest: formats synthetic records against synthetic string tables.
+
+    dlog.py read /dev/ttyACM0 --elf Boot/Debug/STM32H7S7_Boot.elf --elf Appli/Debug/STM32H7S7_Appli.elf
+    dlog.py decode console.log --elf Appli/Debug/STM32H7S7_Appli.elf
+"""
+
+import argparse
+import re
+import struct
+import subprocess
+import sys
+import time
+
+START = 0xDB
+ID_SYNC = 0xFFFF
+ARGS_MAX = 8
+HEADER = struct.Struct("<BBHI")
+CORE_HZ = 600000000             # Until a sync record says otherwise
+CONVERSION = re.compile(r"%([-+ #0]*)(\*|\d+)?(?:\.(\*|\d*))?(hh|h|ll|l|j|z|t|L)?([diouxXcsfFeEgGaAp%])")
+CONTENTS = re.compile(r"^ ([0-9a-f]+) ((?:[0-9a-f]{2,8} ?){1,4})")
+
+
+class LogError(Exception):
+    pass
+
+
+class Image:
+    """Format strings of one ELF, by id."""
+
+    def __init__(self, name, vtor, strings):
+        self.name = name
+        self.vtor = vtor
+        self.strings = strings
+
+    def format(self, id, args):
+        end = self.strings.find(b"\0", id)
+        if id >= len(self.strings) or end < 0:
+            return "<unknown id 0x%04x> %s" % (id, " ".join("0x%08x" % a for a in args))
+        return cformat(self.strings[id:end].decode("ascii", "replace").rstrip("\r\n"), args)
+
+
+def read_image(elf, objdump):
+    from placement import SYMBOL
+    vtor = None
+    for line in subprocess.run([objdump, "-t", elf], check=True, capture_output=True, text=True).stdout.splitlines():
+        m = SYMBOL.match(line)
+        if m and m.group(5) == "g_pfnVectors":
+            vtor = int(m.group(1), 16)
+    if vtor is None:
+        raise LogError("%s has no g_pfnVectors" % elf)
+    out = subprocess.run([objdump, "-s", "-j", ".dlog", elf], capture_output=True, text=True).stdout
+    return Image(elf, vtor, section_contents(out))
+
+
+def section_contents(dump):
+    """Bytes of the section of an objdump -s listing."""
+    data = bytearray()
+    for line in dump.splitlines():
+        m = CONTENTS.match(line)
+        if m:
+            offset = int(m.group(1), 16)
+            data[offset:] = bytes.fromhex(m.group(2).replace(" ", ""))
+    return bytes(data)
+
+
+def signed(value):
+    return value - (1 << 32) if value & 0x80000000 else value
+
+
+def cformat(fmt, args):
+    """printf() with 32-bit argument words."""
+    out, pos = [], 0
+    words = iter(args)
+    for m in CONVERSION.finditer(fmt):
+        out.append(fmt[pos:m.start()])
+        pos = m.end()
+        flags, width, precision, _, conv = m.groups()
+        if conv == "%":
+            out.append("%")
+            continue
+        if width == "*":
+            width = str(signed(next(words, 0)))
+        if precision == "*":
+            precision = str(next(words, 0))
+        spec = "%" + flags + (width or "") + ("." + precision if precision is not None else "")
+        value = next(words, None)
+        if value is None:
+            out.append("<missing>")
+        elif conv in "di":
+            out.append((spec + "d") % signed(value))
+        elif conv in "ouxX":
+            out.append((spec + conv) % value)
+        elif conv == "c":
+            out.append((spec + "c") % chr(value & 0xFF))
+        elif conv in "aA":
+            out.append(struct.unpack("<f", struct.pack("<I", value))[0].hex())
+        elif conv in "fFeEgG":
+            out.append((spec + conv) % struct.unpack("<f", struct.pack("<I", value))[0])
+        elif conv == "p":
+            out.append("0x%08x" % value)
+        else:
+            out.append("<string at 0x%08x>" % value)
+    out.append(fmt[pos:])
+    return "".join(out)
+
+
+def record(id, cycles, args):
+    """Bytes of a record, as dlogWrite() builds it."""
+    words = [START | (len(args) << 8) | (id << 16), cycles & 0xFFFFFFFF] + [a & 0xFFFFFFFF for a in args]
+    check = 0
+    for w in words:
+        check ^= w
+    check ^= check >> 16
+    check ^= check >> 8
+    return struct.pack("<%dI" % len(words), *words) + bytes([check & 0xFF])
+
+
+class Decoder:
+    """Splits the console stream into text lines and records."""
+
+    def __init__(self, images):
+        self.images = images
+        self.image = next(iter(images.values())) if len(images) == 1 else None
+        self.core_hz = CORE_HZ
+        self.data = bytearray()
+        self.line = bytearray()
+        self.last = None
+        self.time = 0.0
+        self.records = 0
+        self.damaged = 0
+        self.unknown = 0
+
+    def seconds(self, cycles):
+        if self.last is not None:
+            self.time += ((cycles - self.last) & 0xFFFFFFFF) / self.core_hz
+        self.last = cycles
+        return self.time
+
+    def parse(self):
+        """Record at the start of the buffer, as (size, id, cycles, args); size 0 while incomplete."""
+        if len(self.data) > 1 and self.data[1] > ARGS_MAX:
+            raise LogError("bad header")
+        if len(self.data) < HEADER.size:
+            return 0, None, None, None
+        _, count, id, cycles = HEADER.unpack_from(self.data)
+        size = HEADER.size + 4 * count + 1
+        if len(self.data) < size:
+            return 0, None, None, None
+        args = list(struct.unpack_from("<%dI" % count, self.data, HEADER.size))
+        if bytes(self.data[:size]) != record(id, cycles, args):
+            raise LogError("check mismatch")
+        return size, id, cycles, args
+
+    def feed(self, chunk):
+        """Lines ready so far: ("text", line) or ("log", seconds, message)."""
+        self.data += chunk
+        out = []
+        while self.data:
+            if self.data[0] != START:
+                c = self.data.pop(0)
+                if c == 0x0A:
+                    out.append(("text", self.line.decode("ascii")))
+                    self.line.clear()
+                elif 0x20 <= c < 0x7F or c == 0x09:
+                    # Control bytes are left over from damaged records or binary dumps
+                    self.line.append(c)
+                continue
+            try:
+                size, id, cycles, args = self.parse()
+            except LogError:
+                self.damaged += 1
+                del self.data[0]
+                continue
+            if size == 0:
+                break
+            del self.data[:size]
+            self.records += 1
+            if id == ID_SYNC and len(args) == 2:
+                seconds = self.seconds(cycles)
+                self.image = self.images.get(args[0])
+                self.core_hz = args[1] or CORE_HZ
+                if self.image is None:
+                    out.append(("log", seconds, "<image 0x%08x not given with --elf>" % args[0]))
+                continue
+            if self.image is None:
+                self.unknown += 1
+                continue
+            out.append(("log", self.seconds(cycles), self.image.format(id, args)))
+        return out
+
+
+def show(lines):
+    for line in lines:
+        if line[0] == "text":
+            print(line[1])
+        else:
+            print("[%12.6f] %s" % (line[1], line[2]))
+
+
+def summary(decoder):
+    if decoder.damaged:
+        print("%d damaged records skipped" % decoder.damaged, file=sys.stderr)
+    if decoder.unknown:
+        print("%d records before a sync record, give the ELF with --elf" % decoder.unknown, file=sys.stderr)
+
+
+def load_images(args):
+    images = {}
+    for elf in args.elf:
+        try:
+            image = read_image(elf, args.objdump)
+        except (OSError, subprocess.CalledProcessError, LogError) as e:
+            sys.exit("%s: %s" % (elf, e))
+        images[image.vtor] = image
+    return images
+
+
+def decode(args):
+    decoder = Decoder(load_images(args))
+    with open(args.log, "rb") as f:
+        show(decoder.feed(f.read() + b"\n"))
+    summary(decoder)
+
+
+def read(args):
+    from fwupdate import SerialLink, UpdateError
+    decoder = Decoder(load_images(args))
+    try:
+        link = SerialLink(args.port, args.baud)
+    except (OSError, UpdateError) as e:
+        sys.exit(str(e))
+    deadline = time.monotonic() + args.timeout if args.timeout else None
+    try:
+        while deadline is None or time.monotonic() < deadline:
+            show(decoder.feed(link.read(0.1)))
+            sys.stdout.flush()
+    except KeyboardInterrupt:
+        pass
+    finally:
+        link.close()
+    summary(decoder)
+
+
+def selftest(args):
+    failed = 0
+
+    def check(name, ok):
+        nonlocal failed
+        print("%-26s %s" % (name, "ok" if ok else "FAIL"))
+        failed += not ok
+
+    boot_strings = b"boot,verify,%lu us\0update,nak,%u,%d\r\n\0"
+    appli_strings = b"adc,%u,%d\0gain %.3f, %5.1e\0ptr %p str %s %c%%\0width [%*d] [%-4x]\0"
+    boot = Image("boot.elf", 0x08000000, boot_strings)
+    appli = Image("appli.elf", 0x70000400, appli_strings)
+    images = {boot.vtor: boot, appli.vtor: appli}
+    f = lambda x: struct.unpack("<I", struct.pack("<f", x))[0]
+
+    log = b"Image: Bootloader\r\n"
+    log += record(ID_SYNC, 1000, [boot.vtor, 500000000])
+    log += record(0, 501000, [1234]) + record(19, 1001000, [7, -3])
+    log += b"Image: Appl" + record(0, 1501000, [1, 2]) + b"ication\r\n"   # Boot record inside a text line
+    log += record(ID_SYNC, 0xFFFFFF00, [appli.vtor, 600000000])
+    log += record(0, 0x00000100 + 600000000 - 0x200, [4095, -2048])      # Past the wrap
+    log += record(10, 600000000 + 1000, [f(1.5), f(-12345.6)])
+    bad = bytearray(record(10, 0, [f(2.0), 0]))
+    bad[9] ^= 0x40
+    log += bytes(bad)
+    log += record(27, 600000000 + 2000, [0x24001000, 0x24002000, ord("Z")])
+    log += record(46, 600000000 + 3000, [6, -42, 0xAB])
+    log += bytes([START]) + b"junk\r\n"
+
+    decoder = Decoder(images)
+    lines = decoder.feed(log[:37]) + decoder.feed(log[37:])           # Split inside a record
+    texts = [line[1] for line in lines if line[0] == "text"]
+    logs = [(round(line[1], 6), line[2]) for line in lines if line[0] == "log"]
+    # Bytes of the damaged record that look like text stay in the text
+    check("text kept", texts[:2] == ["Image: Bootloader", "Image: Application"] and texts[-1].endswith("junk"))
+    check("boot records", logs[0] == (0.001, "boot,verify,1234 us") and logs[1] == (0.002, "update,nak,7,-3"))
+    check("record inside text", logs[2] == (0.003, "boot,verify,1 us"))
+    check("appli after sync", logs[3][1] == "adc,4095,-2048")
+    check("cycle count unwrapped", abs(logs[3][0] - (0.003 + (0xFFFFFF00 - 1501000) / 500e6 + 1.0)) < 1e-6)
+    check("floats", logs[4][1] == "gain 1.500, -1.2e+04")
+    check("check byte refused", decoder.damaged >= 1 and len(logs) == 7)
+    check("pointers, chars, %%", logs[5][1] == "ptr 0x24001000 str <string at 0x24002000> Z%")
+    check("width from argument", logs[6][1] == "width [   -42] [ab  ]")
+
+    dump = ("\nfile.elf:     file format elf32-littlearm\n\nContents of section .dlog:\n"
+            " 0000 61646325 752c2564 00676169 6e20252e  adc%u,%d.gain %.\n"
+            " 0010 3366  3f.\n")
+    check("objdump -s contents", section_contents(dump) == b"adc%u,%d\0gain %.3f")
+    sys.exit(1 if failed else 0)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    sub = parser.add_subparsers(dest="command", required=True)
+
+    def common(p):
+        p.add_argument("--elf", action="append", required=True, help="ELF of an image that logs (repeat for Boot and Appli)")
+        p.add_argument("--objdump", default="arm-none-eabi-objdump")
+
+    p = sub.add_parser("decode", help="print a console capture with the records formatted")
+    p.add_argument("log", help="raw capture of the console UART")
+    common(p)
+    p.set_defaults(func=decode)
+
+    p = sub.add_parser("read", help="print the console live with the records formatted")
+    p.add_argument("port", help="serial port of the board, e.g. /dev/ttyACM0")
+    p.add_argument("--baud", type=int, default=2000000)
+    p.add_argument("--timeout", type=int, default=0, help="seconds to read, 0 until Ctrl-C")
+    common(p)
+    p.set_defaults(func=read)
+
+    p = sub.add_parser("selftest", help="format synthetic records")
+    p.set_defaults(func=selftest)
+
+    args = parser.parse_args()
+    args.func(args)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,339 @@
+#!/usr/bin/env python3
+# SPDX-License-Identifier: Unlicense
+"""Makes and applies delta patches for the bootloader update (Board/bootDelta.c).
+
+diff: encodes a new image as a patch against the image in the running slot,
+to send with fwupdate.py instead of the full image. The bootloader rebuilds
+the new image into the inactive slot, copying unchanged runs from the running
+slot through the NOR memory mapped window. Both images are what is programmed
+at the image offset of a slot (imagepack.py output, or a plain XIP binary);
+the old one must be byte for byte the one on the board, which the bootloader
+checks against old_crc before anything is erased.
+
+    header (little endian)
+      0  magic        "BDLT"
+      4  version      u16, 1
+      6  header_size  u16, ops offset
+      8  old_size     image the patch applies to
+     12  old_crc      CRC-32 of it
+     16  new_size     image the patch produces
+     20  new_crc      CRC-32 of it
+     24  reserved
+     28  header_crc   CRC-32 of bytes 0..27
+
+    ops, until new_size bytes are produced
+      varint (LEB128) length << 1 | 0, then length bytes     DATA
+      varint (LEB128) length << 1 | 1, zigzag varint delta   COPY from old,
+                      at the end of the previous copy + delta
+
+Matches are found from a hash of every 16 byte aligned block of the old image
+and extended both ways, so shifted code is found at any offset. Between
+matches, the position that keeps the previous copy aligned is tried first:
+changed constants and branch offsets then cost a short DATA op and a two byte
+COPY rather than a new search.
+
+apply: rebuilds the new image on the host, as the bootloader would.
+info: prints the header of a patch and its op statistics.
+selftest: round trips synthetic firmware-like edits through diff and apply.
+
+    fwdelta.py diff slotA.img appli.img appli.delta
+    fwupdate.py send /dev/ttyACM0 appli.delta --trials 3
+"""
+
+import argparse
+import random
+import struct
+import sys
+import zlib
+
+MAGIC = 0x544C4442
+VERSION = 1
+HEADER = struct.Struct("<IHHIIIIII")
+OP_DATA = 0
+OP_COPY = 1
+BLOCK = 16                  # Hashed old image block
+MIN_CONTINUE = 8            # Match length worth a COPY at the aligned position
+MIN_MATCH = 2 * BLOCK       # Worth a COPY from anywhere else
+
+
+class DeltaError(Exception):
+    pass
+
+
+def varint(value):
+    out = bytearray()
+    while True:
+        byte = value & 0x7F
+        value >>= 7
+        if value:
+            out.append(byte | 0x80)
+        else:
+            out.append(byte)
+            return bytes(out)
+
+
+def zigzag(value):
+    return (value << 1) if value >= 0 else ((-value << 1) - 1)
+
+
+def match_length(old, i, new, j):
+    """Bytes equal from old[i] and new[j] on."""
+    n = min(len(old) - i, len(new) - j)
+    length = 0
+    step = 256
+    while length < n:
+        k = min(step, n - length)
+        if old[i + length:i + length + k] == new[j + length:j + length + k]:
+            length += k
+        elif k == 1:
+            break
+        else:
+            step = max(1, k // 8)
+            continue
+        step = 256
+    return length
+
+
+def header(old, new):
+    fields = [MAGIC, VERSION, HEADER.size, len(old), zlib.crc32(old), len(new), zlib.crc32(new), 0]
+    return HEADER.pack(*fields, zlib.crc32(HEADER.pack(*fields, 0)[:HEADER.size - 4]))
+
+
+def diff(old, new):
+    """Patch turning old into new."""
+    if not new:
+        raise DeltaError("empty new image")
+    index = {}
+    for i in range(len(old) - BLOCK, -1, -BLOCK):
+        index[old[i:i + BLOCK]] = i
+
+    ops = bytearray()
+    src = 0                 # End of the previous copy, in old
+    literal = 0             # Start of the pending DATA, in new
+    i = 0
+    while i < len(new):
+        best, length = 0, 0
+        aligned = src + (i - literal)
+        if aligned < len(old):
+            length = match_length(old, aligned, new, i)
+            best = aligned
+        if length < MIN_MATCH:
+            j = index.get(new[i:i + BLOCK])
+            if j is not None:
+                n = match_length(old, j, new, i)
+                if n > length:
+                    best, length = j, n
+        if length < (MIN_CONTINUE if best == aligned else MIN_MATCH):
+            i += 1
+            continue
+
+        # Take back the end of the pending DATA when it matches too
+        back = 0
+        while back < i - literal and back < best and old[best - back - 1] == new[i - back - 1]:
+            back += 1
+        start, best, length = i - back, best - back, length + back
+        if start > literal:
+            ops += varint((start - literal) << 1 | OP_DATA) + new[literal:start]
+        ops += varint(length << 1 | OP_COPY) + varint(zigzag(best - src))
+        src = best + length
+        i = literal = start + length
+
+    if literal < len(new):
+        ops += varint((len(new) - literal) << 1 | OP_DATA) + new[literal:]
+    return header(old, new) + bytes(ops)
+
+
+def parse_header(patch):
+    if len(patch) < HEADER.size:
+        raise DeltaError("truncated header")
+    magic, version, header_size, old_size, old_crc, new_size, new_crc, _, crc = HEADER.unpack_from(patch)
+    if magic != MAGIC or version != VERSION or header_size != HEADER.size:
+        raise DeltaError("not a version %d patch" % VERSION)
+    if crc != zlib.crc32(patch[:HEADER.size - 4]):
+        raise DeltaError("header CRC mismatch")
+    return old_size, old_crc, new_size, new_crc
+
+
+def read_varint(patch, pos):
+    value = shift = 0
+    while True:
+        if pos >= len(patch) or shift > 28:
+            raise DeltaError("bad varint at %d" % pos)
+        byte = patch[pos]
+        value |= (byte & 0x7F) << shift
+        shift += 7
+        pos += 1
+        if not byte & 0x80:
+            return value, pos
+
+
+def ops(patch):
+    """(op, length, source or DATA offset in the patch) of each op."""
+    _, _, new_size, _ = parse_header(patch)
+    pos, src, produced = HEADER.size, 0, 0
+    while produced < new_size:
+        value, pos = read_varint(patch, pos)
+        op, length = value & 1, value >> 1
+        if length == 0 or length > new_size - produced:
+            raise DeltaError("op length %d at %d" % (length, pos))
+        if op == OP_COPY:
+            delta, pos = read_varint(patch, pos)
+            src += (delta >> 1) ^ -(delta & 1)
+            yield op, length, src
+            src += length
+        else:
+            if pos + length > len(patch):
+                raise DeltaError("truncated DATA at %d" % pos)
+            yield op, length, pos
+            pos += length
+        produced += length
+    if pos != len(patch):
+        raise DeltaError("%d trailing bytes" % (len(patch) - pos))
+
+
+def apply(old, patch):
+    old_size, old_crc, new_size, new_crc = parse_header(patch)
+    if len(old) < old_size or zlib.crc32(old[:old_size]) != old_crc:
+        raise DeltaError("old image does not match the patch")
+    new = bytearray()
+    for op, length, where in ops(patch):
+        if op == OP_COPY:
+            if where < 0 or where + length > old_size:
+                raise DeltaError("COPY out of the old image")
+            new += old[where:where + length]
+        else:
+            new += patch[where:where + length]
+    if zlib.crc32(new) != new_crc:
+        raise DeltaError("new image CRC mismatch")
+    return bytes(new)
+
+
+def read(path):
+    with open(path, "rb") as f:
+        return f.read()
+
+
+def write(path, data):
+    with open(path, "wb") as f:
+        f.write(data)
+
+
+def cmd_diff(args):
+    old, new = read(args.old), read(args.new)
+    patch = diff(old, new)
+    if apply(old, patch) != new:
+        sys.exit("internal error: patch does not round trip")
+    write(args.patch, patch)
+    print("%s: %d bytes, %.1f%% of %d" % (args.patch, len(patch), 100.0 * len(patch) / len(new), len(new)))
+
+
+def cmd_apply(args):
+    try:
+        write(args.output, apply(read(args.old), read(args.patch)))
+    except DeltaError as e:
+        sys.exit(str(e))
+
+
+def cmd_info(args):
+    patch = read(args.patch)
+    try:
+        old_size, old_crc, new_size, new_crc = parse_header(patch)
+        stats = {OP_DATA: [0, 0], OP_COPY: [0, 0]}
+        for op, length, _ in ops(patch):
+            stats[op][0] += 1
+            stats[op][1] += length
+    except DeltaError as e:
+        sys.exit(str(e))
+    print("old       %d bytes, crc 0x%08X" % (old_size, old_crc))
+    print("new       %d bytes, crc 0x%08X" % (new_size, new_crc))
+    print("patch     %d bytes, %.1f%% of new" % (len(patch), 100.0 * len(patch) / new_size))
+    print("copy      %d ops, %d bytes" % tuple(stats[OP_COPY]))
+    print("data      %d ops, %d bytes" % tuple(stats[OP_DATA]))
+
+
+def firmware(rng, size):
+    """Code-like bytes: repeated instruction patterns with varying operands."""
+    words = [rng.getrandbits(16) for _ in range(64)]
+    out = bytearray()
+    while len(out) < size:
+        out += struct.pack("<HH", rng.choice(words), rng.getrandbits(16) if rng.random() < 0.3 else 0x4770)
+    return bytes(out[:size])
+
+
+def selftest(args):
+    rng = random.Random(7)
+    base = firmware(rng, 256 * 1024)
+
+    def patched(data, count):
+        data = bytearray(data)
+        for _ in range(count):
+            i = rng.randrange(len(data) - 4)
+            data[i:i + 4] = struct.pack("<I", rng.getrandbits(32))
+        return bytes(data)
+
+    mid = len(base) // 2
+    cases = [
+        ("identical", base, base),
+        ("constants", base, patched(base, 40)),
+        ("insert", base, base[:mid] + firmware(rng, 3000) + base[mid:]),
+        ("delete", base, base[:mid] + base[mid + 5000:]),
+        ("shift+edit", base, patched(base[:1000] + bytes(24) + base[1000:], 20)),
+        ("append", base, base + firmware(rng, 10000)),
+        ("truncate", base, base[:100000]),
+        ("unrelated", base, firmware(random.Random(99), 50000)),
+        ("empty old", b"", base[:4096]),
+        ("one byte", base, b"\x5a"),
+    ]
+    failed = 0
+    for name, old, new in cases:
+        patch = diff(old, new)
+        ok = apply(old, patch) == new
+        print("%-12s %7d -> %7d bytes  patch %7d (%5.1f%%)  %s" %
+              (name, len(old), len(new), len(patch), 100.0 * len(patch) / len(new), "ok" if ok else "FAIL"))
+        failed += not ok
+
+    # Corrupt patches must be refused, not applied
+    patch = bytearray(diff(base, patched(base, 10)))
+    for name, bad, old in [("bad header", patch[:8] + bytes([patch[8] ^ 1]) + patch[9:], base),
+                           ("wrong old", bytes(patch), patched(base, 1)),
+                           ("truncated", bytes(patch[:-1]), base),
+                           ("trailing", bytes(patch) + b"\x00", base)]:
+        try:
+            apply(old, bytes(bad))
+            ok = False
+        except DeltaError:
+            ok = True
+        print("%-12s refused  %s" % (name, "ok" if ok else "FAIL"))
+        failed += not ok
+    sys.exit(1 if failed else 0)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    sub = parser.add_subparsers(dest="command", required=True)
+
+    p = sub.add_parser("diff", help="make a patch from the running image to a new one")
+    p.add_argument("old", help="image in the running slot")
+    p.add_argument("new", help="image to install")
+    p.add_argument("patch", help="patch to send with fwupdate.py")
+    p.set_defaults(func=cmd_diff)
+
+    p = sub.add_parser("apply", help="rebuild the new image from the old one and a patch")
+    p.add_argument("old")
+    p.add_argument("patch")
+    p.add_argument("output")
+    p.set_defaults(func=cmd_apply)
+
+    p = sub.add_parser("info", help="print and check a patch")
+    p.add_argument("patch")
+    p.set_defaults(func=cmd_info)
+
+    p = sub.add_parser("selftest", help="round trip synthetic edits through diff and apply")
+    p.set_defaults(func=selftest)
+
+    args = parser.parse_args()
+    args.func(args)
+
+
+if __name__ == "__main__":
+    main()
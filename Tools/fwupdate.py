@@ -0,0 +1,442 @@
+#!/usr/bin/env python3
+# SPDX-License-Identifier: Unlicense
+"""Sends an image to the bootloader over UART4 (Board/bootUpdate.c).
+
+send: programs an image (imagepack.py output, or a plain XIP binary) into an
+A/B slot of the NOR through the ST-LINK virtual COM port, then switches the
+boot-control record over to it. A running app that calls fwUpdateListen()
+resets into the bootloader on the first START frame; START is repeated until
+the bootloader answers READY with its chunk size. Both ends then move to
+--baud, and DATA frames go out with two in flight: chunk n + 2 is only sent
+once chunk n is acknowledged, which is what the two receive buffers of the
+bootloader rely on. A NAK (bad CRC, sequence, stalled frame) or a missing
+reply restarts from the chunk the bootloader asks for. DONE carries the CRC
+of the slot as read back; the bootloader then resets into the new image, and
+its transfer statistics are printed from the console.
+
+A patch made by fwdelta.py is recognised by its header and sent with the
+delta flag: the bootloader rebuilds the new image from the running slot and
+the patch, and DONE carries the CRC of the rebuilt image.
+
+With --loopback the bootloader checks and acknowledges every frame without
+touching the NOR, and compares a CRC of the payload: a test of the link and
+of the rate, from any state of the flash.
+
+    frame (little endian)
+      0  magic        "FWUP"
+      4  cmd          u8, 1: START, 2: DATA
+      5  flags        u8, START bit 0: loopback, bit 2: delta patch,
+                      DATA bit 1: last chunk
+      6  seq          u16, chunk number
+      8  length       u32, valid payload bytes
+     12  crc          CRC-32 of bytes 0..11 and the whole payload
+     16  payload      START: image_size u32, image_crc u32, baud u32,
+                      slot u8 (0xFF: inactive), trials u8, reserved u16
+                      DATA: chunk size bytes, the last one zero padded
+
+    reply (little endian)
+      0  sync         '#'
+      1  status       'R' ready, 'A' ack, 'N' nak, 'D' done, 'F' fail
+      2  seq          u16
+      4  value        u32
+
+selftest: runs the sender against an in-process model of the bootloader,
+with corrupted, truncated and lost frames and replies.
+
+    fwupdate.py send /dev/ttyACM0 appli.img --baud 2000000 --trials 3
+    fwupdate.py send /dev/ttyACM0 appli.img --loopback
+    fwupdate.py send /dev/ttyACM0 appli.delta
+    fwupdate.py selftest
+"""
+
+import argparse
+import os
+import random
+import select
+import socket
+import struct
+import sys
+import threading
+import time
+import zlib
+
+MAGIC = 0x50555746
+SYNC = 0x23
+CMD_START = 1
+CMD_DATA = 2
+FLAG_LOOPBACK = 0x01
+FLAG_LAST = 0x02
+FLAG_DELTA = 0x04
+DELTA_MAGIC = b"BDLT"
+SLOT_INACTIVE = 0xFF
+SLOTS = {"A": 0, "B": 1, "inactive": SLOT_INACTIVE}
+SLOT_SIZE = 0x03FF0000
+
+READY, ACK, NAK, DONE, FAIL = (ord(c) for c in "RANDF")
+ERRORS = ["ok", "crc", "seq", "timeout", "size", "erase", "program", "verify", "activate", "baud", "base", "patch"]
+
+HEADER = struct.Struct("<IBBHII")
+START = struct.Struct("<IIIBBH")
+REPLY = struct.Struct("<BBHI")
+
+
+class UpdateError(Exception):
+    pass
+
+
+def frame(cmd, flags, seq, payload, length):
+    head = struct.pack("<IBBHI", MAGIC, cmd, flags, seq, length)
+    return head + struct.pack("<I", zlib.crc32(payload, zlib.crc32(head))) + payload
+
+
+def error_name(value):
+    return ERRORS[value] if value < len(ERRORS) else str(value)
+
+
+class SerialLink:
+    """Raw POSIX serial port, the rate can change on the fly."""
+
+    def __init__(self, path, baud):
+        import termios
+        import tty
+        self.termios = termios
+        self.fd = os.open(path, os.O_RDWR | os.O_NOCTTY)
+        tty.setraw(self.fd)
+        self.set_baud(baud)
+
+    def set_baud(self, baud):
+        termios = self.termios
+        speed = getattr(termios, "B%d" % baud, None)
+        if speed is None:
+            raise UpdateError("%d baud is not supported by this host" % baud)
+        termios.tcdrain(self.fd)
+        attr = termios.tcgetattr(self.fd)
+        attr[4] = attr[5] = speed
+        termios.tcsetattr(self.fd, termios.TCSANOW, attr)
+
+    def write(self, data):
+        view = memoryview(data)
+        while view:
+            view = view[os.write(self.fd, view):]
+
+    def read(self, timeout):
+        ready, _, _ = select.select([self.fd], [], [], timeout)
+        return os.read(self.fd, 4096) if ready else b""
+
+    def close(self):
+        os.close(self.fd)
+
+
+class SocketLink:
+    """One end of a socket pair, for the self-test."""
+
+    def __init__(self, sock):
+        self.sock = sock
+
+    def set_baud(self, baud):
+        pass
+
+    def write(self, data):
+        self.sock.sendall(data)
+
+    def read(self, timeout):
+        ready, _, _ = select.select([self.sock], [], [], timeout)
+        return self.sock.recv(4096) if ready else b""
+
+    def close(self):
+        self.sock.close()
+
+
+class Sender:
+    def __init__(self, link, image, baud, console_baud, slot, trials, loopback,
+                 start_timeout=1.0, reply_timeout=5.0, retries=20, log=print):
+        self.link = link
+        self.image = image
+        self.baud = baud
+        self.console_baud = console_baud
+        self.slot = slot
+        self.trials = trials
+        self.loopback = loopback
+        self.start_timeout = start_timeout
+        self.reply_timeout = reply_timeout
+        self.retries = retries
+        self.log = log
+        self.pending = b""
+        self.resent = 0
+        # A patch rebuilds the image whose CRC is in its header (fwdelta.py)
+        self.delta = image[:4] == DELTA_MAGIC
+        if self.delta and not loopback:
+            self.expected = struct.unpack_from("<I", image, 20)[0]
+        else:
+            self.expected = zlib.crc32(image)
+
+    def reply(self, timeout):
+        """Next reply, skipping console text and noise, or None."""
+        deadline = time.monotonic() + timeout
+        while True:
+            start = self.pending.find(bytes([SYNC]))
+            if start < 0:
+                self.pending = b""
+            else:
+                self.pending = self.pending[start:]
+                if len(self.pending) >= REPLY.size:
+                    _, status, seq, value = REPLY.unpack_from(self.pending)
+                    if status in (READY, ACK, NAK, DONE, FAIL):
+                        self.pending = self.pending[REPLY.size:]
+                        return status, seq, value
+                    self.pending = self.pending[1:]
+                    continue
+            left = deadline - time.monotonic()
+            if left <= 0:
+                return None
+            self.pending += self.link.read(left)
+
+    def start(self):
+        payload = START.pack(len(self.image), zlib.crc32(self.image), self.baud, self.slot, self.trials, 0)
+        flags = (FLAG_LOOPBACK if self.loopback else 0) | (FLAG_DELTA if self.delta else 0)
+        request = frame(CMD_START, flags, 0, payload, len(payload))
+        for _ in range(self.retries):
+            self.link.write(request)
+            r = self.reply(self.start_timeout)
+            if r is None:
+                continue
+            status, _, value = r
+            if status == READY:
+                return value
+            if status == FAIL:
+                raise UpdateError("START refused: %s" % error_name(value))
+        raise UpdateError("no answer to START")
+
+    def send(self):
+        chunk = self.start()
+        chunks = max(1, (len(self.image) + chunk - 1) // chunk)
+        self.link.set_baud(self.baud)
+        self.log("ready: %d bytes in %d chunks of %d at %d baud%s%s" %
+                 (len(self.image), chunks, chunk, self.baud, " (delta)" if self.delta else "",
+                  " (loopback)" if self.loopback else ""))
+
+        t0 = time.monotonic()
+        base = 0
+        following = 0
+        failures = 0
+        while True:
+            while following < chunks and following < base + 2:
+                data = self.image[following * chunk:(following + 1) * chunk]
+                last = following == chunks - 1
+                self.link.write(frame(CMD_DATA, FLAG_LAST if last else 0, following,
+                                      data + bytes(chunk - len(data)), len(data)))
+                following += 1
+
+            r = self.reply(self.reply_timeout)
+            if r is None:
+                failures += 1
+                if failures > self.retries:
+                    raise UpdateError("no reply, chunk %d" % base)
+                self.resent += following - base
+                following = base
+                continue
+            status, seq, value = r
+            if status == ACK:
+                failures = 0
+                base = max(base, seq + 1)
+            elif status == NAK:
+                failures += 1
+                if failures > self.retries:
+                    raise UpdateError("too many NAKs, chunk %d" % seq)
+                self.log("nak: chunk %d (%s)" % (seq, error_name(value)))
+                self.resent += following - seq
+                base = following = seq
+            elif status == DONE:
+                break
+            elif status == FAIL:
+                raise UpdateError("update failed: %s, chunk %d" % (error_name(value), seq))
+
+        elapsed = time.monotonic() - t0
+        if value != self.expected:
+            raise UpdateError("read back CRC 0x%08X, expected 0x%08X" % (value, self.expected))
+        self.link.set_baud(self.console_baud)
+        self.log("done: %d bytes in %.2f s, %.1f KB/s, %d chunks resent" %
+                 (len(self.image), elapsed, len(self.image) / elapsed / 1024, self.resent))
+
+
+class Emulator(threading.Thread):
+    """Model of Board/bootUpdate.c: go back N with two receive buffers."""
+
+    def __init__(self, link, chunk, drop_acks=(), frame_timeout=0.1):
+        super().__init__(daemon=True)
+        self.link = link
+        self.chunk = chunk
+        self.drop_acks = set(drop_acks)
+        self.frame_timeout = frame_timeout
+        self.slot = bytearray()
+        self.result = None
+        self.naks = 0
+        self.buffer = b""
+
+    def take(self, n, timeout):
+        """n bytes, or what came before the line stalled."""
+        deadline = time.monotonic() + timeout
+        while len(self.buffer) < n:
+            data = self.link.read(max(0.0, deadline - time.monotonic()))
+            if not data:
+                if time.monotonic() >= deadline:
+                    break
+                continue
+            self.buffer += data
+            deadline = time.monotonic() + self.frame_timeout
+        out, self.buffer = self.buffer[:n], self.buffer[n:]
+        return out
+
+    def answer(self, status, seq=0, value=0):
+        self.link.write(REPLY.pack(SYNC, status, seq, value))
+
+    def resync(self, seq, error):
+        self.naks += 1
+        self.buffer = b""
+        while self.link.read(0.02):
+            pass
+        self.answer(NAK, seq, ERRORS.index(error))
+
+    def run(self):
+        while True:
+            head = self.take(HEADER.size + START.size, 5.0)
+            if len(head) < HEADER.size + START.size:
+                self.result = "no start"
+                return
+            magic, cmd, flags, _, length, crc = HEADER.unpack_from(head)
+            if (magic == MAGIC and cmd == CMD_START and length == START.size and
+                    crc == zlib.crc32(head[HEADER.size:], zlib.crc32(head[:12]))):
+                break
+            self.buffer = b""
+        size, image_crc, _, _, _, _ = START.unpack_from(head, HEADER.size)
+        self.answer(READY, 0, self.chunk)
+
+        seq = 0
+        while len(self.slot) < size:
+            data = self.take(HEADER.size + self.chunk, 2.0)
+            if not data:
+                self.result = "timeout"
+                self.answer(FAIL, seq, ERRORS.index("timeout"))
+                return
+            if len(data) < HEADER.size + self.chunk:
+                self.resync(seq, "timeout")
+                continue
+            magic, cmd, flags, fseq, length, crc = HEADER.unpack_from(data)
+            payload = data[HEADER.size:]
+            if magic != MAGIC or cmd != CMD_DATA or crc != zlib.crc32(payload, zlib.crc32(data[:12])):
+                self.resync(seq, "crc")
+                continue
+            if fseq != seq:
+                self.resync(seq, "seq")
+                continue
+            self.slot += payload[:length]
+            seq += 1
+            if flags & FLAG_LAST:
+                break
+            if fseq not in self.drop_acks:
+                self.answer(ACK, fseq, len(self.slot))
+            self.drop_acks.discard(fseq)
+
+        crc = zlib.crc32(bytes(self.slot))
+        self.result = "done" if crc == image_crc else "verify"
+        self.answer(DONE if crc == image_crc else FAIL, seq, crc if crc == image_crc else ERRORS.index("verify"))
+
+
+class FaultyLink(SocketLink):
+    """Corrupts or cuts chosen DATA frames, the first time they are sent."""
+
+    def __init__(self, sock, corrupt=(), truncate=()):
+        super().__init__(sock)
+        self.corrupt = set(corrupt)
+        self.truncate = set(truncate)
+
+    def write(self, data):
+        if len(data) > HEADER.size and data[4] == CMD_DATA:
+            seq = struct.unpack_from("<H", data, 6)[0]
+            if seq in self.corrupt:
+                self.corrupt.discard(seq)
+                data = bytearray(data)
+                data[HEADER.size + seq % 100] ^= 0x40
+            elif seq in self.truncate:
+                self.truncate.discard(seq)
+                data = data[:len(data) // 2]
+        super().write(bytes(data))
+
+
+def selftest(args):
+    rng = random.Random(1)
+    cases = [
+        ("clean", 50000, {}, {}),
+        ("one chunk", 100, {}, {}),
+        ("exact chunks", 4 * 4096, {}, {}),
+        ("corrupt", 50000, {"corrupt": (0, 3, 12)}, {}),
+        ("truncated", 50000, {"truncate": (5,)}, {}),
+        ("lost ack", 50000, {}, {"drop_acks": (2,)}),
+        ("lost last acks", 3 * 4096, {}, {"drop_acks": (0, 1)}),
+        ("everything", 80000, {"corrupt": (1, 9), "truncate": (4, 17)}, {"drop_acks": (6, 7)}),
+    ]
+    failed = 0
+    for name, size, faults, device in cases:
+        image = bytes(rng.getrandbits(8) for _ in range(size))
+        host_sock, device_sock = socket.socketpair()
+        emulator = Emulator(SocketLink(device_sock), 4096, **device)
+        emulator.start()
+        sender = Sender(FaultyLink(host_sock, **faults), image, 2000000, 115200, SLOT_INACTIVE, 0, False,
+                        start_timeout=0.5, reply_timeout=0.5, log=lambda *a: None)
+        try:
+            sender.send()
+            ok = emulator.result == "done" and bytes(emulator.slot) == image
+        except UpdateError as e:
+            print("  %s" % e)
+            ok = False
+        emulator.join(1.0)
+        host_sock.close()
+        device_sock.close()
+        print("%-16s %6d bytes  %2d naks  %2d resent  %s" %
+              (name, size, emulator.naks, sender.resent, "ok" if ok else "FAIL"))
+        failed += not ok
+    sys.exit(1 if failed else 0)
+
+
+def send(args):
+    with open(args.image, "rb") as f:
+        image = f.read()
+    if not image or len(image) > SLOT_SIZE:
+        sys.exit("image must be 1..%d bytes" % SLOT_SIZE)
+    link = SerialLink(args.port, args.console_baud)
+    try:
+        Sender(link, image, args.baud, args.console_baud, SLOTS[args.slot], args.trials, args.loopback).send()
+        # Transfer statistics from bootUpdateReport()
+        deadline = time.monotonic() + 1.0
+        while time.monotonic() < deadline:
+            sys.stdout.write(link.read(0.1).decode("ascii", "replace"))
+        sys.stdout.flush()
+    except UpdateError as e:
+        sys.exit(str(e))
+    finally:
+        link.close()
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    sub = parser.add_subparsers(dest="command", required=True)
+
+    p = sub.add_parser("send", help="program an image over UART4")
+    p.add_argument("port", help="serial port of the board, e.g. /dev/ttyACM0")
+    p.add_argument("image", help="image to program at the image offset of the slot")
+    p.add_argument("--baud", type=int, default=2000000, help="rate of the DATA frames")
+    p.add_argument("--console-baud", type=int, default=2000000, help="rate of the console and START")
+    p.add_argument("--slot", choices=sorted(SLOTS), default="inactive", help="slot to write")
+    p.add_argument("--trials", type=int, default=0, help="trial boots of the new image, 0 for a permanent switch")
+    p.add_argument("--loopback", action="store_true", help="check the transfer only, nothing is written")
+    p.set_defaults(func=send)
+
+    p = sub.add_parser("selftest", help="run the sender against a model of the bootloader")
+    p.set_defaults(func=selftest)
+
+    args = parser.parse_args()
+    args.func(args)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,354 @@
+#!/usr/bin/env python3
+# SPDX-License-Identifier: Unlicense
+"""Packs Appli images for the bootloader (Board/bootLoad.c, Board/bootVerify.c).
+
+pack: compresses a raw binary (objcopy -O binary) linked to run from PSRAM
+(STM32H7S7L8HXH_ROMxspi1_RAMxspi2.ld, 0x90000000) or AXI SRAM
+(STM32H7S7L8HXH_sram.ld, 0x24050000) into one LZ4 block behind a 64 byte
+header, ready to be programmed at the XIP image offset of the NOR in place of
+the plain binary. Without a header there, the bootloader falls back to XIP.
+The header carries the SHA-256 of the payload, which the bootloader checks
+with the HASH peripheral before running anything.
+
+With --xip the binary stays in place: it must be linked to run 1 KB into its
+slot (__FLASH_BEGIN 0x70000400 for slot A, 0x74000400 for slot B, the vector
+table alignment), and the header is padded to fill that first 1 KB. Packed
+images run from RAM and can go to either slot as they are.
+
+    header (little endian)
+      0  magic        "BL4Z"
+      4  version      u16, 2
+      6  header_size  u16, payload offset
+      8  flags        bit 0: payload is LZ4, else stored
+                      bit 1: digest is valid
+                      bit 2: runs in place (XIP) at load_addr
+     12  load_addr    run address, where the vector table lands
+     16  image_size   bytes once decompressed
+     20  packed_size  payload bytes
+     24  digest       SHA-256 of the payload (packed bytes)
+     56  reserved
+     60  header_crc   CRC-32 of bytes 0..59
+
+info: prints the header of an image and checks its payload and digest.
+
+ctrl: writes the 16 byte boot-control record (Common/bootCtrl.h) that selects
+the slot to boot, to be programmed at 0x77FF0000 after erasing that sector.
+With --trial N the new slot gets N boots to call bootCtrlConfirm() before the
+bootloader returns to the fallback slot.
+
+    record (little endian)
+      0  magic        "BCTL"
+      4  active       u8, 0: slot A, 1: slot B
+      5  fallback     u8
+      6  sequence     u16
+      8  crc          CRC-32 of bytes 0..7
+     12  attempts     u16, one bit per trial boot left
+     14  confirmed    u16, 0xFFFF on trial, 0 confirmed
+
+vectors: prints the SHA-256 known answers of Board/bootVerify.c as C.
+
+    imagepack.py pack Debug/STM32H7S7_Appli.bin appli.img --load 0x90000000 --slot B
+    imagepack.py pack Debug/STM32H7S7_Appli.bin appli.img --load 0x70000400 --xip
+    imagepack.py info appli.img
+    imagepack.py ctrl ctrl.bin --active B --fallback A --trial 3
+    imagepack.py vectors
+"""
+
+import argparse
+import hashlib
+import struct
+import sys
+import zlib
+
+MAGIC = b"BL4Z"
+VERSION = 2
+HEADER = struct.Struct("<4sHHIIII32sI")
+HEADER_CRC = struct.Struct("<I")
+FLAG_LZ4 = 0x1
+FLAG_SHA256 = 0x2
+FLAG_XIP = 0x4
+XIP_HEADER_SIZE = 0x400             # Vector table alignment of the payload
+
+# Known answer messages of Board/bootVerify.c: byte i is (i * 167 + 13) & 0xFF
+VECTOR_SIZES = (0, 1, 3, 4, 55, 56, 63, 64, 65, 119, 120, 1000)
+
+MIN_MATCH = 4
+MAX_OFFSET = 0xFFFF
+LAST_LITERALS = 5                   # The block ends with at least 5 literals
+MATCH_SAFE = 12                     # and its last match starts 12 bytes before the end
+
+RUN_REGIONS = (
+    ("psram", 0x90000000, 0x02000000),
+    ("axi", 0x24000000, 0x00072000),
+)
+NOR_REGION = ("nor", 0x70000000, 0x08000000)
+
+SLOTS = {"A": 0x70000000, "B": 0x74000000}
+SLOT_SIZE = 0x03FF0000
+CTRL_ADDRESS = 0x77FF0000
+CTRL_MAGIC = b"BCTL"
+CTRL = struct.Struct("<4sBBH")
+CTRL_STATE = struct.Struct("<HH")
+ATTEMPTS_MAX = 16
+
+
+def lz4_length(out, n):
+    while n >= 255:
+        out.append(255)
+        n -= 255
+    out.append(n)
+
+
+def lz4_sequence(out, literals, offset, match):
+    lit = len(literals)
+    token = (min(lit, 15) << 4) | (min(match - MIN_MATCH, 15) if match else 0)
+    out.append(token)
+    if lit >= 15:
+        lz4_length(out, lit - 15)
+    out += literals
+    if match:
+        out += struct.pack("<H", offset)
+        if match - MIN_MATCH >= 15:
+            lz4_length(out, match - MIN_MATCH - 15)
+
+
+def lz4_compress(data):
+    """Greedy LZ4 block compressor: one hash entry per 4 byte prefix."""
+    n = len(data)
+    out = bytearray()
+    table = {}
+    anchor = 0
+    i = 0
+    limit = n - MATCH_SAFE
+    misses = 0
+    while i < limit:
+        key = data[i:i + 4]
+        ref = table.get(key)
+        table[key] = i
+        if ref is None or i - ref > MAX_OFFSET:
+            # Skip faster through data that does not compress, like the reference encoder
+            misses += 1
+            i += 1 + (misses >> 6)
+            continue
+        misses = 0
+
+        # Extend forward, 32 bytes at a time first
+        end = n - LAST_LITERALS
+        m = MIN_MATCH
+        while i + m + 32 <= end and data[ref + m:ref + m + 32] == data[i + m:i + m + 32]:
+            m += 32
+        while i + m < end and data[ref + m] == data[i + m]:
+            m += 1
+        # and backward over pending literals
+        while i > anchor and ref > 0 and data[i - 1] == data[ref - 1]:
+            i -= 1
+            ref -= 1
+            m += 1
+
+        lz4_sequence(out, data[anchor:i], i - ref, m)
+        i += m
+        anchor = i
+        if i - 2 < limit:
+            table[data[i - 2:i + 2]] = i - 2
+    lz4_sequence(out, data[anchor:], 0, 0)
+    return bytes(out)
+
+
+def lz4_decompress(block, size):
+    out = bytearray()
+    i = 0
+    while i < len(block):
+        token = block[i]
+        i += 1
+        lit = token >> 4
+        if lit == 15:
+            while True:
+                b = block[i]
+                i += 1
+                lit += b
+                if b != 255:
+                    break
+        out += block[i:i + lit]
+        i += lit
+        if i >= len(block):
+            break
+        offset = block[i] | (block[i + 1] << 8)
+        i += 2
+        match = token & 15
+        if match == 15:
+            while True:
+                b = block[i]
+                i += 1
+                match += b
+                if b != 255:
+                    break
+        match += MIN_MATCH
+        if offset == 0 or offset > len(out):
+            raise ValueError("bad match offset %u at %u" % (offset, i))
+        start = len(out) - offset
+        for k in range(match):
+            out.append(out[start + k])
+    if len(out) != size:
+        raise ValueError("decompressed %u bytes, expected %u" % (len(out), size))
+    return bytes(out)
+
+
+def region_of(addr, size, regions=RUN_REGIONS):
+    for name, base, length in regions:
+        if base <= addr and addr + size <= base + length:
+            return name
+    return None
+
+
+def flag_names(flags):
+    names = ["lz4" if flags & FLAG_LZ4 else "stored"]
+    if flags & FLAG_SHA256:
+        names.append("sha256")
+    if flags & FLAG_XIP:
+        names.append("xip")
+    return ", ".join(names)
+
+
+def pack(args):
+    with open(args.input, "rb") as f:
+        image = f.read()
+    if len(image) < 8:
+        sys.exit("%s: too small for a vector table" % args.input)
+    regions = (NOR_REGION,) if args.xip else RUN_REGIONS
+    if region_of(args.load, len(image), regions) is None:
+        sys.exit("load address 0x%08X (+%u bytes) is not in %s"
+                 % (args.load, len(image), "the NOR" if args.xip else "PSRAM or AXI SRAM"))
+
+    # The reset vector must point into the image, or it was linked for another address
+    reset = struct.unpack_from("<I", image, 4)[0] & ~1
+    if not args.load <= reset < args.load + len(image):
+        sys.exit("reset vector 0x%08X is outside the image: not linked to run at 0x%08X" % (reset, args.load))
+
+    flags = FLAG_SHA256
+    payload = image
+    header_size = HEADER.size + HEADER_CRC.size
+    slot = SLOTS[args.slot]
+    if args.xip:
+        flags |= FLAG_XIP
+        header_size = XIP_HEADER_SIZE
+        if args.load - header_size != slot:
+            sys.exit("an XIP image for slot %s must be linked to run at 0x%08X" % (args.slot, slot + header_size))
+    elif not args.stored:
+        packed = lz4_compress(image)
+        if lz4_decompress(packed, len(image)) != image:
+            sys.exit("internal error: LZ4 round trip failed")
+        if len(packed) < len(image):
+            flags |= FLAG_LZ4
+            payload = packed
+
+    digest = hashlib.sha256(payload).digest()
+    header = HEADER.pack(MAGIC, VERSION, header_size, flags, args.load, len(image), len(payload), digest, 0)
+    header += HEADER_CRC.pack(zlib.crc32(header))
+    header += b"\xFF" * (header_size - len(header))
+    if len(header) + len(payload) > SLOT_SIZE:
+        sys.exit("%u bytes do not fit in a slot" % (len(header) + len(payload)))
+    with open(args.output, "wb") as f:
+        f.write(header + payload)
+
+    print("%s: %u -> %u bytes (%.1f%%), %s, runs at 0x%08X (%s)"
+          % (args.output, len(image), len(payload), 100.0 * len(payload) / len(image),
+             flag_names(flags), args.load, region_of(args.load, len(image), regions)))
+    print("program at 0x%08X (slot %s)" % (slot, args.slot))
+    print("sha256 %s" % digest.hex())
+
+
+def info(args):
+    with open(args.image, "rb") as f:
+        data = f.read()
+    size = HEADER.size + HEADER_CRC.size
+    if len(data) < size:
+        sys.exit("%s: no header" % args.image)
+    magic, version, header_size, flags, load, image_size, packed_size, digest, _ = HEADER.unpack_from(data)
+    crc, = HEADER_CRC.unpack_from(data, HEADER.size)
+    if magic != MAGIC:
+        sys.exit("%s: bad magic %r" % (args.image, magic))
+
+    print("version      %u" % version)
+    print("header_size  %u" % header_size)
+    regions = (NOR_REGION,) if flags & FLAG_XIP else RUN_REGIONS
+    print("flags        0x%X (%s)" % (flags, flag_names(flags)))
+    print("load_addr    0x%08X (%s)" % (load, region_of(load, image_size, regions) or "invalid"))
+    print("image_size   %u" % image_size)
+    print("packed_size  %u (%.1f%%)" % (packed_size, 100.0 * packed_size / max(image_size, 1)))
+    print("header_crc   0x%08X (%s)" % (crc, "ok" if crc == zlib.crc32(data[:HEADER.size]) else "BAD"))
+
+    payload = data[header_size:header_size + packed_size]
+    if len(payload) != packed_size:
+        sys.exit("payload truncated: %u of %u bytes" % (len(payload), packed_size))
+    if flags & FLAG_SHA256:
+        ok = hashlib.sha256(payload).digest() == digest
+        print("digest       %s (%s)" % (digest.hex(), "ok" if ok else "BAD"))
+        if not ok:
+            sys.exit(1)
+    if flags & FLAG_LZ4:
+        lz4_decompress(payload, image_size)
+    print("payload      ok")
+
+
+def ctrl(args):
+    if not 0 <= args.trial <= ATTEMPTS_MAX:
+        sys.exit("--trial takes 0..%u boots" % ATTEMPTS_MAX)
+    fallback = args.fallback or args.active
+    record = CTRL.pack(CTRL_MAGIC, ord(args.active) - ord("A"), ord(fallback) - ord("A"), args.sequence & 0xFFFF)
+    record += struct.pack("<I", zlib.crc32(record))
+    if args.trial:
+        record += CTRL_STATE.pack((1 << args.trial) - 1, 0xFFFF)
+    else:
+        record += CTRL_STATE.pack(0, 0)
+    with open(args.output, "wb") as f:
+        f.write(record)
+
+    print("%s: boot slot %s%s, program at 0x%08X"
+          % (args.output, args.active,
+             ", %u trial boots then slot %s" % (args.trial, fallback) if args.trial else "", CTRL_ADDRESS))
+
+
+def vectors(args):
+    for size in VECTOR_SIZES:
+        digest = hashlib.sha256(bytes((i * 167 + 13) & 0xFF for i in range(size))).digest()
+        print("\t{%u, {%s}}," % (size, ", ".join("0x%02X" % b for b in digest)))
+
+
+def number(text):
+    return int(text, 0)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    sub = parser.add_subparsers(dest="command", required=True)
+
+    p = sub.add_parser("pack", help="pack a raw binary for load-and-run boot")
+    p.add_argument("input", help="raw binary of the Appli")
+    p.add_argument("output", help="packed image to program at the XIP image offset")
+    p.add_argument("--load", type=number, required=True, help="address the binary is linked to run at")
+    p.add_argument("--stored", action="store_true", help="do not compress")
+    p.add_argument("--xip", action="store_true", help="run in place from the NOR, header only")
+    p.add_argument("--slot", choices=sorted(SLOTS), default="A", help="NOR slot the image is programmed to")
+    p.set_defaults(func=pack)
+
+    p = sub.add_parser("info", help="print and check a packed image")
+    p.add_argument("image")
+    p.set_defaults(func=info)
+
+    p = sub.add_parser("ctrl", help="write a boot-control record")
+    p.add_argument("output", help="record to program at 0x%08X" % CTRL_ADDRESS)
+    p.add_argument("--active", choices=sorted(SLOTS), required=True, help="slot to boot")
+    p.add_argument("--fallback", choices=sorted(SLOTS), help="slot to return to after a failed trial")
+    p.add_argument("--trial", type=int, default=0, help="trial boots before falling back, 0 for a permanent switch")
+    p.add_argument("--sequence", type=number, default=0, help="update counter")
+    p.set_defaults(func=ctrl)
+
+    p = sub.add_parser("vectors", help="print the SHA-256 known answers for Board/bootVerify.c")
+    p.set_defaults(func=vectors)
+
+    args = parser.parse_args()
+    args.func(args)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,345 @@
+#!/usr/bin/env python3
+# SPDX-License-Identifier: Unlicense
+"""Symbolises the samples of the PC-sampling profiler (Common/pcSample.c).
+
+pcSampleFlush() sends blocks on the console UART, among the text:
+
+    header (little endian)
+      0  magic        "PCSM"
+      4  version      u16, 1
+      6  count        u16, samples that follow
+      8  first        index of the first sample since pcSampleStart()
+     12  dropped      samples lost to a full buffer so far
+     16  rate_hz
+     20  vtor         vector table of the image that sent it
+
+    count samples: pc, lr (u32 each)
+    CRC-32 of the header and the samples
+
+Each block is matched to one of the ELFs given by its vector table address
+(g_pfnVectors), so captures from the Boot and the Appli can be decoded in one
+go. Functions are found at their linked address, whether that is in the XIP
+NOR, ITCM or RAM; overlay code running from an ITCM slot is already mapped
+back to its linked address by the target.
+
+decode: prints the profile of a console capture.
+read: captures the console until the samples stop coming, then prints it.
+selftest: decodes synthetic blocks against a synthetic symbol table.
+
+    pcsample.py read /dev/ttyACM0 --elf Boot/Debug/STM32H7S7_Boot.elf --elf Appli/Debug/STM32H7S7_Appli.elf
+    pcsample.py decode console.log --elf Appli/Debug/STM32H7S7_Appli.elf --callers
+"""
+
+import argparse
+import bisect
+import random
+import struct
+import subprocess
+import sys
+import time
+import zlib
+
+MAGIC = b"PCSM"
+VERSION = 1
+HEADER = struct.Struct("<4sHHIIII")
+SAMPLE = struct.Struct("<II")
+REGIONS = [                     # Where unknown addresses are, by name
+    (0x00000000, 0x00010000, "itcm"),
+    (0x08000000, 0x08010000, "flash"),
+    (0x1FF00000, 0x1FF20000, "system"),
+    (0x20000000, 0x20010000, "dtcm"),
+    (0x24000000, 0x24072000, "axi"),
+    (0x70000000, 0x80000000, "xip"),
+    (0x90000000, 0xA0000000, "psram"),
+]
+
+
+class SampleError(Exception):
+    pass
+
+
+class Image:
+    """Functions of one ELF, sorted by address."""
+
+    def __init__(self, name, vtor, functions):
+        self.name = name
+        self.vtor = vtor
+        self.starts = []
+        self.functions = []
+        for addr, (fname, size) in sorted(functions.items()):
+            self.starts.append(addr)
+            self.functions.append((addr, addr + max(size, 2), fname))
+
+    def lookup(self, addr):
+        addr &= ~1
+        i = bisect.bisect_right(self.starts, addr) - 1
+        if i >= 0 and addr < self.functions[i][1]:
+            return self.functions[i][2]
+        for start, end, region in REGIONS:
+            if start <= addr < end:
+                return "[%s]" % region
+        return "[0x%08x]" % addr
+
+
+def read_image(elf, objdump):
+    from placement import SYMBOL
+    out = subprocess.run([objdump, "-t", elf], check=True, capture_output=True, text=True).stdout
+    functions = {}
+    vtor = None
+    for line in out.splitlines():
+        m = SYMBOL.match(line)
+        if not m:
+            continue
+        if m.group(5) == "g_pfnVectors":
+            vtor = int(m.group(1), 16)
+        elif "F" in m.group(2):
+            functions[int(m.group(1), 16) & ~1] = (m.group(5), int(m.group(4), 16))
+    if vtor is None:
+        raise SampleError("%s has no g_pfnVectors" % elf)
+    return Image(elf, vtor, functions)
+
+
+def parse(data, pos):
+    """Block at data[pos:], as (header dict, [(pc, lr)], end)."""
+    if len(data) - pos < HEADER.size:
+        raise SampleError("truncated header")
+    magic, version, count, first, dropped, rate, vtor = HEADER.unpack_from(data, pos)
+    if magic != MAGIC or version != VERSION:
+        raise SampleError("not a version %d block" % VERSION)
+    end = pos + HEADER.size + count * SAMPLE.size + 4
+    if end > len(data):
+        raise SampleError("truncated block")
+    (crc,) = struct.unpack_from("<I", data, end - 4)
+    if crc != zlib.crc32(data[pos:end - 4]):
+        raise SampleError("CRC mismatch")
+    samples = [SAMPLE.unpack_from(data, pos + HEADER.size + i * SAMPLE.size) for i in range(count)]
+    return dict(first=first, dropped=dropped, rate=rate, vtor=vtor), samples, end
+
+
+def find(data):
+    """Blocks of a console capture, and the number of damaged ones."""
+    blocks, damaged = [], 0
+    pos = data.find(MAGIC)
+    while pos >= 0:
+        try:
+            header, samples, end = parse(data, pos)
+            blocks.append((header, samples))
+            pos = data.find(MAGIC, end)
+        except SampleError:
+            damaged += 1
+            pos = data.find(MAGIC, pos + 1)
+    return blocks, damaged
+
+
+class Profile:
+    def __init__(self, image):
+        self.image = image
+        self.samples = 0
+        self.lost = 0               # In damaged or missing blocks
+        self.dropped = 0            # On the target, buffer full
+        self.rate = 0
+        self.next = 0
+        self.self_counts = {}
+        self.callers = {}
+
+    def add(self, header, samples):
+        if header["first"] > self.next:
+            self.lost += header["first"] - self.next
+        elif header["first"] < self.next:
+            self.next = 0           # Sampling restarted
+        self.next = header["first"] + len(samples)
+        self.dropped = header["dropped"]
+        self.rate = header["rate"]
+        for pc, lr in samples:
+            fn = self.image.lookup(pc)
+            self.self_counts[fn] = self.self_counts.get(fn, 0) + 1
+            callers = self.callers.setdefault(fn, {})
+            caller = self.image.lookup(lr)
+            callers[caller] = callers.get(caller, 0) + 1
+        self.samples += len(samples)
+
+
+def collect(blocks, images):
+    profiles = {}
+    unmatched = 0
+    for header, samples in blocks:
+        image = images.get(header["vtor"])
+        if image is None:
+            unmatched += len(samples)
+            continue
+        profiles.setdefault(header["vtor"], Profile(image)).add(header, samples)
+    return profiles, unmatched
+
+
+def report(profile, top, callers):
+    total = profile.samples or 1
+    rate = profile.rate or 1
+    print("%s: %d samples at %d Hz (%.2f s), %d dropped on the target, %d lost on the link" %
+          (profile.image.name, profile.samples, profile.rate, profile.samples / rate, profile.dropped, profile.lost))
+    print("%8s %6s  %s" % ("samples", "share", "function"))
+    rows = sorted(profile.self_counts.items(), key=lambda kv: (-kv[1], kv[0]))
+    for fn, count in rows[:top]:
+        print("%8d %5.1f%%  %s" % (count, 100.0 * count / total, fn))
+        if callers:
+            by = sorted(profile.callers[fn].items(), key=lambda kv: (-kv[1], kv[0]))
+            for caller, n in by[:3]:
+                print("%8s %5.1f%%    <- %s" % ("", 100.0 * n / count, caller))
+
+
+def load_images(args):
+    images = {}
+    for elf in args.elf:
+        try:
+            image = read_image(elf, args.objdump)
+        except (OSError, subprocess.CalledProcessError, SampleError) as e:
+            sys.exit("%s: %s" % (elf, e))
+        images[image.vtor] = image
+    return images
+
+
+def print_profiles(data, images, args):
+    blocks, damaged = find(data)
+    profiles, unmatched = collect(blocks, images)
+    if damaged:
+        print("%d damaged blocks skipped" % damaged, file=sys.stderr)
+    if unmatched:
+        print("%d samples from an image not given with --elf" % unmatched, file=sys.stderr)
+    for vtor in sorted(profiles):
+        report(profiles[vtor], args.top, args.callers)
+    return bool(profiles)
+
+
+def decode(args):
+    images = load_images(args)
+    with open(args.log, "rb") as f:
+        data = f.read()
+    if not print_profiles(data, images, args):
+        sys.exit("no samples in %s" % args.log)
+
+
+def read(args):
+    from fwupdate import SerialLink, UpdateError
+    images = load_images(args)
+    try:
+        link = SerialLink(args.port, args.baud)
+    except (OSError, UpdateError) as e:
+        sys.exit(str(e))
+    data = bytearray()
+    deadline = time.monotonic() + args.timeout
+    last = None
+    try:
+        # Until no block came for --idle seconds after the first one
+        while time.monotonic() < deadline:
+            chunk = link.read(0.1)
+            data += chunk
+            if chunk and (last is not None or MAGIC in data):
+                last = time.monotonic()
+            if last is not None and time.monotonic() - last > args.idle:
+                break
+    finally:
+        link.close()
+    if not print_profiles(bytes(data), images, args):
+        sys.exit("no samples within %d s" % args.timeout)
+
+
+def block(first, samples, vtor, rate=1000, dropped=0):
+    head = HEADER.pack(MAGIC, VERSION, len(samples), first, dropped, rate, vtor)
+    body = head + b"".join(SAMPLE.pack(pc, lr) for pc, lr in samples)
+    return body + struct.pack("<I", zlib.crc32(body))
+
+
+def selftest(args):
+    rng = random.Random(46)
+    failed = 0
+
+    def check(name, ok):
+        nonlocal failed
+        print("%-26s %s" % (name, "ok" if ok else "FAIL"))
+        failed += not ok
+
+    # Appli: code in the XIP NOR, ITCM and AXI SRAM. Boot: internal flash.
+    appli = Image("appli.elf", 0x70000400, {
+        0x70001000: ("main", 0x200),
+        0x70002000: ("HAL_UART_Transmit", 0x180),
+        0x00000100: ("firQ15", 0x80),
+        0x24000200: ("sortKeys", 0x60),
+        0x70003000: ("ovlKernel", 0x100),       # Overlay, linked in the NOR
+    })
+    boot = Image("boot.elf", 0x08000000, {
+        0x08000400: ("bootVerifyWait", 0x40),
+        0x08000800: ("main", 0x300),
+    })
+    images = {appli.vtor: appli, boot.vtor: boot}
+
+    weights = [(0x00000140, 0x70001011, 50), (0x24000230, 0x70001021, 25),
+               (0x70002050, 0x70001101, 15), (0x70003010, 0x70001041, 5), (0x00008000, 0x70001001, 5)]
+    samples = []
+    for pc, lr, n in weights:
+        samples += [(pc, lr)] * n * 10
+    rng.shuffle(samples)
+    boot_samples = [(0x08000410, 0x08000901)] * 300 + [(0x08000820, 0x08000301)] * 100
+
+    log = b"==========================\r\nImage: Bootloader\r\n"
+    for i in range(0, len(boot_samples), 256):
+        log += block(i, boot_samples[i:i + 256], boot.vtor) + b"Update: ...\r\n"
+    log += b"Image: Application\r\n"
+    for i in range(0, len(samples), 256):
+        log += block(i, samples[i:i + 256], appli.vtor, dropped=7)
+    log += b"PCSM junk\r\n"
+
+    blocks, damaged = find(log)
+    profiles, unmatched = collect(blocks, images)
+    check("blocks found", damaged == 1 and unmatched == 0 and len(profiles) == 2)
+    a, b = profiles[appli.vtor], profiles[boot.vtor]
+    check("sample counts", a.samples == len(samples) and b.samples == len(boot_samples))
+    check("itcm / axi / xip functions", a.self_counts.get("firQ15") == 500 and a.self_counts.get("sortKeys") == 250
+          and a.self_counts.get("HAL_UART_Transmit") == 150)
+    check("overlay at linked address", a.self_counts.get("ovlKernel") == 50)
+    check("unknown by region", a.self_counts.get("[itcm]") == 50)
+    check("callers from LR", a.callers["firQ15"] == {"main": 500})
+    check("boot image", b.self_counts.get("bootVerifyWait") == 300 and b.callers["bootVerifyWait"] == {"main": 300})
+    check("target drops", a.dropped == 7)
+
+    # A block lost on the link shows as a gap in the sample indexes
+    blocks = find(block(0, samples[:256], appli.vtor) + block(512, samples[512:768], appli.vtor))[0]
+    profiles, _ = collect(blocks, images)
+    check("lost block", profiles[appli.vtor].lost == 256)
+
+    bad = bytearray(block(0, samples[:16], appli.vtor))
+    bad[HEADER.size + 5] ^= 1
+    check("CRC refused", find(bytes(bad)) == ([], 1))
+    sys.exit(1 if failed else 0)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    sub = parser.add_subparsers(dest="command", required=True)
+
+    def common(p):
+        p.add_argument("--elf", action="append", required=True, help="ELF of an image that sent samples (repeat for Boot and Appli)")
+        p.add_argument("--objdump", default="arm-none-eabi-objdump")
+        p.add_argument("--top", type=int, default=30, help="functions printed")
+        p.add_argument("--callers", action="store_true", help="print the top callers (from LR) of each function")
+
+    p = sub.add_parser("decode", help="print the profile of a console capture")
+    p.add_argument("log", help="raw capture of the console UART")
+    common(p)
+    p.set_defaults(func=decode)
+
+    p = sub.add_parser("read", help="capture the samples from the console and print the profile")
+    p.add_argument("port", help="serial port of the board, e.g. /dev/ttyACM0")
+    p.add_argument("--baud", type=int, default=2000000)
+    p.add_argument("--timeout", type=int, default=60, help="seconds to wait for samples")
+    p.add_argument("--idle", type=float, default=2.0, help="seconds without data that end the capture")
+    common(p)
+    p.set_defaults(func=read)
+
+    p = sub.add_parser("selftest", help="decode synthetic blocks")
+    p.set_defaults(func=selftest)
+
+    args = parser.parse_args()
+    args.func(args)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,167 @@
+#!/usr/bin/env python3
+# SPDX-License-Identifier: Unlicense
+"""Profile-guided hot/cold code placement for the Appli.
+
+generate: reads a UART log holding the "fprof" records printed by
+funcProfileDump() and the ELF the profile was taken with, ranks functions by
+self cycles per byte and writes the input section lists included by the Appli
+linker scripts:
+
+    placement_itcm.ld   hot code, run from ITCM
+    placement_axi.ld    warm code, run from AXI SRAM
+    (everything else)   cold code, stays XIP in the NOR
+
+scatterLoad() (Common/scatterLoad.c) copies both from flash at startup, through
+the scatter table the linker scripts generate. The Appli must be compiled with -ffunction-sections,
+so that function <f> lives in input section .text.<f>.
+
+compare: reads the "placement_run" records of two logs (before and after the
+placement) and reports the run time and I-cache miss cost reduction.
+
+    placement.py generate --elf Debug/STM32H7S7_Appli.elf --log profile.log
+    placement.py compare before.log after.log
+"""
+
+import argparse
+import os
+import re
+import subprocess
+import sys
+
+ITCM_BUDGET = 48 * 1024 - 1024      # 64 KB minus the overlay slots, minus room for long branch veneers
+AXI_BUDGET = 32 * 1024
+MIN_SHARE = 0.005                   # Functions with less than this share of the self cycles stay cold
+CODE_SECTIONS = (".text", ".itcm_text", ".axi_text")
+EXCLUDE = re.compile(r"^(Reset_Handler|SystemInit|scatter[A-Z].*|__cyg_profile_func_.*|funcProfile.*|prof[A-Z].*)$")
+
+SYMBOL = re.compile(r"^([0-9a-fA-F]+)\s(.{7})\s(\S+)\s+([0-9a-fA-F]+)\s+(\S+)$")
+
+
+def read_profile(path):
+    """Returns {address: (calls, self_cycles)} from the fprof records of a log."""
+    profile = {}
+    with open(path, errors="replace") as f:
+        for line in f:
+            fields = line.strip().split(",")
+            if len(fields) == 4 and fields[0] == "fprof" and fields[1].startswith("0x"):
+                profile[int(fields[1], 16) & ~1] = (int(fields[2]), int(fields[3]))
+    return profile
+
+
+def read_functions(elf, objdump):
+    """Returns {address: (name, size, output section)} for the functions of an ELF."""
+    out = subprocess.run([objdump, "-t", elf], check=True, capture_output=True, text=True).stdout
+    functions = {}
+    for line in out.splitlines():
+        m = SYMBOL.match(line)
+        if m and "F" in m.group(2):
+            addr = int(m.group(1), 16) & ~1
+            functions[addr] = (m.group(5), int(m.group(4), 16), m.group(3))
+    return functions
+
+
+def write_placement(path, source, entries):
+    with open(path, "w", newline="\n") as f:
+        f.write("/* Input sections placed in .%s, generated by Tools/placement.py from %s */\n"
+                % (os.path.basename(path)[len("placement_"):-len(".ld")] + "_text", os.path.basename(source)))
+        for name, size, share in entries:
+            f.write("*(.text.%s)    /* %5.1f%% of self cycles, %u bytes */\n" % (name, 100.0 * share, size))
+
+
+def generate(args):
+    profile = read_profile(args.log)
+    if not profile:
+        sys.exit("no fprof records in %s" % args.log)
+    functions = read_functions(args.elf, args.objdump)
+    total = sum(cycles for _, cycles in profile.values()) or 1
+
+    candidates = []
+    unknown = 0
+    for addr, (calls, cycles) in profile.items():
+        if addr not in functions:
+            unknown += cycles
+            continue
+        name, size, section = functions[addr]
+        share = cycles / total
+        if size == 0 or section not in CODE_SECTIONS or EXCLUDE.match(name) or share < args.min_share:
+            continue
+        candidates.append((cycles / size, name, size, share))
+    candidates.sort(reverse=True)
+
+    hot, warm = [], []
+    itcm_left, axi_left = args.itcm_budget, args.axi_budget
+    for _, name, size, share in candidates:
+        # Functions are 8 byte aligned at worst, keep some slack
+        need = (size + 7) & ~7
+        if need <= itcm_left:
+            hot.append((name, size, share))
+            itcm_left -= need
+        elif need <= axi_left:
+            warm.append((name, size, share))
+            axi_left -= need
+
+    write_placement(os.path.join(args.out_dir, "placement_itcm.ld"), args.log, hot)
+    write_placement(os.path.join(args.out_dir, "placement_axi.ld"), args.log, warm)
+
+    print("%-8s %-32s %8s %7s" % ("region", "function", "bytes", "cycles"))
+    for region, entries in (("itcm", hot), ("axi", warm)):
+        for name, size, share in entries:
+            print("%-8s %-32s %8u %6.1f%%" % (region, name, size, 100.0 * share))
+    print("itcm %u/%u bytes, axi %u/%u bytes, %.1f%% of self cycles placed, %.1f%% unresolved"
+          % (args.itcm_budget - itcm_left, args.itcm_budget, args.axi_budget - axi_left, args.axi_budget,
+             100.0 * sum(s for _, _, s in hot + warm), 100.0 * unknown / total))
+
+
+def read_run(path):
+    """Returns (cold_cycles, warm_cycles) from the last placement_run record of a log."""
+    run = None
+    with open(path, errors="replace") as f:
+        for line in f:
+            fields = line.strip().split(",")
+            if len(fields) == 3 and fields[0] == "placement_run" and fields[1].isdigit():
+                run = (int(fields[1]), int(fields[2]))
+    if run is None:
+        sys.exit("no placement_run record in %s" % path)
+    return run
+
+
+def reduction(before, after):
+    return 100.0 * (before - after) / before if before else 0.0
+
+
+def compare(args):
+    cold0, warm0 = read_run(args.before)
+    cold1, warm1 = read_run(args.after)
+    miss0, miss1 = max(cold0 - warm0, 0), max(cold1 - warm1, 0)
+
+    print("%-24s %10s %10s %10s" % ("cycles per pass", "before", "after", "reduction"))
+    print("%-24s %10u %10u %9.1f%%" % ("run time, warm I-cache", warm0, warm1, reduction(warm0, warm1)))
+    print("%-24s %10u %10u %9.1f%%" % ("run time, cold I-cache", cold0, cold1, reduction(cold0, cold1)))
+    print("%-24s %10u %10u %9.1f%%" % ("I-cache miss cost", miss0, miss1, reduction(miss0, miss1)))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    sub = parser.add_subparsers(dest="command", required=True)
+
+    gen = sub.add_parser("generate", help="write placement files from a function profile")
+    gen.add_argument("--elf", required=True, help="ELF the profile was taken with")
+    gen.add_argument("--log", required=True, help="UART log holding the fprof records")
+    gen.add_argument("--objdump", default="arm-none-eabi-objdump")
+    gen.add_argument("--itcm-budget", type=int, default=ITCM_BUDGET)
+    gen.add_argument("--axi-budget", type=int, default=AXI_BUDGET)
+    gen.add_argument("--min-share", type=float, default=MIN_SHARE)
+    gen.add_argument("--out-dir", default=os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "Appli"))
+    gen.set_defaults(func=generate)
+
+    cmp = sub.add_parser("compare", help="report the gain of a placement")
+    cmp.add_argument("before", help="UART log of the workload before the placement")
+    cmp.add_argument("after", help="UART log of the workload after the placement")
+    cmp.set_defaults(func=compare)
+
+    args = parser.parse_args()
+    args.func(args)
+
+
+if __name__ == "__main__":
+    main()
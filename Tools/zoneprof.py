@@ -0,0 +1,320 @@
+#!/usr/bin/env python3
+# SPDX-License-Identifier: Unlicense
+"""Decodes the zone profile sent by zoneProfileDump() (Common/zoneProfile.c).
+
+The dump is binary, sent on the console UART after a "zprof" CSV record:
+
+    header (little endian)
+      0  magic        "PZON"
+      4  version      u16, 1
+      6  zones        u16, records that follow
+      8  size         bytes, header to CRC included
+     12  core_hz      cycles per second
+     16  bias_cycles  measured by an empty zone, in every inclusive time
+     20  pair_cycles  cost of an empty zone to the enclosing zone
+     24  dropped      zones not recorded: too deep, bad id or unbalanced
+     28  reserved
+
+    record, then name_len name bytes
+      0  incl_cycles  u64, the zone and the zones nested in it
+      8  excl_cycles  u64, the zone itself
+     16  calls, max_incl, max_excl
+     28  id u8, name_len u8, reserved u16
+
+    CRC-32 of everything before it
+
+decode: finds the dumps in a console log (a raw capture of the UART) and
+prints each as a table, heaviest exclusive time first, bias removed.
+read: captures the console until a dump arrives and prints it.
+selftest: decodes dumps made by a model of the profiler, among console text.
+
+    zoneprof.py read /dev/ttyACM0
+    zoneprof.py decode console.log --csv
+"""
+
+import argparse
+import random
+import struct
+import sys
+import time
+import zlib
+
+MAGIC = b"PZON"
+VERSION = 1
+HEADER = struct.Struct("<4sHHIIIIII")
+RECORD = struct.Struct("<QQIIIBBH")
+
+
+class ProfileError(Exception):
+    pass
+
+
+def parse(data, pos):
+    """Dump at data[pos:], as (header dict, zone dicts, end)."""
+    if len(data) - pos < HEADER.size:
+        raise ProfileError("truncated header")
+    magic, version, count, size, core_hz, bias, pair, dropped, _ = HEADER.unpack_from(data, pos)
+    if magic != MAGIC or version != VERSION:
+        raise ProfileError("not a version %d dump" % VERSION)
+    if size < HEADER.size + 4 or pos + size > len(data):
+        raise ProfileError("truncated dump (%d bytes)" % size)
+    end = pos + size
+    (crc,) = struct.unpack_from("<I", data, end - 4)
+    if crc != zlib.crc32(data[pos:end - 4]):
+        raise ProfileError("CRC mismatch")
+
+    zones = []
+    at = pos + HEADER.size
+    for _ in range(count):
+        if at + RECORD.size > end - 4:
+            raise ProfileError("record past the end")
+        incl, excl, calls, max_incl, max_excl, zid, name_len, _ = RECORD.unpack_from(data, at)
+        at += RECORD.size
+        name = data[at:at + name_len].decode("ascii", "replace") or "zone%d" % zid
+        at += name_len
+        zones.append(dict(id=zid, name=name, calls=calls, incl=incl, excl=excl,
+                          max_incl=max_incl, max_excl=max_excl))
+    if at != end - 4:
+        raise ProfileError("%d bytes left after the records" % (end - 4 - at))
+    header = dict(core_hz=core_hz, bias=bias, pair=pair, dropped=dropped)
+    return header, zones, end
+
+
+def find(data):
+    """Dumps found in a console capture, as (header, zones) or ProfileError."""
+    found = []
+    pos = data.find(MAGIC)
+    while pos >= 0:
+        try:
+            header, zones, end = parse(data, pos)
+            found.append((header, zones))
+            pos = data.find(MAGIC, end)
+        except ProfileError as e:
+            found.append(e)
+            pos = data.find(MAGIC, pos + 1)
+    return found
+
+
+def corrected(header, zone):
+    """Inclusive and exclusive cycles without the profiler bias."""
+    bias = header["bias"] * zone["calls"]
+    return max(0, zone["incl"] - bias), max(0, zone["excl"] - bias)
+
+
+def corrected_max(header, zone):
+    return max(0, zone["max_incl"] - header["bias"]), max(0, zone["max_excl"] - header["bias"])
+
+
+def report(header, zones, csv=False):
+    hz = header["core_hz"] or 1
+    total = sum(corrected(header, z)[1] for z in zones) or 1
+    rows = sorted(zones, key=lambda z: corrected(header, z)[1], reverse=True)
+    if csv:
+        print("zone,id,calls,incl_cycles,excl_cycles,max_incl,max_excl")
+        for z in rows:
+            incl, excl = corrected(header, z)
+            print("%s,%d,%d,%d,%d,%d,%d" % ((z["name"], z["id"], z["calls"], incl, excl) + corrected_max(header, z)))
+        return
+    print("core %.1f MHz, bias %d cycles per zone, %d cycles per nested zone, %d dropped" %
+          (hz / 1e6, header["bias"], header["pair"], header["dropped"]))
+    print("%-16s %8s %12s %12s %6s %10s %10s %10s" %
+          ("zone", "calls", "incl us", "excl us", "excl%", "mean incl", "max incl", "max excl"))
+    for z in rows:
+        incl, excl = corrected(header, z)
+        print("%-16s %8d %12.1f %12.1f %5.1f%% %10d %10d %10d" %
+              ((z["name"], z["calls"], incl * 1e6 / hz, excl * 1e6 / hz, 100.0 * excl / total,
+               incl // max(1, z["calls"])) + corrected_max(header, z)))
+
+
+def print_dumps(data, csv):
+    dumps = find(data)
+    good = [d for d in dumps if not isinstance(d, ProfileError)]
+    for d in dumps:
+        if isinstance(d, ProfileError):
+            print("skipped a dump: %s" % d, file=sys.stderr)
+    for header, zones in good:
+        report(header, zones, csv)
+    return bool(good)
+
+
+def decode(args):
+    with open(args.log, "rb") as f:
+        data = f.read()
+    if not print_dumps(data, args.csv):
+        sys.exit("no zone profile in %s" % args.log)
+
+
+def read(args):
+    from fwupdate import SerialLink, UpdateError
+    try:
+        link = SerialLink(args.port, args.baud)
+    except (OSError, UpdateError) as e:
+        sys.exit(str(e))
+    data = bytearray()
+    deadline = time.monotonic() + args.timeout
+    try:
+        while time.monotonic() < deadline:
+            data += link.read(0.1)
+            dumps = [d for d in find(bytes(data)) if not isinstance(d, ProfileError)]
+            if dumps:
+                for header, zones in dumps:
+                    report(header, zones, args.csv)
+                return
+    finally:
+        link.close()
+    sys.exit("no zone profile within %d s" % args.timeout)
+
+
+class Model:
+    """The profiler on a simulated cycle counter, zoneProfile.c line by line."""
+
+    BIAS = 9
+    PAIR = 31
+
+    def __init__(self):
+        self.now = 0x100
+        self.stack = []
+        self.zones = {}
+        self.names = {}
+        self.dropped = 0
+
+    def begin(self, zid):
+        self.work(self.PAIR - self.BIAS)
+        self.stack.append([zid, self.now, 0])
+        self.work(self.BIAS)
+
+    def end(self, zid):
+        if not self.stack or self.stack[-1][0] != zid:
+            self.dropped += 1
+            if self.stack:
+                self.stack.pop()
+            return
+        _, start, nested = self.stack.pop()
+        incl = (self.now - start) & 0xFFFFFFFF
+        excl = incl - nested
+        z = self.zones.setdefault(zid, [0, 0, 0, 0, 0])
+        z[0] += 1
+        z[1] += incl
+        z[2] += excl
+        z[3] = max(z[3], incl)
+        z[4] = max(z[4], excl)
+        if self.stack:
+            self.stack[-1][2] += incl
+
+    def work(self, cycles):
+        self.now = (self.now + cycles) & 0xFFFFFFFF
+
+    def dump(self, core_hz=600000000):
+        body = b""
+        for zid in sorted(self.zones):
+            calls, incl, excl, max_incl, max_excl = self.zones[zid]
+            name = self.names.get(zid, "").encode()
+            body += RECORD.pack(incl, excl, calls, max_incl, max_excl, zid, len(name), 0) + name
+        size = HEADER.size + len(body) + 4
+        data = HEADER.pack(MAGIC, VERSION, len(self.zones), size, core_hz, self.BIAS, self.PAIR, self.dropped, 0) + body
+        return data + struct.pack("<I", zlib.crc32(data))
+
+
+def selftest(args):
+    rng = random.Random(45)
+    failed = 0
+
+    def check(name, ok):
+        nonlocal failed
+        print("%-24s %s" % (name, "ok" if ok else "FAIL"))
+        failed += not ok
+
+    # Control loop with nested zones and an interrupt landing in the middle,
+    # the counter wrapping on the way
+    m = Model()
+    m.now = 0xFFFF0000
+    m.names = {0: "loop", 1: "sensors", 2: "filter", 3: "isr", 4: "output"}
+    expected_excl = {k: 0 for k in m.names}
+    for _ in range(200):
+        m.begin(0)
+        m.work(100)
+        expected_excl[0] += 100
+        m.begin(1)
+        a = rng.randrange(50, 500)
+        m.work(a)
+        m.begin(2)
+        b = rng.randrange(1000, 3000)
+        m.work(b)
+        if rng.random() < 0.3:
+            m.begin(3)
+            m.work(200)
+            m.end(3)
+            expected_excl[3] += 200
+        m.end(2)
+        m.end(1)
+        expected_excl[1] += a
+        expected_excl[2] += b
+        m.begin(4)
+        m.work(50)
+        m.end(4)
+        expected_excl[4] += 50
+        m.end(0)
+    dump = m.dump()
+    text = b"boot ok\r\nzprof,zones,bytes\r\nzprof,5,%d\r\n" % len(dump)
+    found = find(b"\x00garbage PZON" + text + dump + b"\r\nmore text\r\n")
+    ok = len(found) == 2 and isinstance(found[0], ProfileError) and not isinstance(found[1], ProfileError)
+    check("found among text", ok)
+    if ok:
+        header, zones = found[1]
+        by_name = {z["name"]: z for z in zones}
+        check("names and calls", by_name["loop"]["calls"] == 200 and by_name["filter"]["calls"] == 200)
+        # Bias removed, exclusive times are the work done in each zone, but
+        # for the nested zone cost charged to the enclosing one
+        nested = {0: 2, 1: 1, 2: 0, 3: 0, 4: 0}
+        ok = True
+        for zid, name in m.names.items():
+            z = by_name[name]
+            excl = corrected(header, z)[1]
+            calls = z["calls"]
+            extra = 0 if zid != 2 else by_name["isr"]["calls"] * (Model.PAIR - Model.BIAS)
+            if excl != expected_excl[zid] + calls * nested[zid] * (Model.PAIR - Model.BIAS) + extra:
+                ok = False
+        check("exclusive cycles", ok)
+        loop = by_name["loop"]
+        check("inclusive covers nested", corrected(header, loop)[0] >= sum(corrected(header, z)[1] for z in zones))
+        check("max values", by_name["isr"]["max_incl"] == 200 + Model.BIAS)
+
+    bad = bytearray(dump)
+    bad[HEADER.size + 3] ^= 0x40
+    check("CRC refused", isinstance(find(bytes(bad))[0], ProfileError))
+    check("truncated refused", isinstance(find(dump[:-5])[0], ProfileError))
+
+    m = Model()
+    m.begin(0)
+    m.end(1)
+    m.end(0)
+    header, zones, _ = parse(m.dump(), 0)
+    check("unbalanced dropped", header["dropped"] == 2 and zones == [])
+    sys.exit(1 if failed else 0)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    sub = parser.add_subparsers(dest="command", required=True)
+
+    p = sub.add_parser("decode", help="print the dumps found in a console capture")
+    p.add_argument("log", help="raw capture of the console UART")
+    p.add_argument("--csv", action="store_true", help="print CSV instead of a table")
+    p.set_defaults(func=decode)
+
+    p = sub.add_parser("read", help="wait for a dump on the console and print it")
+    p.add_argument("port", help="serial port of the board, e.g. /dev/ttyACM0")
+    p.add_argument("--baud", type=int, default=2000000)
+    p.add_argument("--timeout", type=int, default=60, help="seconds")
+    p.add_argument("--csv", action="store_true", help="print CSV instead of a table")
+    p.set_defaults(func=read)
+
+    p = sub.add_parser("selftest", help="decode dumps made by a model of the profiler")
+    p.set_defaults(func=selftest)
+
+    args = parser.parse_args()
+    args.func(args)
+
+
+if __name__ == "__main__":
+    main()